@@ -2,7 +2,18 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <stdexcept>
 #include <cstddef>
+#include <cstdint>
+#include "id_filter.hpp"
+#include "search_stats.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /**
  * Core interface for ANN algorithms.
@@ -30,6 +41,92 @@ public:
      */
     virtual void fit(const float* data, size_t n_samples) = 0;
 
+    /**
+     * OPTIONAL: Build the index without copying the training data.
+     * The index may keep pointing into data, which the caller must keep
+     * alive and unmodified until the next fit or until the index is
+     * destroyed. get_memory_usage() then excludes the borrowed rows.
+     * Default: fit() (copy).
+     *
+     * @param data Pointer to flattened array: [n_samples * dimension] floats
+     * @param n_samples Number of vectors in training set
+     */
+    virtual void fit_borrowed(const float* data, size_t n_samples) {
+        fit(data, n_samples);
+    }
+
+    /**
+     * OPTIONAL: Build the index from a stream of chunks instead of one
+     * array, for training sets that do not fit in memory next to the index:
+     * fit_begin(), any number of fit_chunk() calls, then fit_end(). Rows get
+     * ids in arrival order, and a chunk may be freed once fit_chunk()
+     * returns. Queries are only allowed after fit_end().
+     * Default: chunks are collected in one buffer that fit_end() passes to
+     * fit(), so peak memory is the whole training set plus the index.
+     *
+     * @param n_total Rows that will be streamed (0 = unknown); lets an
+     *                index size its storage and parameters up front
+     */
+    virtual void fit_begin(size_t n_total) {
+        stream_rows_.clear();
+        stream_rows_.reserve(n_total * dimension_);
+    }
+
+    /**
+     * OPTIONAL: Next chunk of a streamed build, see fit_begin().
+     *
+     * @param data Pointer to flattened array: [n_samples * dimension] floats
+     * @param n_samples Number of vectors in this chunk
+     */
+    virtual void fit_chunk(const float* data, size_t n_samples) {
+        stream_rows_.insert(stream_rows_.end(), data, data + n_samples * dimension_);
+    }
+
+    /**
+     * OPTIONAL: Finish a streamed build, see fit_begin().
+     */
+    virtual void fit_end() {
+        std::vector<float> data;
+        data.swap(stream_rows_);
+        fit(data.data(), data.size() / dimension_);
+    }
+
+    /**
+     * OPTIONAL: Add vectors to a built index without rebuilding it. They
+     * get the next ids (n_samples, n_samples + 1, ... after everything
+     * fit() or earlier add() calls stored) and are searchable when add()
+     * returns. May run while other threads query; queries are only held
+     * up for short steps.
+     * Default: throws std::runtime_error.
+     *
+     * @param data Pointer to flattened array: [n_samples * dimension] floats
+     * @param n_samples Number of vectors to add
+     */
+    virtual void add(const float* data, size_t n_samples) {
+        (void)data;
+        (void)n_samples;
+        throw std::runtime_error(name() + " does not support add()");
+    }
+
+    /**
+     * OPTIONAL: Delete vectors by id. Deleted vectors are tombstoned: they
+     * stop appearing in results at once and their ids are never reused.
+     * Throws std::runtime_error (deleting nothing) if an id does not exist.
+     * Default: throws std::runtime_error.
+     */
+    virtual void remove(const std::vector<int>& ids) {
+        (void)ids;
+        throw std::runtime_error(name() + " does not support remove()");
+    }
+
+    /**
+     * OPTIONAL: Fold earlier add() / remove() calls into the index
+     * structure (merge buffered vectors, drop or route around tombstones)
+     * so queries stop paying for them. Runs alongside queries, e.g. from a
+     * background thread. Default: nothing to do.
+     */
+    virtual void compact() {}
+
     /**
      * Query for k nearest neighbors of a single vector.
      * 
@@ -39,41 +136,329 @@ public:
      */
     virtual std::vector<int> query(const float* query, int k) = 0;
 
+    /**
+     * OPTIONAL: query() into caller buffers, with distances.
+     * Writes the k nearest ids, closest first, to ids[0..k) and, unless
+     * distances is null, their distances to distances[0..k). Slots beyond
+     * the available results get id -1 and distance +inf.
+     *
+     * Distances are the index's own scores (smaller is closer): squared L2
+     * for euclidean, 1 - cosine for angular; approximate when scored on
+     * compressed codes without re-ranking (Hamming counts for 1-bit codes).
+     * Default: query(); throws std::runtime_error if distances are requested.
+     */
+    virtual void search(const float* query, int k, int* ids, float* distances) {
+        if (distances) {
+            throw std::runtime_error(name() + " does not report distances");
+        }
+        std::vector<int> result = this->query(query, k);
+        size_t count = std::min(result.size(), static_cast<size_t>(k));
+        std::copy(result.begin(), result.begin() + count, ids);
+        std::fill(ids + count, ids + k, -1);
+    }
+
+    /**
+     * OPTIONAL: Batch search into caller buffers, row-major [n_queries * k]
+     * (distances may be null), so results need no per-query allocation.
+     * Same layout and padding as search(). The default runs search() in
+     * parallel over the queries, like batch_query(); the first exception a
+     * search() throws is rethrown once the loop is done.
+     *
+     * @param num_threads Threads for this call (0 = OpenMP default)
+     */
+    virtual void batch_search(const float* queries, size_t n_queries, int k,
+                              int* ids, float* distances, int num_threads = 0) {
+        parallel_queries(n_queries, num_threads, [&](size_t i) {
+            search(queries + i * dimension_, k, ids + i * k, distances ? distances + i * k : nullptr);
+        });
+    }
+
+    /**
+     * OPTIONAL: search() restricted to the ids filter allows. The filter is
+     * applied while the index is searched, not to its results, so k ids come
+     * back whenever k ids pass; very selective filters are answered by an
+     * exact scan of the allowed ids instead (see each index's
+     * filter_brute_force). Same layout and padding as search().
+     * Default: throws std::runtime_error.
+     */
+    virtual void search_filtered(const float* query, int k, const IdFilter& filter,
+                                 int* ids, float* distances) {
+        (void)query;
+        (void)k;
+        (void)filter;
+        (void)ids;
+        (void)distances;
+        throw std::runtime_error(name() + " does not support filtered search");
+    }
+
+    /**
+     * OPTIONAL: batch_search() with one filter for every query. The default
+     * runs search_filtered() in parallel over the queries.
+     */
+    virtual void batch_search_filtered(const float* queries, size_t n_queries, int k,
+                                       const IdFilter& filter, int* ids, float* distances,
+                                       int num_threads = 0) {
+        parallel_queries(n_queries, num_threads, [&](size_t i) {
+            search_filtered(queries + i * dimension_, k, filter, ids + i * k,
+                            distances ? distances + i * k : nullptr);
+        });
+    }
+
+    /**
+     * OPTIONAL: Every id within radius of query (distance <= radius, in the
+     * units search() reports), closest first, in ids / distances (replacing
+     * their contents). Results are as exact as search() is.
+     * Default: search() with k doubling from kRangeFirstK until the k-th
+     * distance passes radius or fewer than k ids come back.
+     */
+    virtual void range_search(const float* query, float radius, std::vector<int>& ids,
+                              std::vector<float>& distances) {
+        std::vector<int> found;
+        std::vector<float> found_dists;
+        for (int k = kRangeFirstK;; k *= 2) {
+            found.resize(k);
+            found_dists.resize(k);
+            search(query, k, found.data(), found_dists.data());
+            if (found[k - 1] == -1 || found_dists[k - 1] > radius ||
+                k > std::numeric_limits<int>::max() / 2) {
+                break;
+            }
+        }
+        ids.clear();
+        distances.clear();
+        for (size_t i = 0; i < found.size() && found[i] != -1 && found_dists[i] <= radius; ++i) {
+            ids.push_back(found[i]);
+            distances.push_back(found_dists[i]);
+        }
+    }
+
+    /**
+     * range_search() for n_queries queries, in parallel, as CSR: the results
+     * of query i are ids / distances [offsets[i], offsets[i + 1]), and
+     * offsets has n_queries + 1 entries.
+     *
+     * @param num_threads Threads for this call (0 = OpenMP default)
+     */
+    void batch_range_search(const float* queries, size_t n_queries, float radius,
+                            std::vector<size_t>& offsets, std::vector<int>& ids,
+                            std::vector<float>& distances, int num_threads = 0) {
+        std::vector<std::vector<int>> query_ids(n_queries);
+        std::vector<std::vector<float>> query_dists(n_queries);
+        parallel_queries(n_queries, num_threads, [&](size_t i) {
+            range_search(queries + i * dimension_, radius, query_ids[i], query_dists[i]);
+        });
+
+        offsets.assign(n_queries + 1, 0);
+        for (size_t i = 0; i < n_queries; ++i) {
+            offsets[i + 1] = offsets[i] + query_ids[i].size();
+        }
+        ids.resize(offsets[n_queries]);
+        distances.resize(offsets[n_queries]);
+        for (size_t i = 0; i < n_queries; ++i) {
+            std::copy(query_ids[i].begin(), query_ids[i].end(), ids.begin() + offsets[i]);
+            std::copy(query_dists[i].begin(), query_dists[i].end(), distances.begin() + offsets[i]);
+        }
+    }
+
     /**
      * OPTIONAL: Batch query for better throughput.
-     * Override this for OpenMP parallelization.
+     * The default is batch_search() into one flat buffer, split into
+     * per-query vectors: search() (query() unless overridden) runs in
+     * parallel over the queries (OpenMP, dynamic schedule), so it must be
+     * safe to call concurrently. Batched algorithms override batch_search().
      * 
      * @param queries Pointer to flattened queries: [n_queries * dimension]
      * @param n_queries Number of query vectors
      * @param k Number of neighbors per query
+     * @param num_threads Threads for this call (0 = OpenMP default,
+     *                    i.e. OMP_NUM_THREADS or all cores)
      * @return Vector of vectors: outer[i] = neighbors for query i
      */
     virtual std::vector<std::vector<int>> batch_query(
         const float* queries, 
         size_t n_queries, 
-        int k
+        int k,
+        int num_threads = 0
     ) {
-        // Default: call query() for each
-        std::vector<std::vector<int>> results;
-        results.reserve(n_queries);
+        std::vector<int> ids(n_queries * k);
+        batch_search(queries, n_queries, k, ids.data(), nullptr, num_threads);
+
+        std::vector<std::vector<int>> results(n_queries);
         for (size_t i = 0; i < n_queries; ++i) {
-            results.push_back(query(queries + i * dimension_, k));
+            const int* row = ids.data() + i * k;
+            results[i].assign(row, std::find(row, row + k, -1));
         }
         return results;
     }
 
+    /**
+     * Attach integer labels (tenant, category, time bucket, ...) to ids
+     * first .. first + n - 1 for label_filter(). Ids without one have label
+     * -1. Labels follow ids, not rows: after fit() set them again, after
+     * add() set the new ids'. save() / load() keep them. Must not run
+     * concurrently with label_filter().
+     */
+    void set_labels(const int* labels, size_t n, size_t first = 0) {
+        if (labels_.size() < first + n) {
+            labels_.resize(first + n, -1);
+        }
+        std::copy(labels, labels + n, labels_.begin() + first);
+    }
+
+    void clear_labels() {
+        labels_.clear();
+    }
+
+    const std::vector<int>& labels() const {
+        return labels_;
+    }
+
+    /**
+     * Filter for the ids whose label is one of wanted.
+     */
+    IdFilter label_filter(const std::vector<int>& wanted) const {
+        return IdFilter::from_labels(labels_.data(), labels_.size(), wanted.data(), wanted.size());
+    }
+
+    /**
+     * Filter for the ids whose label, read as a bitset, shares a bit with
+     * bits.
+     */
+    IdFilter label_bits_filter(uint32_t bits) const {
+        return IdFilter::from_label_bits(labels_.data(), labels_.size(), bits);
+    }
+
+    /**
+     * OPTIONAL: Set a named tuning parameter (e.g. "M", "ef_search").
+     * Build parameters must be set before fit(); query-time parameters
+     * can be changed between queries without rebuilding.
+     * 
+     * @param name Parameter name, see get_params() for what is supported
+     * @param value Parameter value (integers are passed as doubles)
+     */
+    virtual void set_param(const std::string& name, double value) {
+        (void)value;
+        throw std::runtime_error(this->name() + " has no parameter '" + name + "'");
+    }
+
+    /**
+     * OPTIONAL: Current values of all tunable parameters.
+     */
+    virtual std::map<std::string, double> get_params() const {
+        return {};
+    }
+
+    /**
+     * OPTIONAL: Write the built index (data structures and parameters) to
+     * path in the versioned format of index_io.hpp.
+     * Default: throws std::runtime_error.
+     */
+    virtual void save(const std::string& path) const {
+        (void)path;
+        throw std::runtime_error(name() + " does not support save()");
+    }
+
+    /**
+     * OPTIONAL: Replace this index with one written by save(), instead of
+     * calling init() and fit(). Metric, dimension and parameters come from
+     * the file; fp32 vectors and graph adjacency are memory-mapped rather
+     * than read, so loading is near-instant and pages fault in on first use.
+     * Throws std::runtime_error if the file holds a different kind of index.
+     * Default: throws std::runtime_error.
+     */
+    virtual void load(const std::string& path) {
+        throw std::runtime_error(name() + " does not support load() of " + path);
+    }
+
     /**
      * Get approximate memory usage in bytes.
      * Used for competition metrics.
      */
     virtual size_t get_memory_usage() const = 0;
 
+    /**
+     * OPTIONAL: Bytes the index keeps on disk and reads during queries,
+     * not counted by get_memory_usage(). Default: 0 (fully in memory).
+     */
+    virtual size_t get_disk_usage() const {
+        return 0;
+    }
+
     /**
      * Get algorithm name for leaderboard.
      */
     virtual std::string name() const = 0;
 
+    /**
+     * OPTIONAL: Search-loop counters summed over every query since the
+     * index was created or reset_stats() ran: queries, distances,
+     * nodes_visited, lists_probed, reranked, heap_pushes, exact_scans (see
+     * search_stats.hpp). Empty when built without ANN_ENABLE_STATS.
+     * Wrappers report their inner indexes' counters.
+     */
+    virtual std::map<std::string, double> get_stats() const {
+        return stats_.snapshot();
+    }
+
+    virtual void reset_stats() {
+        stats_.reset();
+    }
+
 protected:
+    // First k the default range_search() tries
+    static constexpr int kRangeFirstK = 32;
+
+    /**
+     * query() for indexes that implement search(): the ids, without the
+     * -1 padding.
+     */
+    std::vector<int> search_ids(const float* query, int k) {
+        std::vector<int> ids(k);
+        search(query, k, ids.data(), nullptr);
+        ids.erase(std::find(ids.begin(), ids.end(), -1), ids.end());
+        return ids;
+    }
+
+    /**
+     * Call search_one(i) for every query i in parallel (OpenMP, dynamic
+     * schedule); the first exception one throws is rethrown once the loop
+     * is done.
+     */
+    template <typename SearchOne>
+    void parallel_queries(size_t n_queries, int num_threads, SearchOne search_one) {
+        std::exception_ptr error;
+        #pragma omp parallel for schedule(dynamic, 4) num_threads(thread_count(num_threads))
+        for (long long i = 0; i < static_cast<long long>(n_queries); ++i) {
+            try {
+                search_one(static_cast<size_t>(i));
+            } catch (...) {
+                // Exceptions must not escape an OpenMP region
+                #pragma omp critical
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * Threads to use for a num_threads argument (0 = OpenMP default).
+     */
+    static int thread_count(int num_threads) {
+#ifdef _OPENMP
+        return num_threads > 0 ? num_threads : omp_get_max_threads();
+#else
+        (void)num_threads;
+        return 1;
+#endif
+    }
+
     int dimension_ = 0;
     std::string metric_;
+    std::vector<float> stream_rows_;  // default fit_chunk() buffer
+    std::vector<int> labels_;         // set_labels(), by id
+    mutable StatsCounters stats_;     // get_stats(); searches add to it
 };
\ No newline at end of file
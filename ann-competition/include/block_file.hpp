@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * One read of a BlockFile batch: bytes at offset into buffer. For direct
+ * I/O all three must be multiples of BlockFile::kSectorBytes (buffer: its
+ * address).
+ */
+struct BlockRead {
+    uint64_t offset;
+    size_t bytes;
+    void* buffer;
+};
+
+/**
+ * File of 4 KB sectors for index data that stays on disk (diskann.cpp).
+ *
+ * Reads are issued in batches: a batch is submitted to a per-thread
+ * io_uring (raw syscalls, no liburing) and completes when every read in it
+ * has, so one batch costs about one device round trip however many sectors
+ * it names. Without io_uring (old kernel, blocked by seccomp, or
+ * ANN_IO_URING=0) the reads fall back to pread().
+ *
+ * Files are opened with O_DIRECT so reads hit the device rather than the
+ * page cache, which would otherwise quietly turn the index back into an
+ * in-memory one; filesystems without O_DIRECT (tmpfs) and ANN_DIRECT_IO=0
+ * use buffered I/O.
+ */
+class BlockFile {
+public:
+    static constexpr size_t kSectorBytes = 4096;
+
+    BlockFile() = default;
+    ~BlockFile();
+
+    BlockFile(const BlockFile&) = delete;
+    BlockFile& operator=(const BlockFile&) = delete;
+
+    /**
+     * Open path read-only. Throws std::runtime_error if it cannot be opened.
+     */
+    void open(const std::string& path);
+
+    /**
+     * Create a read-write scratch file in dir; it is unlinked at once, so
+     * it disappears when closed (or when the process dies).
+     */
+    void create_temporary(const std::string& dir);
+
+    /**
+     * pwrite() bytes at offset (buffered, also on direct files).
+     */
+    void write(uint64_t offset, const void* data, size_t bytes);
+
+    /**
+     * Switch to direct I/O for subsequent reads, if the filesystem allows.
+     */
+    void enable_direct();
+
+    /**
+     * Perform n reads; all have completed when this returns. Safe to call
+     * from several threads at once. Throws std::runtime_error on I/O errors
+     * and short reads (past the end of the file).
+     */
+    void read(const BlockRead* reads, size_t n) const;
+
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+    bool direct() const { return direct_; }
+
+    /**
+     * "io_uring" or "pread": how this thread's batches are issued.
+     */
+    static const char* backend();
+
+    /**
+     * Sector-aligned allocation for read buffers, released with std::free().
+     */
+    static void* allocate(size_t bytes);
+
+private:
+    int fd_ = -1;
+    bool direct_ = false;
+    std::string path_;
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Shared SIMD distance kernels with runtime ISA dispatch.
+ *
+ * Every kernel accepts an arbitrary dimension: the vectorized main loop is
+ * followed by a masked (AVX-512 / AVX2) or scalar (NEON) tail, so callers
+ * never need to pad vectors.
+ *
+ * The kernel table is selected once, on first use, from CPUID (x86) or the
+ * target baseline (ARM64 always has NEON). Each ISA lives in its own
+ * translation unit compiled with its own flags, so a single build runs at
+ * full speed on any machine it is loaded on.
+ *
+ * Set ANN_FORCE_ISA=scalar|avx2|avx512|neon to override the selection
+ * (useful for A/B benchmarking a specific kernel).
+ */
+
+/**
+ * Distance metric, resolved once in init() so that search loops never
+ * compare strings.
+ */
+enum class Metric : int {
+    Euclidean = 0,
+    Angular = 1,
+};
+
+constexpr int kNumMetrics = 2;
+
+/**
+ * Parse "euclidean" / "angular". Throws std::runtime_error otherwise.
+ */
+Metric parse_metric(const std::string& metric);
+
+/**
+ * Dimensions with a dedicated scan specialization (fixed trip count, fully
+ * unrollable). Slot 0 is the generic runtime-dimension fallback.
+ * These match DatasetConfig and DatasetLoader.DATASETS.
+ */
+constexpr size_t kScanDims[] = {0, 128, 256, 784, 960};
+constexpr int kNumScanDims = sizeof(kScanDims) / sizeof(kScanDims[0]);
+
+using DistanceFunc = float (*)(const float* a, const float* b, size_t dim);
+
+/**
+ * Distances from one query to n rows, row i starting at base + i * stride.
+ * Writes n values to out; smaller is always closer.
+ *
+ * Euclidean scans return squared L2. Angular scans return 1 - q·x and
+ * expect both the query and the rows to be unit length (normalize_rows).
+ */
+using ScanFunc = void (*)(const float* query, const float* base, size_t n,
+                          size_t stride, size_t dim, float* out);
+
+/**
+ * Same as ScanFunc but for a gathered set of rows: out[i] is the distance
+ * to the row starting at base + ids[i] * stride. Used by graph traversal
+ * and re-ranking, where candidates are not contiguous.
+ */
+using ScanIdsFunc = void (*)(const float* query, const float* base, const int* ids,
+                             size_t n, size_t stride, size_t dim, float* out);
+
+/**
+ * 4-bit PQ fast-scan: approximate distances for n_blocks blocks of 32 codes.
+ *
+ * codes holds blocks of m * 16 bytes; byte j of subspace s in a block packs
+ * vector j (low nibble) and vector j + 16 (high nibble), see
+ * pack_pq4_block() in pq.hpp. lut holds m * 16 uint8 entries. Sums are
+ * accumulated in uint16, so m must be <= 257. Writes n_blocks * 32 values.
+ */
+using PQ4ScanFunc = void (*)(const uint8_t* codes, size_t n_blocks, size_t m,
+                             const uint8_t* lut, uint16_t* out);
+
+/**
+ * ScanFunc over rows stored as IEEE half floats (see float_to_half). The
+ * query stays fp32; rows are widened in registers (F16C / AVX-512 / NEON).
+ */
+using F16ScanFunc = void (*)(const float* query, const uint16_t* base, size_t n,
+                             size_t stride, size_t dim, float* out);
+
+/**
+ * Integer dot products for scalar-quantized rows: out[i] = sum_d query[d] *
+ * row_i[d], rows of uint8 codes, query int8 in [-63, 63] (see sq.hpp).
+ * The query bound keeps the u8 x s8 pair sums of pmaddubsw within int16, so
+ * every ISA returns bit-identical results.
+ */
+using U8DotScanFunc = void (*)(const int8_t* query, const uint8_t* base, size_t n,
+                               size_t stride, size_t dim, int32_t* out);
+
+/**
+ * Hamming distances from a binary query code to n binary rows of `words`
+ * 64-bit words each (row i starts at base + i * words).
+ */
+using HammingScanFunc = void (*)(const uint64_t* query, const uint64_t* base, size_t n,
+                                 size_t words, uint32_t* out);
+
+/**
+ * Dot products of nq queries (row-major, stride dim) with n rows (row j at
+ * base + j * stride): out[i * ld + j] = queries_i · row_j.
+ *
+ * Register-blocked over (queries x rows), so each loaded row chunk feeds
+ * several queries; the batch engine in VectorDBKernel sizes the tiles to
+ * stay in cache.
+ */
+using DotTileFunc = void (*)(const float* queries, size_t nq, const float* base, size_t n,
+                             size_t stride, size_t dim, float* out, size_t ld);
+
+struct DistanceKernels {
+    const char* isa;             // Name of the selected instruction set
+    DistanceFunc l2_sqr;         // sum((a - b)^2)
+    DistanceFunc inner_product;  // sum(a * b)
+
+    // scan[metric][dim slot], see kScanDims
+    ScanFunc scan[kNumMetrics][kNumScanDims];
+    ScanIdsFunc scan_ids[kNumMetrics][kNumScanDims];
+
+    PQ4ScanFunc pq4_scan;        // in-register LUT lookups (pshufb / tbl)
+
+    F16ScanFunc f16_scan[kNumMetrics];  // fp16 storage, by metric
+    U8DotScanFunc u8_dot_scan;          // int8 storage (VNNI / pmaddubsw / sdot)
+    HammingScanFunc hamming_scan;       // 1-bit storage (popcnt / cnt)
+
+    DotTileFunc dot_tile;               // batched queries x rows
+};
+
+/**
+ * Kernels for the best instruction set supported by the running CPU.
+ */
+const DistanceKernels& distance_kernels();
+
+/**
+ * Scan kernel for a metric, specialized for dim when one exists.
+ */
+ScanFunc resolve_scan(Metric metric, int dim);
+ScanIdsFunc resolve_scan_ids(Metric metric, int dim);
+
+/**
+ * Scale each of the n rows to unit L2 norm in place (parallel over rows).
+ * All-zero rows are left untouched. Rows are stride floats apart (padded
+ * VectorStore rows); the 3-argument form is for contiguous rows.
+ */
+void normalize_rows(float* data, size_t n, size_t stride, size_t dim);
+void normalize_rows(float* data, size_t n, size_t dim);
+
+/**
+ * Angular queries are copied into buf and normalized to match the stored
+ * unit vectors; euclidean queries are returned as-is.
+ */
+const float* prepare_query(Metric metric, const float* query, size_t dim,
+                           std::vector<float>& buf);
+
+/**
+ * IEEE 754 binary16 conversions (round to nearest even), portable and
+ * independent of F16C; used to encode fp16 storage.
+ */
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t value);
+
+/**
+ * Per-ISA registration hooks.
+ * Each overwrites the entries it implements; anything left untouched keeps
+ * the portable scalar version. Only defined for the current architecture.
+ */
+void register_scalar_kernels(DistanceKernels& k);
+void register_avx2_kernels(DistanceKernels& k);
+void register_avx512_kernels(DistanceKernels& k);
+void register_avx512_vnni_kernels(DistanceKernels& k);
+void register_neon_kernels(DistanceKernels& k);
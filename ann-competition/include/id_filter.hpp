@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Set of ids a filtered search may return (ANNAlgorithm::search_filtered()),
+ * as a bitmap over ids 0 .. size(). Ids at or past size() are rejected, so
+ * vectors added after the filter was built never pass it.
+ *
+ * Build one per predicate and share it across the queries of a batch:
+ * allows() is a single bit test, and count() lets an index pick between
+ * filtering its own traversal and scanning the allowed ids directly.
+ */
+class IdFilter {
+public:
+    IdFilter() = default;
+
+    /**
+     * Ids i < n with mask[i] != 0 (e.g. a numpy bool array).
+     */
+    static IdFilter from_mask(const uint8_t* mask, size_t n) {
+        IdFilter filter(n);
+        filter.fill([&](size_t i) { return mask[i] != 0; });
+        return filter;
+    }
+
+    /**
+     * Ids i < n whose labels[i] is one of wanted[0 .. n_wanted).
+     */
+    static IdFilter from_labels(const int* labels, size_t n, const int* wanted, size_t n_wanted) {
+        std::vector<int> sorted(wanted, wanted + n_wanted);
+        std::sort(sorted.begin(), sorted.end());
+        IdFilter filter(n);
+        filter.fill([&](size_t i) {
+            return std::binary_search(sorted.begin(), sorted.end(), labels[i]);
+        });
+        return filter;
+    }
+
+    /**
+     * Ids i < n whose labels[i], read as a bitset, shares a bit with bits
+     * (labels are then flags, e.g. one bit per category).
+     */
+    static IdFilter from_label_bits(const int* labels, size_t n, uint32_t bits) {
+        IdFilter filter(n);
+        filter.fill([&](size_t i) { return (static_cast<uint32_t>(labels[i]) & bits) != 0; });
+        return filter;
+    }
+
+    /**
+     * Ids begin .. end - 1 of filter as ids 0 .. end - begin - 1, for an
+     * index holding that id range under local ids (a shard).
+     */
+    IdFilter slice(size_t begin, size_t end) const {
+        end = std::max(begin, std::min(end, size_));
+        IdFilter filter(end - begin);
+        size_t count = 0;
+        for (size_t w = 0; w < filter.words_.size(); ++w) {
+            size_t i = begin + w * 64;
+            uint64_t word = words_[i >> 6] >> (i & 63);
+            if ((i & 63) != 0 && (i >> 6) + 1 < words_.size()) {
+                word |= words_[(i >> 6) + 1] << (64 - (i & 63));
+            }
+            size_t span = std::min<size_t>(64, end - i);
+            if (span < 64) {
+                word &= (uint64_t(1) << span) - 1;
+            }
+            filter.words_[w] = word;
+            count += static_cast<size_t>(__builtin_popcountll(word));
+        }
+        filter.count_ = count;
+        return filter;
+    }
+
+    bool allows(int id) const {
+        size_t i = static_cast<size_t>(id);
+        return i < size_ && (words_[i >> 6] >> (i & 63) & 1) != 0;
+    }
+
+    /**
+     * Ids covered by the bitmap (allowed or not).
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * Allowed ids.
+     */
+    size_t count() const { return count_; }
+
+    /**
+     * Whether any id in [begin, end) is allowed; whole words at a time.
+     */
+    bool any(size_t begin, size_t end) const {
+        end = std::min(end, size_);
+        for (size_t i = begin; i < end;) {
+            uint64_t word = words_[i >> 6] >> (i & 63);
+            size_t span = std::min<size_t>(64 - (i & 63), end - i);
+            if (span < 64) {
+                word &= (uint64_t(1) << span) - 1;
+            }
+            if (word != 0) {
+                return true;
+            }
+            i += span;
+        }
+        return false;
+    }
+
+    /**
+     * The allowed ids, ascending.
+     */
+    void collect(std::vector<int>& ids) const {
+        ids.clear();
+        ids.reserve(count_);
+        for (size_t w = 0; w < words_.size(); ++w) {
+            for (uint64_t word = words_[w]; word != 0; word &= word - 1) {
+                ids.push_back(static_cast<int>(w * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+
+private:
+    explicit IdFilter(size_t n) : words_((n + 63) / 64, 0), size_(n) {}
+
+    template <typename Pred>
+    void fill(Pred allowed) {
+        size_t count = 0;
+        #pragma omp parallel for schedule(static) reduction(+ : count)
+        for (long long w = 0; w < static_cast<long long>(words_.size()); ++w) {
+            size_t begin = static_cast<size_t>(w) * 64;
+            size_t end = std::min(size_, begin + 64);
+            uint64_t word = 0;
+            for (size_t i = begin; i < end; ++i) {
+                word |= static_cast<uint64_t>(allowed(i)) << (i - begin);
+            }
+            words_[w] = word;
+            count += static_cast<size_t>(__builtin_popcountll(word));
+        }
+        count_ = count;
+    }
+
+    std::vector<uint64_t> words_;
+    size_t size_ = 0;
+    size_t count_ = 0;
+};
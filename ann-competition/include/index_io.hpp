@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class VectorStore;
+
+/**
+ * Versioned on-disk index format shared by every index's save() / load().
+ *
+ * A file is a fixed header, a list of named binary sections and a table of
+ * contents at the end:
+ *
+ *     header   magic "ANNINDEX", format version, endianness tag,
+ *              TOC offset / count, algorithm kind, metric, dimension
+ *     sections one per array, each starting on a 4 KB boundary
+ *     TOC      (name, offset, bytes) per section
+ *
+ * Scalars (parameters, counts, entry points) go into the "meta" section as
+ * name=value text, so adding a field does not break older readers; a change
+ * that does bumps kIndexFormatVersion.
+ *
+ * Readers mmap the whole file. Because sections are page aligned, fp32 rows
+ * and graph adjacency are used straight from the mapping (map_store(),
+ * array()), so loading costs page faults instead of parsing; smaller arrays
+ * are copied out with vector(). The mapping is private copy-on-write: an
+ * index may modify mapped data without ever writing to the file.
+ */
+constexpr uint32_t kIndexFormatVersion = 1;
+
+class IndexWriter {
+public:
+    /**
+     * Create (truncate) path. kind identifies the index class, e.g. "hnsw".
+     * Throws std::runtime_error if the file cannot be opened.
+     */
+    IndexWriter(const std::string& path, const std::string& kind,
+                const std::string& metric, int dimension);
+    ~IndexWriter();
+
+    IndexWriter(const IndexWriter&) = delete;
+    IndexWriter& operator=(const IndexWriter&) = delete;
+
+    /**
+     * Record a scalar in the "meta" section.
+     */
+    void set(const std::string& name, double value) {
+        meta_[name] = value;
+    }
+
+    /**
+     * Append a raw section.
+     */
+    void write(const std::string& name, const void* data, size_t bytes);
+
+    template <typename T>
+    void write(const std::string& name, const std::vector<T>& values) {
+        write(name, values.data(), values.size() * sizeof(T));
+    }
+
+    /**
+     * Start a section written piecewise with append(), for sections too
+     * large to hold in memory at once.
+     */
+    void begin_section(const std::string& name);
+
+    /**
+     * Append bytes to the section started last.
+     */
+    void append(const void* data, size_t bytes);
+
+    /**
+     * Append the rows of a store (including row padding) as section name,
+     * with its shape recorded as name.n / name.dim / name.stride.
+     */
+    void write_store(const std::string& name, const VectorStore& store);
+
+    /**
+     * Write the meta section, TOC and header. Throws std::runtime_error on
+     * I/O failure; the file is unusable if this is not called.
+     */
+    void finish();
+
+private:
+    struct Section {
+        std::string name;
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    void write_at_end(const void* data, size_t bytes);
+
+    std::string path_;
+    std::string kind_;
+    std::string metric_;
+    int dimension_;
+    int fd_ = -1;
+    uint64_t offset_ = 0;
+    std::vector<Section> sections_;
+    std::map<std::string, double> meta_;
+};
+
+class IndexFile : public std::enable_shared_from_this<IndexFile> {
+public:
+    /**
+     * Map path (private copy-on-write, the file itself is never written).
+     * Throws std::runtime_error
+     * if the file is missing, truncated, or has a different magic, version
+     * or byte order.
+     */
+    static std::shared_ptr<IndexFile> open(const std::string& path);
+
+    ~IndexFile();
+
+    IndexFile(const IndexFile&) = delete;
+    IndexFile& operator=(const IndexFile&) = delete;
+
+    const std::string& kind() const { return kind_; }
+    const std::string& metric() const { return metric_; }
+    int dimension() const { return dimension_; }
+
+    /**
+     * Throw unless the file holds an index of this kind.
+     */
+    void expect_kind(const std::string& kind) const;
+
+    bool has(const std::string& name) const;
+
+    /**
+     * Scalar from the meta section; throws if missing.
+     */
+    double get(const std::string& name) const;
+    double get(const std::string& name, double fallback) const;
+
+    /**
+     * Mapped bytes of a section; throws if missing.
+     */
+    const void* section(const std::string& name, size_t& bytes) const;
+
+    /**
+     * Position of a section in the file, for readers that access it with
+     * their own I/O instead of through the mapping; throws if missing.
+     */
+    uint64_t section_offset(const std::string& name) const;
+
+    const std::string& path() const { return path_; }
+
+    /**
+     * Section viewed as count elements of T, straight from the mapping.
+     * Throws if the size does not match.
+     */
+    template <typename T>
+    T* array(const std::string& name, size_t count) const {
+        size_t bytes = 0;
+        const void* data = section(name, bytes);
+        if (bytes != count * sizeof(T)) {
+            throw std::runtime_error("index file " + path_ + ": section '" + name +
+                                     "' has unexpected size");
+        }
+        return static_cast<T*>(const_cast<void*>(data));
+    }
+
+    /**
+     * Copy of a section as a vector of T.
+     */
+    template <typename T>
+    std::vector<T> vector(const std::string& name) const {
+        size_t bytes = 0;
+        const T* data = static_cast<const T*>(section(name, bytes));
+        if (bytes % sizeof(T) != 0) {
+            throw std::runtime_error("index file " + path_ + ": section '" + name +
+                                     "' has unexpected size");
+        }
+        return std::vector<T>(data, data + bytes / sizeof(T));
+    }
+
+    /**
+     * Point store at rows written by IndexWriter::write_store(). The store
+     * keeps this file mapped for as long as it uses the rows.
+     */
+    void map_store(const std::string& name, VectorStore& store) const;
+
+private:
+    IndexFile() = default;
+
+    struct Section {
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    std::string path_;
+    std::string kind_;
+    std::string metric_;
+    int dimension_ = 0;
+    char* base_ = nullptr;
+    size_t size_ = 0;
+    std::map<std::string, Section> sections_;
+    std::map<std::string, double> meta_;
+};
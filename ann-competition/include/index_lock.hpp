@@ -0,0 +1,41 @@
+#pragma once
+
+#include <mutex>
+#include <shared_mutex>
+
+/**
+ * Locking for indexes that change while they are being queried (add(),
+ * remove(), compact()).
+ *
+ * - read():   held by every query, and by updates while they only read
+ *             (searching for an insert's neighbors, planning a compaction)
+ * - write():  held by updates for the short steps that change what queries
+ *             see (linking new nodes, swapping in compacted lists)
+ * - update(): serializes updates against each other for their duration
+ *
+ * Writers are preferred: a writer takes the gate before waiting for the
+ * shared lock, so queries that arrive meanwhile queue behind it instead of
+ * starving it (std::shared_mutex on its own gives no such guarantee). An
+ * update therefore waits at most for the queries already in flight.
+ */
+class IndexLock {
+public:
+    std::shared_lock<std::shared_mutex> read() const {
+        std::lock_guard<std::mutex> gate(gate_);
+        return std::shared_lock<std::shared_mutex>(mutex_);
+    }
+
+    std::unique_lock<std::shared_mutex> write() const {
+        std::lock_guard<std::mutex> gate(gate_);
+        return std::unique_lock<std::shared_mutex>(mutex_);
+    }
+
+    std::unique_lock<std::mutex> update() const {
+        return std::unique_lock<std::mutex>(update_);
+    }
+
+private:
+    mutable std::mutex gate_;
+    mutable std::shared_mutex mutex_;
+    mutable std::mutex update_;
+};
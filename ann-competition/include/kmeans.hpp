@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Lloyd's k-means on squared L2, shared by the IVF coarse quantizer and the
+ * product quantizer codebooks.
+ *
+ * Assignment is OpenMP-parallel over points; the centroid update is parallel
+ * over clusters and sums each cluster's points in index order, so the result
+ * depends only on the seed, not on the thread count.
+ */
+
+struct KMeansParams {
+    int iterations = 10;
+    unsigned seed = 1234;
+    // Train on at most this many points per centroid (random subsample)
+    size_t max_points_per_centroid = 256;
+};
+
+/**
+ * Train k centroids on n vectors of dimension dim (all zero for n == 0).
+ *
+ * @return Centroids, row-major [k * dim]
+ */
+std::vector<float> kmeans_train(const float* data, size_t n, size_t dim, int k,
+                                const KMeansParams& params = KMeansParams());
+
+/**
+ * Nearest centroid (squared L2) for each of n vectors, OpenMP-parallel.
+ *
+ * @param labels Output [n] centroid indices
+ * @param distances Optional output [n] squared distances (may be nullptr)
+ */
+void kmeans_assign(const float* data, size_t n, size_t dim,
+                   const float* centroids, int k,
+                   int* labels, float* distances = nullptr);
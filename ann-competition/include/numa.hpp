@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * One NUMA node: its id and the CPUs of it this process may run on.
+ */
+struct NumaNode {
+    int id;
+    std::vector<int> cpus;
+};
+
+/**
+ * NUMA nodes with at least one usable CPU, lowest id first, read once from
+ * /sys/devices/system/node and the process affinity mask. Machines without
+ * NUMA (or not Linux, or ANN_NUMA=0) report a single node with id -1 and
+ * every usable CPU, for which the binding calls below only set affinity.
+ */
+const std::vector<NumaNode>& numa_nodes();
+
+/**
+ * Pin the calling thread to node's CPUs and make it allocate from node's
+ * memory (preferred policy: other nodes when it is full). Threads it
+ * starts afterwards, OpenMP teams included, inherit both, so data an index
+ * builds from this thread is first touched, and placed, on node. Best
+ * effort: false if the kernel refused either call.
+ */
+bool numa_bind_thread(const NumaNode& node);
+
+/**
+ * Migrate the whole pages of [data, data + bytes) to node (mbind with
+ * MPOL_MF_MOVE), for memory allocated elsewhere, e.g. a borrowed array.
+ * Best effort: false if the pages were left where they are.
+ */
+bool numa_place(const void* data, size_t bytes, const NumaNode& node);
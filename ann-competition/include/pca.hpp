@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class IndexWriter;
+class IndexFile;
+
+/**
+ * PCA projection to a lower dimension: y = W (x - mean), W holding the
+ * out_dim principal directions of the training data (orthonormal rows,
+ * largest variance first).
+ *
+ * Training estimates the covariance on a sample, finds its top eigenspace
+ * by orthogonal (block power) iteration and orders it by a Rayleigh-Ritz
+ * step, so no dense eigensolver over the full dimension is needed. Since W
+ * has orthonormal rows, ||W (x - z)|| <= ||x - z||: reduced distances
+ * never overestimate full ones, which makes them safe for range searches
+ * and shortlists that are re-ranked on the full vectors.
+ */
+class PCATransform {
+public:
+    /**
+     * Learn the projection from n vectors of dim floats, stride floats apart
+     * (0 = dim, contiguous), keeping out_dim < dim directions.
+     */
+    void train(const float* data, size_t n, size_t dim, size_t stride, size_t out_dim);
+
+    /**
+     * Project n vectors (stride floats apart, 0 = dim) into n * out_dim()
+     * floats. Parallel over rows for large n.
+     */
+    void apply(const float* data, size_t n, size_t stride, float* out) const;
+
+    size_t dim() const { return dim_; }
+    size_t out_dim() const { return out_dim_; }
+
+    /**
+     * Fraction of the training variance the kept directions carry.
+     */
+    double explained_variance() const { return explained_variance_; }
+
+    /**
+     * Write / restore the trained state under prefix (see index_io.hpp).
+     */
+    void save(IndexWriter& out, const std::string& prefix) const;
+    void load(const IndexFile& in, const std::string& prefix);
+
+    size_t get_memory_usage() const {
+        return (mean_.size() + components_.size() + offsets_.size()) * sizeof(float);
+    }
+
+private:
+    size_t dim_ = 0;
+    size_t out_dim_ = 0;
+    double explained_variance_ = 0.0;
+    std::vector<float> mean_;        // dim
+    std::vector<float> components_;  // out_dim * dim, row r = direction r
+    std::vector<float> offsets_;     // out_dim, W mean
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+/**
+ * Hardware counter totals of one measured region, over every thread that
+ * ran it. Counts are scaled up when the kernel multiplexed the counters.
+ */
+struct PerfCounts {
+    bool available = false;   // false: nothing was counted, see error
+    std::string error;        // why the counters could not be opened
+    double cycles = 0;
+    double instructions = 0;
+    double llc_misses = 0;    // last-level cache misses (PERF_COUNT_HW_CACHE_MISSES)
+    double seconds = 0;       // wall time of the region
+};
+
+/**
+ * Run fn() with cycle, instruction and LLC-miss counters (perf_event_open,
+ * user space only) open on the calling thread and on each thread of an
+ * OpenMP team of num_threads (0: the OpenMP default), and return their
+ * sum. Meant for fn() = one batch_search with the same num_threads: the
+ * OpenMP runtime keeps its team threads alive between parallel regions,
+ * so the threads counted are the threads that search. fn() always runs;
+ * where the counters cannot be opened (not Linux, perf_event_paranoid,
+ * a container without the syscall) the result has available = false and
+ * only seconds.
+ */
+PerfCounts perf_measure(int num_threads, const std::function<void()>& fn);
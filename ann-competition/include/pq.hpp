@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class IndexWriter;
+class IndexFile;
+
+/**
+ * Product quantizer (Jegou et al., "Product quantization for nearest
+ * neighbor search", 2011).
+ *
+ * A vector is split into m subvectors of dsub = dim / m floats, and each
+ * subvector is replaced by the index of its nearest centroid in a per-subspace
+ * codebook of 2^nbits entries (k-means trained). With nbits = 8 a 960-dim
+ * vector becomes m bytes instead of 3840.
+ *
+ * Queries use asymmetric distance computation (ADC): a lookup table of
+ * query-subvector to centroid distances is built once, after which each
+ * code costs m table lookups. With nbits = 4 the tables fit in a SIMD
+ * register and are scanned with the pq4_scan kernel (fast-scan).
+ *
+ * Codes are always produced unpacked (one byte per subspace); use
+ * pack_pq4_block() to lay out 4-bit codes for fast-scan.
+ */
+class ProductQuantizer {
+public:
+    /**
+     * Train the m codebooks on n vectors.
+     * Throws std::runtime_error if dim is not a multiple of m.
+     */
+    void train(const float* data, size_t n, size_t dim, int m, int nbits, unsigned seed);
+
+    /**
+     * Encode n vectors into n * m bytes (one code per subspace).
+     */
+    void encode(const float* data, size_t n, uint8_t* codes) const;
+
+    /**
+     * ADC table for squared L2: lut[s * ksub + c] = ||q_s - centroid(s, c)||^2
+     */
+    void compute_l2_lut(const float* query, float* lut) const;
+
+    /**
+     * ADC table for inner product: lut[s * ksub + c] = -(q_s · centroid(s, c))
+     * (negated so that smaller is still closer)
+     */
+    void compute_ip_lut(const float* query, float* lut) const;
+
+    /**
+     * Approximate distances for n unpacked codes: out[i] = sum_s lut[s][code[s]]
+     */
+    void adc_scan(const uint8_t* codes, size_t n, const float* lut, float* out) const;
+
+    int m() const { return m_; }
+    int nbits() const { return nbits_; }
+    int ksub() const { return ksub_; }
+    size_t dsub() const { return dsub_; }
+    size_t lut_size() const { return static_cast<size_t>(m_) * ksub_; }
+
+    const std::vector<float>& codebooks() const { return codebooks_; }
+
+    /**
+     * Write / restore the trained state under prefix (see index_io.hpp).
+     */
+    void save(IndexWriter& out, const std::string& prefix) const;
+    void load(const IndexFile& in, const std::string& prefix);
+
+    size_t get_memory_usage() const {
+        return codebooks_.size() * sizeof(float);
+    }
+
+private:
+    size_t dim_ = 0;
+    size_t dsub_ = 0;
+    int m_ = 0;
+    int nbits_ = 8;
+    int ksub_ = 256;
+    std::vector<float> codebooks_;  // m * ksub * dsub
+};
+
+/**
+ * Number of bytes per 32-vector block of 4-bit codes.
+ */
+inline size_t pq4_block_bytes(int m) {
+    return static_cast<size_t>(m) * 16;
+}
+
+/**
+ * Pack up to 32 unpacked 4-bit codes (count <= 32 rows of m bytes) into one
+ * fast-scan block. Missing rows are packed as code 0.
+ */
+void pack_pq4_block(const uint8_t* codes, size_t count, int m, uint8_t* block);
+
+/**
+ * Inverse of pack_pq4_block(): the first count rows of a block as m bytes
+ * each.
+ */
+void unpack_pq4_block(const uint8_t* block, size_t count, int m, uint8_t* codes);
+
+/**
+ * Quantize a float ADC table (m * 16 entries) to uint8 for pq4_scan.
+ * A float distance is recovered as bias + sum / scale.
+ */
+void quantize_pq4_lut(const float* lut, int m, uint8_t* lut8, float& scale, float& bias);
+
+/**
+ * Largest divisor of dim not greater than dim / 4 (at least 1): the default
+ * number of PQ subspaces, i.e. 4-dim subvectors when dim allows it.
+ */
+int default_pq_m(int dim);
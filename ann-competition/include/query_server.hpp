@@ -0,0 +1,153 @@
+#pragma once
+
+#include "mpmc_queue.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ANNAlgorithm;
+
+/**
+ * One query's answer: up to k ids, closest first, and their distances.
+ */
+struct QueryResult {
+    std::vector<int> ids;
+    std::vector<float> distances;
+};
+
+struct QueryServerParams {
+    // A batch is dispatched once it holds max_batch queries or its oldest
+    // query has waited max_wait_us, whichever comes first
+    size_t max_batch = 64;
+    double max_wait_us = 200.0;
+    // Threads running batches at once, and OpenMP threads each batch uses
+    // (0 = OpenMP default divided among the workers)
+    int workers = 1;
+    int threads_per_batch = 0;
+    // Submissions wait (spinning, then yielding) while this many are queued
+    size_t queue_capacity = 4096;
+};
+
+/**
+ * Counters since the server started; the averages are over completed
+ * queries (wait: submit to batch start, latency: submit to result).
+ */
+struct QueryServerStats {
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t batches = 0;
+    size_t queue_depth = 0;      // submitted, not yet in a batch
+    double mean_batch_size = 0.0;
+    size_t max_batch_size = 0;
+    double mean_wait_us = 0.0;
+    double max_wait_us = 0.0;
+    double mean_latency_us = 0.0;
+};
+
+/**
+ * Serving layer that turns single queries from many threads into batches.
+ *
+ * submit() copies the query into a request and pushes it on a lock-free
+ * MPMC queue (mpmc_queue.hpp); a dispatcher thread drains the queue into
+ * micro-batches under the max_batch / max_wait_us policy and hands them to
+ * a pool of workers, which answer each with one index->batch_search(), so
+ * single-query traffic gets the throughput of the batched kernels (GEMM
+ * tiles, shared graph traversal work) at the cost of at most max_wait_us
+ * extra latency. Requests in one batch may ask for different k.
+ *
+ * The index must outlive the server and stay searchable meanwhile;
+ * add() / remove() may run alongside, as for concurrent batch_search().
+ * The destructor (or stop()) answers every request already submitted.
+ */
+class QueryServer {
+public:
+    /**
+     * Completion callback: result, or the exception batch_search() threw
+     * (then result is empty). Runs on a worker thread and must not throw.
+     */
+    using Callback = std::function<void(QueryResult&& result, std::exception_ptr error)>;
+
+    QueryServer(ANNAlgorithm* index, int dimension,
+                const QueryServerParams& params = QueryServerParams());
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    /**
+     * Queue a search for the k nearest neighbors of query (dimension
+     * floats, copied). Throws std::runtime_error once stopped.
+     */
+    std::future<QueryResult> submit(const float* query, int k);
+    void submit(const float* query, int k, Callback done);
+
+    QueryServerStats stats() const;
+
+    /**
+     * Stop accepting queries, answer the queued ones and join the threads.
+     * Idempotent.
+     */
+    void stop();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        std::vector<float> query;
+        int k;
+        Clock::time_point submitted;
+        std::promise<QueryResult> promise;  // when done is empty
+        Callback done;
+    };
+
+    void enqueue(Request* request);
+    void dispatch_loop();
+    void worker_loop();
+    void run_batch(std::vector<Request*>& batch, std::vector<float>& queries,
+                   std::vector<int>& ids, std::vector<float>& distances);
+    void wait_for_requests(Clock::time_point deadline);
+
+    ANNAlgorithm* index_;
+    int dimension_;
+    QueryServerParams params_;
+
+    MPMCQueue<Request*> queue_;
+    std::atomic<int> submitting_{0};  // submit() calls between check and push
+    std::atomic<bool> stopping_{false};
+
+    // Dispatcher sleep / wake-up when the queue runs dry
+    std::atomic<bool> dispatcher_idle_{false};
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+
+    // Formed batches waiting for a worker
+    std::mutex work_mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable space_cv_;
+    std::deque<std::vector<Request*>> work_;
+    bool work_done_ = false;
+
+    std::thread dispatcher_;
+    std::vector<std::thread> workers_;
+    std::once_flag stopped_;
+
+    // Stats
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> batched_{0};
+    std::atomic<size_t> max_batch_size_{0};
+    std::atomic<uint64_t> wait_ns_{0};
+    std::atomic<uint64_t> max_wait_ns_{0};
+    std::atomic<uint64_t> latency_ns_{0};
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+class ANNAlgorithm;
+
+/**
+ * New index for an impl_type name ("naive", "vectordb", "hnsw", "ivf",
+ * "ivfpq", "diskann"); "pca+<impl>" wraps <impl> in the PCA stage and
+ * "shard+<impl>" splits it into per-NUMA-node <impl> shards. The caller
+ * owns the result. Throws std::runtime_error for unknown names.
+ */
+ANNAlgorithm* create_algorithm(const std::string& impl_type);
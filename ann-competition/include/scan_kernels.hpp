@@ -0,0 +1,81 @@
+#pragma once
+
+#include "distance.hpp"
+
+/**
+ * Scan loops shared by every ISA translation unit.
+ *
+ * K is an ISA-specific kernel struct providing
+ *     template <size_t Dim> static float l2_sqr(const float*, const float*, size_t dim);
+ *     template <size_t Dim> static float inner_product(const float*, const float*, size_t dim);
+ * where Dim == 0 means "use the runtime dim". Instantiating with a fixed Dim
+ * gives the compiler a constant trip count to unroll and lets it inline the
+ * kernel into the row loop.
+ *
+ * Because every instantiation is keyed on the ISA's own K type, code compiled
+ * with different -m flags never collides at link time. Keep this header free
+ * of std:: inline functions for the same reason.
+ */
+
+template <class K, Metric M, size_t Dim>
+void scan_rows(const float* query, const float* base, size_t n,
+               size_t stride, size_t dim, float* out) {
+    const size_t d = Dim ? Dim : dim;
+
+    if (M == Metric::Euclidean) {
+        // Squared L2: same ranking as L2, no sqrt per candidate
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = K::template l2_sqr<Dim>(query, base + i * stride, d);
+        }
+    } else {
+        // Cosine distance on unit vectors: 1 - q·x (see normalize_rows)
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = 1.0f - K::template inner_product<Dim>(query, base + i * stride, d);
+        }
+    }
+}
+
+template <class K, Metric M, size_t Dim>
+void scan_id_rows(const float* query, const float* base, const int* ids,
+                  size_t n, size_t stride, size_t dim, float* out) {
+    const size_t d = Dim ? Dim : dim;
+
+    for (size_t i = 0; i < n; ++i) {
+        const float* x = base + static_cast<size_t>(ids[i]) * stride;
+        if (M == Metric::Euclidean) {
+            out[i] = K::template l2_sqr<Dim>(query, x, d);
+        } else {
+            out[i] = 1.0f - K::template inner_product<Dim>(query, x, d);
+        }
+    }
+}
+
+template <class K, Metric M>
+void register_scan_row(DistanceKernels& k) {
+    ScanFunc* row = k.scan[static_cast<int>(M)];
+    row[0] = scan_rows<K, M, kScanDims[0]>;
+    row[1] = scan_rows<K, M, kScanDims[1]>;
+    row[2] = scan_rows<K, M, kScanDims[2]>;
+    row[3] = scan_rows<K, M, kScanDims[3]>;
+    row[4] = scan_rows<K, M, kScanDims[4]>;
+
+    ScanIdsFunc* ids_row = k.scan_ids[static_cast<int>(M)];
+    ids_row[0] = scan_id_rows<K, M, kScanDims[0]>;
+    ids_row[1] = scan_id_rows<K, M, kScanDims[1]>;
+    ids_row[2] = scan_id_rows<K, M, kScanDims[2]>;
+    ids_row[3] = scan_id_rows<K, M, kScanDims[3]>;
+    ids_row[4] = scan_id_rows<K, M, kScanDims[4]>;
+    static_assert(kNumScanDims == 5, "update register_scan_row with kScanDims");
+}
+
+/**
+ * Fill the whole kernel table from K.
+ */
+template <class K>
+void register_kernel_table(DistanceKernels& k, const char* isa) {
+    k.isa = isa;
+    k.l2_sqr = K::template l2_sqr<0>;
+    k.inner_product = K::template inner_product<0>;
+    register_scan_row<K, Metric::Euclidean>(k);
+    register_scan_row<K, Metric::Angular>(k);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * Hot-path counters: what the search loops did, to explain why a
+ * configuration is slow (get_stats() / reset_stats() on every index).
+ *
+ * A query counts into a plain SearchStats of its own (on the stack or in
+ * the thread's scratch) and adds it to the index's StatsCounters once, when
+ * it is done; each thread adds into its own cache line there, so counting
+ * costs a few register increments per node / list / block and threads never
+ * contend. Compiled in when ANN_ENABLE_STATS is defined (CMake ANN_STATS,
+ * on by default); without it count() is empty and get_stats() is empty too.
+ */
+enum class Stat : int {
+    Queries,        // searches answered (range rounds and filtered ones included)
+    Distances,      // vector distances computed, exact or on codes
+    NodesVisited,   // graph nodes whose neighbor list was expanded
+    ListsProbed,    // IVF lists scanned
+    Reranked,       // candidates re-scored on full-precision vectors
+    HeapPushes,     // entries inserted into result / candidate heaps
+    ExactScans,     // filtered searches answered by an exact scan of the allowed ids
+    Count
+};
+
+static constexpr size_t kStatCount = static_cast<size_t>(Stat::Count);
+
+/**
+ * get_stats() key of each Stat.
+ */
+inline const char* stat_name(Stat stat) {
+    static const char* const names[kStatCount] = {
+        "queries", "distances", "nodes_visited", "lists_probed",
+        "reranked", "heap_pushes", "exact_scans",
+    };
+    return names[static_cast<size_t>(stat)];
+}
+
+/**
+ * Counts of one query (or one batch on one thread).
+ */
+struct SearchStats {
+    uint64_t values[kStatCount] = {};
+
+    void count(Stat stat, uint64_t n = 1) {
+#ifdef ANN_ENABLE_STATS
+        values[static_cast<size_t>(stat)] += n;
+#else
+        (void)stat;
+        (void)n;
+#endif
+    }
+
+    void clear() {
+        for (uint64_t& value : values) {
+            value = 0;
+        }
+    }
+};
+
+/**
+ * Add the totals in from to into, for wrappers whose get_stats() reports
+ * their inner indexes' counters.
+ */
+inline void add_stats(std::map<std::string, double>& into,
+                      const std::map<std::string, double>& from) {
+    for (const auto& entry : from) {
+        into[entry.first] += entry.second;
+    }
+}
+
+/**
+ * An index's totals, kept in per-thread slots (one cache line each) that
+ * are summed when read.
+ */
+class StatsCounters {
+public:
+    StatsCounters() {
+        reset();
+    }
+
+    StatsCounters(const StatsCounters&) = delete;
+    StatsCounters& operator=(const StatsCounters&) = delete;
+
+    void add(const SearchStats& local) {
+#ifdef ANN_ENABLE_STATS
+        Slot& slot = slots_[thread_slot()];
+        for (size_t i = 0; i < kStatCount; ++i) {
+            if (local.values[i]) {
+                slot.values[i].fetch_add(local.values[i], std::memory_order_relaxed);
+            }
+        }
+#else
+        (void)local;
+#endif
+    }
+
+    /**
+     * Totals by stat_name(); empty when counting is compiled out.
+     */
+    std::map<std::string, double> snapshot() const {
+        std::map<std::string, double> totals;
+#ifdef ANN_ENABLE_STATS
+        for (size_t i = 0; i < kStatCount; ++i) {
+            uint64_t total = 0;
+            for (const Slot& slot : slots_) {
+                total += slot.values[i].load(std::memory_order_relaxed);
+            }
+            totals[stat_name(static_cast<Stat>(i))] = static_cast<double>(total);
+        }
+#endif
+        return totals;
+    }
+
+    /**
+     * Zero every total. Queries running meanwhile may land on either side.
+     */
+    void reset() {
+        for (Slot& slot : slots_) {
+            for (std::atomic<uint64_t>& value : slot.values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    // Threads beyond this share slots (still correct, just contended)
+    static constexpr size_t kSlots = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> values[kStatCount];
+    };
+
+    /**
+     * This thread's slot: threads take slots round-robin on first use.
+     */
+    static size_t thread_slot() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed) % kSlots;
+        return slot;
+    }
+
+    Slot slots_[kSlots];
+};
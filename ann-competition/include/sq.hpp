@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class IndexWriter;
+class IndexFile;
+
+/**
+ * Per-dimension scalar quantizer to uint8 codes.
+ *
+ * Dimension d is mapped linearly from [min_d, max_d] (over the training
+ * data) onto 0..255, so x_d ~= min_d + step_d * code_d. That is 4x less
+ * memory traffic than fp32 for a scan that is bandwidth bound.
+ *
+ * Queries stay in float space but are folded into the codec: with
+ * w_d = q_d * step_d quantized to int8 as w_d ~= scale * qcode_d,
+ *
+ *     q · x ~= sum_d q_d * min_d + scale * sum_d qcode_d * code_d
+ *
+ * so scoring a row is one integer dot product (u8_dot_scan) plus a
+ * multiply-add. Query codes are limited to [-63, 63], see U8DotScanFunc.
+ */
+class ScalarQuantizer {
+public:
+    /**
+     * Query folded into the codec: q · x ~= bias + scale * dot(codes, x codes).
+     */
+    struct EncodedQuery {
+        std::vector<int8_t> codes;
+        float bias = 0.0f;
+        float scale = 0.0f;
+    };
+
+    /**
+     * Learn per-dimension ranges from n vectors, stride floats apart
+     * (0 = dim, contiguous).
+     */
+    void train(const float* data, size_t n, size_t dim, size_t stride = 0);
+
+    /**
+     * Encode n vectors (stride floats apart, 0 = dim) into n * dim bytes.
+     */
+    void encode(const float* data, size_t n, uint8_t* codes, size_t stride = 0) const;
+
+    /**
+     * Squared norms of the decoded vectors, ||x~||^2, for n codes.
+     * Euclidean scoring uses ||q||^2 - 2 q · x~ + ||x~||^2.
+     */
+    void decoded_norms(const uint8_t* codes, size_t n, float* out) const;
+
+    void encode_query(const float* query, EncodedQuery& out) const;
+
+    size_t dim() const { return dim_; }
+
+    /**
+     * Write / restore the trained state under prefix (see index_io.hpp).
+     */
+    void save(IndexWriter& out, const std::string& prefix) const;
+    void load(const IndexFile& in, const std::string& prefix);
+
+    size_t get_memory_usage() const {
+        return (mins_.size() + steps_.size()) * sizeof(float);
+    }
+
+private:
+    size_t dim_ = 0;
+    std::vector<float> mins_;   // dim
+    std::vector<float> steps_;  // dim, (max - min) / 255
+};
+
+/**
+ * 1-bit (sign) quantizer: bit d of a code is set when x_d is above the
+ * training mean of dimension d. Codes are packed into 64-bit words
+ * (dim = 960 -> 15 words, 120 bytes) and compared with Hamming distance,
+ * which approximates the angle between the centered vectors; it is only
+ * good for shortlisting and is meant to be followed by an exact re-rank.
+ */
+class BinaryQuantizer {
+public:
+    /**
+     * Learn per-dimension means from n vectors, stride floats apart (0 = dim).
+     */
+    void train(const float* data, size_t n, size_t dim, size_t stride = 0);
+
+    /**
+     * Encode n vectors (stride floats apart, 0 = dim) into n * words()
+     * 64-bit words.
+     */
+    void encode(const float* data, size_t n, uint64_t* codes, size_t stride = 0) const;
+
+    size_t dim() const { return dim_; }
+    size_t words() const { return (dim_ + 63) / 64; }
+
+    /**
+     * Write / restore the trained state under prefix (see index_io.hpp).
+     */
+    void save(IndexWriter& out, const std::string& prefix) const;
+    void load(const IndexFile& in, const std::string& prefix);
+
+    size_t get_memory_usage() const {
+        return means_.size() * sizeof(float);
+    }
+
+private:
+    size_t dim_ = 0;
+    std::vector<float> means_;  // dim
+};
+
+/**
+ * Largest query code magnitude accepted by U8DotScanFunc.
+ */
+constexpr int kSQQueryMax = 63;
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * Bounded top-k selector: keeps the k smallest (distance, id) pairs seen.
+ *
+ * Candidates live in a max-heap of at most k entries, so memory is O(k)
+ * instead of O(n). threshold() is the worst kept distance (+inf until k
+ * candidates are in), and most candidates are rejected with a single
+ * compare against it before touching the heap.
+ *
+ * Reuse one instance across queries with reset() to avoid allocating.
+ */
+class TopK {
+public:
+    using Entry = std::pair<float, int>;
+
+    explicit TopK(size_t k = 0) {
+        reset(k);
+    }
+
+    void reset(size_t k) {
+        k_ = k;
+        heap_.clear();
+        heap_.reserve(k);
+        threshold_ = k > 0 ? std::numeric_limits<float>::infinity()
+                           : -std::numeric_limits<float>::infinity();
+    }
+
+    float threshold() const {
+        return threshold_;
+    }
+
+    size_t size() const {
+        return heap_.size();
+    }
+
+    /**
+     * Entries inserted since construction (reset() keeps counting), for
+     * Stat::HeapPushes; always 0 without ANN_ENABLE_STATS.
+     */
+    uint64_t inserts() const {
+        return inserts_;
+    }
+
+    void push(float dist, int id) {
+        if (dist < threshold_) {
+            insert(dist, id);
+        }
+    }
+
+    /**
+     * Offer a block of n distances for consecutive ids first_id, first_id + 1, ...
+     */
+    void push_block(const float* dists, size_t n, int first_id) {
+        for (size_t j = 0; j < n; ++j) {
+            if (dists[j] < threshold_) {
+                insert(dists[j], first_id + static_cast<int>(j));
+            }
+        }
+    }
+
+    /**
+     * Offer a block of n distances for the given ids.
+     */
+    void push_block(const float* dists, size_t n, const int* ids) {
+        for (size_t j = 0; j < n; ++j) {
+            if (dists[j] < threshold_) {
+                insert(dists[j], ids[j]);
+            }
+        }
+    }
+
+    /**
+     * Offer every entry kept by other (e.g. a per-thread partial top-k).
+     */
+    void merge(const TopK& other) {
+        for (const Entry& entry : other.heap_) {
+            push(entry.first, entry.second);
+        }
+    }
+
+    /**
+     * Kept entries sorted by ascending distance. Leaves the selector empty.
+     */
+    std::vector<Entry> take_sorted() {
+        std::sort_heap(heap_.begin(), heap_.end());
+        std::vector<Entry> result;
+        result.swap(heap_);
+        reset(k_);
+        return result;
+    }
+
+    /**
+     * Kept ids sorted by ascending distance. Leaves the selector empty.
+     */
+    std::vector<int> take_ids() {
+        std::sort_heap(heap_.begin(), heap_.end());
+        std::vector<int> ids(heap_.size());
+        for (size_t i = 0; i < heap_.size(); ++i) {
+            ids[i] = heap_[i].second;
+        }
+        reset(k_);
+        return ids;
+    }
+
+    /**
+     * Kept entries, ascending, written to the first n slots of ids and
+     * distances (distances may be null); slots past the kept entries get
+     * id -1 and distance +inf. Leaves the selector empty.
+     */
+    void take_into(size_t n, int* ids, float* distances) {
+        std::sort_heap(heap_.begin(), heap_.end());
+        size_t count = std::min(n, heap_.size());
+        for (size_t i = 0; i < count; ++i) {
+            ids[i] = heap_[i].second;
+        }
+        std::fill(ids + count, ids + n, -1);
+        if (distances) {
+            for (size_t i = 0; i < count; ++i) {
+                distances[i] = heap_[i].first;
+            }
+            std::fill(distances + count, distances + n, std::numeric_limits<float>::infinity());
+        }
+        reset(k_);
+    }
+
+private:
+    void insert(float dist, int id) {
+#ifdef ANN_ENABLE_STATS
+        ++inserts_;
+#endif
+        if (heap_.size() == k_) {
+            std::pop_heap(heap_.begin(), heap_.end());
+            heap_.back() = Entry(dist, id);
+        } else {
+            heap_.emplace_back(dist, id);
+        }
+        std::push_heap(heap_.begin(), heap_.end());
+        if (heap_.size() == k_) {
+            threshold_ = heap_.front().first;
+        }
+    }
+
+    size_t k_ = 0;
+    float threshold_ = 0.0f;
+    std::vector<Entry> heap_;
+    uint64_t inserts_ = 0;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+/**
+ * Row-major float matrix for base vectors, shared by every index.
+ *
+ * Owned storage lives in a 64-byte aligned arena and each row is padded to
+ * a multiple of 16 floats (one cache line, one AVX-512 register), so every
+ * row starts on a cache-line boundary and never straddles one it does not
+ * need; padding floats are zero. Arenas of 2 MB or more are 2 MB aligned
+ * and advised with MADV_HUGEPAGE, which cuts TLB misses on full scans.
+ * Set ANN_HUGE_PAGES=0 to opt out.
+ *
+ * A store can also borrow rows owned by the caller (never freed, no memory
+ * reported) or map rows from a loaded index file (kept alive by the store,
+ * reported as its own memory).
+ *
+ * Scan kernels take (stride, dim): pass stride() as the row stride and the
+ * real dimension as dim.
+ */
+class VectorStore {
+public:
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kRowAlignFloats = kAlignment / sizeof(float);
+
+    VectorStore() = default;
+    ~VectorStore();
+
+    VectorStore(const VectorStore&) = delete;
+    VectorStore& operator=(const VectorStore&) = delete;
+    VectorStore(VectorStore&& other) noexcept;
+    VectorStore& operator=(VectorStore&& other) noexcept;
+
+    /**
+     * Padded row length for dim floats.
+     */
+    static size_t padded_dim(size_t dim) {
+        return (dim + kRowAlignFloats - 1) / kRowAlignFloats * kRowAlignFloats;
+    }
+
+    /**
+     * Allocate n zeroed rows of dim floats (contents are zero, including
+     * padding). Replaces any previous contents.
+     */
+    void allocate(size_t n, size_t dim);
+
+    /**
+     * allocate(n, dim) and copy n contiguous rows of dim floats. Rows are
+     * copied in parallel, so pages are first touched by the threads that
+     * will scan them.
+     */
+    void assign(const float* data, size_t n, size_t dim);
+
+    /**
+     * Reference n rows owned by the caller, stride floats apart (0 = dim,
+     * contiguous), e.g. caller arrays or a mapped index file.
+     */
+    void borrow(const float* data, size_t n, size_t dim, size_t stride = 0);
+
+    /**
+     * Like borrow(), but the rows belong to the index: owner (e.g. a mapped
+     * IndexFile) is kept alive until the store is cleared, and the rows
+     * count towards memory_usage().
+     */
+    void map(std::shared_ptr<const void> owner, const float* data, size_t n, size_t dim,
+             size_t stride);
+
+    /**
+     * Add n contiguous rows of dim floats at the end. Owned stores grow
+     * geometrically; a borrowed or mapped store first becomes an owned copy.
+     * Row pointers are invalidated when the arena is reallocated.
+     */
+    void append(const float* data, size_t n, size_t dim);
+
+    /**
+     * Make room for n rows of dim floats in total without changing the
+     * contents, so appending up to n rows never reallocates. Same
+     * invalidation and ownership rules as append().
+     */
+    void reserve(size_t n, size_t dim);
+
+    void clear();
+
+    float* row(size_t i) { return data_ + i * stride_; }
+    const float* row(size_t i) const { return data_ + i * stride_; }
+
+    float* data() { return data_; }
+    const float* data() const { return data_; }
+
+    size_t size() const { return n_; }
+    size_t dim() const { return dim_; }
+    size_t stride() const { return stride_; }
+    bool empty() const { return n_ == 0; }
+    bool owned() const { return owned_; }
+
+    /**
+     * Bytes owned or mapped by this store (0 when borrowed).
+     */
+    size_t memory_usage() const { return bytes_; }
+
+private:
+    float* data_ = nullptr;
+    size_t n_ = 0;
+    size_t dim_ = 0;
+    size_t stride_ = 0;
+    size_t bytes_ = 0;
+    size_t capacity_ = 0;  // rows the arena holds (owned)
+    bool owned_ = false;
+    std::shared_ptr<const void> owner_;  // map(): keeps the mapping alive
+};
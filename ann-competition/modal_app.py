@@ -5,6 +5,7 @@ Usage:
     modal run modal_app.py --impl vectordb
     modal run modal_app.py --impl vectordb --dataset nytimes-256-angular
     modal run modal_app.py --impl vectordb --compare naive
+    modal run modal_app.py --impl hnsw --cache-index
 """
 
 import modal
@@ -107,7 +108,8 @@ def _download_dataset_internal(dataset):
     memory=32768,  # 32GB RAM
     timeout=3600,  # 1 hour timeout
 )
-def run_benchmark(impl="vectordb", dataset="gist-960-euclidean", compare=None, k=10, subset_size=None):
+def run_benchmark(impl="vectordb", dataset="gist-960-euclidean", compare=None, k=10, subset_size=None,
+                  cache_index=False):
     """Run ANN benchmark on Modal with high-performance hardware."""
     import subprocess
     import os
@@ -236,6 +238,15 @@ def run_benchmark(impl="vectordb", dataset="gist-960-euclidean", compare=None, k
     # Add subset_size parameter if provided
     if subset_size:
         cmd.extend(["--subset-size", str(subset_size)])
+
+    # Keep built indexes on the volume: later workers load them (mmap)
+    # instead of rebuilding
+    index_path = None
+    if cache_index and not compare:
+        suffix = f"-{subset_size}" if subset_size else ""
+        index_path = f"{VOLUME_MOUNT_PATH}/indexes/{impl}-{dataset}{suffix}.ann"
+        cmd.extend(["--index", index_path])
+        print(f"🗂️  Index cache: {index_path}")
     
     # Set environment for the benchmark
     env = os.environ.copy()
@@ -247,6 +258,10 @@ def run_benchmark(impl="vectordb", dataset="gist-960-euclidean", compare=None, k
     if result.returncode != 0:
         print(f"❌ Benchmark failed with return code {result.returncode}")
         return {"success": False, "error": f"Benchmark failed with return code {result.returncode}"}
+
+    if index_path:
+        # Persist a newly saved index for other containers
+        dataset_volume.commit()
     
     print()
     print("✅ Benchmark completed successfully!")
@@ -363,7 +378,8 @@ def main(
     compare: str = None,
     k: int = 10,
     subset_size: int = None,
-    download_only: bool = False
+    download_only: bool = False,
+    cache_index: bool = False
 ):
     """Main entrypoint for Modal ANN benchmark."""
     
@@ -375,7 +391,7 @@ def main(
             print(f"🚀 Running quick benchmark (subset size: {subset_size})...")
         else:
             print("🚀 Running full benchmark...")
-        result = run_benchmark.remote(impl, dataset, compare, k, subset_size)
+        result = run_benchmark.remote(impl, dataset, compare, k, subset_size, cache_index)
     
     if result["success"]:
         print()
@@ -1,5 +1,6 @@
 from .benchmark import Benchmark, run_comparison
-from .dataset_loader import DatasetLoader, quick_load
+from .tuner import Tuner, pareto_frontier
+from .dataset_loader import DatasetLoader, quick_load, open_vectors, iter_chunks, fit_chunks
 from .metrics import (
     calculate_recall,
     calculate_qps,
@@ -12,8 +13,13 @@ __version__ = '1.0.0'
 __all__ = [
     'Benchmark',
     'run_comparison',
+    'Tuner',
+    'pareto_frontier',
     'DatasetLoader',
     'quick_load',
+    'open_vectors',
+    'iter_chunks',
+    'fit_chunks',
     'calculate_recall',
     'calculate_qps',
     'calculate_percentiles',
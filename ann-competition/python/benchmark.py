@@ -17,26 +17,49 @@ import subprocess
 import os
 from typing import Dict, List, Tuple
 from .metrics import calculate_recall, calculate_percentiles
-from .dataset_loader import DatasetLoader
+from .dataset_loader import DatasetLoader, fit_chunks
 
 
 class Benchmark:
     """Run comprehensive benchmarks on ANN algorithm."""
 
-    def __init__(self, dataset_name: str = "gist-960-euclidean", subset_size: int = None):
+    def __init__(self, dataset_name: str = "gist-960-euclidean", subset_size: int = None,
+                 borrow: bool = False, index_path: str = None, num_threads: int = 0,
+                 stream: bool = False):
         self.loader = DatasetLoader(dataset_name)
-        self.dataset = self.loader.load()
+        # stream: build with fit_chunk() straight from the HDF5 file instead
+        # of loading the training set into memory
+        self.stream = stream
+        self.dataset = self.loader.load(train=not stream)
+        # borrow: fit() references the training array instead of copying it
+        self.borrow = borrow
+        # index_path: load a saved index from here instead of fitting, or
+        # fit and save it there if the file does not exist yet
+        self.index_path = index_path
+        # num_threads: threads per batch_query call (0 = OpenMP default)
+        self.num_threads = num_threads
         
         # Apply subset if specified
         if subset_size:
             print(f"📊 Using dataset subset: {subset_size} vectors")
-            self.dataset['train'] = self.dataset['train'][:subset_size]
+            self.dataset['n_train'] = min(subset_size, self.dataset['n_train'])
+            if self.dataset['train'] is not None:
+                self.dataset['train'] = self.dataset['train'][:subset_size]
             self.dataset['test'] = self.dataset['test'][:min(subset_size//10, len(self.dataset['test']))]
             self.dataset['ground_truth'] = self.dataset['ground_truth'][:min(subset_size//10, len(self.dataset['ground_truth']))]
-            print(f"   Train: {self.dataset['train'].shape}")
+            print(f"   Train: {self.train_shape}")
             print(f"   Test:  {self.dataset['test'].shape}")
             print(f"   Ground truth: {self.dataset['ground_truth'].shape}")
 
+        if borrow and not stream:
+            # Borrowing needs C-contiguous float32; convert once up front
+            self.dataset['train'] = np.ascontiguousarray(self.dataset['train'], dtype=np.float32)
+
+    @property
+    def train_shape(self) -> Tuple[int, int]:
+        """Shape of the training set, loaded or streamed."""
+        return (self.dataset['n_train'], self.dataset['dimension'])
+
     def log_system_specs(self):
         """Log detailed system specifications for performance context."""
         print("\n" + "="*70)
@@ -106,7 +129,8 @@ class Benchmark:
         algorithm, 
         k: int = 10,
         num_warmup: int = 10,
-        num_latency_samples: int = 100
+        num_latency_samples: int = 100,
+        build: bool = True
     ) -> Dict:
         """
         Run complete benchmark suite.
@@ -116,6 +140,8 @@ class Benchmark:
             k: Number of neighbors to retrieve
             num_warmup: Warmup queries before timing
             num_latency_samples: Queries for latency measurement
+            build: False when algorithm is already built (e.g. tuned), to
+                benchmark it as is; build_time is then reported as 0
             
         Returns:
             Dictionary with all metrics
@@ -124,15 +150,22 @@ class Benchmark:
         self.log_system_specs()
 
         print(f"Running benchmark on {self.dataset['name']}")
-        print(f"  Train: {self.dataset['train'].shape}")
+        print(f"  Train: {self.train_shape}")
         print(f"  Test:  {self.dataset['test'].shape}")
         print(f"  k = {k}")
         
         # Build index
-        print("\n[1/4] Building index...")
-        build_time, memory_usage = self._measure_build(algorithm)
-        print(f"  Build time: {build_time:.2f}s")
+        if build:
+            print("\n[1/4] Building index...")
+            build_time, memory_usage = self._measure_build(algorithm)
+            print(f"  Build time: {build_time:.2f}s")
+        else:
+            print("\n[1/4] Using the built index")
+            build_time, memory_usage = 0.0, algorithm.get_memory_usage()
         print(f"  Memory: {memory_usage / 1e6:.1f} MB")
+        disk_usage = algorithm.get_disk_usage()
+        if disk_usage:
+            print(f"  Disk: {disk_usage / 1e6:.1f} MB")
         
         # Warmup
         print(f"\n[2/4] Warming up ({num_warmup} queries)...")
@@ -157,7 +190,7 @@ class Benchmark:
         # Calculate recall
         print("\nCalculating recall...")
         recall = calculate_recall(
-            throughput_metrics['results'],
+            throughput_metrics.pop('results'),
             self.dataset['ground_truth'],
             k
         )
@@ -167,18 +200,108 @@ class Benchmark:
             'algorithm': algorithm.name(),
             'dataset': self.dataset['name'],
             'k': k,
+            'params': algorithm.get_params(),
             'build_time': build_time,
             'memory_mb': memory_usage / 1e6,
+            'disk_mb': disk_usage / 1e6,
             'recall': recall,
             'throughput': throughput_metrics,
             'latency': latency_metrics,
         }
     
+    def run_param_sweep(
+        self,
+        algorithm,
+        param: str,
+        values: List[float],
+        k: int = 10,
+        num_warmup: int = 10,
+        num_latency_samples: int = 100
+    ) -> List[Dict]:
+        """
+        Build the index once, then benchmark each value of a query-time
+        parameter (e.g. ef_search) to trace a recall/QPS curve.
+        
+        Args:
+            algorithm: ANNAlgorithm instance
+            param: Query-time parameter to sweep
+            values: Values to try, in order
+            k: Number of neighbors to retrieve
+            num_warmup: Warmup queries before timing each value
+            num_latency_samples: Queries for latency measurement
+            
+        Returns:
+            List of result dictionaries, one per value
+        """
+        self.log_system_specs()
+
+        print(f"Running {param} sweep on {self.dataset['name']}")
+        print(f"  Train: {self.train_shape}")
+        print(f"  Test:  {self.dataset['test'].shape}")
+        print(f"  k = {k}, {param} in {values}")
+        
+        print("\nBuilding index...")
+        build_time, memory_usage = self._measure_build(algorithm)
+        print(f"  Build time: {build_time:.2f}s")
+        print(f"  Memory: {memory_usage / 1e6:.1f} MB")
+        disk_usage = algorithm.get_disk_usage()
+        if disk_usage:
+            print(f"  Disk: {disk_usage / 1e6:.1f} MB")
+        
+        results = []
+        for value in values:
+            algorithm.set_param(param, value)
+            self._warmup(algorithm, k, num_warmup)
+            throughput_metrics = self._measure_throughput(algorithm, k)
+            latency_metrics = self._measure_latency(
+                algorithm, k, num_latency_samples
+            )
+            recall = calculate_recall(
+                throughput_metrics.pop('results'),
+                self.dataset['ground_truth'],
+                k
+            )
+            print(f"  {param}={value:<8g} Recall@{k}: {recall:.4f}  "
+                  f"QPS: {throughput_metrics['qps']:.1f}  "
+                  f"p50: {latency_metrics['p50']*1000:.2f}ms")
+            
+            results.append({
+                'algorithm': algorithm.name(),
+                'dataset': self.dataset['name'],
+                'k': k,
+                'params': algorithm.get_params(),
+                'build_time': build_time,
+                'memory_mb': memory_usage / 1e6,
+                'disk_mb': disk_usage / 1e6,
+                'recall': recall,
+                'throughput': throughput_metrics,
+                'latency': latency_metrics,
+            })
+        
+        return results
+    
     def _measure_build(self, algorithm) -> Tuple[float, int]:
-        """Measure index build time and memory usage."""
+        """Measure index build (or load) time and memory usage."""
+        if self.index_path and os.path.exists(self.index_path):
+            start = time.perf_counter()
+            algorithm.load(self.index_path)
+            build_time = time.perf_counter() - start
+            print(f"  Loaded index from {self.index_path} (build time is load time)")
+            return build_time, algorithm.get_memory_usage()
+
         start = time.perf_counter()
-        algorithm.fit(self.dataset['train'])
+        if self.stream:
+            n_train = self.dataset['n_train']
+            fit_chunks(algorithm, self.loader.iter_train(limit=n_train),
+                       self.dataset['dimension'], n_train)
+        else:
+            algorithm.fit(self.dataset['train'], borrow=self.borrow)
         build_time = time.perf_counter() - start
+
+        if self.index_path:
+            os.makedirs(os.path.dirname(self.index_path) or '.', exist_ok=True)
+            algorithm.save(self.index_path)
+            print(f"  Saved index to {self.index_path}")
         
         memory_usage = algorithm.get_memory_usage()
         return build_time, memory_usage
@@ -192,9 +315,11 @@ class Benchmark:
     def _measure_throughput(self, algorithm, k: int) -> Dict:
         """Measure batch query throughput (QPS)."""
         test_queries = self.dataset['test']
+        # Results go straight into one int32 array, allocated outside the timer
+        results = np.empty((len(test_queries), k), dtype=np.int32)
         
         start = time.perf_counter()
-        results = algorithm.batch_query(test_queries, k)
+        algorithm.batch_query_into(test_queries, k, results, num_threads=self.num_threads)
         total_time = time.perf_counter() - start
         
         qps = len(test_queries) / total_time
@@ -8,7 +8,10 @@ import h5py
 import numpy as np
 import urllib.request
 from pathlib import Path
-from typing import Dict
+from typing import Dict, Iterable, Iterator, Optional
+
+# Rows per chunk for streamed builds (256 MB of float32 at dimension 960)
+DEFAULT_CHUNK_ROWS = 65536
 
 
 class DatasetLoader:
@@ -84,13 +87,19 @@ class DatasetLoader:
                 self.filepath.unlink()
             raise RuntimeError(f"Failed to download dataset: {e}")
     
-    def load(self) -> Dict[str, np.ndarray]:
+    def load(self, train: bool = True) -> Dict[str, np.ndarray]:
         """
         Load dataset into memory.
         
+        Args:
+            train: Also load the training vectors. With False, 'train' is
+                None and 'n_train' alone describes them; stream them with
+                iter_train() instead.
+        
         Returns:
             Dictionary with:
-            - 'train': Training vectors (n_train, dimension)
+            - 'train': Training vectors (n_train, dimension), or None
+            - 'n_train': Number of training vectors
             - 'test': Test queries (n_test, dimension)
             - 'ground_truth': True k-NN for test queries (n_test, k)
             - 'distances': Distances to true neighbors (n_test, k)
@@ -105,22 +114,24 @@ class DatasetLoader:
         print(f"Loading {self.dataset_name}...")
         
         with h5py.File(self.filepath, 'r') as f:
-            # Load data
-            train = np.array(f['train'])
-            test = np.array(f['test'])
+            # Load data (converted to float32 while reading, no second copy)
+            n_train = f['train'].shape[0]
+            train = _read_float32(f['train']) if train else None
+            test = _read_float32(f['test'])
             neighbors = np.array(f['neighbors'])
             
             # Optional: distances (not all datasets have this)
             distances = np.array(f['distances']) if 'distances' in f else None
             
             print(f"✓ Loaded:")
-            print(f"  Train: {train.shape}")
+            print(f"  Train: {f['train'].shape}{'' if train is not None else ' (streamed)'}")
             print(f"  Test:  {test.shape}")
             print(f"  Ground truth: {neighbors.shape}")
         
         return {
-            'train': train.astype(np.float32),
-            'test': test.astype(np.float32),
+            'train': train,
+            'n_train': n_train,
+            'test': test,
             'ground_truth': neighbors,
             'distances': distances,
             'name': self.dataset_name,
@@ -128,6 +139,22 @@ class DatasetLoader:
             'dimension': self.config['dimension'],
         }
     
+    def iter_train(self, chunk_rows: int = DEFAULT_CHUNK_ROWS,
+                   limit: Optional[int] = None) -> Iterator[np.ndarray]:
+        """
+        Yield the training vectors as float32 chunks read straight from the
+        HDF5 file, so only one chunk is in memory at a time.
+        
+        Args:
+            chunk_rows: Rows per chunk
+            limit: Stop after this many rows (None = all)
+        """
+        if not self.filepath.exists():
+            self.download()
+        
+        with h5py.File(self.filepath, 'r') as f:
+            yield from iter_chunks(f['train'], chunk_rows, limit)
+    
     @classmethod
     def list_datasets(cls) -> list:
         """List all available datasets."""
@@ -146,3 +173,68 @@ def quick_load(dataset_name: str = 'gist-960-euclidean') -> Dict:
     """
     loader = DatasetLoader(dataset_name)
     return loader.load()
+
+
+
+def _read_float32(dataset) -> np.ndarray:
+    """Read an HDF5 dataset into a new float32 array (converted by h5py)."""
+    out = np.empty(dataset.shape, dtype=np.float32)
+    dataset.read_direct(out)
+    return out
+
+
+def open_vectors(path: str, dimension: Optional[int] = None) -> np.ndarray:
+    """
+    Memory-map a file of float32 vectors as a read-only (n, dimension)
+    array; nothing is read until rows are accessed.
+    
+    Formats, by extension:
+    - .fvecs: per row an int32 dimension followed by that many floats
+    - .fbin:  uint32 row count, uint32 dimension, then the rows
+    - anything else: raw row-major float32, dimension required
+    """
+    path = str(path)
+    if path.endswith('.fvecs'):
+        first = np.fromfile(path, dtype=np.int32, count=1)
+        if first.size == 0:
+            raise ValueError(f"{path}: empty .fvecs file")
+        dim = int(first[0])
+        rows = np.memmap(path, dtype=np.float32, mode='r')
+        if rows.size % (dim + 1) != 0:
+            raise ValueError(f"{path}: size is not a multiple of the row length")
+        # Skip each row's leading dimension field (a strided view)
+        return rows.reshape(-1, dim + 1)[:, 1:]
+    if path.endswith('.fbin'):
+        n, dim = (int(v) for v in np.fromfile(path, dtype=np.uint32, count=2))
+        return np.memmap(path, dtype=np.float32, mode='r', offset=8, shape=(n, dim))
+    if dimension is None:
+        raise ValueError(f"{path}: raw float32 files need an explicit dimension")
+    return np.memmap(path, dtype=np.float32, mode='r').reshape(-1, dimension)
+
+
+def iter_chunks(vectors, chunk_rows: int = DEFAULT_CHUNK_ROWS,
+                limit: Optional[int] = None) -> Iterator[np.ndarray]:
+    """
+    Yield C-contiguous float32 chunks of any sliceable (n, dimension) array:
+    an HDF5 dataset, a memmap from open_vectors(), or an ndarray.
+    """
+    n = vectors.shape[0] if limit is None else min(limit, vectors.shape[0])
+    for start in range(0, n, chunk_rows):
+        yield np.ascontiguousarray(vectors[start:min(start + chunk_rows, n)], dtype=np.float32)
+
+
+def fit_chunks(algorithm, chunks: Iterable[np.ndarray], dimension: int, n_total: int = 0):
+    """
+    Build an index from an iterable of (n_chunk, dimension) arrays with
+    fit_begin() / fit_chunk() / fit_end(), holding one chunk at a time.
+    
+    Args:
+        algorithm: ann_cpp.ANNAlgorithm instance
+        chunks: e.g. DatasetLoader.iter_train() or iter_chunks(open_vectors(...))
+        dimension: Vector dimension
+        n_total: Total rows, if known (sizes the index up front)
+    """
+    algorithm.fit_begin(dimension, n_total)
+    for chunk in chunks:
+        algorithm.fit_chunk(chunk)
+    algorithm.fit_end()
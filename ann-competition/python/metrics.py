@@ -3,11 +3,11 @@ Metric calculations for ANN benchmarks.
 """
 
 import numpy as np
-from typing import List
+from typing import List, Union
 
 
 def calculate_recall(
-    predictions: List[List[int]],
+    predictions: Union[List[List[int]], np.ndarray],
     ground_truth: np.ndarray,
     k: int
 ) -> float:
@@ -18,13 +18,21 @@ def calculate_recall(
     Averaged over all queries.
     
     Args:
-        predictions: List of predicted neighbor indices for each query
+        predictions: List of predicted neighbor indices for each query, or
+            an (n_queries, >= k) id array as filled by batch_query_into()
+            (-1 padding never matches)
         ground_truth: Array of shape (n_queries, k) with true neighbors
         k: Number of neighbors
         
     Returns:
         Mean recall across all queries
     """
+    if isinstance(predictions, np.ndarray):
+        # Vectorized: for each true neighbor, is it among the k predictions?
+        truth = ground_truth[:len(predictions), :k]
+        found = (truth[:, :, None] == predictions[:, None, :k]).any(axis=2)
+        return float(found.sum(axis=1).mean() / k)
+
     recalls = []
     
     for i, pred in enumerate(predictions):
@@ -0,0 +1,274 @@
+"""
+Query-time parameter auto-tuning.
+
+Finds the fastest setting of an index's query-time parameters (ef_search,
+nprobe, L_search, rerank depths) that reaches a recall target, on a single
+built index: tuning only calls set_param() between measurements, never
+fit(). Recall is measured on a held-out slice of the test queries, and the
+chosen setting is then benchmarked on the remaining, unseen queries.
+"""
+
+import os
+from contextlib import contextmanager
+from typing import Dict, List, Optional, Tuple
+
+from .benchmark import Benchmark
+from .metrics import calculate_recall
+
+
+# Parameters whose recall grows with their value, with the range searched
+# ('k': the number of neighbors, 'nlist': the index's list count). An index
+# has at most one.
+EFFORT_PARAMS = {
+    'ef_search': ('k', 2048),
+    'nprobe': (1, 'nlist'),
+    'L_search': ('k', 2048),
+}
+
+# Re-ranking depths: tried on a grid, in multiples of k (0 = no re-ranking),
+# and only when the index was built with one > 0. Built with 0, the index
+# kept no full-precision vectors and the parameter does nothing.
+RERANK_PARAMS = ['rerank', 'pca_rerank']
+RERANK_MULTIPLES = [0, 2, 5, 10, 20]
+
+
+def _reranks(name: str, params: Dict[str, float]) -> bool:
+    """Whether re-ranking depth name changes this index's results."""
+    if params.get(name, 0) <= 0:
+        return False
+    if name == 'rerank':
+        # vectordb re-ranks compressed rows and ivfpq PQ codes; fp32
+        # vectors and flat lists have nothing to re-rank
+        return params.get('storage_bits', 32) < 32 or params.get('pq_m', 0) > 0
+    return True
+
+
+def pareto_frontier(points: List[Dict]) -> List[Dict]:
+    """
+    Points no other point beats on recall, QPS and p50 latency at once,
+    by recall.
+    """
+    def dominates(a, b):
+        at_least = (a['recall'] >= b['recall'] and a['qps'] >= b['qps']
+                    and a['latency']['p50'] <= b['latency']['p50'])
+        better = (a['recall'] > b['recall'] or a['qps'] > b['qps']
+                  or a['latency']['p50'] < b['latency']['p50'])
+        return at_least and better
+
+    frontier = [p for p in points if not any(dominates(q, p) for q in points)]
+    return sorted(frontier, key=lambda p: p['recall'])
+
+
+class Tuner:
+    """Search a built index's query-time parameters for a recall target."""
+
+    def __init__(self, benchmark: Benchmark, k: int = 10, target_recall: float = 0.9,
+                 tune_queries: Optional[int] = None, resolution: float = 0.1,
+                 num_warmup: int = 10, num_latency_samples: int = 100):
+        """
+        Args:
+            benchmark: Benchmark holding the dataset (and index_path, if any)
+            k: Number of neighbors per query
+            target_recall: Recall@k the chosen setting must reach
+            tune_queries: Test queries held out for tuning (default: half);
+                the rest validate the chosen setting
+            resolution: Stop refining an effort parameter once the smallest
+                passing value is known to within this fraction
+            num_warmup: Warmup queries before timing each setting
+            num_latency_samples: Queries for latency measurement
+        """
+        self.benchmark = benchmark
+        self.k = k
+        self.target_recall = target_recall
+        n_test = len(benchmark.dataset['test'])
+        self.tune_queries = min(n_test, tune_queries or max(1, n_test // 2))
+        self.resolution = resolution
+        self.num_warmup = num_warmup
+        self.num_latency_samples = num_latency_samples
+        self.points = []
+        self._measured = {}
+
+    @contextmanager
+    def _queries(self, begin: int, end: Optional[int] = None):
+        """Let the benchmark see only test queries [begin, end)."""
+        dataset = self.benchmark.dataset
+        test, ground_truth = dataset['test'], dataset['ground_truth']
+        dataset['test'] = test[begin:end]
+        dataset['ground_truth'] = ground_truth[begin:end]
+        try:
+            yield
+        finally:
+            dataset['test'], dataset['ground_truth'] = test, ground_truth
+
+    def search_space(self, algorithm) -> Tuple[Optional[Tuple[str, int, int]], Dict[str, List[float]]]:
+        """
+        The parameters to search: (name, low, high) of the index's effort
+        parameter, or None, and the grid of each re-ranking depth.
+        """
+        params = algorithm.get_params()
+        bounds = {'k': self.k, 'nlist': int(params.get('nlist', 1))}
+        effort = None
+        for name, (low, high) in EFFORT_PARAMS.items():
+            if name in params:
+                low, high = bounds.get(low, low), bounds.get(high, high)
+                effort = (name, min(low, high), high)
+                break
+
+        grids = {}
+        for name in RERANK_PARAMS:
+            if _reranks(name, params):
+                values = {m * self.k for m in RERANK_MULTIPLES} | {params[name]}
+                grids[name] = sorted(float(v) for v in values)
+        return effort, grids
+
+    def measure(self, algorithm, setting: Dict[str, float]) -> Dict:
+        """Recall, QPS and latency on the tuning queries with setting applied."""
+        key = tuple(sorted(setting.items()))
+        if key in self._measured:
+            return self._measured[key]
+
+        benchmark = self.benchmark
+        algorithm.set_params(setting)
+        benchmark._warmup(algorithm, self.k, self.num_warmup)
+        throughput_metrics = benchmark._measure_throughput(algorithm, self.k)
+        latency_metrics = benchmark._measure_latency(algorithm, self.k,
+                                                     self.num_latency_samples)
+        recall = calculate_recall(
+            throughput_metrics.pop('results'),
+            benchmark.dataset['ground_truth'],
+            self.k
+        )
+        point = {
+            'setting': dict(setting),
+            'recall': recall,
+            'qps': throughput_metrics['qps'],
+            'latency': latency_metrics,
+        }
+        label = ' '.join(f"{name}={value:g}" for name, value in sorted(setting.items()))
+        print(f"  {label:<28} Recall@{self.k}: {recall:.4f}  "
+              f"QPS: {point['qps']:.1f}  p50: {latency_metrics['p50']*1000:.2f}ms"
+              f"{'  ✓' if recall >= self.target_recall else ''}")
+        self._measured[key] = point
+        self.points.append(point)
+        return point
+
+    def _smallest_passing(self, algorithm, fixed: Dict[str, float], effort: Tuple[str, int, int]):
+        """
+        Smallest effort value (to within resolution) meeting the target with
+        the fixed parameters: doubling from low, then bisection.
+        """
+        name, low, high = effort
+
+        def passes(value):
+            point = self.measure(algorithm, {**fixed, name: float(value)})
+            return point['recall'] >= self.target_recall
+
+        if passes(low):
+            return
+        failing, value = low, low
+        while value < high:
+            value = min(high, value * 2)
+            if passes(value):
+                break
+            failing = value
+        else:
+            return  # even high misses the target
+        while value - failing > max(1, failing * self.resolution):
+            middle = (failing + value) // 2
+            if passes(middle):
+                value = middle
+            else:
+                failing = middle
+
+    def tune(self, algorithm) -> Dict:
+        """
+        Build (or load) the index once, search its query-time parameters on
+        the tuning queries, leave it set to the lowest-latency setting that
+        meets the target (the highest-recall one if none does), benchmark
+        that setting on the remaining queries and save the index, with the
+        setting, to the benchmark's index_path.
+
+        Returns:
+            Dictionary with the target, the chosen setting, the Pareto
+            frontier and every measured point, plus the held-out benchmark
+            ('validation', None when no query was left over)
+        """
+        benchmark = self.benchmark
+        benchmark.log_system_specs()
+
+        n_test = len(benchmark.dataset['test'])
+        print(f"Tuning {algorithm.name()} on {benchmark.dataset['name']}")
+        print(f"  Train: {benchmark.train_shape}")
+        print(f"  Tuning queries: {self.tune_queries}, held out: {n_test - self.tune_queries}")
+        print(f"  k = {self.k}, target recall@{self.k} >= {self.target_recall}")
+
+        print("\nBuilding index...")
+        build_time, memory_usage = benchmark._measure_build(algorithm)
+        print(f"  Build time: {build_time:.2f}s")
+        print(f"  Memory: {memory_usage / 1e6:.1f} MB")
+
+        effort, grids = self.search_space(algorithm)
+        described = ([f"{effort[0]} in [{effort[1]}, {effort[2]}]"] if effort else []) + \
+                    [f"{name} in {[int(v) for v in values]}" for name, values in grids.items()]
+        print(f"\nSearching {', '.join(described) or 'nothing (no query-time parameters)'}...")
+
+        # Every combination of the re-ranking grids, each with its smallest
+        # passing effort value
+        combinations = [{}]
+        for name, values in grids.items():
+            combinations = [{**c, name: v} for c in combinations for v in values]
+        with self._queries(0, self.tune_queries):
+            for fixed in combinations:
+                if effort:
+                    self._smallest_passing(algorithm, fixed, effort)
+                else:
+                    self.measure(algorithm, fixed)
+
+        passing = [p for p in self.points if p['recall'] >= self.target_recall]
+        if passing:
+            chosen = min(passing, key=lambda p: p['latency']['p50'])
+        else:
+            chosen = max(self.points, key=lambda p: p['recall'])
+            print(f"\n⚠ No setting reaches recall {self.target_recall}; "
+                  f"using the most accurate one ({chosen['recall']:.4f})")
+        algorithm.set_params(chosen['setting'])
+        frontier = pareto_frontier(self.points)
+
+        print(f"\nPareto frontier (recall vs QPS / p50 latency):")
+        for point in frontier:
+            label = ' '.join(f"{n}={v:g}" for n, v in sorted(point['setting'].items()))
+            print(f"  {label:<28} Recall@{self.k}: {point['recall']:.4f}  "
+                  f"QPS: {point['qps']:.1f}  p50: {point['latency']['p50']*1000:.2f}ms"
+                  f"{'  ← chosen' if point is chosen else ''}")
+
+        validation = None
+        if self.tune_queries < n_test:
+            print(f"\nValidating the chosen setting on {n_test - self.tune_queries} held-out queries...")
+            with self._queries(self.tune_queries):
+                validation = benchmark.run_full_benchmark(
+                    algorithm, k=self.k, num_warmup=self.num_warmup,
+                    num_latency_samples=self.num_latency_samples, build=False)
+            validation['build_time'] = build_time
+
+        if benchmark.index_path:
+            # Query-time parameters are saved with the index, so a later
+            # load() searches with the chosen setting
+            os.makedirs(os.path.dirname(benchmark.index_path) or '.', exist_ok=True)
+            algorithm.save(benchmark.index_path)
+            print(f"\n✓ Saved tuned index to {benchmark.index_path}")
+
+        return {
+            'algorithm': algorithm.name(),
+            'dataset': benchmark.dataset['name'],
+            'k': self.k,
+            'target_recall': self.target_recall,
+            'met_target': bool(passing),
+            'tune_queries': self.tune_queries,
+            'build_time': build_time,
+            'memory_mb': memory_usage / 1e6,
+            'chosen': chosen,
+            'params': algorithm.get_params(),
+            'frontier': frontier,
+            'points': self.points,
+            'validation': validation,
+        }
@@ -6,6 +6,16 @@ Usage:
     python scripts/benchmark.py --impl vectordb
     python scripts/benchmark.py --impl naive --dataset nytimes-256-angular
     python scripts/benchmark.py --impl vectordb --compare naive
+    python scripts/benchmark.py --impl hnsw --param M=32 --param ef_construction=400
+    python scripts/benchmark.py --impl hnsw --sweep ef_search=10,20,40,80,160
+    python scripts/benchmark.py --impl ivf --param nlist=4096 --sweep nprobe=1,4,16,64
+    python scripts/benchmark.py --impl ivfpq --param pq_nbits=4 --param rerank=100 --sweep nprobe=4,16,64
+    python scripts/benchmark.py --impl hnsw --index indexes/hnsw-gist.ann
+    python scripts/benchmark.py --impl ivfpq --stream
+    python scripts/benchmark.py --impl diskann --param R=64 --sweep L_search=20,50,100,200
+    python scripts/benchmark.py --impl hnsw --pca --param pca_dim=128 --sweep pca_rerank=50,100,200
+    python scripts/benchmark.py --impl vectordb --shard --param shards=2
+    python scripts/benchmark.py --impl hnsw --tune --target-recall 0.9 --index indexes/hnsw-gist.ann
 """
 
 import argparse
@@ -20,17 +30,27 @@ sys.path.insert(0, str(project_root))
 sys.path.insert(0, str(project_root / "build"))
 
 from python.benchmark import Benchmark, run_comparison
+from python.tuner import Tuner
 from python.dataset_loader import DatasetLoader
 from ann_cpp import ANNAlgorithm
 
 
+def parse_params(pairs):
+    """Parse ['M=16', 'ef_search=64'] into {'M': 16.0, 'ef_search': 64.0}."""
+    params = {}
+    for pair in pairs:
+        name, value = pair.split('=', 1)
+        params[name] = float(value)
+    return params
+
+
 def main():
     parser = argparse.ArgumentParser(
         description='Benchmark ANN algorithm implementation'
     )
     parser.add_argument(
         '--impl',
-        choices=['naive', 'vectordb'],
+        choices=['naive', 'vectordb', 'hnsw', 'ivf', 'ivfpq', 'diskann'],
         default='vectordb',
         help='Implementation to benchmark'
     )
@@ -58,6 +78,65 @@ def main():
         type=int,
         help='Use only a subset of the dataset for quick testing'
     )
+    parser.add_argument(
+        '--param',
+        action='append',
+        default=[],
+        metavar='NAME=VALUE',
+        help='Set an algorithm parameter before building (repeatable)'
+    )
+    parser.add_argument(
+        '--sweep',
+        metavar='NAME=V1,V2,...',
+        help='Build once, then benchmark each value of a query-time parameter'
+    )
+    parser.add_argument(
+        '--tune',
+        action='store_true',
+        help='Build once, then find the fastest query-time parameters reaching --target-recall'
+    )
+    parser.add_argument(
+        '--target-recall',
+        type=float,
+        default=0.9,
+        help='Recall@k the tuned parameters must reach (default: 0.9)'
+    )
+    parser.add_argument(
+        '--tune-queries',
+        type=int,
+        help='Test queries used for tuning (default: half); the rest validate the result'
+    )
+    parser.add_argument(
+        '--pca',
+        action='store_true',
+        help='Put a PCA reduction stage in front of the index (pca_dim, pca_rerank)'
+    )
+    parser.add_argument(
+        '--shard',
+        action='store_true',
+        help='Split the index into per-NUMA-node shards (shards)'
+    )
+    parser.add_argument(
+        '--borrow',
+        action='store_true',
+        help='Let the index reference the training array instead of copying it'
+    )
+    parser.add_argument(
+        '--stream',
+        action='store_true',
+        help='Build from chunks read straight from the dataset file (training set never fully in memory)'
+    )
+    parser.add_argument(
+        '--threads',
+        type=int,
+        default=0,
+        help='Threads for batch queries (default: OMP_NUM_THREADS or all cores)'
+    )
+    parser.add_argument(
+        '--index',
+        metavar='PATH',
+        help='Load the index from PATH instead of fitting; fit and save it there if missing'
+    )
     parser.add_argument(
         '--list-datasets',
         action='store_true',
@@ -83,16 +162,55 @@ def main():
     # Create algorithm instance(s)
     algorithms = []
     
-    algo = ANNAlgorithm(args.impl, metric)
-    algorithms.append((f"{args.impl} ({metric})", algo))
+    impl = f"pca+{args.impl}" if args.pca else args.impl
+    if args.shard:
+        impl = f"shard+{impl}"
+    algo = ANNAlgorithm(impl, metric)
+    algo.set_params(parse_params(args.param))
+    algorithms.append((f"{impl} ({metric})", algo))
     
     if args.compare:
         compare_algo = ANNAlgorithm(args.compare, metric)
         algorithms.append((f"{args.compare} ({metric})", compare_algo))
     
     # Run benchmark
-    if len(algorithms) == 1:
-        benchmark = Benchmark(args.dataset, subset_size=args.subset_size)
+    if args.tune:
+        benchmark = Benchmark(args.dataset, subset_size=args.subset_size, borrow=args.borrow,
+                              index_path=args.index, num_threads=args.threads,
+                              stream=args.stream)
+        tuner = Tuner(benchmark, k=args.k, target_recall=args.target_recall,
+                      tune_queries=args.tune_queries)
+        results = tuner.tune(algo)
+
+        print("\n" + "="*60)
+        print("TUNED")
+        print("="*60)
+        print(f"Algorithm:     {results['algorithm']}")
+        print(f"Target:        Recall@{args.k} >= {args.target_recall}"
+              f"{'' if results['met_target'] else ' (not reached)'}")
+        print(f"Chosen:        " + ' '.join(f"{name}={value:g}" for name, value
+                                         in sorted(results['chosen']['setting'].items())))
+        print(f"Recall@{args.k}:     {results['chosen']['recall']:.4f} (tuning queries)")
+        validation = results['validation']
+        if validation:
+            print(f"Recall@{args.k}:     {validation['recall']:.4f} (held-out queries)")
+            print(f"QPS:           {validation['throughput']['qps']:.1f}")
+            print(f"Latency (p50): {validation['latency']['p50']*1000:.2f}ms")
+            print(f"Latency (p99): {validation['latency']['p99']*1000:.2f}ms")
+
+        results_list = [results]
+    elif args.sweep:
+        name, values = args.sweep.split('=', 1)
+        benchmark = Benchmark(args.dataset, subset_size=args.subset_size, borrow=args.borrow,
+                              index_path=args.index, num_threads=args.threads,
+                              stream=args.stream)
+        results_list = benchmark.run_param_sweep(
+            algo, name, [float(v) for v in values.split(',')], k=args.k
+        )
+    elif len(algorithms) == 1:
+        benchmark = Benchmark(args.dataset, subset_size=args.subset_size, borrow=args.borrow,
+                              index_path=args.index, num_threads=args.threads,
+                              stream=args.stream)
         results = benchmark.run_full_benchmark(algo, k=args.k)
         
         # Print summary
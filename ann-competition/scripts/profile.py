@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""
+Per-query cost profile: what the search loops did for each query
+(get_stats(): distances, nodes visited, lists probed, reranked candidates,
+heap pushes) next to what it cost the CPU (cycles, instructions, LLC misses
+from perf_event_open around one batch query).
+
+Usage:
+    python scripts/profile.py --impl hnsw --subset-size 100000
+    python scripts/profile.py --impl hnsw --sweep ef_search=10,20,40,80,160
+    python scripts/profile.py --impl ivfpq --param nlist=4096 --sweep nprobe=4,16,64
+    python scripts/profile.py --impl hnsw --pca --param pca_dim=128 --output results/profile.json
+
+Hardware counters need Linux with perf_event_paranoid <= 2 (user-space
+counting of the process's own threads) and a CPU or VM that exposes a PMU;
+without them only the work counters and timings are reported.
+"""
+
+import argparse
+import json
+import sys
+from pathlib import Path
+from datetime import datetime
+
+import numpy as np
+
+# Add project root and build directory to path
+project_root = Path(__file__).parent.parent
+sys.path.insert(0, str(project_root))
+sys.path.insert(0, str(project_root / "build"))
+
+from python.benchmark import Benchmark
+from python.metrics import calculate_recall
+from ann_cpp import ANNAlgorithm
+
+
+# get_stats() counters shown per query, in table order
+WORK_COUNTERS = ['distances', 'nodes_visited', 'lists_probed', 'reranked', 'heap_pushes']
+
+
+def parse_params(pairs):
+    """Parse ['M=16', 'ef_search=64'] into {'M': 16.0, 'ef_search': 64.0}."""
+    params = {}
+    for pair in pairs:
+        name, value = pair.split('=', 1)
+        params[name] = float(value)
+    return params
+
+
+def profile_once(algorithm, queries, ground_truth, k, num_threads, warmup=10):
+    """
+    Profile one batch query over all queries at the current parameters.
+
+    Returns a dict with recall, qps, the per-query work counters and, when
+    the hardware counters could be opened, cycles / instructions / LLC
+    misses per query and IPC.
+    """
+    for query in queries[:warmup]:
+        algorithm.query(query, k)
+
+    algorithm.reset_stats()
+    perf = algorithm.profile_batch_search(queries, k, num_threads=num_threads)
+    stats = algorithm.get_stats()
+
+    # Recall from a separate, uncounted run of the same batch
+    results = np.empty((len(queries), k), dtype=np.int32)
+    algorithm.batch_query_into(queries, k, results, num_threads=num_threads)
+    recall = calculate_recall(results, ground_truth, k)
+
+    n = perf['queries']
+    row = {
+        'params': algorithm.get_params(),
+        'recall': recall,
+        'qps': n / perf['seconds'],
+        'seconds': perf['seconds'],
+        'num_queries': n,
+        'stats': stats,
+        'per_query': {name: stats.get(name, 0.0) / n for name in WORK_COUNTERS},
+        'perf_available': perf['available'],
+    }
+    if perf['available']:
+        row['perf'] = {
+            'cycles_per_query': perf['cycles'] / n,
+            'instructions_per_query': perf['instructions'] / n,
+            'llc_misses_per_query': perf['llc_misses'] / n,
+            'ipc': perf['instructions'] / perf['cycles'] if perf['cycles'] else 0.0,
+        }
+    else:
+        row['perf_error'] = perf['error']
+    return row
+
+
+def print_header(label):
+    print(f"\n{label:<16} {'Recall':>7} {'QPS':>10} "
+          f"{'Mcyc/q':>8} {'IPC':>5} {'LLC/q':>8} "
+          f"{'dist/q':>9} {'nodes/q':>8} {'lists/q':>8} {'rerank/q':>8} {'heap/q':>8}")
+    print('-' * 112)
+
+
+def print_row(label, row):
+    if row['perf_available']:
+        perf = row['perf']
+        hw = (f"{perf['cycles_per_query'] / 1e6:>8.3f} {perf['ipc']:>5.2f} "
+              f"{perf['llc_misses_per_query']:>8.1f}")
+    else:
+        hw = f"{'-':>8} {'-':>5} {'-':>8}"
+    per_query = row['per_query']
+    print(f"{label:<16} {row['recall']:>7.4f} {row['qps']:>10.1f} {hw} "
+          f"{per_query['distances']:>9.1f} {per_query['nodes_visited']:>8.1f} "
+          f"{per_query['lists_probed']:>8.1f} {per_query['reranked']:>8.1f} "
+          f"{per_query['heap_pushes']:>8.1f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Profile per-query search work and hardware cost'
+    )
+    parser.add_argument(
+        '--impl',
+        choices=['naive', 'vectordb', 'hnsw', 'ivf', 'ivfpq', 'diskann'],
+        default='hnsw',
+        help='Implementation to profile'
+    )
+    parser.add_argument(
+        '--dataset',
+        default='gist-960-euclidean',
+        help='Dataset to use'
+    )
+    parser.add_argument(
+        '--k',
+        type=int,
+        default=10,
+        help='Number of neighbors to retrieve'
+    )
+    parser.add_argument(
+        '--subset-size',
+        type=int,
+        help='Use only a subset of the dataset for quick testing'
+    )
+    parser.add_argument(
+        '--param',
+        action='append',
+        default=[],
+        metavar='NAME=VALUE',
+        help='Set an algorithm parameter before building (repeatable)'
+    )
+    parser.add_argument(
+        '--sweep',
+        metavar='NAME=V1,V2,...',
+        help='Build once, then profile each value of a query-time parameter'
+    )
+    parser.add_argument(
+        '--pca',
+        action='store_true',
+        help='Put a PCA reduction stage in front of the index (pca_dim, pca_rerank)'
+    )
+    parser.add_argument(
+        '--shard',
+        action='store_true',
+        help='Split the index into per-NUMA-node shards (shards)'
+    )
+    parser.add_argument(
+        '--threads',
+        type=int,
+        default=1,
+        help='Threads for the profiled batch (default 1: per-query cost without contention; 0 = all cores)'
+    )
+    parser.add_argument(
+        '--index',
+        metavar='PATH',
+        help='Load the index from PATH instead of fitting; fit and save it there if missing'
+    )
+    parser.add_argument(
+        '--output',
+        help='Save results to JSON file'
+    )
+
+    args = parser.parse_args()
+
+    impl = f"pca+{args.impl}" if args.pca else args.impl
+    if args.shard:
+        impl = f"shard+{impl}"
+    benchmark = Benchmark(args.dataset, subset_size=args.subset_size,
+                          index_path=args.index, num_threads=args.threads)
+    metric = benchmark.loader.config['metric']
+    algo = ANNAlgorithm(impl, metric)
+    algo.set_params(parse_params(args.param))
+
+    print(f"Profiling {impl} on {benchmark.dataset['name']}")
+    print(f"  Train: {benchmark.train_shape}")
+    print(f"  Test:  {benchmark.dataset['test'].shape}")
+    print(f"  k = {args.k}, threads = {args.threads or 'all'}")
+
+    print("\nBuilding index...")
+    build_time, memory_usage = benchmark._measure_build(algo)
+    print(f"  Build time: {build_time:.2f}s")
+    print(f"  Memory: {memory_usage / 1e6:.1f} MB")
+
+    queries = benchmark.dataset['test']
+    ground_truth = benchmark.dataset['ground_truth']
+    if args.sweep:
+        name, values = args.sweep.split('=', 1)
+        points = [(name, float(v)) for v in values.split(',')]
+    else:
+        points = [(None, None)]
+
+    rows = []
+    for index, (name, value) in enumerate(points):
+        if name is not None:
+            algo.set_param(name, value)
+        row = profile_once(algo, queries, ground_truth, args.k, args.threads)
+        if index == 0:
+            if not row['perf_available']:
+                print(f"\n  Hardware counters unavailable: {row['perf_error']}")
+            if not row['stats']:
+                print("  Work counters compiled out (built with -DANN_STATS=OFF)")
+            print_header(name or 'config')
+        print_row(f"{name}={value:g}" if name is not None else algo.name(), row)
+        rows.append(row)
+
+    if args.output:
+        output_path = Path(args.output)
+        output_path.parent.mkdir(parents=True, exist_ok=True)
+
+        with open(output_path, 'w') as f:
+            json.dump({
+                'timestamp': datetime.now().isoformat(),
+                'algorithm': algo.name(),
+                'dataset': benchmark.dataset['name'],
+                'k': args.k,
+                'threads': args.threads,
+                'build_time': build_time,
+                'memory_mb': memory_usage / 1e6,
+                'results': rows,
+            }, f, indent=2)
+
+        print(f"\n✓ Results saved to {output_path}")
+
+
+if __name__ == '__main__':
+    main()
@@ -144,7 +144,7 @@ if __name__ == '__main__':
     import argparse
     
     parser = argparse.ArgumentParser()
-    parser.add_argument('--impl', default='vectordb', choices=['naive', 'vectordb'])
+    parser.add_argument('--impl', default='vectordb', choices=['naive', 'vectordb', 'hnsw', 'ivf', 'ivfpq', 'diskann'])
     parser.add_argument('--metric', default='euclidean', choices=['euclidean', 'angular'])
     
     args = parser.parse_args()
@@ -1,13 +1,20 @@
 #include "../include/ann_interface.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include "../include/sq.hpp"
+#include "../include/topk.hpp"
+#include "../include/vector_store.hpp"
 #include <cmath>
 #include <algorithm>
+#include <numeric>
 #include <omp.h>        // OpenMP support
 
-// SIMD intrinsics - architecture specific
-#if defined(__x86_64__) || defined(_M_X64) || defined(__i386) || defined(_M_IX86)
-    #include <immintrin.h>  // AVX/AVX2 intrinsics for x86_64
-#elif defined(__aarch64__) || defined(__arm64__)
-    #include <arm_neon.h>    // NEON intrinsics for ARM64
+#ifdef ANN_HAVE_BLAS
+// Fortran BLAS (OpenBLAS, MKL, reference BLAS all export it)
+extern "C" void sgemm_(const char* transa, const char* transb, const int* m, const int* n,
+                       const int* k, const float* alpha, const float* a, const int* lda,
+                       const float* b, const int* ldb, const float* beta, float* c,
+                       const int* ldc);
 #endif
 
 /**
@@ -15,15 +22,69 @@
  * 
  * This is where you implement your optimized ANN algorithm.
  * 
+ * Distance kernels come from distance.hpp (AVX-512 / AVX2+FMA / NEON,
+ * picked at load time from CPUID).
+ *
  * Ideas to try:
- * 1. SIMD optimization (AVX2/AVX-512)
- * 2. OpenMP parallelization
- * 3. Cache-friendly memory layout
- * 4. Approximate algorithms:
+ * 1. OpenMP parallelization
+ * 2. Cache-friendly memory layout
+ * 3. Approximate algorithms:
  *    - HNSW (Hierarchical Navigable Small World)
  *    - IVF (Inverted File Index)
  *    - Product Quantization
  * 
+ * Storage (set_param, before fit()):
+ * - storage_bits: 32 = fp32 (exact), 16 = fp16, 8 = per-dimension int8,
+ *                 1 = sign bits scanned by Hamming distance (shortlist only,
+ *                 use with rerank). Compressed rows cut the bytes streamed
+ *                 per candidate 2-32x.
+ * - rerank:       with compressed storage, re-score this many candidates
+ *                 on exact fp32 rows (0 = off). The fp32 rows are only kept
+ *                 if rerank > 0 at fit() time.
+ *
+ * - reorder_dims:  (default 1) euclidean fp32 rows that are not borrowed
+ *                  get their dimensions sorted by decreasing variance, so
+ *                  early abandoning can stop after the leading ones.
+ *                  Queries are permuted to match; results do not change.
+ *
+ * Query-time:
+ * - query_threads: split each query() scan over this many threads (local
+ *                  top-k per shard, then a merge) to cut single-query
+ *                  latency; 0 / 1 = one thread. batch_query() parallelizes
+ *                  over queries instead.
+ * - early_abandon: euclidean fp32 scans stop summing a row once its
+ *                  partial distance passes the current k-th best (checked
+ *                  every 64 dimensions); exact either way. 1 = on, 0 = off,
+ *                  -1 = auto (dimension >= 256). range_search() abandons
+ *                  against its radius unless this is 0.
+ *
+ * fit_begin() / fit_chunk() / fit_end() copy each chunk straight into the
+ * fp32 arena (sized up front when the total is known) and encode once at
+ * the end, so the result matches fit() and no second copy of the data is
+ * ever held; compressed storage encodes from that arena and then frees it
+ * unless it is kept for re-ranking.
+ *
+ * fit_borrowed() scans the caller's rows in place instead of copying them
+ * (angular rows are rescaled by a stored 1 / ||x|| since they cannot be
+ * normalized in place); compressed modes then re-rank on borrowed rows
+ * for free.
+ *
+ * save() / load() persist every storage mode; loaded fp32 rows are mapped
+ * from the file.
+ *
+ * search_filtered() scans only the rows the filter allows: block by block
+ * (skipping blocks without any) for broad filters, row by row for ones
+ * that allow under 1/16 of the rows.
+ *
+ * search() / batch_search() also return the distances (batch_query() is
+ * batch_search() into one buffer). batch_search() on fp32 storage is a
+ * blocked GEMM: a tile of queries is scored against an L2-sized tile of
+ * rows with the dot_tile micro-kernel
+ * (or BLAS sgemm when built with -DANN_WITH_BLAS=ON), using
+ * ||q - x||^2 = ||q||^2 + ||x||^2 - 2 q·x, so every row read from memory
+ * serves a whole tile of queries. Query tiles are spread over OpenMP
+ * threads; compressed storage runs search() in parallel instead.
+ *
  * Competition metrics:
  * - Recall @ k=10 (must be >= 90%)
  * - Queries per second (QPS)
@@ -36,105 +97,919 @@ public:
     void init(const std::string& metric, int dimension) override {
         metric_ = metric;
         dimension_ = dimension;
+
+        // Resolve the metric once; the scan kernel is specialized on
+        // (metric, dimension) so the inner loop has no branches.
+        metric_type_ = parse_metric(metric);
+        scan_ = resolve_scan(metric_type_, dimension);
+        scan_ids_ = resolve_scan_ids(metric_type_, dimension);
+        f16_scan_ = distance_kernels().f16_scan[static_cast<int>(metric_type_)];
+        u8_dot_scan_ = distance_kernels().u8_dot_scan;
+        hamming_scan_ = distance_kernels().hamming_scan;
+        head_scan_ = resolve_scan(Metric::Euclidean,
+                                  static_cast<int>(std::min<size_t>(kAbandonHeadDims, dimension)));
+    }
+
+    void set_param(const std::string& name, double value) override {
+        if (name == "storage_bits") {
+            int bits = static_cast<int>(value);
+            if (bits != 32 && bits != 16 && bits != 8 && bits != 1) {
+                throw std::runtime_error("storage_bits must be 32, 16, 8 or 1");
+            }
+            storage_bits_ = bits;
+        } else if (name == "rerank") {
+            rerank_ = std::max(0, static_cast<int>(value));
+        } else if (name == "query_threads") {
+            query_threads_ = std::max(0, static_cast<int>(value));
+        } else if (name == "early_abandon") {
+            early_abandon_ = std::max(-1, std::min(1, static_cast<int>(value)));
+        } else if (name == "reorder_dims") {
+            reorder_dims_ = value != 0.0;
+        } else {
+            ANNAlgorithm::set_param(name, value);
+        }
+    }
+
+    std::map<std::string, double> get_params() const override {
+        return {
+            {"storage_bits", storage_bits_},
+            {"rerank", rerank_},
+            {"query_threads", query_threads_},
+            {"early_abandon", early_abandon_},
+            {"reorder_dims", reorder_dims_ ? 1.0 : 0.0},
+        };
     }
 
     void fit(const float* data, size_t n_samples) override {
-        n_samples_ = n_samples;
-        
-        // Copy data into our storage
-        // TODO: Consider memory alignment for SIMD (use aligned_alloc)
-        data_.resize(n_samples * dimension_);
-        std::copy(data, data + n_samples * dimension_, data_.begin());
+        build(data, n_samples, false);
+    }
+
+    void fit_borrowed(const float* data, size_t n_samples) override {
+        build(data, n_samples, true);
+    }
+
+    void fit_begin(size_t n_total) override {
+        reset_storage();
+        rows_.reserve(n_total, dimension_);
+    }
+
+    void fit_chunk(const float* data, size_t n_samples) override {
+        size_t first = rows_.size();
+        rows_.append(data, n_samples, dimension_);
+        if (metric_type_ == Metric::Angular) {
+            normalize_rows(rows_.row(first), n_samples, rows_.stride(), dimension_);
+        }
+    }
+
+    void fit_end() override {
+        n_samples_ = rows_.size();
+        encode_rows(rows_.data(), rows_.stride(), false);
     }
 
     std::vector<int> query(const float* query, int k) override {
-        // Compute distances to all vectors
-        std::vector<std::pair<float, int>> distances;
-        distances.reserve(n_samples_);
-        
-        for (size_t i = 0; i < n_samples_; ++i) {
-            float dist = compute_distance(query, &data_[i * dimension_]);
-            distances.emplace_back(dist, static_cast<int>(i));
-        }
-        
-        // Partial sort to get k smallest
-        std::partial_sort(
-            distances.begin(),
-            distances.begin() + k,
-            distances.end()
-        );
-        
-        // Extract indices
-        std::vector<int> result(k);
-        for (int i = 0; i < k; ++i) {
-            result[i] = distances[i].second;
-        }
-        
-        return result;
+        return search_ids(query, k);
+    }
+
+    void search(const float* query, int k, int* ids, float* distances) override {
+        search_rows(query, k, nullptr, ids, distances);
+    }
+
+    void search_filtered(const float* query, int k, const IdFilter& filter, int* ids,
+                         float* distances) override {
+        search_rows(query, k, &filter, ids, distances);
+    }
+
+    /**
+     * Exact scan of every row: early-abandoning on euclidean fp32 rows,
+     * else whole blocks scored (on the fp32 rows when kept, so compressed
+     * storage with rerank answers exactly).
+     */
+    void range_search(const float* query, float radius, std::vector<int>& ids,
+                      std::vector<float>& distances) override {
+        QueryScratch& scratch = query_scratch();
+        query = row_space_query(query, scratch);
+        std::vector<std::pair<float, int>>& found = scratch.found;
+        found.clear();
+        SearchStats stats;
+        stats.count(Stat::Queries);
+        stats.count(Stat::Distances, n_samples_);
+        stats_.add(stats);
+
+        if (!rows_.empty() && metric_type_ == Metric::Euclidean && early_abandon_ != 0) {
+            abandon_scan(query, 0, n_samples_, nullptr, [&]() { return radius; },
+                         [&](float dist, int id) {
+                             if (dist <= radius) {
+                                 found.emplace_back(dist, id);
+                             }
+                         });
+        } else {
+            PreparedQuery prepared = prepare_scan(query, scratch);
+            float block[kScanBlock];
+            for (size_t start = 0; start < n_samples_; start += kScanBlock) {
+                size_t count = std::min(kScanBlock, n_samples_ - start);
+                if (!rows_.empty()) {
+                    score_rows(query, start, count, block);
+                } else {
+                    score_block(prepared, start, count, block);
+                }
+                for (size_t j = 0; j < count; ++j) {
+                    if (block[j] <= radius) {
+                        found.emplace_back(block[j], static_cast<int>(start + j));
+                    }
+                }
+            }
+        }
+
+        std::sort(found.begin(), found.end());
+        ids.resize(found.size());
+        distances.resize(found.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            distances[i] = found[i].first;
+            ids[i] = found[i].second;
+        }
+    }
+
+    void batch_search(const float* queries, size_t n_queries, int k, int* ids,
+                      float* distances, int num_threads = 0) override {
+        if (stored_bits_ != 32) {
+            ANNAlgorithm::batch_search(queries, n_queries, k, ids, distances, num_threads);
+            return;
+        }
+        if (n_samples_ == 0 || rows_.size() == 0) {
+            // Not fit, or loaded without rows: nothing to tile over
+            size_t n = n_queries * static_cast<size_t>(k);
+            std::fill(ids, ids + n, -1);
+            if (distances) {
+                std::fill(distances, distances + n, std::numeric_limits<float>::infinity());
+            }
+            return;
+        }
+        int threads = thread_count(num_threads);
+
+        std::vector<float> normalized;
+        if (metric_type_ == Metric::Angular) {
+            normalized.assign(queries, queries + n_queries * dimension_);
+            normalize_rows(normalized.data(), n_queries, dimension_);
+            queries = normalized.data();
+        } else if (!dim_order_.empty()) {
+            normalized.resize(n_queries * dimension_);
+            for (size_t i = 0; i < n_queries; ++i) {
+                for (int d = 0; d < dimension_; ++d) {
+                    normalized[i * dimension_ + d] = queries[i * dimension_ + dim_order_[d]];
+                }
+            }
+            queries = normalized.data();
+        }
+
+        // Rows per tile: the row tile stays in L2 while the query tile
+        // streams over it
+        size_t row_bytes = rows_.stride() * sizeof(float);
+        size_t tile_rows = std::max<size_t>(16, std::min<size_t>(1024, kBatchTileBytes / row_bytes));
+
+        // Query tiles are the unit of parallel work: shrink them (down to
+        // the 4-query register block) until every thread gets one
+        size_t per_thread = (n_queries + threads - 1) / threads;
+        size_t tile_queries = std::min(kBatchQueries, std::max<size_t>(4, (per_thread + 3) / 4 * 4));
+        long long n_tiles = static_cast<long long>((n_queries + tile_queries - 1) / tile_queries);
+
+        std::vector<float> query_norms(n_queries, 0.0f);
+        if (metric_type_ == Metric::Euclidean) {
+            DistanceFunc inner_product = distance_kernels().inner_product;
+            for (size_t i = 0; i < n_queries; ++i) {
+                const float* q = queries + i * dimension_;
+                query_norms[i] = inner_product(q, q, dimension_);
+            }
+        }
+
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+        for (long long tile = 0; tile < n_tiles; ++tile) {
+            size_t q0 = static_cast<size_t>(tile) * tile_queries;
+            size_t nq = std::min(tile_queries, n_queries - q0);
+            const float* query_tile = queries + q0 * dimension_;
+
+            // Per-thread tile buffers, reused across calls; every row is
+            // scanned before the tile's heaps are written out
+            QueryScratch& scratch = query_scratch();
+            std::vector<float>& dots = scratch.tile;
+            dots.resize(tile_queries * tile_rows);
+            std::vector<TopK>& heaps = scratch.tile_tops;
+            heaps.resize(nq);
+            uint64_t pushes = 0;
+            for (size_t i = 0; i < nq; ++i) {
+                heaps[i].reset(k);
+                pushes += heaps[i].inserts();
+            }
+
+            for (size_t r0 = 0; r0 < n_samples_; r0 += tile_rows) {
+                size_t nr = std::min(tile_rows, n_samples_ - r0);
+                compute_dot_tile(query_tile, nq, rows_.row(r0), nr, dots.data(), tile_rows);
+
+                for (size_t i = 0; i < nq; ++i) {
+                    float* row_dists = dots.data() + i * tile_rows;
+                    if (metric_type_ == Metric::Euclidean) {
+                        float query_norm = query_norms[q0 + i];
+                        for (size_t j = 0; j < nr; ++j) {
+                            row_dists[j] = query_norm + norms_[r0 + j] - 2.0f * row_dists[j];
+                        }
+                    } else if (!inv_norms_.empty()) {
+                        for (size_t j = 0; j < nr; ++j) {
+                            row_dists[j] = 1.0f - row_dists[j] * inv_norms_[r0 + j];
+                        }
+                    } else {
+                        for (size_t j = 0; j < nr; ++j) {
+                            row_dists[j] = 1.0f - row_dists[j];
+                        }
+                    }
+                    heaps[i].push_block(row_dists, nr, static_cast<int>(r0));
+                }
+            }
+
+            uint64_t inserted = 0;
+            for (size_t i = 0; i < nq; ++i) {
+                inserted += heaps[i].inserts();
+                heaps[i].take_into(k, ids + (q0 + i) * k,
+                                   distances ? distances + (q0 + i) * k : nullptr);
+            }
+            SearchStats stats;
+            stats.count(Stat::Queries, nq);
+            stats.count(Stat::Distances, nq * n_samples_);
+            stats.count(Stat::HeapPushes, inserted - pushes);
+            stats_.add(stats);
+        }
+    }
+
+    void save(const std::string& path) const override {
+        IndexWriter out(path, "vectordb", metric_, dimension_);
+        out.set("storage_bits", storage_bits_);
+        out.set("rerank", rerank_);
+        out.set("query_threads", query_threads_);
+        out.set("early_abandon", early_abandon_);
+        out.set("reorder_dims", reorder_dims_ ? 1.0 : 0.0);
+        out.set("stored_bits", stored_bits_);
+        out.set("n_samples", static_cast<double>(n_samples_));
+        if (!rows_.empty()) {
+            out.write_store("rows", rows_);
+        }
+        out.write("inv_norms", inv_norms_);
+        out.write("norms", norms_);
+        out.write("codes_f16", codes_f16_);
+        out.write("codes_u8", codes_u8_);
+        out.write("codes_bin", codes_bin_);
+        if (stored_bits_ == 8) {
+            sq_.save(out, "sq");
+        } else if (stored_bits_ == 1) {
+            bq_.save(out, "bq");
+        }
+        if (!dim_order_.empty()) {
+            out.write("dim_order", dim_order_);
+        }
+        if (!labels_.empty()) {
+            out.write("labels", labels_);
+        }
+        out.finish();
+    }
+
+    void load(const std::string& path) override {
+        std::shared_ptr<IndexFile> in = IndexFile::open(path);
+        in->expect_kind("vectordb");
+        init(in->metric(), in->dimension());
+
+        storage_bits_ = static_cast<int>(in->get("storage_bits"));
+        rerank_ = static_cast<int>(in->get("rerank"));
+        query_threads_ = static_cast<int>(in->get("query_threads", 0));
+        early_abandon_ = static_cast<int>(in->get("early_abandon", -1));
+        reorder_dims_ = in->get("reorder_dims", 1) != 0.0;
+        stored_bits_ = static_cast<int>(in->get("stored_bits"));
+        n_samples_ = static_cast<size_t>(in->get("n_samples"));
+
+        rows_.clear();
+        if (in->has("rows")) {
+            in->map_store("rows", rows_);
+        }
+        inv_norms_ = in->vector<float>("inv_norms");
+        norms_ = in->vector<float>("norms");
+        codes_f16_ = in->vector<uint16_t>("codes_f16");
+        codes_u8_ = in->vector<uint8_t>("codes_u8");
+        codes_bin_ = in->vector<uint64_t>("codes_bin");
+        if (stored_bits_ == 8) {
+            sq_.load(*in, "sq");
+        } else if (stored_bits_ == 1) {
+            bq_.load(*in, "bq");
+        }
+        dim_order_ = in->has("dim_order") ? in->vector<int>("dim_order") : std::vector<int>();
+        labels_ = in->has("labels") ? in->vector<int>("labels") : std::vector<int>();
     }
 
     size_t get_memory_usage() const override {
-        return data_.size() * sizeof(float);
+        return rows_.memory_usage() +
+               inv_norms_.size() * sizeof(float) +
+               codes_f16_.size() * sizeof(uint16_t) +
+               codes_u8_.size() * sizeof(uint8_t) +
+               codes_bin_.size() * sizeof(uint64_t) +
+               norms_.size() * sizeof(float) +
+               dim_order_.size() * sizeof(int) +
+               labels_.size() * sizeof(int) +
+               (stored_bits_ == 8 ? sq_.get_memory_usage() : 0) +
+               (stored_bits_ == 1 ? bq_.get_memory_usage() : 0);
     }
 
     std::string name() const override {
-        return "NaiveBruteForce";
+        return "BruteForceSIMD";
     }
 
 private:
+    // Rows scanned per kernel call; the distance buffer stays in L1
+    static constexpr size_t kScanBlock = 256;
+
+    // Smallest intra-query shard worth a thread (fork/join costs a few us)
+    static constexpr size_t kMinShardRows = 16384;
+
+    // Filters allowing at most 1/kGatherFraction of the rows are scored row
+    // by row instead of block by block
+    static constexpr size_t kGatherFraction = 16;
+
+    // abandon_scan(): dimensions scored for the whole block first, then
+    // per surviving row between threshold checks
+    static constexpr size_t kAbandonHeadDims = 64;
+    static constexpr size_t kAbandonChunkDims = 64;
+
+    // early_abandon = -1 turns it on from this dimension up; below, the
+    // full-width block scan is as fast
+    static constexpr size_t kAbandonMinDims = 256;
+
+    // Rows sampled for the per-dimension variances of reorder_dimensions()
+    static constexpr size_t kReorderSampleRows = 65536;
+
+    // batch_search tiling: max queries per tile, and the byte budget of a row
+    // tile (about half of a typical per-core L2)
+    static constexpr size_t kBatchQueries = 64;
+    static constexpr size_t kBatchTileBytes = 512 * 1024;
+
+    /**
+     * A prepared query for scan_range(): the (normalized) floats plus the
+     * int8 / binary encodings when the storage needs them.
+     */
+    struct PreparedQuery {
+        const float* query;
+        const ScalarQuantizer::EncodedQuery* sq;
+        float norm;              // ||q||^2, int8 euclidean
+        const uint64_t* bits;    // BinaryQuantizer code
+    };
+
+    /**
+     * Per-thread buffers for search() and batch_search(), reused across calls
+     * (and across instances; every user resizes what it needs).
+     */
+    struct QueryScratch {
+        std::vector<float> normalized;
+        std::vector<float> reordered;  // row_space_query(): permuted query
+        ScalarQuantizer::EncodedQuery encoded;
+        std::vector<uint64_t> query_bits;
+        TopK top;
+        std::vector<TopK> shard_tops;  // query_threads > 1: one per shard
+        std::vector<int> shortlist;  // re-rank candidates
+        std::vector<int> allowed;    // scan_allowed() ids
+        std::vector<std::pair<float, int>> found;  // range_search() hits
+        std::vector<float> exact;    // re-rank distances
+        std::vector<float> tile;     // batch_search dot-product tile
+        std::vector<TopK> tile_tops; // batch_search: one per query of the tile
+    };
+
+    static QueryScratch& query_scratch() {
+        thread_local QueryScratch scratch;
+        return scratch;
+    }
+
+    /**
+     * search() over the rows filter allows (all rows if null). Selective
+     * filters score just the allowed rows; others scan every block that
+     * holds an allowed row and offer only those.
+     */
+    void search_rows(const float* query, int k, const IdFilter* filter, int* ids,
+                     float* distances) {
+        QueryScratch& scratch = query_scratch();
+        query = row_space_query(query, scratch);
+
+        bool rerank = stored_bits_ != 32 && rerank_ > 0 && !rows_.empty();
+        size_t n_candidates = rerank ? std::max(k, rerank_) : static_cast<size_t>(k);
+        n_candidates = std::min(n_candidates, n_samples_);
+
+        // Compute distances to all vectors, keeping only the n_candidates best
+        PreparedQuery prepared = prepare_scan(query, scratch);
+        TopK& top = scratch.top;
+        top.reset(n_candidates);
+        SearchStats stats;
+        stats.count(Stat::Queries);
+        uint64_t pushes = top.inserts();
+
+        int shards = query_shards();
+        if (filter && filter->count() * kGatherFraction <= n_samples_) {
+            scan_allowed(prepared, *filter, top, scratch.allowed);
+            stats.count(Stat::ExactScans);
+            stats.count(Stat::Distances, scratch.allowed.size());
+        } else if (shards <= 1) {
+            stats.count(Stat::Distances, scan_range(prepared, 0, n_samples_, filter, top));
+        } else {
+            // Intra-query parallelism: contiguous shards of whole blocks,
+            // each with a local top-k, merged afterwards
+            std::vector<TopK>& shard_tops = scratch.shard_tops;
+            shard_tops.resize(shards);
+            size_t n_blocks = (n_samples_ + kScanBlock - 1) / kScanBlock;
+            size_t scored = 0;
+            for (TopK& shard_top : shard_tops) {
+                pushes -= shard_top.inserts();
+            }
+
+            #pragma omp parallel for schedule(static, 1) num_threads(shards) reduction(+ : scored)
+            for (int shard = 0; shard < shards; ++shard) {
+                size_t begin = std::min(n_samples_, n_blocks * shard / shards * kScanBlock);
+                size_t end = std::min(n_samples_, n_blocks * (shard + 1) / shards * kScanBlock);
+                shard_tops[shard].reset(n_candidates);
+                scored += scan_range(prepared, begin, end, filter, shard_tops[shard]);
+            }
+            for (TopK& shard_top : shard_tops) {
+                pushes += shard_top.inserts();
+                top.merge(shard_top);
+            }
+            stats.count(Stat::Distances, scored);
+        }
+
+        if (!rerank) {
+            stats.count(Stat::HeapPushes, top.inserts() - pushes);
+            stats_.add(stats);
+            top.take_into(k, ids, distances);
+            return;
+        }
+
+        // Exact re-rank of the shortlist on fp32 rows
+        std::vector<int>& shortlist = scratch.shortlist;
+        shortlist.resize(top.size());
+        top.take_into(shortlist.size(), shortlist.data(), nullptr);
+        std::vector<float>& exact = scratch.exact;
+        exact.resize(shortlist.size());
+        scan_ids_(query, rows_.data(), shortlist.data(), shortlist.size(), rows_.stride(),
+                  dimension_, exact.data());
+        if (!inv_norms_.empty()) {
+            for (size_t i = 0; i < shortlist.size(); ++i) {
+                exact[i] = 1.0f - (1.0f - exact[i]) * inv_norms_[shortlist[i]];
+            }
+        }
+
+        top.reset(k);
+        top.push_block(exact.data(), shortlist.size(), shortlist.data());
+        stats.count(Stat::Reranked, shortlist.size());
+        stats.count(Stat::Distances, shortlist.size());
+        stats.count(Stat::HeapPushes, top.inserts() - pushes);
+        stats_.add(stats);
+        top.take_into(k, ids, distances);
+    }
+
+    /**
+     * The query encodings the storage scans need (int8 / binary codes).
+     */
+    PreparedQuery prepare_scan(const float* query, QueryScratch& scratch) const {
+        ScalarQuantizer::EncodedQuery& encoded = scratch.encoded;
+        float query_norm = 0.0f;
+        if (stored_bits_ == 8) {
+            sq_.encode_query(query, encoded);
+            query_norm = distance_kernels().inner_product(query, query, dimension_);
+        }
+        std::vector<uint64_t>& query_bits = scratch.query_bits;
+        if (stored_bits_ == 1) {
+            query_bits.resize(bq_.words());
+            bq_.encode(query, 1, query_bits.data());
+        }
+        return PreparedQuery{query, &encoded, query_norm, query_bits.data()};
+    }
+
+    /**
+     * Distances to rows start .. start + count - 1 in the stored format.
+     */
+    void score_block(const PreparedQuery& q, size_t start, size_t count, float* block) const {
+        if (stored_bits_ == 16) {
+            f16_scan_(q.query, &codes_f16_[start * dimension_], count, dimension_, dimension_,
+                      block);
+        } else if (stored_bits_ == 8) {
+            int32_t dots[kScanBlock];
+            u8_dot_scan_(q.sq->codes.data(), &codes_u8_[start * dimension_], count,
+                         dimension_, dimension_, dots);
+            score_sq_block(*q.sq, q.norm, start, count, dots, block);
+        } else if (stored_bits_ == 1) {
+            uint32_t hamming[kScanBlock];
+            hamming_scan_(q.bits, &codes_bin_[start * bq_.words()], count, bq_.words(),
+                          hamming);
+            for (size_t j = 0; j < count; ++j) {
+                block[j] = static_cast<float>(hamming[j]);
+            }
+        } else {
+            score_rows(q.query, start, count, block);
+        }
+    }
+
+    /**
+     * Exact distances to fp32 rows start .. start + count - 1.
+     */
+    void score_rows(const float* query, size_t start, size_t count, float* block) const {
+        scan_(query, rows_.row(start), count, rows_.stride(), dimension_, block);
+        if (!inv_norms_.empty()) {
+            rescale_borrowed(block, count, start);
+        }
+    }
+
+    /**
+     * Early-abandoning euclidean scan of the fp32 rows [begin, end) (only
+     * those filter allows, if any). Each block is scored on its first
+     * kAbandonHeadDims dimensions in one kernel call; rows still within
+     * bound() then add kAbandonChunkDims dimensions at a time and drop out
+     * as soon as the partial sum, which only grows, passes it. keep(dist,
+     * id) gets the full distance of every row that never did. With the
+     * dimensions in decreasing variance order (reorder_dims) the head
+     * carries most of the distance, so far rows cost a fraction of it.
+     * Returns how many rows were scored (at least on the head).
+     */
+    template <typename Bound, typename Keep>
+    size_t abandon_scan(const float* query, size_t begin, size_t end, const IdFilter* filter,
+                        Bound bound, Keep keep) const {
+        size_t dim = static_cast<size_t>(dimension_);
+        size_t head = std::min(kAbandonHeadDims, dim);
+        ScanFunc head_scan = head == dim ? scan_ : head_scan_;
+        DistanceFunc l2_sqr = distance_kernels().l2_sqr;
+        float block[kScanBlock];
+        size_t scored = 0;
+        for (size_t start = begin; start < end; start += kScanBlock) {
+            size_t count = std::min(kScanBlock, end - start);
+            if (filter && !filter->any(start, start + count)) {
+                continue;
+            }
+            head_scan(query, rows_.row(start), count, rows_.stride(), head, block);
+            scored += count;
+            for (size_t j = 0; j < count; ++j) {
+                int id = static_cast<int>(start + j);
+                float dist = block[j];
+                float limit = bound();
+                if (dist > limit || (filter && !filter->allows(id))) {
+                    continue;
+                }
+                const float* row = rows_.row(start + j);
+                for (size_t d = head; d < dim && dist <= limit; d += kAbandonChunkDims) {
+                    dist += l2_sqr(query + d, row + d, std::min(kAbandonChunkDims, dim - d));
+                }
+                keep(dist, id);
+            }
+        }
+        return scored;
+    }
+
+    /**
+     * Whether top-k scans of the fp32 rows abandon far rows early: on for
+     * euclidean fp32 storage when early_abandon is 1, or -1 (auto) and the
+     * vectors have at least kAbandonMinDims dimensions.
+     */
+    bool abandons() const {
+        return stored_bits_ == 32 && metric_type_ == Metric::Euclidean &&
+               (early_abandon_ > 0 ||
+                (early_abandon_ < 0 && static_cast<size_t>(dimension_) >= kAbandonMinDims));
+    }
+
+    /**
+     * The query in the rows' space: normalized for angular, and with its
+     * dimensions permuted like the rows when fit() reordered them.
+     */
+    const float* row_space_query(const float* query, QueryScratch& scratch) const {
+        query = prepare_query(metric_type_, query, dimension_, scratch.normalized);
+        if (dim_order_.empty()) {
+            return query;
+        }
+        std::vector<float>& reordered = scratch.reordered;
+        reordered.resize(dimension_);
+        for (int d = 0; d < dimension_; ++d) {
+            reordered[d] = query[dim_order_[d]];
+        }
+        return reordered.data();
+    }
+
+    /**
+     * Permute the dimensions of the owned fp32 rows into decreasing
+     * variance order (dim_order_[d] = original dimension now at d),
+     * estimated on up to kReorderSampleRows evenly spaced rows. Euclidean
+     * distances do not change, but the leading dimensions then carry most
+     * of each one, which is what abandon_scan() needs.
+     */
+    void reorder_dimensions() {
+        size_t dim = static_cast<size_t>(dimension_);
+        size_t step = std::max<size_t>(1, n_samples_ / kReorderSampleRows);
+        std::vector<double> sum(dim, 0.0);
+        std::vector<double> sum_sq(dim, 0.0);
+        size_t sampled = 0;
+        for (size_t i = 0; i < n_samples_; i += step, ++sampled) {
+            const float* row = rows_.row(i);
+            for (size_t d = 0; d < dim; ++d) {
+                sum[d] += row[d];
+                sum_sq[d] += static_cast<double>(row[d]) * row[d];
+            }
+        }
+        std::vector<double> variance(dim);
+        for (size_t d = 0; d < dim; ++d) {
+            double mean = sum[d] / sampled;
+            variance[d] = sum_sq[d] / sampled - mean * mean;
+        }
+
+        dim_order_.resize(dim);
+        std::iota(dim_order_.begin(), dim_order_.end(), 0);
+        std::stable_sort(dim_order_.begin(), dim_order_.end(),
+                         [&](int a, int b) { return variance[a] > variance[b]; });
+
+        #pragma omp parallel
+        {
+            std::vector<float> original(dim);
+            #pragma omp for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(n_samples_); ++i) {
+                float* row = rows_.row(i);
+                std::copy(row, row + dim, original.begin());
+                for (size_t d = 0; d < dim; ++d) {
+                    row[d] = original[dim_order_[d]];
+                }
+            }
+        }
+    }
+
+    /**
+     * Offer rows [begin, end) to top, one cache-sized block at a time; with
+     * a filter, only its rows (blocks without any are skipped). Returns
+     * how many rows were scored.
+     */
+    size_t scan_range(const PreparedQuery& q, size_t begin, size_t end, const IdFilter* filter,
+                      TopK& top) const {
+        if (abandons()) {
+            return abandon_scan(q.query, begin, end, filter, [&]() { return top.threshold(); },
+                         [&](float dist, int id) {
+                             if (dist < top.threshold()) {
+                                 top.push(dist, id);
+                             }
+                         });
+        }
+        float block[kScanBlock];
+        size_t scored = 0;
+        for (size_t start = begin; start < end; start += kScanBlock) {
+            size_t count = std::min(kScanBlock, end - start);
+            if (filter && !filter->any(start, start + count)) {
+                continue;
+            }
+            score_block(q, start, count, block);
+            scored += count;
+            if (!filter) {
+                top.push_block(block, count, static_cast<int>(start));
+                continue;
+            }
+            for (size_t j = 0; j < count; ++j) {
+                int id = static_cast<int>(start + j);
+                if (block[j] < top.threshold() && filter->allows(id)) {
+                    top.push(block[j], id);
+                }
+            }
+        }
+        return scored;
+    }
+
+    /**
+     * Offer just the rows filter allows, scored by id (for filters too
+     * selective to be worth streaming every block).
+     */
+    void scan_allowed(const PreparedQuery& q, const IdFilter& filter, TopK& top,
+                      std::vector<int>& allowed) const {
+        filter.collect(allowed);
+        allowed.erase(std::lower_bound(allowed.begin(), allowed.end(), static_cast<int>(n_samples_)),
+                      allowed.end());
+        float block[kScanBlock];
+        for (size_t start = 0; start < allowed.size(); start += kScanBlock) {
+            size_t count = std::min(kScanBlock, allowed.size() - start);
+            const int* ids = allowed.data() + start;
+            if (stored_bits_ == 32) {
+                scan_ids_(q.query, rows_.data(), ids, count, rows_.stride(), dimension_, block);
+            }
+            for (size_t j = 0; j < count; ++j) {
+                size_t row = static_cast<size_t>(ids[j]);
+                if (stored_bits_ == 16) {
+                    f16_scan_(q.query, &codes_f16_[row * dimension_], 1, dimension_, dimension_,
+                              &block[j]);
+                } else if (stored_bits_ == 8) {
+                    int32_t dot;
+                    u8_dot_scan_(q.sq->codes.data(), &codes_u8_[row * dimension_], 1, dimension_,
+                                 dimension_, &dot);
+                    score_sq_block(*q.sq, q.norm, row, 1, &dot, &block[j]);
+                } else if (stored_bits_ == 1) {
+                    uint32_t hamming;
+                    hamming_scan_(q.bits, &codes_bin_[row * bq_.words()], 1, bq_.words(), &hamming);
+                    block[j] = static_cast<float>(hamming);
+                } else if (!inv_norms_.empty()) {
+                    rescale_borrowed(&block[j], 1, row);
+                }
+            }
+            top.push_block(block, count, ids);
+        }
+    }
+
+    /**
+     * Threads one query() scan is split over: query_threads, capped so each
+     * shard has at least kMinShardRows rows; 1 when already inside a
+     * parallel region (e.g. batch_query) so cores are not oversubscribed.
+     */
+    int query_shards() const {
+#ifdef _OPENMP
+        if (query_threads_ <= 1 || omp_in_parallel()) {
+            return 1;
+        }
+        size_t max_shards = std::max<size_t>(1, n_samples_ / kMinShardRows);
+        return static_cast<int>(std::min<size_t>(query_threads_, max_shards));
+#else
+        return 1;
+#endif
+    }
+
+    /**
+     * out[i * ld + j] = queries_i · rows_j for a query tile and a row tile
+     * (rows_.stride() floats apart).
+     */
+    void compute_dot_tile(const float* queries, size_t nq, const float* rows, size_t nr,
+                          float* out, size_t ld) const {
+#ifdef ANN_HAVE_BLAS
+        // Row-major out (nq x nr) is column-major (nr x nq) = rows^T * queries
+        const int m = static_cast<int>(nr);
+        const int n = static_cast<int>(nq);
+        const int kdim = dimension_;
+        const int lda = static_cast<int>(rows_.stride());
+        const int ldc = static_cast<int>(ld);
+        const float alpha = 1.0f;
+        const float beta = 0.0f;
+        sgemm_("T", "N", &m, &n, &kdim, &alpha, rows, &lda, queries, &kdim, &beta, out, &ldc);
+#else
+        distance_kernels().dot_tile(queries, nq, rows, nr, rows_.stride(), dimension_, out, ld);
+#endif
+    }
+
     /**
-     * Compute distance between two vectors.
-     * 
-     * TODO for VectorDBKernel implementation:
-     * 1. Vectorize with SIMD intrinsics (_mm256_*)
-     * 2. Use FMA instructions if available
-     * 3. Consider loop unrolling
-     */
-    float compute_distance(const float* a, const float* b) const {
-        if (metric_ == "euclidean") {
-            return euclidean_distance(a, b);
-        } else { // angular (cosine)
-            return angular_distance(a, b);
-        }
-    }
-    
-    float euclidean_distance(const float* a, const float* b) const {
-        float sum = 0.0f;
-        
-        // TODO: Optimize with AVX2
-        // __m256 vec_sum = _mm256_setzero_ps();
-        // for (int i = 0; i < dimension_; i += 8) {
-        //     __m256 va = _mm256_loadu_ps(&a[i]);
-        //     __m256 vb = _mm256_loadu_ps(&b[i]);
-        //     __m256 diff = _mm256_sub_ps(va, vb);
-        //     vec_sum = _mm256_fmadd_ps(diff, diff, vec_sum);
-        // }
-        
-        for (int i = 0; i < dimension_; ++i) {
-            float diff = a[i] - b[i];
-            sum += diff * diff;
-        }
-        
-        return std::sqrt(sum);
-    }
-    
-    float angular_distance(const float* a, const float* b) const {
-        // Cosine similarity: 1 - (a·b) / (|a||b|)
-        float dot = 0.0f;
-        float norm_a = 0.0f;
-        float norm_b = 0.0f;
-        
-        // TODO: Optimize with SIMD
-        for (int i = 0; i < dimension_; ++i) {
-            dot += a[i] * b[i];
-            norm_a += a[i] * a[i];
-            norm_b += b[i] * b[i];
-        }
-        
-        return 1.0f - (dot / (std::sqrt(norm_a) * std::sqrt(norm_b)));
-    }
-
-    std::vector<float> data_;
+     * Copy (or borrow) the rows, then build the configured storage.
+     */
+    void build(const float* data, size_t n_samples, bool borrow) {
+        reset_storage();
+        n_samples_ = n_samples;
+
+        // Rows the encoders read (source_stride floats apart): unit vectors
+        // for angular
+        const float* source = nullptr;
+        size_t source_stride = dimension_;
+        std::vector<float> normalized;
+
+        if (borrow) {
+            rows_.borrow(data, n_samples_, dimension_);
+            source = data;
+            if (metric_type_ == Metric::Angular) {
+                // The caller's rows cannot be normalized in place; keep
+                // 1 / ||x|| instead and rescale scores (rescale_borrowed),
+                // also for compressed storage, where rerank may be raised
+                // after fit() and range_search() reads the rows
+                inv_norms_.resize(n_samples_);
+                DistanceFunc inner_product = distance_kernels().inner_product;
+                #pragma omp parallel for schedule(static)
+                for (long long i = 0; i < static_cast<long long>(n_samples_); ++i) {
+                    const float* row = data + i * dimension_;
+                    float norm_sqr = inner_product(row, row, dimension_);
+                    inv_norms_[i] = norm_sqr > 0.0f ? 1.0f / std::sqrt(norm_sqr) : 0.0f;
+                }
+            }
+            if (metric_type_ == Metric::Angular && stored_bits_ != 32) {
+                // Encoders still need unit vectors (temporary copy)
+                normalized.assign(data, data + n_samples_ * dimension_);
+                normalize_rows(normalized.data(), n_samples_, dimension_);
+                source = normalized.data();
+            }
+        } else {
+            // Copy data into the aligned, padded arena
+            rows_.assign(data, n_samples_, dimension_);
+
+            // Angular: store unit vectors so scoring is a single inner product
+            if (metric_type_ == Metric::Angular) {
+                normalize_rows(rows_.data(), n_samples_, rows_.stride(), dimension_);
+            }
+            source = rows_.data();
+            source_stride = rows_.stride();
+        }
+
+        encode_rows(source, source_stride, borrow);
+    }
+
+    /**
+     * Drop every stored row and code, ahead of a new build.
+     */
+    void reset_storage() {
+        n_samples_ = 0;
+        rows_.clear();
+        inv_norms_.clear();
+        codes_f16_.clear();
+        codes_u8_.clear();
+        codes_bin_.clear();
+        norms_.clear();
+        dim_order_.clear();
+        stored_bits_ = storage_bits_;
+    }
+
+    /**
+     * Build the configured storage from the n_samples_ rows in rows_ (or at
+     * source, unit length for angular, source_stride floats apart).
+     */
+    void encode_rows(const float* source, size_t source_stride, bool borrow) {
+        size_t n_values = n_samples_ * dimension_;
+        if (stored_bits_ == 32 && metric_type_ == Metric::Euclidean && reorder_dims_ && !borrow) {
+            reorder_dimensions();
+        }
+        if (stored_bits_ == 32 && metric_type_ == Metric::Euclidean) {
+            norms_.resize(n_samples_);
+            DistanceFunc inner_product = distance_kernels().inner_product;
+            #pragma omp parallel for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(n_samples_); ++i) {
+                const float* row = rows_.row(i);
+                norms_[i] = inner_product(row, row, dimension_);
+            }
+        } else if (stored_bits_ == 16) {
+            codes_f16_.resize(n_values);
+            #pragma omp parallel for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(n_samples_); ++i) {
+                const float* row = source + i * source_stride;
+                uint16_t* code = &codes_f16_[i * dimension_];
+                for (int d = 0; d < dimension_; ++d) {
+                    code[d] = float_to_half(row[d]);
+                }
+            }
+        } else if (stored_bits_ == 8) {
+            sq_.train(source, n_samples_, dimension_, source_stride);
+            codes_u8_.resize(n_values);
+            sq_.encode(source, n_samples_, codes_u8_.data(), source_stride);
+            if (metric_type_ == Metric::Euclidean) {
+                norms_.resize(n_samples_);
+                sq_.decoded_norms(codes_u8_.data(), n_samples_, norms_.data());
+            }
+        } else if (stored_bits_ == 1) {
+            bq_.train(source, n_samples_, dimension_, source_stride);
+            codes_bin_.resize(n_samples_ * bq_.words());
+            bq_.encode(source, n_samples_, codes_bin_.data(), source_stride);
+        }
+
+        // Compressed storage only keeps its own fp32 rows for re-ranking
+        // (borrowed rows cost nothing and stay available)
+        if (stored_bits_ != 32 && rerank_ == 0 && !borrow) {
+            rows_.clear();
+        }
+    }
+
+    /**
+     * Borrowed angular rows are not unit length: turn the scan's 1 - q·x
+     * into 1 - q·x / ||x|| for rows start .. start + count.
+     */
+    void rescale_borrowed(float* dists, size_t count, size_t start) const {
+        for (size_t j = 0; j < count; ++j) {
+            dists[j] = 1.0f - (1.0f - dists[j]) * inv_norms_[start + j];
+        }
+    }
+
+    /**
+     * Turn int8 dot products into distances:
+     * euclidean ||q||^2 - 2 q · x~ + ||x~||^2, angular 1 - q · x~.
+     */
+    void score_sq_block(const ScalarQuantizer::EncodedQuery& encoded, float query_norm,
+                        size_t start, size_t count, const int32_t* dots, float* out) const {
+        for (size_t j = 0; j < count; ++j) {
+            float ip = encoded.bias + encoded.scale * static_cast<float>(dots[j]);
+            out[j] = metric_type_ == Metric::Euclidean
+                ? query_norm + norms_[start + j] - 2.0f * ip
+                : 1.0f - ip;
+        }
+    }
+
+    // Parameters
+    int storage_bits_ = 32;
+    int rerank_ = 0;
+    int query_threads_ = 0;
+    int early_abandon_ = -1;
+    bool reorder_dims_ = true;
+
+    Metric metric_type_ = Metric::Euclidean;
+    ScanFunc scan_ = nullptr;
+    ScanIdsFunc scan_ids_ = nullptr;
+    F16ScanFunc f16_scan_ = nullptr;
+    U8DotScanFunc u8_dot_scan_ = nullptr;
+    HammingScanFunc hamming_scan_ = nullptr;
+    ScanFunc head_scan_ = nullptr;     // euclidean, first kAbandonHeadDims dimensions
+
+    int stored_bits_ = 32;             // storage_bits_ at fit() time
+    VectorStore rows_;                 // fp32 rows (storage or re-rank), owned or borrowed
+    std::vector<float> inv_norms_;     // borrowed angular rows: 1 / ||x||
+    std::vector<uint16_t> codes_f16_;  // storage_bits = 16
+    std::vector<uint8_t> codes_u8_;    // storage_bits = 8
+    std::vector<uint64_t> codes_bin_;  // storage_bits = 1, bq_.words() per row
+    std::vector<float> norms_;         // euclidean, 32 / 8 bits: ||x||^2 (decoded for int8)
+    std::vector<int> dim_order_;       // reorder_dims: original dimension stored at each slot
+    ScalarQuantizer sq_;
+    BinaryQuantizer bq_;
     size_t n_samples_ = 0;
 };
 
@@ -2,12 +2,42 @@
 #include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include "../include/ann_interface.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include "../include/perf_counters.hpp"
+#include "../include/query_server.hpp"
+#include "../include/registry.hpp"
 
 namespace py = pybind11;
 
-// Forward declarations for factory functions
-extern "C" ANNAlgorithm* create_vectordb_kernel();
-extern "C" ANNAlgorithm* create_naive_algorithm();
+/**
+ * Pointer into a caller-provided result array, after checking that it is a
+ * writable C-contiguous (rows, cols) array of T.
+ */
+template <typename T>
+static T* output_buffer(py::array& out, size_t rows, size_t cols, const char* what) {
+    if (!out.dtype().is(py::dtype::of<T>()) || !(out.flags() & py::array::c_style) ||
+        !out.writeable() || out.ndim() != 2 ||
+        static_cast<size_t>(out.shape(0)) != rows || static_cast<size_t>(out.shape(1)) != cols) {
+        throw std::runtime_error(std::string(what) + " must be a writable C-contiguous " +
+                                 py::str(py::dtype::of<T>()).cast<std::string>() + " array of shape (" +
+                                 std::to_string(rows) + ", " + std::to_string(cols) + ")");
+    }
+    return static_cast<T*>(out.mutable_data());
+}
+
+/**
+ * labels as a 1-D int32 array of n entries (n = 0: any length).
+ */
+static py::array_t<int, py::array::c_style | py::array::forcecast> label_array(py::object labels,
+                                                                              size_t n) {
+    py::array_t<int, py::array::c_style | py::array::forcecast> array(labels);
+    if (array.ndim() != 1 || (n > 0 && static_cast<size_t>(array.shape(0)) != n)) {
+        throw std::runtime_error("labels must be a 1D array with one label per vector" +
+                                 (n > 0 ? " (" + std::to_string(n) + ")" : std::string()));
+    }
+    return array;
+}
 
 /**
  * Python wrapper for C++ ANNAlgorithm.
@@ -16,13 +46,7 @@ extern "C" ANNAlgorithm* create_naive_algorithm();
 class PyANNWrapper {
 public:
     PyANNWrapper(const std::string& impl_type, const std::string& metric) {
-        if (impl_type == "naive") {
-            algo_ = create_naive_algorithm();
-        } else if (impl_type == "vectordb") {
-            algo_ = create_vectordb_kernel();
-        } else {
-            throw std::runtime_error("Unknown implementation: " + impl_type);
-        }
+        algo_ = create_algorithm(impl_type);
         metric_ = metric;
     }
 
@@ -30,31 +54,171 @@ public:
         delete algo_;
     }
 
-    void fit(py::array_t<float> X) {
+    void fit(py::array X, bool borrow, py::object labels) {
+        fit_vectors(X, borrow);
+        algo_->clear_labels();
+        if (!labels.is_none()) {
+            auto array = label_array(labels, X.shape(0));
+            algo_->set_labels(array.data(), array.shape(0));
+        }
+    }
+
+    void fit_vectors(py::array X, bool borrow) {
+        if (!borrow) {
+            // Converts any dtype / layout; the index keeps its own copy
+            py::array_t<float, py::array::c_style | py::array::forcecast> data(X);
+            py::buffer_info buf = data.request();
+
+            if (buf.ndim != 2) {
+                throw std::runtime_error("Input must be 2D array (n_samples, dimension)");
+            }
+
+            size_t n_samples = buf.shape[0];
+            int dimension = buf.shape[1];
+
+            algo_->init(metric_, dimension);
+            algo_->fit(static_cast<float*>(buf.ptr), n_samples);
+            dimension_ = dimension;
+            borrowed_ = py::none();
+            return;
+        }
+
+        // Borrow: scan the caller's buffer in place, so it must already be
+        // exactly what the kernels expect (a converted temporary would die)
+        if (!X.dtype().is(py::dtype::of<float>()) || !(X.flags() & py::array::c_style)) {
+            throw std::runtime_error("fit(borrow=True) requires a C-contiguous float32 array");
+        }
+        if (X.ndim() != 2) {
+            throw std::runtime_error("Input must be 2D array (n_samples, dimension)");
+        }
+
+        size_t n_samples = X.shape(0);
+        int dimension = X.shape(1);
+
+        algo_->init(metric_, dimension);
+        algo_->fit_borrowed(static_cast<const float*>(X.data()), n_samples);
+        dimension_ = dimension;
+        borrowed_ = X;  // keeps the buffer alive for the index
+    }
+
+    void fit_begin(int dimension, size_t n_total) {
+        algo_->init(metric_, dimension);
+        algo_->fit_begin(n_total);
+        algo_->clear_labels();
+        dimension_ = dimension;
+        borrowed_ = py::none();
+    }
+
+    void fit_chunk(py::array_t<float, py::array::c_style | py::array::forcecast> X) {
         py::buffer_info buf = X.request();
-        
+
         if (buf.ndim != 2) {
             throw std::runtime_error("Input must be 2D array (n_samples, dimension)");
         }
-        
+        if (dimension_ < 0) {
+            throw std::runtime_error("fit_chunk() requires fit_begin() first");
+        }
+        if (buf.shape[1] != dimension_) {
+            throw std::runtime_error("fit_chunk() vectors must have dimension " + std::to_string(dimension_));
+        }
+
         size_t n_samples = buf.shape[0];
-        int dimension = buf.shape[1];
-        
-        algo_->init(metric_, dimension);
-        algo_->fit(static_cast<float*>(buf.ptr), n_samples);
+        // The loader can read the next chunk meanwhile
+        py::gil_scoped_release release;
+        algo_->fit_chunk(static_cast<float*>(buf.ptr), n_samples);
     }
 
-    std::vector<int> query(py::array_t<float> v, int k) {
+    void fit_end() {
+        py::gil_scoped_release release;
+        algo_->fit_end();
+    }
+
+    void add(py::array_t<float, py::array::c_style | py::array::forcecast> X, py::object labels) {
+        py::buffer_info buf = X.request();
+
+        if (buf.ndim != 2) {
+            throw std::runtime_error("Input must be 2D array (n_samples, dimension)");
+        }
+
+        if (dimension_ < 0) {
+            throw std::runtime_error("add() requires fit() or load() first");
+        }
+        if (buf.shape[1] != dimension_) {
+            throw std::runtime_error("add() vectors must have dimension " + std::to_string(dimension_));
+        }
+
+        size_t n_samples = buf.shape[0];
+        // The new ids' labels are in place before queries can return them;
+        // an unlabeled index stays unlabeled, a labeled one gets -1
+        size_t first = algo_->labels().size();
+        if (!labels.is_none()) {
+            if (first == 0) {
+                throw std::runtime_error("add(labels=...) requires labels for the existing vectors "
+                                         "(fit(labels=...) or set_labels())");
+            }
+            auto array = label_array(labels, n_samples);
+            algo_->set_labels(array.data(), n_samples, first);
+        } else if (first > 0) {
+            std::vector<int> unlabeled(n_samples, -1);
+            algo_->set_labels(unlabeled.data(), n_samples, first);
+        }
+
+        try {
+            // Queries from other Python threads keep running during the insert
+            py::gil_scoped_release release;
+            algo_->add(static_cast<float*>(buf.ptr), n_samples);
+        } catch (...) {
+            if (first > 0) {
+                std::vector<int> kept(algo_->labels().begin(), algo_->labels().begin() + first);
+                algo_->clear_labels();
+                algo_->set_labels(kept.data(), first);
+            }
+            throw;
+        }
+    }
+
+    void set_labels(py::object labels) {
+        auto array = label_array(labels, 0);
+        algo_->clear_labels();
+        algo_->set_labels(array.data(), array.shape(0));
+    }
+
+    void remove(const std::vector<int>& ids) {
+        algo_->remove(ids);
+    }
+
+    void compact() {
+        py::gil_scoped_release release;
+        algo_->compact();
+    }
+
+    std::vector<int> query(py::array_t<float, py::array::c_style | py::array::forcecast> v, int k,
+                           py::object filter, py::object labels, py::object label_bits) {
         py::buffer_info buf = v.request();
         
         if (buf.ndim != 1) {
             throw std::runtime_error("Query must be 1D array (dimension,)");
         }
         
+        IdFilter id_filter;
+        if (make_filter(filter, labels, label_bits, id_filter)) {
+            std::vector<int> ids(k > 0 ? k : 0);
+            {
+                py::gil_scoped_release release;
+                algo_->search_filtered(static_cast<float*>(buf.ptr), k, id_filter, ids.data(), nullptr);
+            }
+            ids.erase(std::find(ids.begin(), ids.end(), -1), ids.end());
+            return ids;
+        }
+
+        // v keeps the buffer alive; other Python threads may run meanwhile
+        py::gil_scoped_release release;
         return algo_->query(static_cast<float*>(buf.ptr), k);
     }
 
-    std::vector<std::vector<int>> batch_query(py::array_t<float> X, int k) {
+    std::vector<std::vector<int>> batch_query(
+            py::array_t<float, py::array::c_style | py::array::forcecast> X, int k,
+            int num_threads, py::object filter, py::object labels, py::object label_bits) {
         py::buffer_info buf = X.request();
         
         if (buf.ndim != 2) {
@@ -62,20 +226,401 @@ public:
         }
         
         size_t n_queries = buf.shape[0];
-        return algo_->batch_query(static_cast<float*>(buf.ptr), n_queries, k);
+        IdFilter id_filter;
+        if (make_filter(filter, labels, label_bits, id_filter)) {
+            std::vector<std::vector<int>> results(n_queries);
+            if (k <= 0) {
+                return results;
+            }
+            std::vector<int> ids(n_queries * k);
+            py::gil_scoped_release release;
+            algo_->batch_search_filtered(static_cast<float*>(buf.ptr), n_queries, k, id_filter,
+                                         ids.data(), nullptr, num_threads);
+            for (size_t i = 0; i < n_queries; ++i) {
+                auto row = ids.begin() + i * k;
+                results[i].assign(row, std::find(row, row + k, -1));
+            }
+            return results;
+        }
+
+        py::gil_scoped_release release;
+        return algo_->batch_query(static_cast<float*>(buf.ptr), n_queries, k, num_threads);
+    }
+
+    void batch_query_into(py::array_t<float, py::array::c_style | py::array::forcecast> X, int k,
+                          py::array ids, py::object distances, int num_threads,
+                          py::object filter, py::object labels, py::object label_bits) {
+        py::buffer_info buf = X.request();
+
+        if (buf.ndim != 2) {
+            throw std::runtime_error("Queries must be 2D array (n_queries, dimension)");
+        }
+
+        size_t n_queries = buf.shape[0];
+        int32_t* id_out = output_buffer<int32_t>(ids, n_queries, k, "ids");
+        float* dist_out = nullptr;
+        py::array dist_array;
+        if (!distances.is_none()) {
+            if (!py::isinstance<py::array>(distances)) {
+                throw std::runtime_error("distances must be a numpy array or None");
+            }
+            dist_array = distances.cast<py::array>();
+            dist_out = output_buffer<float>(dist_array, n_queries, k, "distances");
+        }
+
+        IdFilter id_filter;
+        bool filtered = make_filter(filter, labels, label_bits, id_filter);
+        py::gil_scoped_release release;
+        if (filtered) {
+            algo_->batch_search_filtered(static_cast<float*>(buf.ptr), n_queries, k, id_filter,
+                                         id_out, dist_out, num_threads);
+        } else {
+            algo_->batch_search(static_cast<float*>(buf.ptr), n_queries, k, id_out, dist_out,
+                                num_threads);
+        }
+    }
+
+    py::tuple batch_search(py::array_t<float, py::array::c_style | py::array::forcecast> X, int k,
+                           int num_threads, py::object filter, py::object labels,
+                           py::object label_bits) {
+        py::buffer_info buf = X.request();
+
+        if (buf.ndim != 2) {
+            throw std::runtime_error("Queries must be 2D array (n_queries, dimension)");
+        }
+
+        size_t n_queries = buf.shape[0];
+        py::array_t<int32_t> ids({n_queries, static_cast<size_t>(k)});
+        py::array_t<float> distances({n_queries, static_cast<size_t>(k)});
+        int32_t* id_out = ids.mutable_data();
+        float* dist_out = distances.mutable_data();
+        IdFilter id_filter;
+        bool filtered = make_filter(filter, labels, label_bits, id_filter);
+        {
+            py::gil_scoped_release release;
+            if (filtered) {
+                algo_->batch_search_filtered(static_cast<float*>(buf.ptr), n_queries, k, id_filter,
+                                             id_out, dist_out, num_threads);
+            } else {
+                algo_->batch_search(static_cast<float*>(buf.ptr), n_queries, k, id_out, dist_out,
+                                    num_threads);
+            }
+        }
+        return py::make_tuple(ids, distances);
+    }
+
+    py::tuple range_query(py::array_t<float, py::array::c_style | py::array::forcecast> v,
+                          float radius) {
+        py::buffer_info buf = v.request();
+
+        if (buf.ndim != 1) {
+            throw std::runtime_error("Query must be 1D array (dimension,)");
+        }
+
+        std::vector<int> ids;
+        std::vector<float> distances;
+        {
+            py::gil_scoped_release release;
+            algo_->range_search(static_cast<float*>(buf.ptr), radius, ids, distances);
+        }
+        return py::make_tuple(py::array_t<int32_t>(ids.size(), ids.data()),
+                              py::array_t<float>(distances.size(), distances.data()));
+    }
+
+    py::tuple batch_range_query(py::array_t<float, py::array::c_style | py::array::forcecast> X,
+                                float radius, int num_threads) {
+        py::buffer_info buf = X.request();
+
+        if (buf.ndim != 2) {
+            throw std::runtime_error("Queries must be 2D array (n_queries, dimension)");
+        }
+
+        size_t n_queries = buf.shape[0];
+        std::vector<size_t> offsets;
+        std::vector<int> ids;
+        std::vector<float> distances;
+        {
+            py::gil_scoped_release release;
+            algo_->batch_range_search(static_cast<float*>(buf.ptr), n_queries, radius, offsets, ids,
+                                      distances, num_threads);
+        }
+        std::vector<int64_t> offsets64(offsets.begin(), offsets.end());
+        return py::make_tuple(py::array_t<int64_t>(offsets64.size(), offsets64.data()),
+                              py::array_t<int32_t>(ids.size(), ids.data()),
+                              py::array_t<float>(distances.size(), distances.data()));
+    }
+
+    void save(const std::string& path) const {
+        algo_->save(path);
+    }
+
+    void load(const std::string& path) {
+        std::shared_ptr<IndexFile> file = IndexFile::open(path);
+        std::string metric = file->metric();
+        if (metric != metric_) {
+            throw std::runtime_error("Index file " + path + " was built for metric '" + metric +
+                                     "', not '" + metric_ + "'");
+        }
+        algo_->load(path);
+        dimension_ = file->dimension();
+        borrowed_ = py::none();  // the loaded index no longer references X
+    }
+
+    void set_param(const std::string& name, double value) {
+        algo_->set_param(name, value);
+    }
+
+    void set_params(py::dict params) {
+        for (auto item : params) {
+            algo_->set_param(item.first.cast<std::string>(), item.second.cast<double>());
+        }
+    }
+
+    std::map<std::string, double> get_params() const {
+        return algo_->get_params();
+    }
+
+    std::map<std::string, double> get_stats() const {
+        return algo_->get_stats();
+    }
+
+    void reset_stats() {
+        algo_->reset_stats();
+    }
+
+    py::dict profile_batch_search(py::array_t<float, py::array::c_style | py::array::forcecast> X,
+                                  int k, int num_threads) {
+        py::buffer_info buf = X.request();
+
+        if (buf.ndim != 2) {
+            throw std::runtime_error("Queries must be 2D array (n_queries, dimension)");
+        }
+        if (k <= 0) {
+            throw std::runtime_error("k must be positive");
+        }
+
+        size_t n_queries = buf.shape[0];
+        std::vector<int32_t> ids(n_queries * k);
+        std::vector<float> distances(n_queries * k);
+        PerfCounts counts;
+        {
+            py::gil_scoped_release release;
+            counts = perf_measure(num_threads, [&]() {
+                algo_->batch_search(static_cast<float*>(buf.ptr), n_queries, k, ids.data(),
+                                    distances.data(), num_threads);
+            });
+        }
+        py::dict out;
+        out["queries"] = n_queries;
+        out["seconds"] = counts.seconds;
+        out["available"] = counts.available;
+        if (counts.available) {
+            out["cycles"] = counts.cycles;
+            out["instructions"] = counts.instructions;
+            out["llc_misses"] = counts.llc_misses;
+        } else {
+            out["error"] = counts.error;
+        }
+        return out;
     }
 
     size_t get_memory_usage() const {
         return algo_->get_memory_usage();
     }
 
+    size_t get_disk_usage() const {
+        return algo_->get_disk_usage();
+    }
+
     std::string name() const {
         return algo_->name();
     }
 
+    ANNAlgorithm* algorithm() const {
+        return algo_;
+    }
+
+    int dimension() const {
+        return dimension_;
+    }
+
 private:
+    /**
+     * The filter given by the query keyword arguments, if any: filter is a
+     * mask over ids (nonzero = may be returned), labels a list of accepted
+     * labels, label_bits a bitmask the label must share a bit with. Built
+     * once per call (with the GIL held) and shared by all its queries.
+     */
+    bool make_filter(py::object filter, py::object labels, py::object label_bits,
+                     IdFilter& out) const {
+        int given = !filter.is_none() + !labels.is_none() + !label_bits.is_none();
+        if (given == 0) {
+            return false;
+        }
+        if (given > 1) {
+            throw std::runtime_error("pass only one of filter, labels and label_bits");
+        }
+        if (!filter.is_none()) {
+            py::array_t<uint8_t, py::array::c_style | py::array::forcecast> mask(filter);
+            if (mask.ndim() != 1) {
+                throw std::runtime_error("filter must be a 1D mask with one entry per id");
+            }
+            out = IdFilter::from_mask(mask.data(), mask.shape(0));
+            return true;
+        }
+        if (algo_->labels().empty()) {
+            throw std::runtime_error("label filters require labels (fit(labels=...) or set_labels())");
+        }
+        if (!labels.is_none()) {
+            out = algo_->label_filter(labels.cast<std::vector<int>>());
+        } else {
+            out = algo_->label_bits_filter(label_bits.cast<uint32_t>());
+        }
+        return true;
+    }
+
     ANNAlgorithm* algo_ = nullptr;
     std::string metric_;
+    int dimension_ = -1;  // set by fit() / load()
+    py::object borrowed_ = py::none();  // training array referenced by fit(borrow=True)
+};
+
+/**
+ * (ids, distances) arrays for one QueryResult; needs the GIL.
+ */
+static py::tuple result_arrays(const QueryResult& result) {
+    return py::make_tuple(py::array_t<int32_t>(result.ids.size(), result.ids.data()),
+                          py::array_t<float>(result.distances.size(), result.distances.data()));
+}
+
+/**
+ * Python wrapper for QueryServer: submit() returns an asyncio future,
+ * query() blocks with the GIL released. Completions take the GIL only to
+ * hand the result to the event loop (call_soon_threadsafe).
+ */
+class PyQueryServer {
+public:
+    PyQueryServer(PyANNWrapper& index, size_t max_batch, double max_wait_us, int workers,
+                  int threads_per_batch, size_t queue_capacity) {
+        if (index.dimension() < 0) {
+            throw std::runtime_error("QueryServer requires fit() or load() first");
+        }
+        QueryServerParams params;
+        params.max_batch = max_batch;
+        params.max_wait_us = max_wait_us;
+        params.workers = workers;
+        params.threads_per_batch = threads_per_batch;
+        params.queue_capacity = queue_capacity;
+        dimension_ = index.dimension();
+        server_.reset(new QueryServer(index.algorithm(), dimension_, params));
+    }
+
+    ~PyQueryServer() {
+        close();
+    }
+
+    py::object submit(py::array_t<float, py::array::c_style | py::array::forcecast> v, int k) {
+        std::vector<float> query = checked_query(v);
+        py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+        // Held outside Python's reference tracking until the completion,
+        // which runs on a worker thread and drops it under the GIL
+        auto* pending = new PendingFuture{loop, loop.attr("create_future")()};
+        py::object future = pending->future;
+        try {
+            // A full queue makes submit() wait for the workers, whose
+            // completions take the GIL: it must not be held meanwhile
+            py::gil_scoped_release release;
+            server_->submit(query.data(), k, [pending](QueryResult&& result, std::exception_ptr error) {
+                py::gil_scoped_acquire gil;
+                std::unique_ptr<PendingFuture> owned(pending);
+                try {
+                    py::object value = py::none();
+                    py::object exception = py::none();
+                    if (error) {
+                        try {
+                            std::rethrow_exception(error);
+                        } catch (const std::exception& e) {
+                            exception = py::module_::import("builtins").attr("RuntimeError")(e.what());
+                        }
+                    } else {
+                        value = result_arrays(result);
+                    }
+                    owned->loop.attr("call_soon_threadsafe")(py::cpp_function(&settle),
+                                                             owned->future, value, exception);
+                } catch (py::error_already_set&) {
+                    // The loop is closed: nobody is left to await the result
+                }
+            });
+        } catch (...) {
+            // The GIL is held again here, as dropping the Python objects needs
+            delete pending;
+            throw;
+        }
+        return future;
+    }
+
+    py::tuple query(py::array_t<float, py::array::c_style | py::array::forcecast> v, int k) {
+        std::vector<float> query = checked_query(v);
+        QueryResult result;
+        {
+            py::gil_scoped_release release;
+            result = server_->submit(query.data(), k).get();
+        }
+        return result_arrays(result);
+    }
+
+    py::dict stats() const {
+        QueryServerStats stats = server_->stats();
+        py::dict out;
+        out["submitted"] = stats.submitted;
+        out["completed"] = stats.completed;
+        out["failed"] = stats.failed;
+        out["batches"] = stats.batches;
+        out["queue_depth"] = stats.queue_depth;
+        out["mean_batch_size"] = stats.mean_batch_size;
+        out["max_batch_size"] = stats.max_batch_size;
+        out["mean_wait_us"] = stats.mean_wait_us;
+        out["max_wait_us"] = stats.max_wait_us;
+        out["mean_latency_us"] = stats.mean_latency_us;
+        return out;
+    }
+
+    void close() {
+        // Completions need the GIL, so it must not be held while they drain
+        py::gil_scoped_release release;
+        server_->stop();
+    }
+
+private:
+    struct PendingFuture {
+        py::object loop;
+        py::object future;
+    };
+
+    static void settle(py::object future, py::object value, py::object exception) {
+        if (future.attr("done")().cast<bool>()) {
+            return;  // cancelled meanwhile
+        }
+        if (exception.is_none()) {
+            future.attr("set_result")(value);
+        } else {
+            future.attr("set_exception")(exception);
+        }
+    }
+
+    /**
+     * Validate v and copy it, under the GIL: once the GIL is released, other
+     * Python threads may write to the array.
+     */
+    std::vector<float> checked_query(const py::array_t<float, py::array::c_style | py::array::forcecast>& v) const {
+        if (v.ndim() != 1 || v.shape(0) != dimension_) {
+            throw std::runtime_error("Query must be 1D array of dimension " + std::to_string(dimension_));
+        }
+        return std::vector<float>(v.data(), v.data() + dimension_);
+    }
+
+    std::unique_ptr<QueryServer> server_;
+    int dimension_ = 0;
 };
 
 PYBIND11_MODULE(ann_cpp, m) {
@@ -87,33 +632,221 @@ PYBIND11_MODULE(ann_cpp, m) {
              py::arg("metric"),
              "Create ANN algorithm.\n\n"
              "Args:\n"
-             "    impl_type: 'naive' or 'vectordb'\n"
+             "    impl_type: 'naive', 'vectordb', 'hnsw', 'ivf', 'ivfpq' or 'diskann';\n"
+             "        'pca+<impl>' builds <impl> on PCA-reduced vectors (pca_dim,\n"
+             "        pca_rerank) and re-ranks on the full ones; 'shard+<impl>'\n"
+             "        splits the data into <impl> shards, one per NUMA node (shards)\n"
              "    metric: 'euclidean' or 'angular'")
         .def("fit", &PyANNWrapper::fit,
              py::arg("X"),
+             py::arg("borrow") = false,
+             py::arg("labels") = py::none(),
              "Build index from training data.\n\n"
              "Args:\n"
-             "    X: numpy array of shape (n_samples, dimension)")
+             "    X: numpy array of shape (n_samples, dimension)\n"
+             "    borrow: reference X instead of copying it (X must be C-contiguous\n"
+             "        float32 and must not be modified while the index uses it).\n"
+             "        Indexes that need their own layout still copy.\n"
+             "    labels: optional int array of shape (n_samples,) for label filters\n"
+             "        (query(labels=...) / query(label_bits=...)); saved with the index")
+        .def("fit_begin", &PyANNWrapper::fit_begin,
+             py::arg("dimension"),
+             py::arg("n_total") = 0,
+             "Start building the index from chunks (fit_chunk(), then fit_end()).\n\n"
+             "For training sets too large to hold in memory next to the index;\n"
+             "see python.dataset_loader for chunk readers.\n\n"
+             "Args:\n"
+             "    dimension: vector dimension\n"
+             "    n_total: rows that will be streamed, if known (0 = unknown); lets\n"
+             "        the index size its storage and parameters up front")
+        .def("fit_chunk", &PyANNWrapper::fit_chunk,
+             py::arg("X"),
+             "Add the next chunk of training vectors (n_chunk, dimension).\n\n"
+             "Rows get ids in arrival order; the chunk may be freed afterwards.")
+        .def("fit_end", &PyANNWrapper::fit_end,
+             "Finish a streamed build; the index can be queried afterwards.")
+        .def("add", &PyANNWrapper::add,
+             py::arg("X"),
+             py::arg("labels") = py::none(),
+             "Add vectors to a built index without rebuilding it.\n\n"
+             "They get the next ids (after the fit() rows and earlier adds). Safe to\n"
+             "call while other threads query (hnsw, ivf, ivfpq).\n\n"
+             "Args:\n"
+             "    X: numpy array of shape (n_vectors, dimension)\n"
+             "    labels: optional int array of shape (n_vectors,); the index must be\n"
+             "        labeled already. Unlabeled adds to a labeled index get label -1.")
+        .def("set_labels", &PyANNWrapper::set_labels,
+             py::arg("labels"),
+             "Replace the per-vector labels (int array, one per id) used by label\n"
+             "filters, e.g. after fit_end(). Not safe while other threads query.")
+        .def("remove", &PyANNWrapper::remove,
+             py::arg("ids"),
+             "Delete vectors by id (tombstones: excluded from results at once)")
+        .def("compact", &PyANNWrapper::compact,
+             "Fold added and deleted vectors into the index structure.\n\n"
+             "Runs alongside queries, e.g. from a background thread, and keeps\n"
+             "query cost from growing with the number of updates.")
         .def("query", &PyANNWrapper::query,
              py::arg("v"),
              py::arg("k"),
+             py::arg("filter") = py::none(),
+             py::arg("labels") = py::none(),
+             py::arg("label_bits") = py::none(),
              "Query for k nearest neighbors.\n\n"
              "Args:\n"
              "    v: numpy array of shape (dimension,)\n"
              "    k: number of neighbors\n"
+             "    filter: optional 1D bool / uint8 mask over ids; only ids with a\n"
+             "        nonzero entry are returned (ids past its end never are)\n"
+             "    labels: optional list of labels; only ids with one of them are returned\n"
+             "    label_bits: optional int; only ids whose label shares a bit with it\n"
+             "        are returned. At most one of filter / labels / label_bits.\n"
              "Returns:\n"
-             "    List of k indices")
+             "    List of k indices (fewer if a filter allows fewer)")
         .def("batch_query", &PyANNWrapper::batch_query,
              py::arg("X"),
              py::arg("k"),
-             "Batch query for k nearest neighbors.\n\n"
+             py::arg("num_threads") = 0,
+             py::arg("filter") = py::none(),
+             py::arg("labels") = py::none(),
+             py::arg("label_bits") = py::none(),
+             "Batch query for k nearest neighbors, parallel over queries.\n\n"
              "Args:\n"
              "    X: numpy array of shape (n_queries, dimension)\n"
              "    k: number of neighbors per query\n"
+             "    num_threads: threads for this call (0 = OMP_NUM_THREADS / all cores)\n"
+             "    filter, labels, label_bits: as for query(), applied to every query\n"
              "Returns:\n"
              "    List of lists of indices")
+        .def("batch_query_into", &PyANNWrapper::batch_query_into,
+             py::arg("X"),
+             py::arg("k"),
+             py::arg("ids"),
+             py::arg("distances") = py::none(),
+             py::arg("num_threads") = 0,
+             py::arg("filter") = py::none(),
+             py::arg("labels") = py::none(),
+             py::arg("label_bits") = py::none(),
+             "Batch query writing into preallocated arrays (no per-query objects).\n\n"
+             "Args:\n"
+             "    X: numpy array of shape (n_queries, dimension)\n"
+             "    k: number of neighbors per query\n"
+             "    ids: int32 array of shape (n_queries, k), C-contiguous; filled with\n"
+             "        neighbor ids, closest first, -1 where there are fewer than k\n"
+             "    distances: optional float32 array of the same shape; filled with the\n"
+             "        index's distances (squared L2 / 1 - cosine), +inf for padding\n"
+             "    num_threads: threads for this call (0 = OMP_NUM_THREADS / all cores)\n"
+             "    filter, labels, label_bits: as for query(), applied to every query")
+        .def("batch_search", &PyANNWrapper::batch_search,
+             py::arg("X"),
+             py::arg("k"),
+             py::arg("num_threads") = 0,
+             py::arg("filter") = py::none(),
+             py::arg("labels") = py::none(),
+             py::arg("label_bits") = py::none(),
+             "batch_query_into() with newly allocated arrays.\n\n"
+             "Returns:\n"
+             "    (ids, distances): int32 and float32 arrays of shape (n_queries, k)")
+        .def("range_query", &PyANNWrapper::range_query,
+             py::arg("v"),
+             py::arg("radius"),
+             "All neighbors within radius of one query.\n\n"
+             "Args:\n"
+             "    v: numpy array of shape (dimension,)\n"
+             "    radius: distance bound, in the units batch_search() reports\n"
+             "        (squared L2 / 1 - cosine); neighbors at distance <= radius\n"
+             "Returns:\n"
+             "    (ids, distances): int32 and float32 arrays, closest first")
+        .def("batch_range_query", &PyANNWrapper::batch_range_query,
+             py::arg("X"),
+             py::arg("radius"),
+             py::arg("num_threads") = 0,
+             "range_query() for many queries, parallel over queries, in CSR form.\n\n"
+             "Returns:\n"
+             "    (offsets, ids, distances): offsets is int64 of shape (n_queries + 1,);\n"
+             "    query i's neighbors are ids[offsets[i]:offsets[i + 1]] (int32) with\n"
+             "    distances[offsets[i]:offsets[i + 1]] (float32), closest first")
+        .def("save", &PyANNWrapper::save,
+             py::arg("path"),
+             "Save the built index (versioned binary format) for load()")
+        .def("load", &PyANNWrapper::load,
+             py::arg("path"),
+             "Load an index written by save() instead of calling fit().\n\n"
+             "Parameters come from the file; vectors and graph adjacency are\n"
+             "memory-mapped, so loading takes milliseconds. Raises if the file\n"
+             "holds another kind of index or another metric.")
+        .def("set_param", &PyANNWrapper::set_param,
+             py::arg("name"),
+             py::arg("value"),
+             "Set a build or query-time parameter.\n\n"
+             "Build parameters (e.g. M, ef_construction, nlist) must be set before fit();\n"
+             "query parameters (e.g. ef_search, nprobe) can change between queries.")
+        .def("set_params", &PyANNWrapper::set_params,
+             py::arg("params"),
+             "Set several parameters from a dict")
+        .def("get_params", &PyANNWrapper::get_params,
+             "Get current parameter values as a dict")
+        .def("get_stats", &PyANNWrapper::get_stats,
+             "Search work counted since the last reset_stats(), as a dict.\n\n"
+             "Totals over every query of every thread: queries, distances,\n"
+             "nodes_visited, lists_probed, reranked, heap_pushes, exact_scans\n"
+             "(per query: divide by queries). Empty if the module was built\n"
+             "with -DANN_STATS=OFF.")
+        .def("reset_stats", &PyANNWrapper::reset_stats,
+             "Zero the get_stats() counters")
+        .def("profile_batch_search", &PyANNWrapper::profile_batch_search,
+             py::arg("X"),
+             py::arg("k"),
+             py::arg("num_threads") = 0,
+             "batch_search() under hardware counters, for scripts/profile.py.\n\n"
+             "Returns:\n"
+             "    dict with queries, seconds and available; when available also\n"
+             "    cycles, instructions and llc_misses summed over the searching\n"
+             "    threads (perf_event_open, user space), else error saying why\n"
+             "    the counters could not be opened")
         .def("get_memory_usage", &PyANNWrapper::get_memory_usage,
              "Get memory usage in bytes")
+        .def("get_disk_usage", &PyANNWrapper::get_disk_usage,
+             "Get bytes kept on disk and read by queries (diskann; else 0)")
         .def("name", &PyANNWrapper::name,
              "Get algorithm name");
+
+    py::class_<PyQueryServer>(m, "QueryServer")
+        .def(py::init<PyANNWrapper&, size_t, double, int, int, size_t>(),
+             py::arg("index"),
+             py::arg("max_batch") = 64,
+             py::arg("max_wait_us") = 200.0,
+             py::arg("workers") = 1,
+             py::arg("threads_per_batch") = 0,
+             py::arg("queue_capacity") = 4096,
+             py::keep_alive<1, 2>(),
+             "Serve single queries from many callers as micro-batches.\n\n"
+             "Queries go through a lock-free queue to a dispatcher that batches\n"
+             "them (dispatching at max_batch queries or once the oldest has waited\n"
+             "max_wait_us) and runs each batch with batch_search() on one of\n"
+             "workers threads (threads_per_batch OpenMP threads each, 0 = share\n"
+             "all cores). The index must not be refit while the server runs.")
+        .def("submit", &PyQueryServer::submit,
+             py::arg("v"),
+             py::arg("k"),
+             "Queue one query from a running asyncio loop.\n\n"
+             "Returns:\n"
+             "    asyncio.Future resolving to (ids, distances): int32 / float32\n"
+             "    arrays, closest first. Await it: ids, d = await server.submit(v, 10)")
+        .def("query", &PyQueryServer::query,
+             py::arg("v"),
+             py::arg("k"),
+             "Queue one query and wait for it with the GIL released, so queries\n"
+             "from many Python threads are batched together.\n\n"
+             "Returns:\n"
+             "    (ids, distances): int32 and float32 arrays, closest first")
+        .def("stats", &PyQueryServer::stats,
+             "Counters: submitted, completed, failed, batches, queue_depth,\n"
+             "mean_batch_size, max_batch_size, mean_wait_us / max_wait_us (submit\n"
+             "to batch start) and mean_latency_us (submit to result)")
+        .def("close", &PyQueryServer::close,
+             "Stop accepting queries and answer the queued ones (also on deletion)");
+
+    m.def("simd_isa", []() { return std::string(distance_kernels().isa); },
+          "Instruction set selected for the distance kernels at load time");
 }
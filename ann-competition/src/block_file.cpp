@@ -0,0 +1,374 @@
+#include "../include/block_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ANN_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+static bool env_enabled(const char* name) {
+    const char* env = std::getenv(name);
+    return env == nullptr || std::strcmp(env, "0") != 0;
+}
+
+static std::string io_error(const std::string& what, const std::string& path) {
+    return "block file " + path + ": " + what + " (" + std::strerror(errno) + ")";
+}
+
+/**
+ * pread() until done; false on error or end of file.
+ */
+static bool pread_fully(int fd, void* buffer, size_t bytes, uint64_t offset) {
+    char* p = static_cast<char*>(buffer);
+    while (bytes > 0) {
+        ssize_t got = ::pread(fd, p, bytes, static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        p += got;
+        bytes -= static_cast<size_t>(got);
+        offset += static_cast<uint64_t>(got);
+    }
+    return true;
+}
+
+#ifdef ANN_HAVE_IO_URING
+
+/**
+ * Minimal io_uring: one submission / completion ring pair per thread,
+ * used synchronously (submit a batch, wait for all of it).
+ */
+class IoRing {
+public:
+    static constexpr unsigned kEntries = 64;
+
+    IoRing() {
+        if (!env_enabled("ANN_IO_URING")) {
+            return;
+        }
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, kEntries, &params));
+        if (fd < 0) {
+            return;  // not available: callers use pread()
+        }
+
+        sq_bytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_bytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        single_mmap_ = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap_) {
+            sq_bytes_ = cq_bytes_ = std::max(sq_bytes_, cq_bytes_);
+        }
+        sq_ring_ = ::mmap(nullptr, sq_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap_ ? sq_ring_
+                                : ::mmap(nullptr, cq_bytes_, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, sqes_bytes_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+            unmap(sqes);
+            ::close(fd);
+            return;
+        }
+
+        char* sq = static_cast<char*>(sq_ring_);
+        char* cq = static_cast<char*>(cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        fd_ = fd;
+    }
+
+    ~IoRing() {
+        if (fd_ >= 0) {
+            shutdown();
+        }
+    }
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    bool available() const { return fd_ >= 0; }
+
+    /**
+     * Perform the reads on file_fd. Reads the kernel rejects or cuts short
+     * are redone with pread(); returns false if any of those fail too.
+     *
+     * Should io_uring_enter() itself fail, the ring is drained and shut
+     * down and this thread continues with pread(), this batch included:
+     * no read may still be in flight into the caller's buffers once this
+     * returns, and no completion may be left for the next batch.
+     */
+    bool read(int file_fd, const BlockRead* reads, size_t n) {
+        bool ok = true;
+        size_t chunk = std::min<size_t>(sq_entries_, kEntries);
+        for (size_t begin = 0; begin < n; begin += chunk) {
+            unsigned count = static_cast<unsigned>(std::min(chunk, n - begin));
+            const BlockRead* batch = reads + begin;
+            if (!available()) {
+                // Shut down by an earlier chunk of this call
+                for (unsigned i = 0; i < count; ++i) {
+                    ok = pread_fully(file_fd, batch[i].buffer, batch[i].bytes, batch[i].offset) && ok;
+                }
+                continue;
+            }
+
+            // Sole producer: fill the slots after the tail, then publish
+            unsigned tail = *sq_tail_;
+            for (unsigned i = 0; i < count; ++i) {
+                const BlockRead& r = batch[i];
+                unsigned slot = (tail + i) & sq_mask_;
+                io_uring_sqe* sqe = &sqes_[slot];
+                std::memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = file_fd;
+                sqe->addr = reinterpret_cast<uint64_t>(r.buffer);
+                sqe->len = static_cast<unsigned>(r.bytes);
+                sqe->off = r.offset;
+                sqe->user_data = i;
+                sq_array_[slot] = slot;
+            }
+            __atomic_store_n(sq_tail_, tail + count, __ATOMIC_RELEASE);
+
+            bool reaped[kEntries] = {};
+            unsigned to_submit = count;
+            unsigned done = 0;
+            while (done < count) {
+                done += reap(file_fd, batch, reaped, ok);
+                if (done == count) {
+                    break;
+                }
+                if (enter(to_submit)) {
+                    continue;
+                }
+
+                // Ring unusable: withdraw the reads the kernel has not taken
+                // (it only reads the tail in io_uring_enter()), wait out the
+                // ones it has, and redo the rest with pread()
+                __atomic_store_n(sq_tail_, tail + count - to_submit, __ATOMIC_RELEASE);
+                unsigned in_flight = count - to_submit;
+                while (done < in_flight) {
+                    done += reap(file_fd, batch, reaped, ok);
+                    unsigned nothing = 0;
+                    if (done < in_flight && !enter(nothing)) {
+                        // Cannot even wait for them: report the batch failed
+                        // and stop using the ring
+                        shutdown();
+                        return false;
+                    }
+                }
+                shutdown();
+                for (unsigned i = 0; i < count; ++i) {
+                    if (!reaped[i]) {
+                        ok = pread_fully(file_fd, batch[i].buffer, batch[i].bytes, batch[i].offset) && ok;
+                    }
+                }
+                break;
+            }
+        }
+        return ok;
+    }
+
+private:
+    /**
+     * Submit the to_submit queued entries (decremented by what the kernel
+     * took) and wait for a completion. False on an error other than an
+     * interruption or a momentarily full completion queue.
+     */
+    bool enter(unsigned& to_submit) {
+        long rc = syscall(__NR_io_uring_enter, fd_, to_submit, 1u, IORING_ENTER_GETEVENTS,
+                          nullptr, 0);
+        if (rc < 0) {
+            return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+        }
+        to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(rc));
+        return true;
+    }
+
+    /**
+     * Consume the completions ready now, redoing failed or short reads with
+     * pread(); returns how many there were.
+     */
+    unsigned reap(int file_fd, const BlockRead* batch, bool* reaped, bool& ok) {
+        unsigned head = *cq_head_;
+        unsigned ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned count = ready - head;
+        for (; head != ready; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            const BlockRead& r = batch[cqe.user_data];
+            reaped[cqe.user_data] = true;
+            if (cqe.res != static_cast<int>(r.bytes)) {
+                ok = pread_fully(file_fd, r.buffer, r.bytes, r.offset) && ok;
+            }
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    /**
+     * Release the ring; available() is false from now on.
+     */
+    void shutdown() {
+        unmap(sqes_);
+        ::close(fd_);
+        fd_ = -1;
+        sq_ring_ = cq_ring_ = nullptr;
+        sqes_ = nullptr;
+    }
+
+    void unmap(void* sqes) {
+        if (sqes != nullptr && sqes != MAP_FAILED) {
+            ::munmap(sqes, sqes_bytes_);
+        }
+        if (cq_ring_ != nullptr && cq_ring_ != MAP_FAILED && !single_mmap_) {
+            ::munmap(cq_ring_, cq_bytes_);
+        }
+        if (sq_ring_ != nullptr && sq_ring_ != MAP_FAILED) {
+            ::munmap(sq_ring_, sq_bytes_);
+        }
+    }
+
+    int fd_ = -1;
+    bool single_mmap_ = false;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_bytes_ = 0;
+    size_t cq_bytes_ = 0;
+    size_t sqes_bytes_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+
+static IoRing& io_ring() {
+    thread_local IoRing ring;
+    return ring;
+}
+
+#endif  // ANN_HAVE_IO_URING
+
+BlockFile::~BlockFile() {
+    close();
+}
+
+void BlockFile::open(const std::string& path) {
+    close();
+    path_ = path;
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw std::runtime_error(io_error("cannot open", path));
+    }
+    enable_direct();
+}
+
+void BlockFile::create_temporary(const std::string& dir) {
+    close();
+    std::string pattern = dir + "/ann-blocks-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    fd_ = ::mkstemp(name.data());
+    if (fd_ < 0) {
+        throw std::runtime_error(io_error("cannot create a file in", dir));
+    }
+    ::unlink(name.data());
+    path_ = name.data();
+}
+
+void BlockFile::write(uint64_t offset, const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t written = ::pwrite(fd_, p, bytes, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(io_error("write failed", path_));
+        }
+        p += written;
+        bytes -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+}
+
+void BlockFile::enable_direct() {
+#ifdef O_DIRECT
+    if (fd_ >= 0 && !direct_ && env_enabled("ANN_DIRECT_IO")) {
+        int flags = ::fcntl(fd_, F_GETFL);
+        // Rejected (EINVAL) by filesystems without direct I/O
+        direct_ = flags >= 0 && ::fcntl(fd_, F_SETFL, flags | O_DIRECT) == 0;
+    }
+#endif
+}
+
+void BlockFile::read(const BlockRead* reads, size_t n) const {
+    bool ok = true;
+#ifdef ANN_HAVE_IO_URING
+    IoRing& ring = io_ring();
+    if (ring.available()) {
+        ok = ring.read(fd_, reads, n);
+    } else
+#endif
+    {
+        for (size_t i = 0; i < n; ++i) {
+            ok = pread_fully(fd_, reads[i].buffer, reads[i].bytes, reads[i].offset) && ok;
+        }
+    }
+    if (!ok) {
+        throw std::runtime_error(io_error("read failed", path_));
+    }
+}
+
+void BlockFile::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+    direct_ = false;
+}
+
+const char* BlockFile::backend() {
+#ifdef ANN_HAVE_IO_URING
+    if (io_ring().available()) {
+        return "io_uring";
+    }
+#endif
+    return "pread";
+}
+
+void* BlockFile::allocate(size_t bytes) {
+    size_t rounded = (bytes + kSectorBytes - 1) / kSectorBytes * kSectorBytes;
+    void* p = std::aligned_alloc(kSectorBytes, std::max(rounded, kSectorBytes));
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
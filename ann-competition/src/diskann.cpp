@@ -0,0 +1,868 @@
+#include "../include/ann_interface.hpp"
+#include "../include/block_file.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include "../include/pq.hpp"
+#include "../include/topk.hpp"
+#include "../include/vector_store.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+
+/**
+ * Disk-resident graph index, after Subramanya et al., "DiskANN: Fast
+ * Accurate Billion-point Nearest Neighbor Search on a Single Node" (2019).
+ *
+ * Only the PQ codes of the vectors stay in memory. The full vectors and
+ * the graph live on disk as one fixed-size record per node (vector,
+ * neighbor count, R neighbor slots), packed into 4 KB sectors so that a node
+ * costs one sector read (or a few when a record is larger than a sector,
+ * e.g. 960-dim fp32).
+ *
+ * fit() trains the PQ and builds a Vamana graph in memory: each node links
+ * to the robust-pruned set of nodes a greedy search for it visits, and
+ * alpha > 1 keeps some long edges so that searches converge in few hops.
+ * Nodes are inserted in parallel batches like HNSW (see insert_batch()), so
+ * the graph depends only on the data, the parameters and the seed. The
+ * records then go to a scratch file and only the codes are kept in memory.
+ *
+ * search() is a beam search from the medoid ranked by PQ distance. Every
+ * round reads the records of the beam_width closest unexpanded candidates
+ * in one batch (BlockFile: io_uring, else pread), scores their full
+ * vectors exactly and queues their neighbors by PQ distance. The result is
+ * the k exact best among the expanded nodes, so re-ranking costs no extra
+ * I/O.
+ *
+ * Parameters (set_param):
+ * - R:          max out-degree (build)
+ * - L_build:    candidate list size while building (graph quality vs time)
+ * - alpha:      pruning slack, >= 1 (build)
+ * - pq_m:       PQ subspaces, 8-bit codes (0 = auto, dim / 4) (build)
+ * - seed:       RNG seed for insertion order and PQ training
+ * - L_search:   candidate list size while querying (recall vs I/O)
+ * - beam_width: records read per round (I/O parallelism vs wasted reads)
+ * - filter_brute_force: filters allowing at most this fraction of the ids
+ *               are answered without the graph (query)
+ *
+ * search_filtered() walks the graph as usual but only scores allowed nodes.
+ * Selective filters instead rank the allowed ids by PQ distance, which
+ * costs no I/O, and read just the L_search best of them for re-ranking.
+ *
+ * get_memory_usage() counts the in-memory part (codes, codebooks) and
+ * get_disk_usage() the node records. fit() writes them to an unlinked file
+ * in $ANN_DISK_DIR (default $TMPDIR, else /tmp); save() copies them into
+ * the index file, and load() reads them from that file with direct I/O
+ * instead of mapping it. Building still holds the vectors and the graph in
+ * memory.
+ */
+class DiskANNIndex : public ANNAlgorithm {
+public:
+    void init(const std::string& metric, int dimension) override {
+        metric_ = metric;
+        dimension_ = dimension;
+        metric_type_ = parse_metric(metric);
+        scan_ = resolve_scan(metric_type_, dimension);
+        scan_ids_ = resolve_scan_ids(metric_type_, dimension);
+    }
+
+    void set_param(const std::string& name, double value) override {
+        if (name == "R") {
+            R_ = std::max(2, static_cast<int>(value));
+        } else if (name == "L_build") {
+            L_build_ = std::max(1, static_cast<int>(value));
+        } else if (name == "alpha") {
+            alpha_ = std::max(1.0f, static_cast<float>(value));
+        } else if (name == "pq_m") {
+            pq_m_param_ = std::max(0, static_cast<int>(value));
+        } else if (name == "seed") {
+            seed_ = static_cast<unsigned>(value);
+        } else if (name == "L_search") {
+            L_search_ = std::max(1, static_cast<int>(value));
+        } else if (name == "beam_width") {
+            beam_width_ = std::max(1, static_cast<int>(value));
+        } else if (name == "filter_brute_force") {
+            filter_brute_force_ = std::max(0.0, std::min(1.0, value));
+        } else {
+            ANNAlgorithm::set_param(name, value);
+        }
+    }
+
+    std::map<std::string, double> get_params() const override {
+        return {
+            {"R", R_},
+            {"L_build", L_build_},
+            {"alpha", alpha_},
+            {"pq_m", pq_.m() > 0 ? pq_.m() : pq_m_param_},
+            {"seed", seed_},
+            {"L_search", L_search_},
+            {"beam_width", beam_width_},
+            {"filter_brute_force", filter_brute_force_},
+        };
+    }
+
+    void fit(const float* data, size_t n_samples) override {
+        n_samples_ = n_samples;
+        degree_ = R_;
+        if (n_samples == 0) {
+            // Nothing to train or link: search_graph() answers with padding,
+            // and the (empty) scratch file keeps save() working
+            pq_ = ProductQuantizer();
+            codes_.clear();
+            medoid_ = 0;
+            set_layout();
+            nodes_.create_temporary(disk_dir());
+            nodes_offset_ = 0;
+            nodes_.enable_direct();
+            return;
+        }
+        VectorStore vectors;
+        vectors.assign(data, n_samples, dimension_);
+        if (metric_type_ == Metric::Angular) {
+            normalize_rows(vectors.data(), n_samples, vectors.stride(), dimension_);
+        }
+
+        encode_codes(vectors);
+
+        std::vector<int> graph;
+        build_graph(vectors, graph);
+
+        set_layout();
+        nodes_.create_temporary(disk_dir());
+        nodes_offset_ = 0;
+        write_records(vectors, graph);
+        nodes_.enable_direct();
+    }
+
+    std::vector<int> query(const float* query, int k) override {
+        return search_ids(query, k);
+    }
+
+    void search(const float* query, int k, int* ids, float* distances) override {
+        search_graph(query, k, nullptr, ids, distances);
+    }
+
+    void search_filtered(const float* query, int k, const IdFilter& filter, int* ids,
+                         float* distances) override {
+        search_graph(query, k, &filter, ids, distances);
+    }
+
+    void save(const std::string& path) const override {
+        IndexWriter out(path, "diskann", metric_, dimension_);
+        out.set("R", R_);
+        out.set("L_build", L_build_);
+        out.set("alpha", alpha_);
+        out.set("pq_m", pq_m_param_);
+        out.set("seed", seed_);
+        out.set("L_search", L_search_);
+        out.set("beam_width", beam_width_);
+        out.set("filter_brute_force", filter_brute_force_);
+        out.set("n_samples", static_cast<double>(n_samples_));
+        out.set("degree", degree_);
+        out.set("medoid", medoid_);
+        out.set("record_bytes", static_cast<double>(record_bytes_));
+        out.set("records_per_sector", static_cast<double>(records_per_sector_));
+        out.set("sectors_per_record", static_cast<double>(sectors_per_record_));
+        pq_.save(out, "pq");
+        out.write("codes", codes_);
+        if (!labels_.empty()) {
+            out.write("labels", labels_);
+        }
+
+        // Node records, copied through a bounded buffer
+        out.begin_section("nodes");
+        size_t total = total_sectors();
+        std::unique_ptr<char, FreeDeleter> buffer(
+            static_cast<char*>(BlockFile::allocate(kCopySectors * BlockFile::kSectorBytes)));
+        for (size_t sector = 0; sector < total; sector += kCopySectors) {
+            size_t bytes = std::min(kCopySectors, total - sector) * BlockFile::kSectorBytes;
+            BlockRead read{nodes_offset_ + sector * BlockFile::kSectorBytes, bytes, buffer.get()};
+            nodes_.read(&read, 1);
+            out.append(buffer.get(), bytes);
+        }
+        out.finish();
+    }
+
+    void load(const std::string& path) override {
+        std::shared_ptr<IndexFile> in = IndexFile::open(path);
+        in->expect_kind("diskann");
+        init(in->metric(), in->dimension());
+
+        R_ = static_cast<int>(in->get("R"));
+        L_build_ = static_cast<int>(in->get("L_build"));
+        alpha_ = static_cast<float>(in->get("alpha"));
+        pq_m_param_ = static_cast<int>(in->get("pq_m"));
+        seed_ = static_cast<unsigned>(in->get("seed"));
+        L_search_ = static_cast<int>(in->get("L_search"));
+        beam_width_ = static_cast<int>(in->get("beam_width"));
+        filter_brute_force_ = in->get("filter_brute_force", filter_brute_force_);
+        n_samples_ = static_cast<size_t>(in->get("n_samples"));
+        degree_ = static_cast<int>(in->get("degree"));
+        medoid_ = static_cast<int>(in->get("medoid"));
+        set_layout();
+        if (record_bytes_ != static_cast<size_t>(in->get("record_bytes")) ||
+            records_per_sector_ != static_cast<size_t>(in->get("records_per_sector")) ||
+            sectors_per_record_ != static_cast<size_t>(in->get("sectors_per_record"))) {
+            throw std::runtime_error("index file " + path + ": inconsistent DiskANN record layout");
+        }
+
+        pq_ = ProductQuantizer();
+        pq_.load(*in, "pq");
+        codes_ = in->vector<uint8_t>("codes");
+        labels_ = in->has("labels") ? in->vector<int>("labels") : std::vector<int>();
+        size_t node_bytes = 0;
+        in->section("nodes", node_bytes);
+        nodes_offset_ = in->section_offset("nodes");
+        if (codes_.size() != n_samples_ * pq_.m() ||
+            node_bytes != total_sectors() * BlockFile::kSectorBytes ||
+            nodes_offset_ % BlockFile::kSectorBytes != 0) {
+            throw std::runtime_error("index file " + path + ": inconsistent DiskANN sections");
+        }
+
+        // Records are read from the file itself, not from the mapping
+        nodes_.open(path);
+    }
+
+    size_t get_memory_usage() const override {
+        return codes_.size() * sizeof(uint8_t) + pq_.get_memory_usage() +
+               labels_.size() * sizeof(int);
+    }
+
+    size_t get_disk_usage() const override {
+        return total_sectors() * BlockFile::kSectorBytes;
+    }
+
+    std::string name() const override {
+        return "DiskANN";
+    }
+
+private:
+    using Candidate = std::pair<float, int>;  // (distance, id)
+
+    // Insertion batch size: at most 1/kInsertBatchFraction of the nodes
+    // already in the graph, and at most kMaxInsertBatch
+    static constexpr size_t kInsertBatchFraction = 32;
+    static constexpr size_t kMaxInsertBatch = 8192;
+
+    // PQ codebooks are trained on at most this many vectors
+    static constexpr size_t kPQTrainRows = 65536;
+
+    // Sectors per write while building / per copy while saving
+    static constexpr size_t kCopySectors = 1024;
+
+    struct FreeDeleter {
+        void operator()(char* p) const { std::free(p); }
+    };
+
+    /**
+     * Entry of the search candidate list, kept sorted by PQ distance.
+     */
+    struct Frontier {
+        float dist;
+        int id;
+        bool expanded;
+    };
+
+    /**
+     * Reverse link of a batch insertion: add source to target's list.
+     */
+    struct BackLink {
+        int target;
+        int source;
+    };
+
+    /**
+     * Per-thread query buffers, reused across queries (and instances).
+     */
+    struct QueryScratch {
+        std::vector<float> normalized;
+        std::vector<float> lut;
+        std::vector<char> visited;  // all zero between searches
+        std::vector<int> touched;
+        std::vector<Frontier> frontier;
+        std::vector<BlockRead> reads;
+        std::vector<int> batch;
+        std::unique_ptr<char, FreeDeleter> buffer;  // sector aligned
+        size_t buffer_bytes = 0;
+        TopK top;
+        TopK shortlist;  // filtered exact scans, by PQ distance
+    };
+
+    /**
+     * Per-thread build buffers.
+     */
+    struct BuildScratch {
+        std::vector<char> visited;
+        std::vector<int> touched;
+        std::vector<Frontier> frontier;
+        std::vector<int> pending;
+        std::vector<float> dists;
+        std::vector<Candidate> expanded;
+    };
+
+    /**
+     * Unmark the nodes a search marked, restoring visited to all zero.
+     */
+    static void clear_visited(std::vector<char>& visited, std::vector<int>& touched) {
+        for (int id : touched) {
+            visited[id] = 0;
+        }
+        touched.clear();
+    }
+
+    /**
+     * search() / search_filtered() (filter may be null). Nodes the filter
+     * rejects are still expanded, to route the search, but never scored.
+     */
+    void search_graph(const float* query, int k, const IdFilter* filter, int* ids,
+                      float* distances) const {
+        QueryScratch& scratch = query_scratch();
+        TopK& top = scratch.top;
+        top.reset(k);
+        SearchStats stats;
+        stats.count(Stat::Queries);
+        uint64_t pushes = top.inserts();
+        if (n_samples_ == 0) {
+            top.take_into(k, ids, distances);
+            return;
+        }
+        query = prepare_query(metric_type_, query, dimension_, scratch.normalized);
+
+        // Euclidean: ||q - x~||^2. Angular: -q·x~, which ranks like 1 - q·x~
+        std::vector<float>& lut = scratch.lut;
+        lut.resize(pq_.lut_size());
+        if (metric_type_ == Metric::Euclidean) {
+            pq_.compute_l2_lut(query, lut.data());
+        } else {
+            pq_.compute_ip_lut(query, lut.data());
+        }
+        size_t list_size = std::max(L_search_, k);
+
+        if (filter && filter->count() <= filter_brute_force_ * n_samples_) {
+            // Rank the allowed ids by PQ distance in memory, then read and
+            // re-rank the list_size best
+            std::vector<int>& allowed = scratch.batch;
+            filter->collect(allowed);
+            allowed.erase(std::lower_bound(allowed.begin(), allowed.end(), static_cast<int>(n_samples_)),
+                          allowed.end());
+            TopK& shortlist = scratch.shortlist;
+            shortlist.reset(list_size);
+            for (int id : allowed) {
+                shortlist.push(pq_distance(lut.data(), id), id);
+            }
+            stats.count(Stat::Distances, allowed.size());
+            allowed.resize(shortlist.size());
+            shortlist.take_into(allowed.size(), allowed.data(), nullptr);
+            read_records(allowed, scratch);
+            for (size_t j = 0; j < allowed.size(); ++j) {
+                float exact;
+                scan_(query, reinterpret_cast<const float*>(record_in_buffer(scratch, j, allowed[j])),
+                      1, 0, dimension_, &exact);
+                top.push(exact, allowed[j]);
+            }
+            stats.count(Stat::ExactScans);
+            stats.count(Stat::Distances, allowed.size());
+            stats.count(Stat::Reranked, allowed.size());
+            stats.count(Stat::HeapPushes, top.inserts() - pushes);
+            stats_.add(stats);
+            top.take_into(k, ids, distances);
+            return;
+        }
+
+        std::vector<char>& visited = scratch.visited;
+        std::vector<int>& touched = scratch.touched;
+        if (visited.size() < n_samples_) {
+            visited.resize(n_samples_, 0);
+        }
+        std::vector<Frontier>& frontier = scratch.frontier;
+        frontier.clear();
+
+        size_t beam = static_cast<size_t>(beam_width_);
+        std::vector<int>& batch = scratch.batch;
+
+        // A failed read must not leave nodes marked: the scratch outlives
+        // this search
+        try {
+            visited[medoid_] = 1;
+            touched.push_back(medoid_);
+            frontier.push_back({pq_distance(lut.data(), medoid_), medoid_, false});
+            stats.count(Stat::Distances);
+
+            while (true) {
+                // The beam_width closest candidates not expanded yet
+                batch.clear();
+                for (Frontier& f : frontier) {
+                    if (!f.expanded) {
+                        f.expanded = true;
+                        batch.push_back(f.id);
+                        if (batch.size() == beam) {
+                            break;
+                        }
+                    }
+                }
+                if (batch.empty()) {
+                    break;
+                }
+
+                read_records(batch, scratch);
+                stats.count(Stat::NodesVisited, batch.size());
+                for (size_t j = 0; j < batch.size(); ++j) {
+                    const char* record = record_in_buffer(scratch, j, batch[j]);
+                    if (!filter || filter->allows(batch[j])) {
+                        float exact;
+                        scan_(query, reinterpret_cast<const float*>(record), 1, 0, dimension_, &exact);
+                        top.push(exact, batch[j]);
+                        stats.count(Stat::Reranked);
+                        stats.count(Stat::Distances);
+                    }
+
+                    uint32_t count;
+                    std::memcpy(&count, record + dimension_ * sizeof(float), sizeof(count));
+                    const uint32_t* links = reinterpret_cast<const uint32_t*>(
+                        record + (dimension_ + 1) * sizeof(float));
+                    for (uint32_t i = 0; i < count; ++i) {
+                        int neighbor = static_cast<int>(links[i]);
+                        if (visited[neighbor]) {
+                            continue;
+                        }
+                        visited[neighbor] = 1;
+                        touched.push_back(neighbor);
+                        insert_frontier(frontier, list_size,
+                                        {pq_distance(lut.data(), neighbor), neighbor, false});
+                        stats.count(Stat::Distances);
+                    }
+                }
+            }
+        } catch (...) {
+            clear_visited(visited, touched);
+            throw;
+        }
+        clear_visited(visited, touched);
+        stats.count(Stat::HeapPushes, top.inserts() - pushes);
+        stats_.add(stats);
+        top.take_into(k, ids, distances);
+    }
+
+    /**
+     * Read the records of ids into the scratch buffer, one batch.
+     */
+    void read_records(const std::vector<int>& ids, QueryScratch& scratch) const {
+        size_t record_span = sectors_per_record_ * BlockFile::kSectorBytes;
+        if (scratch.buffer_bytes < ids.size() * record_span) {
+            scratch.buffer.reset(static_cast<char*>(BlockFile::allocate(ids.size() * record_span)));
+            scratch.buffer_bytes = ids.size() * record_span;
+        }
+        std::vector<BlockRead>& reads = scratch.reads;
+        reads.resize(ids.size());
+        for (size_t j = 0; j < ids.size(); ++j) {
+            reads[j] = {record_sector_offset(ids[j]), record_span,
+                        scratch.buffer.get() + j * record_span};
+        }
+        nodes_.read(reads.data(), reads.size());
+    }
+
+    /**
+     * Record of id, the j-th read by read_records().
+     */
+    const char* record_in_buffer(const QueryScratch& scratch, size_t j, int id) const {
+        return scratch.buffer.get() + j * sectors_per_record_ * BlockFile::kSectorBytes +
+               record_offset_in_sectors(id);
+    }
+
+    static QueryScratch& query_scratch() {
+        thread_local QueryScratch scratch;
+        return scratch;
+    }
+
+    static BuildScratch& build_scratch() {
+        thread_local BuildScratch scratch;
+        return scratch;
+    }
+
+    static std::string disk_dir() {
+        for (const char* name : {"ANN_DISK_DIR", "TMPDIR"}) {
+            const char* env = std::getenv(name);
+            if (env != nullptr && *env != '\0') {
+                return env;
+            }
+        }
+        return "/tmp";
+    }
+
+    /**
+     * Keep frontier sorted and at most list_size long.
+     */
+    static void insert_frontier(std::vector<Frontier>& frontier, size_t list_size,
+                                const Frontier& entry) {
+        if (frontier.size() >= list_size && entry.dist >= frontier.back().dist) {
+            return;
+        }
+        auto pos = std::upper_bound(frontier.begin(), frontier.end(), entry.dist,
+                                    [](float d, const Frontier& f) { return d < f.dist; });
+        frontier.insert(pos, entry);
+        if (frontier.size() > list_size) {
+            frontier.pop_back();
+        }
+    }
+
+    float pq_distance(const float* lut, int id) const {
+        const int m = pq_.m();
+        const int ksub = pq_.ksub();
+        const uint8_t* code = codes_.data() + static_cast<size_t>(id) * m;
+        float sum = 0.0f;
+        for (int s = 0; s < m; ++s) {
+            sum += lut[s * ksub + code[s]];
+        }
+        return sum;
+    }
+
+    float distance(const float* a, const float* b) const {
+        float d;
+        scan_(a, b, 1, 0, dimension_, &d);
+        return d;
+    }
+
+    /**
+     * Train the PQ on a random sample and encode every vector.
+     */
+    void encode_codes(const VectorStore& vectors) {
+        int m = pq_m_param_ > 0 ? pq_m_param_ : default_pq_m(dimension_);
+        size_t n_train = std::min(n_samples_, kPQTrainRows);
+        std::vector<size_t> sample(n_samples_);
+        std::iota(sample.begin(), sample.end(), size_t(0));
+        std::mt19937 rng(seed_);
+        std::shuffle(sample.begin(), sample.end(), rng);
+
+        std::vector<float> rows(n_train * dimension_);
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n_train); ++i) {
+            std::memcpy(rows.data() + i * dimension_, vectors.row(sample[i]),
+                        dimension_ * sizeof(float));
+        }
+        pq_ = ProductQuantizer();
+        pq_.train(rows.data(), n_train, dimension_, m, 8, seed_);
+
+        // pq_.encode() wants contiguous rows: encode in chunks
+        codes_.assign(n_samples_ * m, 0);
+        rows.resize(std::min(n_samples_, kPQTrainRows) * dimension_);
+        for (size_t start = 0; start < n_samples_; start += kPQTrainRows) {
+            size_t count = std::min(kPQTrainRows, n_samples_ - start);
+            #pragma omp parallel for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(count); ++i) {
+                std::memcpy(rows.data() + i * dimension_, vectors.row(start + i),
+                            dimension_ * sizeof(float));
+            }
+            pq_.encode(rows.data(), count, codes_.data() + start * m);
+        }
+    }
+
+    /**
+     * Vamana graph over vectors: graph holds n lists of [count, R ids].
+     */
+    void build_graph(const VectorStore& vectors, std::vector<int>& graph) {
+        graph.assign(n_samples_ * (degree_ + 1), 0);
+        medoid_ = find_medoid(vectors);
+
+        // Insertion order: seeded shuffle, medoid first
+        std::vector<int> order(n_samples_);
+        std::iota(order.begin(), order.end(), 0);
+        std::mt19937 rng(seed_);
+        std::shuffle(order.begin(), order.end(), rng);
+        std::iter_swap(order.begin(), std::find(order.begin(), order.end(), medoid_));
+
+        // Batches grow with the graph: early nodes go in one at a time,
+        // later ones kInsertBatchFraction of the graph size at once
+        size_t begin = 1;
+        while (begin < n_samples_) {
+            size_t batch = std::max<size_t>(1, begin / kInsertBatchFraction);
+            size_t end = std::min(n_samples_, begin + std::min(batch, kMaxInsertBatch));
+            insert_batch(vectors, graph, order, begin, end);
+            begin = end;
+        }
+    }
+
+    /**
+     * The vector closest to the mean (lowest id on ties).
+     */
+    int find_medoid(const VectorStore& vectors) const {
+        std::vector<double> sum(dimension_, 0.0);
+        for (size_t i = 0; i < n_samples_; ++i) {
+            const float* row = vectors.row(i);
+            for (int d = 0; d < dimension_; ++d) {
+                sum[d] += row[d];
+            }
+        }
+        std::vector<float> mean(VectorStore::padded_dim(dimension_), 0.0f);
+        for (int d = 0; d < dimension_; ++d) {
+            mean[d] = static_cast<float>(sum[d] / static_cast<double>(n_samples_));
+        }
+
+        Candidate best(std::numeric_limits<float>::infinity(), 0);
+        #pragma omp parallel
+        {
+            Candidate local(std::numeric_limits<float>::infinity(), 0);
+            #pragma omp for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(n_samples_); ++i) {
+                // Squared L2 even for angular: the point nearest the centroid
+                float d = 0.0f;
+                const float* row = vectors.row(i);
+                for (int j = 0; j < dimension_; ++j) {
+                    float diff = row[j] - mean[j];
+                    d += diff * diff;
+                }
+                local = std::min(local, Candidate(d, static_cast<int>(i)));
+            }
+            #pragma omp critical
+            best = std::min(best, local);
+        }
+        return best.second;
+    }
+
+    /**
+     * Insert order[begin .. end) in parallel. Each node runs a greedy
+     * search on the graph as it was before the batch and prunes what it
+     * visited into its own list (nothing links to batch nodes yet, so no
+     * one else reads those lists); the reverse links are then grouped by
+     * target and each target is updated, and re-pruned if full, by one
+     * thread in node order. The graph is the same for any thread count.
+     */
+    void insert_batch(const VectorStore& vectors, std::vector<int>& graph,
+                      const std::vector<int>& order, size_t begin, size_t end) {
+        #pragma omp parallel for schedule(dynamic, 8)
+        for (long long i = static_cast<long long>(begin); i < static_cast<long long>(end); ++i) {
+            int node = order[i];
+            BuildScratch& scratch = build_scratch();
+            greedy_search(vectors, graph, vectors.row(node), scratch);
+            std::vector<int> links = robust_prune(vectors, node, scratch.expanded);
+            int* list = graph.data() + static_cast<size_t>(node) * (degree_ + 1);
+            list[0] = static_cast<int>(links.size());
+            std::copy(links.begin(), links.end(), list + 1);
+        }
+
+        std::vector<BackLink> back_links;
+        for (size_t i = begin; i < end; ++i) {
+            const int* list = graph.data() + static_cast<size_t>(order[i]) * (degree_ + 1);
+            for (int j = 1; j <= list[0]; ++j) {
+                back_links.push_back({list[j], order[i]});
+            }
+        }
+        std::sort(back_links.begin(), back_links.end(), [](const BackLink& a, const BackLink& b) {
+            return a.target != b.target ? a.target < b.target : a.source < b.source;
+        });
+
+        std::vector<size_t> groups;
+        for (size_t i = 0; i < back_links.size(); ++i) {
+            if (i == 0 || back_links[i].target != back_links[i - 1].target) {
+                groups.push_back(i);
+            }
+        }
+        groups.push_back(back_links.size());
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (long long g = 0; g < static_cast<long long>(groups.size()) - 1; ++g) {
+            int target = back_links[groups[g]].target;
+            int* list = graph.data() + static_cast<size_t>(target) * (degree_ + 1);
+            std::vector<int> ids(list + 1, list + 1 + list[0]);
+            for (size_t i = groups[g]; i < groups[g + 1]; ++i) {
+                if (std::find(ids.begin(), ids.end(), back_links[i].source) == ids.end()) {
+                    ids.push_back(back_links[i].source);
+                }
+            }
+            if (ids.size() > static_cast<size_t>(degree_)) {
+                const float* base = vectors.row(target);
+                std::vector<Candidate> candidates;
+                candidates.reserve(ids.size());
+                for (int id : ids) {
+                    candidates.emplace_back(distance(base, vectors.row(id)), id);
+                }
+                ids = robust_prune(vectors, target, candidates);
+            }
+            list[0] = static_cast<int>(ids.size());
+            std::copy(ids.begin(), ids.end(), list + 1);
+        }
+    }
+
+    /**
+     * Greedy search for point from the medoid with a list of L_build
+     * candidates; leaves every expanded node and its distance in
+     * scratch.expanded.
+     */
+    void greedy_search(const VectorStore& vectors, const std::vector<int>& graph,
+                       const float* point, BuildScratch& scratch) const {
+        std::vector<char>& visited = scratch.visited;
+        std::vector<int>& touched = scratch.touched;
+        std::vector<Frontier>& frontier = scratch.frontier;
+        std::vector<int>& pending = scratch.pending;
+        std::vector<float>& dists = scratch.dists;
+        if (visited.size() < n_samples_) {
+            visited.resize(n_samples_, 0);
+        }
+        dists.resize(degree_);
+        frontier.clear();
+        scratch.expanded.clear();
+
+        size_t list_size = static_cast<size_t>(L_build_);
+        visited[medoid_] = 1;
+        touched.push_back(medoid_);
+        frontier.push_back({distance(point, vectors.row(medoid_)), medoid_, false});
+
+        size_t next = 0;
+        while (next < frontier.size()) {
+            Frontier& current = frontier[next];
+            if (current.expanded) {
+                ++next;
+                continue;
+            }
+            current.expanded = true;
+            scratch.expanded.emplace_back(current.dist, current.id);
+
+            const int* list = graph.data() + static_cast<size_t>(current.id) * (degree_ + 1);
+            pending.clear();
+            for (int j = 1; j <= list[0]; ++j) {
+                if (!visited[list[j]]) {
+                    visited[list[j]] = 1;
+                    touched.push_back(list[j]);
+                    pending.push_back(list[j]);
+                }
+            }
+            scan_ids_(point, vectors.data(), pending.data(), pending.size(), vectors.stride(),
+                      dimension_, dists.data());
+            for (size_t j = 0; j < pending.size(); ++j) {
+                insert_frontier(frontier, list_size, {dists[j], pending[j], false});
+            }
+            // Insertions may land before next: restart at the closest
+            // unexpanded candidate
+            next = 0;
+        }
+
+        clear_visited(visited, touched);
+    }
+
+    /**
+     * Robust prune (Algorithm 2 in the paper): repeatedly keep the closest
+     * remaining candidate p* and drop every candidate c with
+     * alpha * d(p*, c) <= d(node, c), up to degree_ neighbors.
+     */
+    std::vector<int> robust_prune(const VectorStore& vectors, int node,
+                                  std::vector<Candidate>& candidates) const {
+        std::sort(candidates.begin(), candidates.end());
+        std::vector<int> kept;
+        std::vector<char> removed(candidates.size(), 0);
+        for (size_t i = 0; i < candidates.size() && kept.size() < static_cast<size_t>(degree_); ++i) {
+            int id = candidates[i].second;
+            if (removed[i] || id == node ||
+                (i > 0 && id == candidates[i - 1].second)) {
+                continue;
+            }
+            kept.push_back(id);
+            const float* chosen = vectors.row(id);
+            for (size_t j = i + 1; j < candidates.size(); ++j) {
+                if (!removed[j] && alpha_ * distance(chosen, vectors.row(candidates[j].second)) <=
+                                       candidates[j].first) {
+                    removed[j] = 1;
+                }
+            }
+        }
+        return kept;
+    }
+
+    /**
+     * Record layout: dim floats, a uint32 count and degree_ uint32 ids,
+     * several records per sector when they fit, else whole sectors each.
+     */
+    void set_layout() {
+        record_bytes_ = (static_cast<size_t>(dimension_) + 1 + degree_) * sizeof(uint32_t);
+        if (record_bytes_ <= BlockFile::kSectorBytes) {
+            records_per_sector_ = BlockFile::kSectorBytes / record_bytes_;
+            sectors_per_record_ = 1;
+        } else {
+            records_per_sector_ = 1;
+            sectors_per_record_ = (record_bytes_ + BlockFile::kSectorBytes - 1) / BlockFile::kSectorBytes;
+        }
+    }
+
+    size_t total_sectors() const {
+        if (records_per_sector_ == 0) {
+            return 0;
+        }
+        return (n_samples_ + records_per_sector_ - 1) / records_per_sector_ * sectors_per_record_;
+    }
+
+    uint64_t record_sector_offset(int id) const {
+        uint64_t sector = static_cast<uint64_t>(id) / records_per_sector_ * sectors_per_record_;
+        return nodes_offset_ + sector * BlockFile::kSectorBytes;
+    }
+
+    size_t record_offset_in_sectors(int id) const {
+        return static_cast<size_t>(id) % records_per_sector_ * record_bytes_;
+    }
+
+    /**
+     * Fill the scratch file with every node's record, kCopySectors at a time.
+     */
+    void write_records(const VectorStore& vectors, const std::vector<int>& graph) {
+        size_t chunk_nodes = std::max<size_t>(1, kCopySectors / sectors_per_record_) * records_per_sector_;
+        size_t chunk_bytes = (chunk_nodes / records_per_sector_) * sectors_per_record_ *
+                             BlockFile::kSectorBytes;
+        std::unique_ptr<char, FreeDeleter> buffer(static_cast<char*>(BlockFile::allocate(chunk_bytes)));
+
+        for (size_t first = 0; first < n_samples_; first += chunk_nodes) {
+            size_t count = std::min(chunk_nodes, n_samples_ - first);
+            size_t bytes = (count + records_per_sector_ - 1) / records_per_sector_ *
+                           sectors_per_record_ * BlockFile::kSectorBytes;
+            std::memset(buffer.get(), 0, bytes);
+
+            #pragma omp parallel for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(count); ++i) {
+                size_t id = first + i;
+                char* record = buffer.get() +
+                               static_cast<size_t>(i) / records_per_sector_ * sectors_per_record_ *
+                                   BlockFile::kSectorBytes +
+                               record_offset_in_sectors(static_cast<int>(id));
+                std::memcpy(record, vectors.row(id), dimension_ * sizeof(float));
+                // [count, ids] as uint32 (ids are never negative)
+                const int* list = graph.data() + id * (degree_ + 1);
+                std::memcpy(record + dimension_ * sizeof(float), list, (1 + list[0]) * sizeof(int));
+            }
+            nodes_.write(first / records_per_sector_ * sectors_per_record_ * BlockFile::kSectorBytes,
+                         buffer.get(), bytes);
+        }
+    }
+
+    // Parameters
+    int R_ = 64;
+    int L_build_ = 100;
+    float alpha_ = 1.2f;
+    int pq_m_param_ = 0;
+    unsigned seed_ = 1234;
+    int L_search_ = 100;
+    int beam_width_ = 4;
+    double filter_brute_force_ = 0.1;
+
+    Metric metric_type_ = Metric::Euclidean;
+    ScanFunc scan_ = nullptr;
+    ScanIdsFunc scan_ids_ = nullptr;
+
+    size_t n_samples_ = 0;
+    int degree_ = 64;                 // R_ at fit() time
+    int medoid_ = 0;
+    ProductQuantizer pq_;
+    std::vector<uint8_t> codes_;      // n * m, in memory
+
+    // On disk
+    BlockFile nodes_;
+    uint64_t nodes_offset_ = 0;       // byte offset of record sector 0
+    size_t record_bytes_ = 0;
+    size_t records_per_sector_ = 0;
+    size_t sectors_per_record_ = 0;
+};
+
+// Factory function
+extern "C" ANNAlgorithm* create_diskann_index() {
+    return new DiskANNIndex();
+}
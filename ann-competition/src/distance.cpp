@@ -0,0 +1,287 @@
+#include "../include/distance.hpp"
+#include "../include/scan_kernels.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * Portable scalar kernels and runtime selection of the best ISA.
+ *
+ * This file is compiled without any ISA-specific flags, so it is safe to run
+ * on every CPU and may only call into an ISA table after CPUID says so.
+ */
+
+struct ScalarKernels {
+    template <size_t Dim>
+    static float l2_sqr(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+        float sum = 0.0f;
+        for (size_t i = 0; i < d; ++i) {
+            float diff = a[i] - b[i];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    template <size_t Dim>
+    static float inner_product(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+        float sum = 0.0f;
+        for (size_t i = 0; i < d; ++i) {
+            sum += a[i] * b[i];
+        }
+        return sum;
+    }
+};
+
+static void pq4_scan_scalar(const uint8_t* codes, size_t n_blocks, size_t m,
+                            const uint8_t* lut, uint16_t* out) {
+    for (size_t b = 0; b < n_blocks; ++b) {
+        uint16_t acc[32] = {0};
+        const uint8_t* block = codes + b * m * 16;
+        for (size_t s = 0; s < m; ++s) {
+            const uint8_t* sub_lut = lut + s * 16;
+            const uint8_t* sub_codes = block + s * 16;
+            for (int j = 0; j < 16; ++j) {
+                acc[j] += sub_lut[sub_codes[j] & 0x0F];
+                acc[j + 16] += sub_lut[sub_codes[j] >> 4];
+            }
+        }
+        std::memcpy(out + b * 32, acc, sizeof(acc));
+    }
+}
+
+template <Metric M>
+static void f16_scan_scalar(const float* query, const uint16_t* base, size_t n,
+                            size_t stride, size_t dim, float* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const uint16_t* row = base + i * stride;
+        float sum = 0.0f;
+        for (size_t j = 0; j < dim; ++j) {
+            float x = half_to_float(row[j]);
+            if (M == Metric::Euclidean) {
+                float diff = query[j] - x;
+                sum += diff * diff;
+            } else {
+                sum += query[j] * x;
+            }
+        }
+        out[i] = M == Metric::Euclidean ? sum : 1.0f - sum;
+    }
+}
+
+static void u8_dot_scan_scalar(const int8_t* query, const uint8_t* base, size_t n,
+                               size_t stride, size_t dim, int32_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* row = base + i * stride;
+        int32_t sum = 0;
+        for (size_t j = 0; j < dim; ++j) {
+            sum += static_cast<int32_t>(row[j]) * query[j];
+        }
+        out[i] = sum;
+    }
+}
+
+static void hamming_scan_scalar(const uint64_t* query, const uint64_t* base, size_t n,
+                                size_t words, uint32_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const uint64_t* row = base + i * words;
+        uint32_t sum = 0;
+        for (size_t w = 0; w < words; ++w) {
+            sum += static_cast<uint32_t>(__builtin_popcountll(query[w] ^ row[w]));
+        }
+        out[i] = sum;
+    }
+}
+
+static void dot_tile_scalar(const float* queries, size_t nq, const float* base, size_t n,
+                            size_t stride, size_t dim, float* out, size_t ld) {
+    for (size_t i = 0; i < nq; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            out[i * ld + j] = ScalarKernels::inner_product<0>(queries + i * dim, base + j * stride, dim);
+        }
+    }
+}
+
+void register_scalar_kernels(DistanceKernels& k) {
+    register_kernel_table<ScalarKernels>(k, "scalar");
+    k.pq4_scan = pq4_scan_scalar;
+    k.f16_scan[static_cast<int>(Metric::Euclidean)] = f16_scan_scalar<Metric::Euclidean>;
+    k.f16_scan[static_cast<int>(Metric::Angular)] = f16_scan_scalar<Metric::Angular>;
+    k.u8_dot_scan = u8_dot_scan_scalar;
+    k.hamming_scan = hamming_scan_scalar;
+    k.dot_tile = dot_tile_scalar;
+}
+
+Metric parse_metric(const std::string& metric) {
+    if (metric == "euclidean") {
+        return Metric::Euclidean;
+    } else if (metric == "angular") {
+        return Metric::Angular;
+    }
+    throw std::runtime_error("Unknown metric: " + metric);
+}
+
+static bool isa_allowed(const char* forced, const char* isa) {
+    return forced == nullptr || std::strcmp(forced, isa) == 0;
+}
+
+static DistanceKernels select_kernels() {
+    DistanceKernels k;
+    register_scalar_kernels(k);
+
+    const char* forced = std::getenv("ANN_FORCE_ISA");
+    if (forced != nullptr && std::strcmp(forced, "scalar") == 0) {
+        return k;
+    }
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386) || defined(_M_IX86)
+    __builtin_cpu_init();
+    bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                    __builtin_cpu_supports("f16c") && __builtin_cpu_supports("popcnt");
+    bool has_avx512 = has_avx2 &&
+                      __builtin_cpu_supports("avx512f") &&
+                      __builtin_cpu_supports("avx512bw") &&
+                      __builtin_cpu_supports("avx512dq") &&
+                      __builtin_cpu_supports("avx512vl");
+
+    if (has_avx512 && isa_allowed(forced, "avx512")) {
+        register_avx2_kernels(k);
+        register_avx512_kernels(k);
+        if (__builtin_cpu_supports("avx512vnni")) {
+            register_avx512_vnni_kernels(k);
+        }
+    } else if (has_avx2 && isa_allowed(forced, "avx2")) {
+        register_avx2_kernels(k);
+    }
+#elif defined(__aarch64__) || defined(__arm64__)
+    if (isa_allowed(forced, "neon")) {
+        register_neon_kernels(k);
+    }
+#endif
+
+    return k;
+}
+
+const DistanceKernels& distance_kernels() {
+    // Thread-safe one-time initialization (C++11 magic statics)
+    static const DistanceKernels kernels = select_kernels();
+    return kernels;
+}
+
+static int scan_dim_slot(int dim) {
+    for (int i = 1; i < kNumScanDims; ++i) {
+        if (kScanDims[i] == static_cast<size_t>(dim)) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+ScanFunc resolve_scan(Metric metric, int dim) {
+    return distance_kernels().scan[static_cast<int>(metric)][scan_dim_slot(dim)];
+}
+
+ScanIdsFunc resolve_scan_ids(Metric metric, int dim) {
+    return distance_kernels().scan_ids[static_cast<int>(metric)][scan_dim_slot(dim)];
+}
+
+void normalize_rows(float* data, size_t n, size_t stride, size_t dim) {
+    DistanceFunc inner_product = distance_kernels().inner_product;
+
+    // Small inputs (single queries) stay on the calling thread
+    #pragma omp parallel for schedule(static) if (n > 1024)
+    for (long long i = 0; i < static_cast<long long>(n); ++i) {
+        float* row = data + i * stride;
+        float norm_sqr = inner_product(row, row, dim);
+        if (norm_sqr > 0.0f) {
+            float inv_norm = 1.0f / std::sqrt(norm_sqr);
+            for (size_t j = 0; j < dim; ++j) {
+                row[j] *= inv_norm;
+            }
+        }
+    }
+}
+
+void normalize_rows(float* data, size_t n, size_t dim) {
+    normalize_rows(data, n, dim, dim);
+}
+
+const float* prepare_query(Metric metric, const float* query, size_t dim,
+                           std::vector<float>& buf) {
+    if (metric != Metric::Angular) {
+        return query;
+    }
+    buf.assign(query, query + dim);
+    normalize_rows(buf.data(), 1, dim);
+    return buf.data();
+}
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t abs = bits & 0x7FFFFFFFu;
+
+    if (abs >= 0x7F800000u) {
+        // Inf stays inf, NaN stays a (quiet) NaN
+        return static_cast<uint16_t>(sign | 0x7C00u | (abs > 0x7F800000u ? 0x0200u : 0u));
+    }
+    if (abs >= 0x477FF000u) {
+        // Rounds past 65504, the largest finite half
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+    if (abs < 0x38800000u) {
+        // Below 2^-14: half subnormal (or zero)
+        if (abs < 0x33000000u) {
+            return static_cast<uint16_t>(sign);
+        }
+        uint32_t mantissa = (abs & 0x007FFFFFu) | 0x00800000u;
+        uint32_t shift = 126u - (abs >> 23);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u))) {
+            ++half;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // Normal: rebias the exponent (127 - 15) and round the dropped 13 bits
+    uint32_t half = (abs >> 13) - (112u << 10);
+    uint32_t rest = abs & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+        ++half;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float half_to_float(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1Fu;
+    uint32_t mantissa = value & 0x03FFu;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: normalize into a float exponent
+            uint32_t e = 113;
+            while ((mantissa & 0x0400u) == 0) {
+                mantissa <<= 1;
+                --e;
+            }
+            bits = sign | (e << 23) | ((mantissa & 0x03FFu) << 13);
+        }
+    } else if (exponent == 0x1Fu) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
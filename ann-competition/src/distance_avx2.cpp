@@ -0,0 +1,308 @@
+#include "../include/distance.hpp"
+#include "../include/scan_kernels.hpp"
+#include <immintrin.h>
+
+/**
+ * AVX2 + FMA (+ F16C, POPCNT) kernels.
+ * Compiled with -mavx2 -mfma -mf16c -mpopcnt (see CMakeLists.txt); only
+ * reached after the dispatcher in distance.cpp has confirmed CPU support.
+ */
+
+static inline float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+    return _mm_cvtss_f32(lo);
+}
+
+// Mask with the first n (0..7) lanes enabled, for maskload of the tail
+static inline __m256i tail_mask(size_t n) {
+    static const int kMask[16] = {
+        -1, -1, -1, -1, -1, -1, -1, -1,
+         0,  0,  0,  0,  0,  0,  0,  0,
+    };
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kMask + 8 - n));
+}
+
+struct Avx2Kernels {
+    template <size_t Dim>
+    static float l2_sqr(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+
+        // Four independent accumulators hide the FMA latency
+        __m256 s0 = _mm256_setzero_ps();
+        __m256 s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps();
+        __m256 s3 = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 32 <= d; i += 32) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+            __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+            __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+            s0 = _mm256_fmadd_ps(d0, d0, s0);
+            s1 = _mm256_fmadd_ps(d1, d1, s1);
+            s2 = _mm256_fmadd_ps(d2, d2, s2);
+            s3 = _mm256_fmadd_ps(d3, d3, s3);
+        }
+        for (; i + 8 <= d; i += 8) {
+            __m256 v = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            s0 = _mm256_fmadd_ps(v, v, s0);
+        }
+        if (i < d) {
+            __m256i mask = tail_mask(d - i);
+            __m256 v = _mm256_sub_ps(_mm256_maskload_ps(a + i, mask),
+                                     _mm256_maskload_ps(b + i, mask));
+            s1 = _mm256_fmadd_ps(v, v, s1);
+        }
+
+        return hsum256(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    }
+
+    template <size_t Dim>
+    static float inner_product(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+
+        __m256 s0 = _mm256_setzero_ps();
+        __m256 s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps();
+        __m256 s3 = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 32 <= d; i += 32) {
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+            s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), s2);
+            s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), s3);
+        }
+        for (; i + 8 <= d; i += 8) {
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+        }
+        if (i < d) {
+            __m256i mask = tail_mask(d - i);
+            s1 = _mm256_fmadd_ps(_mm256_maskload_ps(a + i, mask),
+                                 _mm256_maskload_ps(b + i, mask), s1);
+        }
+
+        return hsum256(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    }
+};
+
+/**
+ * 4-bit fast-scan: each subspace's 16-entry LUT sits in a register and
+ * pshufb looks up 32 codes at once (low lane: vectors 0-15 from the low
+ * nibbles, high lane: vectors 16-31 from the high nibbles).
+ */
+static void pq4_scan_avx2(const uint8_t* codes, size_t n_blocks, size_t m,
+                          const uint8_t* lut, uint16_t* out) {
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+
+    for (size_t b = 0; b < n_blocks; ++b) {
+        const uint8_t* block = codes + b * m * 16;
+        __m256i acc_lo = _mm256_setzero_si256();  // vectors 0-15
+        __m256i acc_hi = _mm256_setzero_si256();  // vectors 16-31
+
+        for (size_t s = 0; s < m; ++s) {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + s * 16));
+            __m256i idx = _mm256_set_m128i(_mm_and_si128(_mm_srli_epi16(c, 4), low_nibble),
+                                           _mm_and_si128(c, low_nibble));
+            __m256i table = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + s * 16)));
+            __m256i v = _mm256_shuffle_epi8(table, idx);
+
+            acc_lo = _mm256_add_epi16(acc_lo, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+            acc_hi = _mm256_add_epi16(acc_hi, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + b * 32), acc_lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + b * 32 + 16), acc_hi);
+    }
+}
+
+static inline int32_t hsum256_epi32(__m256i v) {
+    __m128i lo = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    lo = _mm_add_epi32(lo, _mm_unpackhi_epi64(lo, lo));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, 1));
+    return _mm_cvtsi128_si32(lo);
+}
+
+/**
+ * fp16 rows widened with vcvtph2ps, 16 dims per iteration over two
+ * accumulators; the tail converts one element at a time.
+ */
+template <Metric M>
+static void f16_scan_avx2(const float* query, const uint16_t* base, size_t n,
+                          size_t stride, size_t dim, float* out) {
+    for (size_t r = 0; r < n; ++r) {
+        const uint16_t* row = base + r * stride;
+        __m256 s0 = _mm256_setzero_ps();
+        __m256 s1 = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            __m256 x0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+            __m256 x1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 8)));
+            __m256 q0 = _mm256_loadu_ps(query + i);
+            __m256 q1 = _mm256_loadu_ps(query + i + 8);
+            if (M == Metric::Euclidean) {
+                __m256 d0 = _mm256_sub_ps(q0, x0);
+                __m256 d1 = _mm256_sub_ps(q1, x1);
+                s0 = _mm256_fmadd_ps(d0, d0, s0);
+                s1 = _mm256_fmadd_ps(d1, d1, s1);
+            } else {
+                s0 = _mm256_fmadd_ps(q0, x0, s0);
+                s1 = _mm256_fmadd_ps(q1, x1, s1);
+            }
+        }
+
+        float sum = hsum256(_mm256_add_ps(s0, s1));
+        for (; i < dim; ++i) {
+            float x = _cvtsh_ss(row[i]);
+            if (M == Metric::Euclidean) {
+                float diff = query[i] - x;
+                sum += diff * diff;
+            } else {
+                sum += query[i] * x;
+            }
+        }
+        out[r] = M == Metric::Euclidean ? sum : 1.0f - sum;
+    }
+}
+
+/**
+ * u8 x s8 dot products with pmaddubsw (pairwise products to int16) and
+ * pmaddwd against ones (pairs to int32), 64 codes per iteration.
+ */
+static void u8_dot_scan_avx2(const int8_t* query, const uint8_t* base, size_t n,
+                             size_t stride, size_t dim, int32_t* out) {
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    for (size_t r = 0; r < n; ++r) {
+        const uint8_t* row = base + r * stride;
+        __m256i s0 = _mm256_setzero_si256();
+        __m256i s1 = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 64 <= dim; i += 64) {
+            __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+            __m256i c1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i + 32));
+            __m256i q0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + i));
+            __m256i q1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + i + 32));
+            s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(_mm256_maddubs_epi16(c0, q0), ones));
+            s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(_mm256_maddubs_epi16(c1, q1), ones));
+        }
+        for (; i + 32 <= dim; i += 32) {
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+            __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + i));
+            s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(_mm256_maddubs_epi16(c, q), ones));
+        }
+
+        int32_t sum = hsum256_epi32(_mm256_add_epi32(s0, s1));
+        for (; i < dim; ++i) {
+            sum += static_cast<int32_t>(row[i]) * query[i];
+        }
+        out[r] = sum;
+    }
+}
+
+/**
+ * Hamming distances with the popcnt instruction, two independent counters
+ * per row (the scalar kernel uses __builtin_popcountll, one counter, which
+ * is a library call without -mpopcnt).
+ */
+static void hamming_scan_avx2(const uint64_t* query, const uint64_t* base, size_t n,
+                              size_t words, uint32_t* out) {
+    for (size_t r = 0; r < n; ++r) {
+        const uint64_t* row = base + r * words;
+        uint64_t s0 = 0;
+        uint64_t s1 = 0;
+
+        size_t w = 0;
+        for (; w + 2 <= words; w += 2) {
+            s0 += _mm_popcnt_u64(query[w] ^ row[w]);
+            s1 += _mm_popcnt_u64(query[w + 1] ^ row[w + 1]);
+        }
+        if (w < words) {
+            s0 += _mm_popcnt_u64(query[w] ^ row[w]);
+        }
+        out[r] = static_cast<uint32_t>(s0 + s1);
+    }
+}
+
+/**
+ * 4 queries x 2 rows register tile: 8 accumulators plus 6 operand
+ * registers fit the 16 ymm registers, and each row load feeds 4 FMAs.
+ */
+static void dot_tile_avx2(const float* queries, size_t nq, const float* base, size_t n,
+                          size_t stride, size_t dim, float* out, size_t ld) {
+    constexpr size_t MR = 4;
+    constexpr size_t NR = 2;
+
+    size_t i = 0;
+    for (; i + MR <= nq; i += MR) {
+        const float* q = queries + i * dim;
+
+        size_t j = 0;
+        for (; j + NR <= n; j += NR) {
+            const float* x = base + j * stride;
+            __m256 acc[MR][NR];
+            for (size_t r = 0; r < MR; ++r) {
+                for (size_t c = 0; c < NR; ++c) {
+                    acc[r][c] = _mm256_setzero_ps();
+                }
+            }
+
+            size_t d = 0;
+            for (; d + 8 <= dim; d += 8) {
+                __m256 x0 = _mm256_loadu_ps(x + d);
+                __m256 x1 = _mm256_loadu_ps(x + stride + d);
+                for (size_t r = 0; r < MR; ++r) {
+                    __m256 v = _mm256_loadu_ps(q + r * dim + d);
+                    acc[r][0] = _mm256_fmadd_ps(v, x0, acc[r][0]);
+                    acc[r][1] = _mm256_fmadd_ps(v, x1, acc[r][1]);
+                }
+            }
+            if (d < dim) {
+                __m256i mask = tail_mask(dim - d);
+                __m256 x0 = _mm256_maskload_ps(x + d, mask);
+                __m256 x1 = _mm256_maskload_ps(x + stride + d, mask);
+                for (size_t r = 0; r < MR; ++r) {
+                    __m256 v = _mm256_maskload_ps(q + r * dim + d, mask);
+                    acc[r][0] = _mm256_fmadd_ps(v, x0, acc[r][0]);
+                    acc[r][1] = _mm256_fmadd_ps(v, x1, acc[r][1]);
+                }
+            }
+
+            for (size_t r = 0; r < MR; ++r) {
+                for (size_t c = 0; c < NR; ++c) {
+                    out[(i + r) * ld + j + c] = hsum256(acc[r][c]);
+                }
+            }
+        }
+        for (; j < n; ++j) {
+            for (size_t r = 0; r < MR; ++r) {
+                out[(i + r) * ld + j] = Avx2Kernels::inner_product<0>(q + r * dim, base + j * stride, dim);
+            }
+        }
+    }
+
+    // Leftover queries, one row at a time
+    for (; i < nq; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            out[i * ld + j] = Avx2Kernels::inner_product<0>(queries + i * dim, base + j * stride, dim);
+        }
+    }
+}
+
+void register_avx2_kernels(DistanceKernels& k) {
+    register_kernel_table<Avx2Kernels>(k, "avx2");
+    k.pq4_scan = pq4_scan_avx2;
+    k.f16_scan[static_cast<int>(Metric::Euclidean)] = f16_scan_avx2<Metric::Euclidean>;
+    k.f16_scan[static_cast<int>(Metric::Angular)] = f16_scan_avx2<Metric::Angular>;
+    k.u8_dot_scan = u8_dot_scan_avx2;
+    k.hamming_scan = hamming_scan_avx2;
+    k.dot_tile = dot_tile_avx2;
+}
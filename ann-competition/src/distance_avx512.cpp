@@ -0,0 +1,187 @@
+#include "../include/distance.hpp"
+#include "../include/scan_kernels.hpp"
+#include <immintrin.h>
+
+/**
+ * AVX-512 kernels.
+ * Compiled with -mavx512f -mavx512bw -mavx512dq -mavx512vl (see
+ * CMakeLists.txt); the tail uses a masked load, so there is no scalar loop.
+ */
+
+static inline __mmask16 tail_mask(size_t n) {
+    return static_cast<__mmask16>((1u << n) - 1u);
+}
+
+struct Avx512Kernels {
+    template <size_t Dim>
+    static float l2_sqr(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+
+        __m512 s0 = _mm512_setzero_ps();
+        __m512 s1 = _mm512_setzero_ps();
+        __m512 s2 = _mm512_setzero_ps();
+        __m512 s3 = _mm512_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 64 <= d; i += 64) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+            __m512 d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+            __m512 d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+            s0 = _mm512_fmadd_ps(d0, d0, s0);
+            s1 = _mm512_fmadd_ps(d1, d1, s1);
+            s2 = _mm512_fmadd_ps(d2, d2, s2);
+            s3 = _mm512_fmadd_ps(d3, d3, s3);
+        }
+        for (; i + 16 <= d; i += 16) {
+            __m512 v = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            s0 = _mm512_fmadd_ps(v, v, s0);
+        }
+        if (i < d) {
+            __mmask16 mask = tail_mask(d - i);
+            __m512 v = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                     _mm512_maskz_loadu_ps(mask, b + i));
+            s1 = _mm512_fmadd_ps(v, v, s1);
+        }
+
+        return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+    }
+
+    template <size_t Dim>
+    static float inner_product(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+
+        __m512 s0 = _mm512_setzero_ps();
+        __m512 s1 = _mm512_setzero_ps();
+        __m512 s2 = _mm512_setzero_ps();
+        __m512 s3 = _mm512_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 64 <= d; i += 64) {
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+            s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+            s2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), s2);
+            s3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), s3);
+        }
+        for (; i + 16 <= d; i += 16) {
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+        }
+        if (i < d) {
+            __mmask16 mask = tail_mask(d - i);
+            s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                 _mm512_maskz_loadu_ps(mask, b + i), s1);
+        }
+
+        return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+    }
+};
+
+/**
+ * fp16 rows widened with vcvtph2ps, 32 dims per iteration; the tail uses a
+ * masked 16-bit load.
+ */
+template <Metric M>
+static void f16_scan_avx512(const float* query, const uint16_t* base, size_t n,
+                            size_t stride, size_t dim, float* out) {
+    for (size_t r = 0; r < n; ++r) {
+        const uint16_t* row = base + r * stride;
+        __m512 s0 = _mm512_setzero_ps();
+        __m512 s1 = _mm512_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 32 <= dim; i += 32) {
+            __m512 x0 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i)));
+            __m512 x1 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i + 16)));
+            __m512 q0 = _mm512_loadu_ps(query + i);
+            __m512 q1 = _mm512_loadu_ps(query + i + 16);
+            if (M == Metric::Euclidean) {
+                __m512 d0 = _mm512_sub_ps(q0, x0);
+                __m512 d1 = _mm512_sub_ps(q1, x1);
+                s0 = _mm512_fmadd_ps(d0, d0, s0);
+                s1 = _mm512_fmadd_ps(d1, d1, s1);
+            } else {
+                s0 = _mm512_fmadd_ps(q0, x0, s0);
+                s1 = _mm512_fmadd_ps(q1, x1, s1);
+            }
+        }
+        for (; i < dim; i += 16) {
+            __mmask16 mask = tail_mask(dim - i < 16 ? dim - i : 16);
+            __m512 x = _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(mask, row + i));
+            __m512 q = _mm512_maskz_loadu_ps(mask, query + i);
+            if (M == Metric::Euclidean) {
+                __m512 d = _mm512_sub_ps(q, x);
+                s0 = _mm512_fmadd_ps(d, d, s0);
+            } else {
+                s0 = _mm512_fmadd_ps(q, x, s0);
+            }
+        }
+
+        float sum = _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+        out[r] = M == Metric::Euclidean ? sum : 1.0f - sum;
+    }
+}
+
+/**
+ * 4 queries x 4 rows register tile: 16 accumulators plus 8 operand
+ * registers out of 32 zmm; the dim tail uses masked loads.
+ */
+static void dot_tile_avx512(const float* queries, size_t nq, const float* base, size_t n,
+                            size_t stride, size_t dim, float* out, size_t ld) {
+    constexpr size_t MR = 4;
+    constexpr size_t NR = 4;
+
+    size_t i = 0;
+    for (; i + MR <= nq; i += MR) {
+        const float* q = queries + i * dim;
+
+        size_t j = 0;
+        for (; j + NR <= n; j += NR) {
+            const float* x = base + j * stride;
+            __m512 acc[MR][NR];
+            for (size_t r = 0; r < MR; ++r) {
+                for (size_t c = 0; c < NR; ++c) {
+                    acc[r][c] = _mm512_setzero_ps();
+                }
+            }
+
+            for (size_t d = 0; d < dim; d += 16) {
+                __mmask16 mask = tail_mask(dim - d < 16 ? dim - d : 16);
+                __m512 xv[NR];
+                for (size_t c = 0; c < NR; ++c) {
+                    xv[c] = _mm512_maskz_loadu_ps(mask, x + c * stride + d);
+                }
+                for (size_t r = 0; r < MR; ++r) {
+                    __m512 v = _mm512_maskz_loadu_ps(mask, q + r * dim + d);
+                    for (size_t c = 0; c < NR; ++c) {
+                        acc[r][c] = _mm512_fmadd_ps(v, xv[c], acc[r][c]);
+                    }
+                }
+            }
+
+            for (size_t r = 0; r < MR; ++r) {
+                for (size_t c = 0; c < NR; ++c) {
+                    out[(i + r) * ld + j + c] = _mm512_reduce_add_ps(acc[r][c]);
+                }
+            }
+        }
+        for (; j < n; ++j) {
+            for (size_t r = 0; r < MR; ++r) {
+                out[(i + r) * ld + j] = Avx512Kernels::inner_product<0>(q + r * dim, base + j * stride, dim);
+            }
+        }
+    }
+
+    // Leftover queries, one row at a time
+    for (; i < nq; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            out[i * ld + j] = Avx512Kernels::inner_product<0>(queries + i * dim, base + j * stride, dim);
+        }
+    }
+}
+
+void register_avx512_kernels(DistanceKernels& k) {
+    register_kernel_table<Avx512Kernels>(k, "avx512");
+    k.f16_scan[static_cast<int>(Metric::Euclidean)] = f16_scan_avx512<Metric::Euclidean>;
+    k.f16_scan[static_cast<int>(Metric::Angular)] = f16_scan_avx512<Metric::Angular>;
+    k.dot_tile = dot_tile_avx512;
+}
@@ -0,0 +1,41 @@
+#include "../include/distance.hpp"
+#include <immintrin.h>
+
+/**
+ * AVX-512 VNNI kernels.
+ * Compiled with the AVX-512 flags plus -mavx512vnni (see CMakeLists.txt);
+ * registered on top of the AVX-512 table only when CPUID reports VNNI.
+ */
+
+/**
+ * u8 x s8 dot products with vpdpbusd, which multiplies, sums groups of four
+ * and accumulates into int32 in one instruction. 128 codes per iteration;
+ * the tail uses a masked byte load.
+ */
+static void u8_dot_scan_vnni(const int8_t* query, const uint8_t* base, size_t n,
+                             size_t stride, size_t dim, int32_t* out) {
+    for (size_t r = 0; r < n; ++r) {
+        const uint8_t* row = base + r * stride;
+        __m512i s0 = _mm512_setzero_si512();
+        __m512i s1 = _mm512_setzero_si512();
+
+        size_t i = 0;
+        for (; i + 128 <= dim; i += 128) {
+            s0 = _mm512_dpbusd_epi32(s0, _mm512_loadu_si512(row + i), _mm512_loadu_si512(query + i));
+            s1 = _mm512_dpbusd_epi32(s1, _mm512_loadu_si512(row + i + 64),
+                                     _mm512_loadu_si512(query + i + 64));
+        }
+        for (; i < dim; i += 64) {
+            size_t rest = dim - i;
+            __mmask64 mask = rest >= 64 ? ~__mmask64(0) : ((__mmask64(1) << rest) - 1);
+            s0 = _mm512_dpbusd_epi32(s0, _mm512_maskz_loadu_epi8(mask, row + i),
+                                     _mm512_maskz_loadu_epi8(mask, query + i));
+        }
+
+        out[r] = _mm512_reduce_add_epi32(_mm512_add_epi32(s0, s1));
+    }
+}
+
+void register_avx512_vnni_kernels(DistanceKernels& k) {
+    k.u8_dot_scan = u8_dot_scan_vnni;
+}
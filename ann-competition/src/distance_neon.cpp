@@ -0,0 +1,284 @@
+#include "../include/distance.hpp"
+#include "../include/scan_kernels.hpp"
+#include <arm_neon.h>
+
+/**
+ * NEON kernels for ARM64.
+ * NEON is part of the AArch64 baseline, so no special flags are required.
+ * The int8 dot product uses sdot when the target has the dot-product
+ * extension (__ARM_FEATURE_DOTPROD, e.g. ANN_NATIVE_ARCH=ON on Apple M1 or
+ * Graviton 2+) and widening multiply-adds otherwise.
+ */
+
+struct NeonKernels {
+    template <size_t Dim>
+    static float l2_sqr(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+
+        float32x4_t s0 = vdupq_n_f32(0.0f);
+        float32x4_t s1 = vdupq_n_f32(0.0f);
+        float32x4_t s2 = vdupq_n_f32(0.0f);
+        float32x4_t s3 = vdupq_n_f32(0.0f);
+
+        size_t i = 0;
+        for (; i + 16 <= d; i += 16) {
+            float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+            float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+            float32x4_t d2 = vsubq_f32(vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+            float32x4_t d3 = vsubq_f32(vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+            s0 = vfmaq_f32(s0, d0, d0);
+            s1 = vfmaq_f32(s1, d1, d1);
+            s2 = vfmaq_f32(s2, d2, d2);
+            s3 = vfmaq_f32(s3, d3, d3);
+        }
+        for (; i + 4 <= d; i += 4) {
+            float32x4_t v = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+            s0 = vfmaq_f32(s0, v, v);
+        }
+
+        float sum = vaddvq_f32(vaddq_f32(vaddq_f32(s0, s1), vaddq_f32(s2, s3)));
+        for (; i < d; ++i) {
+            float diff = a[i] - b[i];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    template <size_t Dim>
+    static float inner_product(const float* a, const float* b, size_t dim) {
+        const size_t d = Dim ? Dim : dim;
+
+        float32x4_t s0 = vdupq_n_f32(0.0f);
+        float32x4_t s1 = vdupq_n_f32(0.0f);
+        float32x4_t s2 = vdupq_n_f32(0.0f);
+        float32x4_t s3 = vdupq_n_f32(0.0f);
+
+        size_t i = 0;
+        for (; i + 16 <= d; i += 16) {
+            s0 = vfmaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+            s1 = vfmaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+            s2 = vfmaq_f32(s2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+            s3 = vfmaq_f32(s3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+        }
+        for (; i + 4 <= d; i += 4) {
+            s0 = vfmaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+        }
+
+        float sum = vaddvq_f32(vaddq_f32(vaddq_f32(s0, s1), vaddq_f32(s2, s3)));
+        for (; i < d; ++i) {
+            sum += a[i] * b[i];
+        }
+        return sum;
+    }
+};
+
+/**
+ * 4-bit fast-scan with tbl: one 16-entry LUT register per subspace, 32
+ * codes looked up per block (low nibbles: vectors 0-15, high: 16-31).
+ */
+static void pq4_scan_neon(const uint8_t* codes, size_t n_blocks, size_t m,
+                          const uint8_t* lut, uint16_t* out) {
+    const uint8x16_t low_nibble = vdupq_n_u8(0x0F);
+
+    for (size_t b = 0; b < n_blocks; ++b) {
+        const uint8_t* block = codes + b * m * 16;
+        uint16x8_t a0 = vdupq_n_u16(0);
+        uint16x8_t a1 = vdupq_n_u16(0);
+        uint16x8_t a2 = vdupq_n_u16(0);
+        uint16x8_t a3 = vdupq_n_u16(0);
+
+        for (size_t s = 0; s < m; ++s) {
+            uint8x16_t c = vld1q_u8(block + s * 16);
+            uint8x16_t table = vld1q_u8(lut + s * 16);
+            uint8x16_t lo = vqtbl1q_u8(table, vandq_u8(c, low_nibble));
+            uint8x16_t hi = vqtbl1q_u8(table, vshrq_n_u8(c, 4));
+            a0 = vaddw_u8(a0, vget_low_u8(lo));
+            a1 = vaddw_u8(a1, vget_high_u8(lo));
+            a2 = vaddw_u8(a2, vget_low_u8(hi));
+            a3 = vaddw_u8(a3, vget_high_u8(hi));
+        }
+
+        vst1q_u16(out + b * 32, a0);
+        vst1q_u16(out + b * 32 + 8, a1);
+        vst1q_u16(out + b * 32 + 16, a2);
+        vst1q_u16(out + b * 32 + 24, a3);
+    }
+}
+
+/**
+ * fp16 rows widened with fcvtl, 8 dims per iteration.
+ */
+template <Metric M>
+static void f16_scan_neon(const float* query, const uint16_t* base, size_t n,
+                          size_t stride, size_t dim, float* out) {
+    for (size_t r = 0; r < n; ++r) {
+        const uint16_t* row = base + r * stride;
+        float32x4_t s0 = vdupq_n_f32(0.0f);
+        float32x4_t s1 = vdupq_n_f32(0.0f);
+
+        size_t i = 0;
+        for (; i + 8 <= dim; i += 8) {
+            float16x8_t h = vreinterpretq_f16_u16(vld1q_u16(row + i));
+            float32x4_t x0 = vcvt_f32_f16(vget_low_f16(h));
+            float32x4_t x1 = vcvt_high_f32_f16(h);
+            float32x4_t q0 = vld1q_f32(query + i);
+            float32x4_t q1 = vld1q_f32(query + i + 4);
+            if (M == Metric::Euclidean) {
+                float32x4_t d0 = vsubq_f32(q0, x0);
+                float32x4_t d1 = vsubq_f32(q1, x1);
+                s0 = vfmaq_f32(s0, d0, d0);
+                s1 = vfmaq_f32(s1, d1, d1);
+            } else {
+                s0 = vfmaq_f32(s0, q0, x0);
+                s1 = vfmaq_f32(s1, q1, x1);
+            }
+        }
+
+        float sum = vaddvq_f32(vaddq_f32(s0, s1));
+        for (; i < dim; ++i) {
+            float x = half_to_float(row[i]);
+            if (M == Metric::Euclidean) {
+                float diff = query[i] - x;
+                sum += diff * diff;
+            } else {
+                sum += query[i] * x;
+            }
+        }
+        out[r] = M == Metric::Euclidean ? sum : 1.0f - sum;
+    }
+}
+
+/**
+ * u8 x s8 dot products, 16 codes per iteration.
+ *
+ * sdot is signed x signed, so codes are shifted to c - 128 with an xor and
+ * the 128 * sum(q) term is added back at the end.
+ */
+static void u8_dot_scan_neon(const int8_t* query, const uint8_t* base, size_t n,
+                             size_t stride, size_t dim, int32_t* out) {
+    int32_t query_sum = 0;
+    for (size_t i = 0; i < dim; ++i) {
+        query_sum += query[i];
+    }
+
+    for (size_t r = 0; r < n; ++r) {
+        const uint8_t* row = base + r * stride;
+        int32x4_t acc = vdupq_n_s32(0);
+
+        size_t i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            int8x16_t c = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(row + i), vdupq_n_u8(0x80)));
+            int8x16_t q = vld1q_s8(query + i);
+#if defined(__ARM_FEATURE_DOTPROD)
+            acc = vdotq_s32(acc, c, q);
+#else
+            int16x8_t lo = vmull_s8(vget_low_s8(c), vget_low_s8(q));
+            int16x8_t hi = vmull_high_s8(c, q);
+            acc = vpadalq_s16(acc, lo);
+            acc = vpadalq_s16(acc, hi);
+#endif
+        }
+
+        int32_t sum = vaddvq_s32(acc);
+        for (; i < dim; ++i) {
+            sum += (static_cast<int32_t>(row[i]) - 128) * query[i];
+        }
+        out[r] = sum + 128 * query_sum;
+    }
+}
+
+/**
+ * Hamming distances with cnt (per-byte popcount), 128 bits per iteration,
+ * pairwise-accumulated into uint16 lanes.
+ */
+static void hamming_scan_neon(const uint64_t* query, const uint64_t* base, size_t n,
+                              size_t words, uint32_t* out) {
+    for (size_t r = 0; r < n; ++r) {
+        const uint64_t* row = base + r * words;
+        uint16x8_t acc = vdupq_n_u16(0);
+
+        size_t w = 0;
+        for (; w + 2 <= words; w += 2) {
+            uint64x2_t x = veorq_u64(vld1q_u64(query + w), vld1q_u64(row + w));
+            acc = vpadalq_u8(acc, vcntq_u8(vreinterpretq_u8_u64(x)));
+        }
+
+        uint32_t sum = vaddlvq_u16(acc);
+        if (w < words) {
+            sum += static_cast<uint32_t>(__builtin_popcountll(query[w] ^ row[w]));
+        }
+        out[r] = sum;
+    }
+}
+
+/**
+ * 4 queries x 4 rows register tile: 16 accumulators plus 8 operand
+ * registers out of 32; the dim tail is scalar.
+ */
+static void dot_tile_neon(const float* queries, size_t nq, const float* base, size_t n,
+                          size_t stride, size_t dim, float* out, size_t ld) {
+    constexpr size_t MR = 4;
+    constexpr size_t NR = 4;
+
+    size_t i = 0;
+    for (; i + MR <= nq; i += MR) {
+        const float* q = queries + i * dim;
+
+        size_t j = 0;
+        for (; j + NR <= n; j += NR) {
+            const float* x = base + j * stride;
+            float32x4_t acc[MR][NR];
+            for (size_t r = 0; r < MR; ++r) {
+                for (size_t c = 0; c < NR; ++c) {
+                    acc[r][c] = vdupq_n_f32(0.0f);
+                }
+            }
+
+            size_t d = 0;
+            for (; d + 4 <= dim; d += 4) {
+                float32x4_t xv[NR];
+                for (size_t c = 0; c < NR; ++c) {
+                    xv[c] = vld1q_f32(x + c * stride + d);
+                }
+                for (size_t r = 0; r < MR; ++r) {
+                    float32x4_t v = vld1q_f32(q + r * dim + d);
+                    for (size_t c = 0; c < NR; ++c) {
+                        acc[r][c] = vfmaq_f32(acc[r][c], v, xv[c]);
+                    }
+                }
+            }
+
+            for (size_t r = 0; r < MR; ++r) {
+                for (size_t c = 0; c < NR; ++c) {
+                    float sum = vaddvq_f32(acc[r][c]);
+                    for (size_t t = d; t < dim; ++t) {
+                        sum += q[r * dim + t] * x[c * stride + t];
+                    }
+                    out[(i + r) * ld + j + c] = sum;
+                }
+            }
+        }
+        for (; j < n; ++j) {
+            for (size_t r = 0; r < MR; ++r) {
+                out[(i + r) * ld + j] = NeonKernels::inner_product<0>(q + r * dim, base + j * stride, dim);
+            }
+        }
+    }
+
+    // Leftover queries, one row at a time
+    for (; i < nq; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            out[i * ld + j] = NeonKernels::inner_product<0>(queries + i * dim, base + j * stride, dim);
+        }
+    }
+}
+
+void register_neon_kernels(DistanceKernels& k) {
+    register_kernel_table<NeonKernels>(k, "neon");
+    k.pq4_scan = pq4_scan_neon;
+    k.f16_scan[static_cast<int>(Metric::Euclidean)] = f16_scan_neon<Metric::Euclidean>;
+    k.f16_scan[static_cast<int>(Metric::Angular)] = f16_scan_neon<Metric::Angular>;
+    k.u8_dot_scan = u8_dot_scan_neon;
+    k.hamming_scan = hamming_scan_neon;
+    k.dot_tile = dot_tile_neon;
+}
@@ -0,0 +1,1141 @@
+#include "../include/ann_interface.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include "../include/index_lock.hpp"
+#include "../include/topk.hpp"
+#include "../include/vector_store.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <random>
+
+/**
+ * Prefetch the cache lines of [p, p + bytes) for reading.
+ */
+static inline void prefetch_lines(const void* p, size_t bytes) {
+    const char* line = static_cast<const char*>(p);
+    for (size_t offset = 0; offset < bytes; offset += 64) {
+        __builtin_prefetch(line + offset, 0, 3);
+    }
+}
+
+/**
+ * HNSW (Hierarchical Navigable Small World) graph index.
+ *
+ * Malkov & Yashunin, "Efficient and robust approximate nearest neighbor
+ * search using Hierarchical Navigable Small World graphs" (2016).
+ *
+ * Each vector is assigned a random level with P(level >= l) = M^-l. Upper
+ * levels form progressively sparser graphs used to find a good entry point;
+ * level 0 holds every vector with up to 2*M neighbors and is where the
+ * actual beam search (width ef_search) happens.
+ *
+ * Parameters (set_param):
+ * - M:               neighbors per node on upper levels (2*M on level 0)
+ * - ef_construction: beam width while inserting (build quality vs time)
+ * - ef_search:       beam width while querying (recall vs QPS)
+ * - seed:            RNG seed for level assignment
+ * - filter_brute_force: filters allowing at most this fraction of the ids
+ *                    are answered by an exact scan of the allowed ids
+ *                    (query; 0 = always search the graph)
+ * - reorder:         BFS-renumber the nodes at the end of fit() (build)
+ *
+ * fit() inserts nodes in parallel batches (see insert_batch()); the graph
+ * depends only on the data, the parameters and the seed.
+ *
+ * add() inserts more nodes the same way: neighbor searches run alongside
+ * queries and only linking pauses them. remove() tombstones nodes, which
+ * still route searches but never appear in results; compact() repairs the
+ * graph around them (each neighbor of a deleted node is relinked from the
+ * deleted node's own neighbors, as in hnswlib) so searches stop visiting
+ * them. Deleted vectors keep their rows, because ids are row positions.
+ *
+ * search_filtered() runs the usual beam search but, like tombstones,
+ * lets ids the filter rejects route the search without entering the
+ * result beam, so the beam fills with allowed ids only. The rarer those
+ * are, the more of the graph that walks, so filters below
+ * filter_brute_force are scanned exactly instead.
+ *
+ * Memory layout: each node is one cache-line aligned block of nodes_
+ * holding its level-0 list followed by its vector, so expanding a
+ * candidate touches one region instead of a list array and a vector
+ * array. The beam search prefetches the next candidate's list and the
+ * vectors of the neighbors it is about to score, and tracks visited nodes
+ * with per-thread epoch tags instead of clearing flags after each query.
+ * With reorder (on by default) fit() finally renumbers the nodes in BFS
+ * order of the level-0 graph, so neighbors sit in nearby blocks; callers
+ * keep seeing the original ids.
+ *
+ * save() / load() persist the graph; a loaded index maps the node blocks
+ * straight from the file.
+ */
+class HNSWIndex : public ANNAlgorithm {
+public:
+    void init(const std::string& metric, int dimension) override {
+        metric_ = metric;
+        dimension_ = dimension;
+        metric_type_ = parse_metric(metric);
+        scan_ = resolve_scan(metric_type_, dimension);
+        scan_ids_ = resolve_scan_ids(metric_type_, dimension);
+        prefetch_bytes_ = std::min(kPrefetchVectorBytes, static_cast<size_t>(dimension) * sizeof(float));
+    }
+
+    void set_param(const std::string& name, double value) override {
+        if (name == "M") {
+            M_ = std::max(2, static_cast<int>(value));
+        } else if (name == "ef_construction") {
+            ef_construction_ = std::max(1, static_cast<int>(value));
+        } else if (name == "ef_search") {
+            ef_search_ = std::max(1, static_cast<int>(value));
+        } else if (name == "seed") {
+            seed_ = static_cast<unsigned>(value);
+        } else if (name == "filter_brute_force") {
+            filter_brute_force_ = std::max(0.0, std::min(1.0, value));
+        } else if (name == "reorder") {
+            reorder_ = value != 0.0;
+        } else {
+            ANNAlgorithm::set_param(name, value);
+        }
+    }
+
+    std::map<std::string, double> get_params() const override {
+        return {
+            {"M", M_},
+            {"ef_construction", ef_construction_},
+            {"ef_search", ef_search_},
+            {"seed", seed_},
+            {"filter_brute_force", filter_brute_force_},
+            {"reorder", reorder_ ? 1.0 : 0.0},
+        };
+    }
+
+    void fit(const float* data, size_t n_samples) override {
+        auto write = lock_.write();
+        init_layout();
+        nodes_.allocate(n_samples, node_floats());
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n_samples); ++i) {
+            std::memcpy(vector_at(static_cast<int>(i)), data + i * dimension_,
+                        dimension_ * sizeof(float));
+        }
+        if (metric_type_ == Metric::Angular) {
+            normalize_rows(vectors(), n_samples, nodes_.stride(), dimension_);
+        }
+        build_graph();
+    }
+
+    void fit_begin(size_t n_total) override {
+        auto write = lock_.write();
+        init_layout();
+        nodes_.clear();
+        nodes_.reserve(n_total, node_floats());
+    }
+
+    void fit_chunk(const float* data, size_t n_samples) override {
+        auto write = lock_.write();
+        append_nodes(data, n_samples);
+    }
+
+    void fit_end() override {
+        auto write = lock_.write();
+        build_graph();
+    }
+
+    void add(const float* data, size_t n_new) override {
+        auto update = lock_.update();
+        if (max_m0_ == 0) {
+            throw std::runtime_error("HNSW: add() requires fit() or load() first");
+        }
+        if (n_new == 0) {
+            return;
+        }
+
+        size_t begin = n_samples_;
+        size_t end = begin + n_new;
+        std::mt19937 rng(seed_ + static_cast<unsigned>(begin));
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::vector<int> levels(n_new);
+        for (int& level : levels) {
+            level = static_cast<int>(-std::log(1.0 - uniform(rng)) * level_mult_);
+        }
+
+        // Grow every per-node array; new nodes stay unreachable until linked
+        {
+            auto write = lock_.write();
+            append_nodes(data, n_new);
+            if (!order_.empty()) {
+                for (size_t i = begin; i < end; ++i) {
+                    order_.push_back(static_cast<int>(i));
+                    position_.push_back(static_cast<int>(i));
+                }
+            }
+            levels_.insert(levels_.end(), levels.begin(), levels.end());
+            upper_links_.resize(end);
+            for (size_t i = begin; i < end; ++i) {
+                if (levels_[i] > 0) {
+                    upper_links_[i].assign(static_cast<size_t>(levels_[i]) * (max_m_ + 1), 0);
+                }
+            }
+            if (!deleted_.empty()) {
+                deleted_.resize(end, 0);
+            }
+            if (entry_point_ < 0) {
+                entry_point_ = static_cast<int>(begin);
+                max_level_ = levels_[begin];
+                n_samples_ = ++begin;
+            }
+        }
+
+        while (begin < end) {
+            size_t batch = std::max<size_t>(1, begin / kInsertBatchFraction);
+            size_t stop = std::min(end, begin + std::min(batch, kMaxInsertBatch));
+            {
+                auto read = lock_.read();
+                link_batch(begin, stop);
+            }
+            auto write = lock_.write();
+            commit_batch(begin, stop);
+            n_samples_ = stop;
+            begin = stop;
+        }
+    }
+
+    void remove(const std::vector<int>& ids) override {
+        auto update = lock_.update();
+        auto write = lock_.write();
+        for (int id : ids) {
+            if (id < 0 || static_cast<size_t>(id) >= n_samples_) {
+                throw std::runtime_error("HNSW: remove() of unknown id " + std::to_string(id));
+            }
+        }
+        if (deleted_.empty()) {
+            deleted_.assign(n_samples_, 0);
+        }
+        for (int id : ids) {
+            int node = internal(id);
+            n_deleted_ += deleted_[node] == 0;
+            deleted_[node] = 1;
+        }
+    }
+
+    void compact() override {
+        auto update = lock_.update();
+        if (n_deleted_ == 0) {
+            return;
+        }
+
+        // Plan the new lists while queries keep running...
+        std::vector<Repair> repairs;
+        {
+            auto read = lock_.read();
+            #pragma omp parallel
+            {
+                std::vector<Repair> local;
+
+                #pragma omp for schedule(dynamic, 256)
+                for (long long id = 0; id < static_cast<long long>(n_samples_); ++id) {
+                    if (deleted_[id]) {
+                        continue;
+                    }
+                    for (int l = 0; l <= levels_[id]; ++l) {
+                        Repair repair;
+                        if (plan_repair(static_cast<int>(id), l, repair)) {
+                            local.push_back(std::move(repair));
+                        }
+                    }
+                }
+
+                #pragma omp critical
+                for (Repair& repair : local) {
+                    repairs.push_back(std::move(repair));
+                }
+            }
+        }
+
+        // ...then swap them in
+        auto write = lock_.write();
+        for (const Repair& repair : repairs) {
+            int* links = links_at(repair.node, repair.level);
+            links[0] = static_cast<int>(repair.links.size());
+            std::copy(repair.links.begin(), repair.links.end(), links + 1);
+        }
+        for (size_t id = 0; id < n_samples_; ++id) {
+            if (deleted_[id]) {
+                for (int l = 0; l <= levels_[id]; ++l) {
+                    links_at(static_cast<int>(id), l)[0] = 0;
+                }
+            }
+        }
+
+        // A deleted entry point is replaced by the highest live node
+        if (entry_point_ >= 0 && deleted_[entry_point_]) {
+            entry_point_ = -1;
+            max_level_ = -1;
+            for (size_t id = 0; id < n_samples_; ++id) {
+                if (!deleted_[id] && levels_[id] > max_level_) {
+                    entry_point_ = static_cast<int>(id);
+                    max_level_ = levels_[id];
+                }
+            }
+        }
+    }
+
+    std::vector<int> query(const float* query, int k) override {
+        return search_ids(query, k);
+    }
+
+    void search(const float* query, int k, int* ids, float* distances) override {
+        search_graph(query, k, nullptr, ids, distances);
+    }
+
+    void search_filtered(const float* query, int k, const IdFilter& filter, int* ids,
+                         float* distances) override {
+        search_graph(query, k, &filter, ids, distances);
+    }
+
+    void save(const std::string& path) const override {
+        auto read = lock_.read();
+        IndexWriter out(path, "hnsw", metric_, dimension_);
+        out.set("M", M_);
+        out.set("ef_construction", ef_construction_);
+        out.set("ef_search", ef_search_);
+        out.set("seed", seed_);
+        out.set("filter_brute_force", filter_brute_force_);
+        out.set("max_m", max_m_);
+        out.set("max_m0", max_m0_);
+        out.set("level_mult", level_mult_);
+        out.set("entry_point", entry_point_);
+        out.set("max_level", max_level_);
+        out.set("n_samples", static_cast<double>(n_samples_));
+        out.set("reorder", reorder_ ? 1.0 : 0.0);
+        out.set("link_floats", static_cast<double>(link_floats_));
+        out.write_store("nodes", nodes_);
+        out.write("levels", levels_);
+        if (!order_.empty()) {
+            out.write("order", order_);
+        }
+
+        // Upper levels are sparse (about n / M nodes): one flat array,
+        // each node's lists sized by its level
+        std::vector<int> upper;
+        for (const auto& links : upper_links_) {
+            upper.insert(upper.end(), links.begin(), links.end());
+        }
+        out.write("upper_links", upper);
+        if (n_deleted_ > 0) {
+            out.write("deleted", deleted_);
+        }
+        if (!labels_.empty()) {
+            out.write("labels", labels_);
+        }
+        out.finish();
+    }
+
+    void load(const std::string& path) override {
+        std::shared_ptr<IndexFile> in = IndexFile::open(path);
+        in->expect_kind("hnsw");
+        auto write = lock_.write();
+        init(in->metric(), in->dimension());
+
+        M_ = static_cast<int>(in->get("M"));
+        ef_construction_ = static_cast<int>(in->get("ef_construction"));
+        ef_search_ = static_cast<int>(in->get("ef_search"));
+        seed_ = static_cast<unsigned>(in->get("seed"));
+        filter_brute_force_ = in->get("filter_brute_force", filter_brute_force_);
+        max_m_ = static_cast<int>(in->get("max_m"));
+        max_m0_ = static_cast<int>(in->get("max_m0"));
+        level_mult_ = in->get("level_mult");
+        entry_point_ = static_cast<int>(in->get("entry_point"));
+        max_level_ = static_cast<int>(in->get("max_level"));
+        n_samples_ = static_cast<size_t>(in->get("n_samples"));
+
+        reorder_ = in->get("reorder", reorder_ ? 1.0 : 0.0) != 0.0;
+        if (in->has("nodes")) {
+            link_floats_ = static_cast<size_t>(in->get("link_floats"));
+            in->map_store("nodes", nodes_);
+        } else {
+            load_split_layout(*in);
+        }
+        levels_ = in->vector<int>("levels");
+        if (levels_.size() != n_samples_) {
+            throw std::runtime_error("index file " + path + ": inconsistent HNSW levels");
+        }
+
+        std::vector<int> upper = in->vector<int>("upper_links");
+        upper_links_.assign(n_samples_, {});
+        size_t pos = 0;
+        for (size_t i = 0; i < n_samples_; ++i) {
+            size_t count = static_cast<size_t>(levels_[i]) * (max_m_ + 1);
+            if (pos + count > upper.size()) {
+                throw std::runtime_error("index file " + path + ": inconsistent HNSW levels");
+            }
+            upper_links_[i].assign(upper.begin() + pos, upper.begin() + pos + count);
+            pos += count;
+        }
+        deleted_.clear();
+        n_deleted_ = 0;
+        if (in->has("deleted")) {
+            deleted_ = in->vector<uint8_t>("deleted");
+            if (deleted_.size() != n_samples_) {
+                throw std::runtime_error("index file " + path + ": inconsistent HNSW tombstones");
+            }
+            n_deleted_ = static_cast<size_t>(std::count(deleted_.begin(), deleted_.end(), 1));
+        }
+        order_ = in->has("order") ? in->vector<int>("order") : std::vector<int>();
+        position_.assign(order_.size(), 0);
+        for (size_t i = 0; i < order_.size(); ++i) {
+            position_[order_[i]] = static_cast<int>(i);
+        }
+        labels_ = in->has("labels") ? in->vector<int>("labels") : std::vector<int>();
+    }
+
+    size_t get_memory_usage() const override {
+        auto read = lock_.read();
+        size_t bytes = nodes_.memory_usage();
+        bytes += levels_.size() * sizeof(int);
+        bytes += (order_.size() + position_.size()) * sizeof(int);
+        bytes += deleted_.size();
+        bytes += labels_.size() * sizeof(int);
+        for (const auto& links : upper_links_) {
+            bytes += links.size() * sizeof(int);
+        }
+        return bytes;
+    }
+
+    std::string name() const override {
+        return "HNSW";
+    }
+
+private:
+    using Candidate = std::pair<float, int>;  // (distance, id)
+    using MaxHeap = std::priority_queue<Candidate>;
+    using MinHeap = std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>>;
+
+    // Insertion batch size: at most 1/kInsertBatchFraction of the nodes
+    // already in the graph, and at most kMaxInsertBatch
+    static constexpr size_t kInsertBatchFraction = 32;
+    static constexpr size_t kMaxInsertBatch = 8192;
+
+    // Prefetched per neighbor vector (the hardware prefetcher streams the
+    // rest of long rows) and per upcoming candidate list
+    static constexpr size_t kPrefetchVectorBytes = 512;
+    static constexpr size_t kPrefetchListBytes = 128;
+
+    /**
+     * New neighbor list for (node, level), computed by compact().
+     */
+    struct Repair {
+        int node;
+        int level;
+        std::vector<int> links;
+    };
+
+    /**
+     * Reverse link of a batch insertion: add source to target's list.
+     */
+    struct BackLink {
+        int level;
+        int target;
+        int source;
+    };
+
+    /**
+     * Per-thread search buffers, reused across queries (and across
+     * instances), so concurrent queries share nothing and a query does not
+     * allocate or clear an n-sized visited array.
+     */
+    struct SearchScratch {
+        std::vector<uint16_t> visited;  // visited[node] == epoch: seen by this search
+        uint16_t epoch = 0;
+        std::vector<int> pending;
+        std::vector<int> rows;          // filtered exact scans: allowed nodes
+        std::vector<float> dists;
+        std::vector<float> normalized;  // angular query
+        TopK top;                       // filtered exact scans
+        SearchStats stats;              // this search's counts, added to stats_ at its end
+    };
+
+    static SearchScratch& search_scratch() {
+        thread_local SearchScratch scratch;
+        return scratch;
+    }
+
+    /**
+     * Node layout for the current M, set before rows are stored.
+     */
+    void init_layout() {
+        max_m_ = M_;
+        max_m0_ = 2 * M_;
+        level_mult_ = 1.0 / std::log(static_cast<double>(M_));
+        link_floats_ = VectorStore::padded_dim(max_m0_ + 1);
+    }
+
+    /**
+     * Width of a node block: level-0 list, then the vector.
+     */
+    size_t node_floats() const {
+        return link_floats_ + dimension_;
+    }
+
+    /**
+     * Vector of node 0; node i's is nodes_.stride() floats further.
+     */
+    float* vectors() {
+        return nodes_.data() + link_floats_;
+    }
+
+    const float* vectors() const {
+        return nodes_.data() + link_floats_;
+    }
+
+    /**
+     * Append n vectors as new nodes with empty level-0 lists (normalized
+     * for angular).
+     */
+    void append_nodes(const float* data, size_t n) {
+        std::vector<float> blocks(n * node_floats(), 0.0f);
+        for (size_t i = 0; i < n; ++i) {
+            std::copy(data + i * dimension_, data + (i + 1) * dimension_,
+                      blocks.begin() + i * node_floats() + link_floats_);
+        }
+        size_t first = nodes_.size();
+        nodes_.append(blocks.data(), n, node_floats());
+        if (metric_type_ == Metric::Angular) {
+            normalize_rows(nodes_.row(first) + link_floats_, n, nodes_.stride(), dimension_);
+        }
+    }
+
+    /**
+     * load() of a file with separate "vectors" and "links0" sections:
+     * interleave them into nodes_.
+     */
+    void load_split_layout(const IndexFile& in) {
+        VectorStore rows;
+        in.map_store("vectors", rows);
+        const int* links0 = in.array<int>("links0", n_samples_ * (max_m0_ + 1));
+        link_floats_ = VectorStore::padded_dim(max_m0_ + 1);
+        nodes_.allocate(n_samples_, node_floats());
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n_samples_); ++i) {
+            std::copy(links0 + i * (max_m0_ + 1), links0 + (i + 1) * (max_m0_ + 1),
+                      links_at(static_cast<int>(i), 0));
+            std::memcpy(vector_at(static_cast<int>(i)), rows.row(i), dimension_ * sizeof(float));
+        }
+    }
+
+    /**
+     * Build the graph over the rows in nodes_ (already normalized for
+     * angular), replacing any previous graph.
+     */
+    void build_graph() {
+        n_samples_ = nodes_.size();
+        for (size_t i = 0; i < n_samples_; ++i) {
+            links_at(static_cast<int>(i), 0)[0] = 0;
+        }
+        order_.clear();
+        position_.clear();
+        upper_links_.assign(n_samples_, {});
+        levels_.assign(n_samples_, 0);
+        deleted_.clear();
+        n_deleted_ = 0;
+        max_level_ = -1;
+        entry_point_ = -1;
+
+        // Levels are drawn up front from the seed, so they do not depend on
+        // how insertion is scheduled
+        std::mt19937 rng(seed_);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (size_t i = 0; i < n_samples_; ++i) {
+            levels_[i] = static_cast<int>(-std::log(1.0 - uniform(rng)) * level_mult_);
+        }
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n_samples_); ++i) {
+            if (levels_[i] > 0) {
+                upper_links_[i].assign(static_cast<size_t>(levels_[i]) * (max_m_ + 1), 0);
+            }
+        }
+
+        // Batches grow with the graph: early nodes go in one at a time,
+        // later ones kInsertBatchFraction of the graph size at once
+        size_t begin = 0;
+        while (begin < n_samples_) {
+            size_t batch = std::max<size_t>(1, begin / kInsertBatchFraction);
+            size_t end = std::min(n_samples_, begin + std::min(batch, kMaxInsertBatch));
+            insert_batch(begin, end);
+            begin = end;
+        }
+        if (reorder_) {
+            reorder_nodes();
+        }
+    }
+
+    /**
+     * Renumber the nodes in breadth-first order of the level-0 graph from
+     * the entry point, so a search's neighbors tend to sit in nearby
+     * blocks (and pages). Rows are permuted in place, one cycle at a time,
+     * so this needs no second copy of the index; order_ / position_ map
+     * between the new node numbers and the ids callers see.
+     */
+    void reorder_nodes() {
+        if (n_samples_ < 2) {
+            return;
+        }
+        std::vector<int> order;
+        order.reserve(n_samples_);
+        std::vector<uint8_t> seen(n_samples_, 0);
+        auto visit_from = [&](int start) {
+            seen[start] = 1;
+            order.push_back(start);
+            for (size_t head = order.size() - 1; head < order.size(); ++head) {
+                const int* links = links_at(order[head], 0);
+                for (int i = 1; i <= links[0]; ++i) {
+                    if (!seen[links[i]]) {
+                        seen[links[i]] = 1;
+                        order.push_back(links[i]);
+                    }
+                }
+            }
+        };
+        visit_from(entry_point_);
+        for (size_t id = 0; id < n_samples_; ++id) {
+            if (!seen[id]) {
+                visit_from(static_cast<int>(id));  // not reachable from the entry point
+            }
+        }
+        std::vector<int> position(n_samples_);
+        for (size_t i = 0; i < n_samples_; ++i) {
+            position[order[i]] = static_cast<int>(i);
+        }
+
+        // Rename the neighbors, then move each node to its new slot
+        #pragma omp parallel for schedule(static)
+        for (long long id = 0; id < static_cast<long long>(n_samples_); ++id) {
+            for (int l = 0; l <= levels_[id]; ++l) {
+                int* links = links_at(static_cast<int>(id), l);
+                for (int i = 1; i <= links[0]; ++i) {
+                    links[i] = position[links[i]];
+                }
+            }
+        }
+        size_t row_bytes = nodes_.stride() * sizeof(float);
+        std::vector<float> held(nodes_.stride());
+        std::fill(seen.begin(), seen.end(), 0);
+        for (size_t start = 0; start < n_samples_; ++start) {
+            if (seen[start]) {
+                continue;
+            }
+            // Slot i takes the row of node order[i]
+            std::memcpy(held.data(), nodes_.row(start), row_bytes);
+            for (size_t slot = start;;) {
+                seen[slot] = 1;
+                size_t from = static_cast<size_t>(order[slot]);
+                if (from == start) {
+                    std::memcpy(nodes_.row(slot), held.data(), row_bytes);
+                    break;
+                }
+                std::memcpy(nodes_.row(slot), nodes_.row(from), row_bytes);
+                slot = from;
+            }
+        }
+        std::vector<std::vector<int>> upper(n_samples_);
+        std::vector<int> levels(n_samples_);
+        for (size_t i = 0; i < n_samples_; ++i) {
+            upper[i].swap(upper_links_[order[i]]);
+            levels[i] = levels_[order[i]];
+        }
+        upper_links_.swap(upper);
+        levels_.swap(levels);
+        entry_point_ = position[entry_point_];
+        order_.swap(order);
+        position_.swap(position);
+    }
+
+    /**
+     * Node number of a caller id, and back (identity unless reordered).
+     */
+    int internal(int id) const {
+        return position_.empty() ? id : position_[id];
+    }
+
+    int external(int node) const {
+        return order_.empty() ? node : order_[node];
+    }
+
+    /**
+     * search() / search_filtered() (filter may be null).
+     */
+    void search_graph(const float* query, int k, const IdFilter* filter, int* ids,
+                      float* distances) const {
+        SearchScratch& scratch = search_scratch();
+        query = prepare_query(metric_type_, query, dimension_, scratch.normalized);
+        auto read = lock_.read();
+        SearchStats& stats = scratch.stats;
+        stats.clear();
+        stats.count(Stat::Queries);
+
+        if (filter && filter->count() <= filter_brute_force_ * n_samples_) {
+            TopK& top = scratch.top;
+            top.reset(k);
+            uint64_t pushes = top.inserts();
+            scan_allowed(query, *filter, top, scratch);
+            stats.count(Stat::ExactScans);
+            stats.count(Stat::HeapPushes, top.inserts() - pushes);
+            stats_.add(stats);
+            top.take_into(k, ids, distances);
+            return;
+        }
+
+        MaxHeap top;
+        if (entry_point_ >= 0) {
+            // Greedy descent through the upper levels
+            int cur = entry_point_;
+            float cur_dist = distance(query, vector_at(cur));
+            stats.count(Stat::Distances);
+            for (int level = max_level_; level > 0; --level) {
+                greedy_step(query, cur, cur_dist, level);
+            }
+
+            // Beam search on level 0
+            size_t ef = std::max(ef_search_, k);
+            top = search_layer(query, cur, cur_dist, ef, 0, true, filter);
+            while (top.size() > static_cast<size_t>(k)) {
+                top.pop();
+            }
+        }
+        stats_.add(stats);
+
+        std::fill(ids + top.size(), ids + k, -1);
+        if (distances) {
+            std::fill(distances + top.size(), distances + k, std::numeric_limits<float>::infinity());
+        }
+        for (size_t i = top.size(); i-- > 0;) {
+            ids[i] = external(top.top().second);
+            if (distances) {
+                distances[i] = top.top().first;
+            }
+            top.pop();
+        }
+    }
+
+    /**
+     * Exact scan of the live ids filter allows (top gets caller ids).
+     */
+    void scan_allowed(const float* query, const IdFilter& filter, TopK& top,
+                      SearchScratch& scratch) const {
+        std::vector<int>& allowed = scratch.pending;
+        std::vector<int>& rows = scratch.rows;
+        filter.collect(allowed);
+        rows.clear();
+        size_t kept = 0;
+        for (int id : allowed) {
+            if (static_cast<size_t>(id) >= n_samples_) {
+                break;
+            }
+            int node = internal(id);
+            if (n_deleted_ > 0 && deleted_[node]) {
+                continue;
+            }
+            allowed[kept++] = id;
+            rows.push_back(node);
+        }
+
+        std::vector<float>& dists = scratch.dists;
+        dists.resize(kept);
+        scan_ids_(query, vectors(), rows.data(), kept, nodes_.stride(), dimension_, dists.data());
+        scratch.stats.count(Stat::Distances, kept);
+        top.push_block(dists.data(), kept, allowed.data());
+    }
+
+    float* vector_at(int id) {
+        return nodes_.row(id) + link_floats_;
+    }
+
+    const float* vector_at(int id) const {
+        return nodes_.row(id) + link_floats_;
+    }
+
+    float distance(const float* a, const float* b) const {
+        float d;
+        scan_(a, b, 1, 0, dimension_, &d);
+        return d;
+    }
+
+    /**
+     * Neighbor list of a node at a level: [count, id_0, id_1, ...]. The
+     * level-0 list heads the node's block in nodes_.
+     */
+    int* links_at(int id, int level) {
+        if (level == 0) {
+            return reinterpret_cast<int*>(nodes_.row(id));
+        }
+        return upper_links_[id].data() + static_cast<size_t>(level - 1) * (max_m_ + 1);
+    }
+
+    const int* links_at(int id, int level) const {
+        return const_cast<HNSWIndex*>(this)->links_at(id, level);
+    }
+
+    /**
+     * Move (cur, cur_dist) to the closest node reachable greedily on a level.
+     */
+    void greedy_step(const float* query, int& cur, float& cur_dist, int level) const {
+        bool changed = true;
+        SearchScratch& scratch = search_scratch();
+        std::vector<float>& dists = scratch.dists;
+        dists.resize(max_m0_);
+        while (changed) {
+            changed = false;
+            const int* links = links_at(cur, level);
+            int count = links[0];
+            scan_ids_(query, vectors(), links + 1, count, nodes_.stride(), dimension_,
+                      dists.data());
+            scratch.stats.count(Stat::NodesVisited);
+            scratch.stats.count(Stat::Distances, count);
+            for (int i = 0; i < count; ++i) {
+                if (dists[i] < cur_dist) {
+                    cur_dist = dists[i];
+                    cur = links[i + 1];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    /**
+     * Beam search on one level starting from (entry, entry_dist).
+     * Returns up to ef closest nodes found, farthest on top. With
+     * skip_deleted, tombstoned nodes are traversed but not returned, and
+     * so are nodes a filter rejects.
+     */
+    MaxHeap search_layer(const float* query, int entry, float entry_dist,
+                         size_t ef, int level, bool skip_deleted = false,
+                         const IdFilter* filter = nullptr) const {
+        const uint8_t* deleted = skip_deleted && n_deleted_ > 0 ? deleted_.data() : nullptr;
+        auto returnable = [&](int id) {
+            return (!deleted || !deleted[id]) && (!filter || filter->allows(external(id)));
+        };
+        // Thread-local visited tags: a node is visited when its tag is this
+        // search's epoch, so nothing is cleared between searches except
+        // once every 65535 of them, when the epoch wraps
+        SearchScratch& scratch = search_scratch();
+        std::vector<uint16_t>& visited = scratch.visited;
+        std::vector<int>& pending = scratch.pending;
+        std::vector<float>& dists = scratch.dists;
+        if (visited.size() < n_samples_) {
+            visited.resize(n_samples_, 0);
+        }
+        if (++scratch.epoch == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            scratch.epoch = 1;
+        }
+        const uint16_t epoch = scratch.epoch;
+        pending.reserve(max_m0_);
+        dists.resize(max_m0_);
+
+        MaxHeap top;
+        MinHeap candidates;
+        if (returnable(entry)) {
+            top.emplace(entry_dist, entry);
+        }
+        candidates.emplace(entry_dist, entry);
+        visited[entry] = epoch;
+
+        while (!candidates.empty()) {
+            Candidate current = candidates.top();
+            if (top.size() >= ef && current.first > top.top().first) {
+                break;
+            }
+            candidates.pop();
+
+            // The next candidate's list (on level 0, its whole block) loads
+            // while this one's neighbors are scored
+            if (!candidates.empty()) {
+                prefetch_lines(links_at(candidates.top().second, level), kPrefetchListBytes);
+            }
+
+            // Gather unvisited neighbors, prefetching their vectors, then
+            // score them in one kernel call
+            const int* links = links_at(current.second, level);
+            int count = links[0];
+            pending.clear();
+            for (int i = 1; i <= count; ++i) {
+                int neighbor = links[i];
+                if (visited[neighbor] != epoch) {
+                    visited[neighbor] = epoch;
+                    pending.push_back(neighbor);
+                    prefetch_lines(vector_at(neighbor), prefetch_bytes_);
+                }
+            }
+            scan_ids_(query, vectors(), pending.data(), pending.size(),
+                      nodes_.stride(), dimension_, dists.data());
+            scratch.stats.count(Stat::NodesVisited);
+            scratch.stats.count(Stat::Distances, pending.size());
+
+            for (size_t i = 0; i < pending.size(); ++i) {
+                float d = dists[i];
+                if (top.size() < ef || d < top.top().first) {
+                    candidates.emplace(d, pending[i]);
+                    scratch.stats.count(Stat::HeapPushes);
+                    if (returnable(pending[i])) {
+                        top.emplace(d, pending[i]);
+                        scratch.stats.count(Stat::HeapPushes);
+                        if (top.size() > ef) {
+                            top.pop();
+                        }
+                    }
+                }
+            }
+        }
+
+        return top;
+    }
+
+    /**
+     * Diversity heuristic (Algorithm 4 in the paper): keep a candidate only
+     * if it is closer to the base point than to every neighbor kept so far.
+     * candidates must be sorted by ascending distance to the base point.
+     */
+    std::vector<int> select_neighbors(const std::vector<Candidate>& candidates,
+                                      int max_neighbors) const {
+        std::vector<int> selected;
+        selected.reserve(max_neighbors);
+        for (const Candidate& c : candidates) {
+            if (static_cast<int>(selected.size()) >= max_neighbors) {
+                break;
+            }
+            bool keep = true;
+            for (int s : selected) {
+                if (distance(vector_at(c.second), vector_at(s)) < c.first) {
+                    keep = false;
+                    break;
+                }
+            }
+            if (keep) {
+                selected.push_back(c.second);
+            }
+        }
+        return selected;
+    }
+
+    /**
+     * Add new_neighbor to node's list at level, re-pruning if it is full.
+     */
+    void add_link(int node, int new_neighbor, int level) {
+        int* links = links_at(node, level);
+        int max_links = level == 0 ? max_m0_ : max_m_;
+        int count = links[0];
+
+        if (count < max_links) {
+            links[count + 1] = new_neighbor;
+            links[0] = count + 1;
+            return;
+        }
+
+        const float* base = vector_at(node);
+        std::vector<Candidate> candidates;
+        candidates.reserve(count + 1);
+        candidates.emplace_back(distance(base, vector_at(new_neighbor)), new_neighbor);
+        for (int i = 1; i <= count; ++i) {
+            candidates.emplace_back(distance(base, vector_at(links[i])), links[i]);
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        std::vector<int> selected = select_neighbors(candidates, max_links);
+        links[0] = static_cast<int>(selected.size());
+        std::copy(selected.begin(), selected.end(), links + 1);
+    }
+
+    /**
+     * Insert nodes [begin, end) in parallel. Every node of the batch
+     * searches the graph as it was before the batch and picks its own
+     * neighbors (nothing links to batch nodes yet, so nothing else reads
+     * their lists); the reverse links are then grouped by target node and
+     * each target's list is updated by one thread, in node order. Neither
+     * phase needs locks, and the graph is the same for any thread count.
+     * A batch of one node is exactly the sequential HNSW insertion.
+     */
+    void insert_batch(size_t begin, size_t end) {
+        if (entry_point_ < 0) {
+            entry_point_ = static_cast<int>(begin);
+            max_level_ = levels_[begin];
+            ++begin;
+        }
+        link_batch(begin, end);
+        commit_batch(begin, end);
+    }
+
+    /**
+     * First phase of insert_batch(): only writes the lists of the new
+     * nodes, so it may run while the graph is being queried.
+     */
+    void link_batch(size_t begin, size_t end) {
+        #pragma omp parallel for schedule(dynamic, 8)
+        for (long long id = static_cast<long long>(begin); id < static_cast<long long>(end); ++id) {
+            link_new_node(static_cast<int>(id));
+        }
+    }
+
+    /**
+     * Second phase of insert_batch(): reverse links and entry point.
+     */
+    void commit_batch(size_t begin, size_t end) {
+        std::vector<BackLink> back_links;
+        for (size_t id = begin; id < end; ++id) {
+            for (int l = std::min(levels_[id], max_level_); l >= 0; --l) {
+                const int* links = links_at(static_cast<int>(id), l);
+                for (int i = 1; i <= links[0]; ++i) {
+                    back_links.push_back({l, links[i], static_cast<int>(id)});
+                }
+            }
+        }
+        std::sort(back_links.begin(), back_links.end(),
+                  [](const BackLink& a, const BackLink& b) {
+                      if (a.level != b.level) {
+                          return a.level < b.level;
+                      }
+                      return a.target != b.target ? a.target < b.target : a.source < b.source;
+                  });
+
+        std::vector<size_t> groups;
+        for (size_t i = 0; i < back_links.size(); ++i) {
+            if (i == 0 || back_links[i].level != back_links[i - 1].level ||
+                back_links[i].target != back_links[i - 1].target) {
+                groups.push_back(i);
+            }
+        }
+        groups.push_back(back_links.size());
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (long long g = 0; g < static_cast<long long>(groups.size()) - 1; ++g) {
+            for (size_t i = groups[g]; i < groups[g + 1]; ++i) {
+                add_link(back_links[i].target, back_links[i].source, back_links[i].level);
+            }
+        }
+
+        for (size_t id = begin; id < end; ++id) {
+            if (levels_[id] > max_level_) {
+                entry_point_ = static_cast<int>(id);
+                max_level_ = levels_[id];
+            }
+        }
+    }
+
+    /**
+     * Replacement list for a live node's list at level if it links to
+     * deleted nodes: its live neighbors plus the live neighbors of the
+     * deleted ones, pruned with the usual heuristic. Returns false when the
+     * list has no deleted neighbor.
+     */
+    bool plan_repair(int node, int level, Repair& repair) const {
+        const int* links = links_at(node, level);
+        bool affected = false;
+        for (int i = 1; i <= links[0]; ++i) {
+            affected |= deleted_[links[i]] != 0;
+        }
+        if (!affected) {
+            return false;
+        }
+
+        std::vector<int> ids;
+        for (int i = 1; i <= links[0]; ++i) {
+            int neighbor = links[i];
+            if (!deleted_[neighbor]) {
+                ids.push_back(neighbor);
+                continue;
+            }
+            const int* second = links_at(neighbor, level);
+            for (int j = 1; j <= second[0]; ++j) {
+                if (!deleted_[second[j]] && second[j] != node) {
+                    ids.push_back(second[j]);
+                }
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        const float* base = vector_at(node);
+        std::vector<Candidate> candidates;
+        candidates.reserve(ids.size());
+        for (int id : ids) {
+            candidates.emplace_back(distance(base, vector_at(id)), id);
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        repair.node = node;
+        repair.level = level;
+        repair.links = select_neighbors(candidates, level == 0 ? max_m0_ : max_m_);
+        return true;
+    }
+
+    /**
+     * Search the current graph for a node's neighbors at each of its
+     * levels and fill its own lists (the first half of an insertion).
+     */
+    void link_new_node(int id) {
+        int level = levels_[id];
+        const float* point = vector_at(id);
+        int cur = entry_point_;
+        float cur_dist = distance(point, vector_at(cur));
+        for (int l = max_level_; l > level; --l) {
+            greedy_step(point, cur, cur_dist, l);
+        }
+
+        for (int l = std::min(level, max_level_); l >= 0; --l) {
+            MaxHeap top = search_layer(point, cur, cur_dist, ef_construction_, l);
+
+            std::vector<Candidate> candidates(top.size());
+            for (size_t i = candidates.size(); i-- > 0;) {
+                candidates[i] = top.top();
+                top.pop();
+            }
+
+            std::vector<int> neighbors = select_neighbors(candidates, max_m_);
+            int* links = links_at(id, l);
+            links[0] = static_cast<int>(neighbors.size());
+            std::copy(neighbors.begin(), neighbors.end(), links + 1);
+
+            cur = candidates.front().second;
+            cur_dist = candidates.front().first;
+        }
+    }
+
+    // Parameters
+    int M_ = 16;
+    int ef_construction_ = 200;
+    int ef_search_ = 64;
+    unsigned seed_ = 100;
+    double filter_brute_force_ = 0.02;
+    bool reorder_ = true;
+
+    // Derived at fit()
+    int max_m_ = 0;
+    int max_m0_ = 0;
+    double level_mult_ = 0.0;
+
+    Metric metric_type_ = Metric::Euclidean;
+    ScanFunc scan_ = nullptr;
+    ScanIdsFunc scan_ids_ = nullptr;
+    size_t prefetch_bytes_ = 0;
+
+    // One block per node: level-0 list (link_floats_ slots), then vector
+    VectorStore nodes_;
+    size_t link_floats_ = 0;
+    std::vector<std::vector<int>> upper_links_;  // per node: level * (max_m + 1)
+    std::vector<int> order_;                     // reorder_nodes(): node -> caller id
+    std::vector<int> position_;                  // caller id -> node
+    std::vector<int> levels_;
+    std::vector<uint8_t> deleted_;               // tombstones, empty until remove()
+    size_t n_deleted_ = 0;
+    IndexLock lock_;
+    int entry_point_ = -1;
+    int max_level_ = -1;
+    size_t n_samples_ = 0;
+};
+
+// Factory function
+extern "C" ANNAlgorithm* create_hnsw_index() {
+    return new HNSWIndex();
+}
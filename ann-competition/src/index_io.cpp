@@ -0,0 +1,283 @@
+#include "../include/index_io.hpp"
+#include "../include/vector_store.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kMagic[8] = {'A', 'N', 'N', 'I', 'N', 'D', 'E', 'X'};
+static constexpr uint32_t kEndianTag = 0x01020304u;
+
+// Sections start on a page boundary so mapped rows keep their alignment
+static constexpr uint64_t kSectionAlign = 4096;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t toc_offset;
+    uint64_t toc_count;
+    int32_t dimension;
+    char kind[32];
+    char metric[32];
+};
+
+struct TocEntry {
+    char name[64];
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+static void copy_name(char* dst, size_t capacity, const std::string& src, const char* what) {
+    if (src.size() >= capacity) {
+        throw std::runtime_error(std::string("index file: ") + what + " '" + src + "' is too long");
+    }
+    std::memset(dst, 0, capacity);
+    std::memcpy(dst, src.data(), src.size());
+}
+
+static std::string read_name(const char* src, size_t capacity) {
+    return std::string(src, strnlen(src, capacity));
+}
+
+static std::string io_error(const std::string& what, const std::string& path) {
+    return "index file " + path + ": " + what + " (" + std::strerror(errno) + ")";
+}
+
+IndexWriter::IndexWriter(const std::string& path, const std::string& kind,
+                         const std::string& metric, int dimension)
+    : path_(path), kind_(kind), metric_(metric), dimension_(dimension) {
+    // Written under a temporary name and renamed by finish(), so readers
+    // never see a half-written index
+    fd_ = ::open((path_ + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error(io_error("cannot create", path_));
+    }
+    offset_ = kSectionAlign;  // header page, written last
+}
+
+IndexWriter::~IndexWriter() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        ::unlink((path_ + ".tmp").c_str());
+    }
+}
+
+void IndexWriter::write_at_end(const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t written = ::pwrite(fd_, p, bytes, static_cast<off_t>(offset_));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(io_error("write failed", path_));
+        }
+        p += written;
+        bytes -= static_cast<size_t>(written);
+        offset_ += static_cast<uint64_t>(written);
+    }
+}
+
+void IndexWriter::write(const std::string& name, const void* data, size_t bytes) {
+    begin_section(name);
+    append(data, bytes);
+}
+
+void IndexWriter::begin_section(const std::string& name) {
+    // Holes left by the alignment read back as zeros
+    offset_ = (offset_ + kSectionAlign - 1) / kSectionAlign * kSectionAlign;
+    sections_.push_back({name, offset_, 0});
+}
+
+void IndexWriter::append(const void* data, size_t bytes) {
+    if (sections_.empty()) {
+        throw std::runtime_error("index file " + path_ + ": append() before begin_section()");
+    }
+    write_at_end(data, bytes);
+    sections_.back().bytes += bytes;
+}
+
+void IndexWriter::write_store(const std::string& name, const VectorStore& store) {
+    set(name + ".n", static_cast<double>(store.size()));
+    set(name + ".dim", static_cast<double>(store.dim()));
+    set(name + ".stride", static_cast<double>(store.stride()));
+    write(name, store.data(), store.size() * store.stride() * sizeof(float));
+}
+
+void IndexWriter::finish() {
+    std::string meta;
+    char line[512];
+    for (const auto& entry : meta_) {
+        std::snprintf(line, sizeof(line), "%s=%.17g\n", entry.first.c_str(), entry.second);
+        meta += line;
+    }
+    write("meta", meta.data(), meta.size());
+
+    std::vector<TocEntry> toc(sections_.size());
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        copy_name(toc[i].name, sizeof(toc[i].name), sections_[i].name, "section name");
+        toc[i].offset = sections_[i].offset;
+        toc[i].bytes = sections_[i].bytes;
+    }
+    offset_ = (offset_ + 7) / 8 * 8;
+    uint64_t toc_offset = offset_;
+    write_at_end(toc.data(), toc.size() * sizeof(TocEntry));
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kIndexFormatVersion;
+    header.endian = kEndianTag;
+    header.toc_offset = toc_offset;
+    header.toc_count = toc.size();
+    header.dimension = dimension_;
+    copy_name(header.kind, sizeof(header.kind), kind_, "index kind");
+    copy_name(header.metric, sizeof(header.metric), metric_, "metric");
+    if (::pwrite(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        throw std::runtime_error(io_error("write failed", path_));
+    }
+
+    if (::close(fd_) != 0) {
+        fd_ = -1;
+        throw std::runtime_error(io_error("close failed", path_));
+    }
+    fd_ = -1;
+    if (std::rename((path_ + ".tmp").c_str(), path_.c_str()) != 0) {
+        ::unlink((path_ + ".tmp").c_str());
+        throw std::runtime_error(io_error("rename failed", path_));
+    }
+}
+
+std::shared_ptr<IndexFile> IndexFile::open(const std::string& path) {
+    std::shared_ptr<IndexFile> file(new IndexFile());
+    file->path_ = path;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(io_error("cannot open", path));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error(io_error("cannot stat", path));
+    }
+    file->size_ = static_cast<size_t>(st.st_size);
+    if (file->size_ < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("index file " + path + ": truncated");
+    }
+
+    // Private + writable: pages are shared with the page cache until an
+    // index writes to them (copy-on-write), and the file is never modified
+    void* base = ::mmap(nullptr, file->size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error(io_error("mmap failed", path));
+    }
+    file->base_ = static_cast<char*>(base);
+
+    FileHeader header;
+    std::memcpy(&header, file->base_, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("index file " + path + ": not an index file");
+    }
+    if (header.endian != kEndianTag) {
+        throw std::runtime_error("index file " + path + ": written on a machine with a different byte order");
+    }
+    if (header.version != kIndexFormatVersion) {
+        throw std::runtime_error("index file " + path + ": format version " +
+                                 std::to_string(header.version) + " is not supported (expected " +
+                                 std::to_string(kIndexFormatVersion) + ")");
+    }
+    if (header.toc_offset + header.toc_count * sizeof(TocEntry) > file->size_) {
+        throw std::runtime_error("index file " + path + ": truncated");
+    }
+
+    file->kind_ = read_name(header.kind, sizeof(header.kind));
+    file->metric_ = read_name(header.metric, sizeof(header.metric));
+    file->dimension_ = header.dimension;
+
+    const TocEntry* toc = reinterpret_cast<const TocEntry*>(file->base_ + header.toc_offset);
+    for (uint64_t i = 0; i < header.toc_count; ++i) {
+        if (toc[i].offset + toc[i].bytes > file->size_) {
+            throw std::runtime_error("index file " + path + ": truncated");
+        }
+        file->sections_[read_name(toc[i].name, sizeof(toc[i].name))] = {toc[i].offset, toc[i].bytes};
+    }
+
+    size_t meta_bytes = 0;
+    const char* meta = static_cast<const char*>(file->section("meta", meta_bytes));
+    std::string text(meta, meta_bytes);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        size_t eq = text.find('=', pos);
+        if (eq != std::string::npos && eq < end) {
+            file->meta_[text.substr(pos, eq - pos)] = std::strtod(text.c_str() + eq + 1, nullptr);
+        }
+        pos = end + 1;
+    }
+    return file;
+}
+
+IndexFile::~IndexFile() {
+    if (base_ != nullptr) {
+        ::munmap(base_, size_);
+    }
+}
+
+void IndexFile::expect_kind(const std::string& kind) const {
+    if (kind_ != kind) {
+        throw std::runtime_error("index file " + path_ + " holds a '" + kind_ +
+                                 "' index, expected '" + kind + "'");
+    }
+}
+
+bool IndexFile::has(const std::string& name) const {
+    return sections_.count(name) != 0;
+}
+
+double IndexFile::get(const std::string& name) const {
+    auto it = meta_.find(name);
+    if (it == meta_.end()) {
+        throw std::runtime_error("index file " + path_ + ": missing field '" + name + "'");
+    }
+    return it->second;
+}
+
+double IndexFile::get(const std::string& name, double fallback) const {
+    auto it = meta_.find(name);
+    return it == meta_.end() ? fallback : it->second;
+}
+
+const void* IndexFile::section(const std::string& name, size_t& bytes) const {
+    auto it = sections_.find(name);
+    if (it == sections_.end()) {
+        throw std::runtime_error("index file " + path_ + ": missing section '" + name + "'");
+    }
+    bytes = static_cast<size_t>(it->second.bytes);
+    return base_ + it->second.offset;
+}
+
+uint64_t IndexFile::section_offset(const std::string& name) const {
+    auto it = sections_.find(name);
+    if (it == sections_.end()) {
+        throw std::runtime_error("index file " + path_ + ": missing section '" + name + "'");
+    }
+    return it->second.offset;
+}
+
+void IndexFile::map_store(const std::string& name, VectorStore& store) const {
+    size_t n = static_cast<size_t>(get(name + ".n"));
+    size_t dim = static_cast<size_t>(get(name + ".dim"));
+    size_t stride = static_cast<size_t>(get(name + ".stride"));
+    store.map(shared_from_this(), array<float>(name, n * stride), n, dim, stride);
+}
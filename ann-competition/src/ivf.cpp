@@ -0,0 +1,1290 @@
+#include "../include/ann_interface.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include "../include/index_lock.hpp"
+#include "../include/kmeans.hpp"
+#include "../include/pq.hpp"
+#include "../include/topk.hpp"
+#include "../include/vector_store.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+/**
+ * IVF (inverted file) index with a k-means coarse quantizer.
+ *
+ * fit() trains nlist centroids, assigns every vector to its nearest one and
+ * stores each list's vectors contiguously, so a probed list is one
+ * streaming scan. query() ranks the centroids and scans only the nprobe
+ * closest lists.
+ *
+ * With pq_m set, lists store product-quantized residuals (x - centroid)
+ * instead of floats (IVF-PQ). Lists are then scanned with ADC lookup tables:
+ * 8-bit codes through a float table, 4-bit codes in 32-vector fast-scan
+ * blocks with the table held in a SIMD register. An optional exact re-rank
+ * over the original floats restores the precision PQ gives up.
+ *
+ * Parameters (set_param):
+ * - nlist:         number of lists (0 = auto, 4 * sqrt(n))
+ * - nprobe:        lists scanned per query (recall vs QPS)
+ * - kmeans_iters:  Lloyd iterations when training the quantizer
+ * - seed:          RNG seed for k-means
+ * - pq_m:          PQ subspaces (0 = store floats, -1 = auto, dim / 4)
+ * - pq_nbits:      bits per PQ code, 8 (ADC tables) or 4 (fast-scan)
+ * - rerank:        re-rank this many PQ candidates on exact floats (0 = off).
+ *                  The floats are only kept if rerank > 0 before fit().
+ * - filter_brute_force: filters allowing at most this fraction of the ids
+ *                  scan every list instead of the closest ones (query)
+ *
+ * Every build step (k-means, assignment, list filling, PQ encoding) is
+ * OpenMP-parallel and independent of the thread count.
+ *
+ * add() assigns new vectors to their nearest centroid and appends them to
+ * a per-list tail of raw floats, scanned exactly after the list itself;
+ * remove() tombstones ids, which are skipped during scans. compact()
+ * rebuilds the lists without tombstones and with the tails merged in
+ * (PQ-encoded when the lists are), while queries keep using the old ones.
+ * The centroids and PQ codebooks are not retrained.
+ *
+ * fit_begin() / fit_chunk() / fit_end() build the same layout from a stream:
+ * k-means (and the PQ) are trained on the first rows as soon as enough
+ * have arrived, every later chunk is assigned and stored (or encoded) on
+ * arrival, and fit_end() sorts the stored rows into list order in place.
+ * Peak memory is the index plus the training rows plus one chunk. Without
+ * the total row count nlist cannot be picked in advance, so then the whole
+ * stream is buffered and passed to fit().
+ *
+ * search_filtered() scores only the rows the filter allows (the ids of a
+ * list are checked before its rows or codes are touched, except in 4-bit
+ * blocks, which are scored whole) and, when the nprobe closest lists hold
+ * fewer than k of them, keeps probing the next closest nprobe lists.
+ *
+ * save() / load() persist both variants; loaded float lists are mapped from
+ * the file.
+ */
+class IVFIndex : public ANNAlgorithm {
+public:
+    explicit IVFIndex(int pq_m = 0) : pq_m_param_(pq_m) {}
+
+    void init(const std::string& metric, int dimension) override {
+        metric_ = metric;
+        dimension_ = dimension;
+        metric_type_ = parse_metric(metric);
+        scan_ = resolve_scan(metric_type_, dimension);
+        scan_ids_ = resolve_scan_ids(metric_type_, dimension);
+        centroid_scan_ = resolve_scan(Metric::Euclidean, dimension);
+    }
+
+    void set_param(const std::string& name, double value) override {
+        if (name == "nlist") {
+            nlist_param_ = std::max(0, static_cast<int>(value));
+        } else if (name == "nprobe") {
+            nprobe_ = std::max(1, static_cast<int>(value));
+        } else if (name == "kmeans_iters") {
+            kmeans_iters_ = std::max(1, static_cast<int>(value));
+        } else if (name == "seed") {
+            seed_ = static_cast<unsigned>(value);
+        } else if (name == "pq_m") {
+            pq_m_param_ = std::max(-1, static_cast<int>(value));
+        } else if (name == "pq_nbits") {
+            pq_nbits_ = static_cast<int>(value);
+        } else if (name == "rerank") {
+            rerank_ = std::max(0, static_cast<int>(value));
+        } else if (name == "filter_brute_force") {
+            filter_brute_force_ = std::max(0.0, std::min(1.0, value));
+        } else {
+            ANNAlgorithm::set_param(name, value);
+        }
+    }
+
+    std::map<std::string, double> get_params() const override {
+        return {
+            {"nlist", nlist_ > 0 ? nlist_ : nlist_param_},
+            {"nprobe", nprobe_},
+            {"kmeans_iters", kmeans_iters_},
+            {"seed", seed_},
+            {"pq_m", use_pq() ? pq_.m() : pq_m_param_},
+            {"pq_nbits", pq_nbits_},
+            {"rerank", rerank_},
+            {"filter_brute_force", filter_brute_force_},
+        };
+    }
+
+    void fit(const float* data, size_t n_samples) override {
+        auto write = lock_.write();
+        n_samples_ = n_samples;
+
+        // Angular: cluster and scan unit vectors
+        std::vector<float> normalized;
+        if (metric_type_ == Metric::Angular) {
+            normalized.assign(data, data + n_samples * dimension_);
+            normalize_rows(normalized.data(), n_samples, dimension_);
+            data = normalized.data();
+        }
+
+        nlist_ = list_count(n_samples);
+        clear_updates();
+
+        if (n_samples == 0) {
+            // Nothing to cluster: one empty list, so queries get -1 padding
+            // and add() has a centroid to assign to
+            centroids_.assign(dimension_, 0.0f);
+            list_offsets_.assign(nlist_ + 1, 0);
+            list_ids_.clear();
+            list_vectors_.clear();
+            list_codes_.clear();
+            list_block_offsets_.clear();
+            vectors_.clear();
+            pq_ = ProductQuantizer();
+            return;
+        }
+
+        KMeansParams params;
+        params.iterations = kmeans_iters_;
+        params.seed = seed_;
+        centroids_ = kmeans_train(data, n_samples, dimension_, nlist_, params);
+
+        std::vector<int> labels(n_samples);
+        kmeans_assign(data, n_samples, dimension_, centroids_.data(), nlist_, labels.data());
+
+        bucket_by_list(labels);
+
+        list_vectors_.clear();
+        list_codes_.clear();
+        vectors_.clear();
+
+        if (pq_m_param_ == 0) {
+            // Flat lists: copy each list's vectors contiguously
+            list_vectors_.allocate(n_samples, dimension_);
+            #pragma omp parallel for schedule(static)
+            for (long long pos = 0; pos < static_cast<long long>(n_samples); ++pos) {
+                const float* src = data + static_cast<size_t>(list_ids_[pos]) * dimension_;
+                std::copy(src, src + dimension_, list_vectors_.row(pos));
+            }
+            pq_ = ProductQuantizer();
+            return;
+        }
+
+        build_pq_lists(data, labels);
+
+        if (rerank_ > 0) {
+            vectors_.assign(data, n_samples, dimension_);
+        }
+    }
+
+    void fit_begin(size_t n_total) override {
+        auto write = lock_.write();
+        n_samples_ = 0;
+        centroids_.clear();
+        pq_ = ProductQuantizer();
+        list_offsets_.clear();
+        list_ids_.clear();
+        list_vectors_.clear();
+        list_codes_.clear();
+        list_block_offsets_.clear();
+        vectors_.clear();
+        stream_labels_.clear();
+        stream_total_ = n_total;
+        if (n_total == 0) {
+            // Unknown size, so nlist cannot be chosen yet: buffer everything
+            ANNAlgorithm::fit_begin(0);
+            return;
+        }
+
+        nlist_ = list_count(n_total);
+        size_t train_rows = static_cast<size_t>(nlist_) * kStreamTrainPerList;
+        if (pq_m_param_ != 0) {
+            train_rows = std::max(train_rows, kPQTrainRows);
+        }
+        stream_train_rows_ = std::min(n_total, train_rows);
+        ANNAlgorithm::fit_begin(stream_train_rows_);
+        stream_labels_.reserve(n_total);
+        if (pq_m_param_ == 0) {
+            list_vectors_.reserve(n_total, dimension_);
+        } else if (rerank_ > 0) {
+            vectors_.reserve(n_total, dimension_);
+        }
+    }
+
+    void fit_chunk(const float* data, size_t n_samples) override {
+        if (stream_total_ == 0) {
+            ANNAlgorithm::fit_chunk(data, n_samples);
+            return;
+        }
+        auto write = lock_.write();
+        std::vector<float> normalized;
+        if (metric_type_ == Metric::Angular) {
+            normalized.assign(data, data + n_samples * dimension_);
+            normalize_rows(normalized.data(), n_samples, dimension_);
+            data = normalized.data();
+        }
+
+        if (centroids_.empty()) {
+            // Still collecting the training rows
+            size_t buffered = stream_rows_.size() / dimension_;
+            size_t take = std::min(n_samples, stream_train_rows_ - buffered);
+            ANNAlgorithm::fit_chunk(data, take);
+            if (buffered + take < stream_train_rows_) {
+                return;
+            }
+            train_streamed();
+            data += take * dimension_;
+            n_samples -= take;
+        }
+        append_streamed(data, n_samples);
+    }
+
+    void fit_end() override {
+        if (stream_total_ == 0) {
+            ANNAlgorithm::fit_end();
+            return;
+        }
+        auto write = lock_.write();
+        if (centroids_.empty() && stream_rows_.empty()) {
+            throw std::runtime_error(name() + ": fit_end() without any fit_chunk() rows");
+        }
+        if (centroids_.empty()) {
+            // Fewer rows arrived than fit_begin() announced
+            nlist_ = std::max(1, std::min(nlist_, static_cast<int>(stream_rows_.size() / dimension_)));
+            train_streamed();
+        }
+        stream_total_ = 0;
+
+        // Rows and codes were stored in arrival (id) order; move them into
+        // list order in place
+        n_samples_ = stream_labels_.size();
+        bucket_by_list(stream_labels_);
+        std::vector<int>().swap(stream_labels_);
+        clear_updates();
+
+        if (!use_pq()) {
+            gather_rows(reinterpret_cast<char*>(list_vectors_.data()),
+                        list_vectors_.stride() * sizeof(float), list_ids_);
+            return;
+        }
+        const int m = pq_.m();
+        gather_rows(reinterpret_cast<char*>(list_codes_.data()), m, list_ids_);
+        if (pq_nbits_ == 4) {
+            std::vector<uint8_t> codes;
+            codes.swap(list_codes_);
+            pack_pq4_lists(list_offsets_, codes, m, list_block_offsets_, list_codes_);
+        }
+    }
+
+    void add(const float* data, size_t n_new) override {
+        auto update = lock_.update();
+        if (centroids_.empty()) {
+            throw std::runtime_error(name() + ": add() requires fit() or load() first");
+        }
+        if (n_new == 0) {
+            return;
+        }
+
+        std::vector<float> normalized;
+        if (metric_type_ == Metric::Angular) {
+            normalized.assign(data, data + n_new * dimension_);
+            normalize_rows(normalized.data(), n_new, dimension_);
+            data = normalized.data();
+        }
+
+        // Centroids only change in fit() / load(), so assign before locking
+        std::vector<int> labels(n_new);
+        kmeans_assign(data, n_new, dimension_, centroids_.data(), nlist_, labels.data());
+
+        auto write = lock_.write();
+        size_t first_row = tail_vectors_.size();
+        tail_vectors_.append(data, n_new, dimension_);
+        for (size_t i = 0; i < n_new; ++i) {
+            tail_rows_[labels[i]].push_back(static_cast<int>(first_row + i));
+            tail_lists_.push_back(labels[i]);
+        }
+        if (!deleted_.empty()) {
+            deleted_.resize(n_samples_ + n_new, 0);
+        }
+        n_samples_ += n_new;
+    }
+
+    void remove(const std::vector<int>& ids) override {
+        auto update = lock_.update();
+        auto write = lock_.write();
+        for (int id : ids) {
+            if (id < 0 || static_cast<size_t>(id) >= n_samples_) {
+                throw std::runtime_error(name() + ": remove() of unknown id " + std::to_string(id));
+            }
+        }
+        if (deleted_.empty()) {
+            deleted_.assign(n_samples_, 0);
+        }
+        for (int id : ids) {
+            n_deleted_ += deleted_[id] == 0;
+            deleted_[id] = 1;
+        }
+    }
+
+    void compact() override {
+        auto update = lock_.update();
+        size_t stored = list_ids_.size() + tail_vectors_.size();
+        if (tail_vectors_.empty() && stored == n_samples_ - n_deleted_) {
+            return;
+        }
+
+        // Build the new lists while queries keep scanning the old ones...
+        CompactedLists next;
+        {
+            auto read = lock_.read();
+            build_compacted_lists(next);
+        }
+
+        // ...then swap them in
+        auto write = lock_.write();
+        list_offsets_ = std::move(next.offsets);
+        list_ids_ = std::move(next.ids);
+        list_vectors_ = std::move(next.vectors);
+        list_codes_ = std::move(next.codes);
+        list_block_offsets_ = std::move(next.block_offsets);
+        if (!vectors_.empty()) {
+            for (size_t r = 0; r < tail_vectors_.size(); ++r) {
+                vectors_.append(tail_vectors_.row(r), 1, dimension_);
+            }
+        }
+        tail_vectors_.clear();
+        tail_rows_.assign(nlist_, {});
+        tail_lists_.clear();
+        tail_begin_ = n_samples_;
+    }
+
+    std::vector<int> query(const float* query, int k) override {
+        return search_ids(query, k);
+    }
+
+    void search(const float* query, int k, int* ids, float* distances) override {
+        search_lists(query, k, nullptr, ids, distances);
+    }
+
+    void search_filtered(const float* query, int k, const IdFilter& filter, int* ids,
+                         float* distances) override {
+        search_lists(query, k, &filter, ids, distances);
+    }
+
+    /**
+     * Float lists: every vector of the nprobe closest lists (and their add()
+     * tails) within radius, exactly scored. IVF-PQ uses the default, whose
+     * search() calls re-rank when rerank is set.
+     */
+    void range_search(const float* query, float radius, std::vector<int>& ids,
+                      std::vector<float>& distances) override {
+        if (use_pq()) {
+            ANNAlgorithm::range_search(query, radius, ids, distances);
+            return;
+        }
+        QueryScratch& scratch = query_scratch();
+        query = prepare_query(metric_type_, query, dimension_, scratch.normalized);
+        auto read = lock_.read();
+        SearchStats& stats = scratch.stats;
+        stats.clear();
+        stats.count(Stat::Queries);
+        rank_lists(query, std::min(nprobe_, nlist_), scratch);
+        stats.count(Stat::ListsProbed, scratch.probes.size());
+
+        std::vector<std::pair<float, int>>& found = scratch.found;
+        found.clear();
+        auto keep = [&](const float* dists, size_t count, const int* row_ids) {
+            for (size_t j = 0; j < count; ++j) {
+                if (dists[j] <= radius && (n_deleted_ == 0 || !deleted_[row_ids[j]])) {
+                    found.emplace_back(dists[j], row_ids[j]);
+                }
+            }
+        };
+        float block[kScanBlock];
+        int tail_ids[kScanBlock];
+        for (int list : scratch.probes) {
+            size_t begin = list_offsets_[list];
+            size_t end = list_offsets_[list + 1];
+            for (size_t start = begin; start < end; start += kScanBlock) {
+                size_t count = std::min(kScanBlock, end - start);
+                scan_(query, list_vectors_.row(start), count, list_vectors_.stride(), dimension_, block);
+                keep(block, count, &list_ids_[start]);
+            }
+            stats.count(Stat::Distances, end - begin);
+            if (tail_vectors_.empty()) {
+                continue;
+            }
+            const std::vector<int>& rows = tail_rows_[list];
+            for (size_t start = 0; start < rows.size(); start += kScanBlock) {
+                size_t count = std::min(kScanBlock, rows.size() - start);
+                scan_ids_(query, tail_vectors_.data(), rows.data() + start, count,
+                          tail_vectors_.stride(), dimension_, block);
+                for (size_t j = 0; j < count; ++j) {
+                    tail_ids[j] = static_cast<int>(tail_begin_ + rows[start + j]);
+                }
+                keep(block, count, tail_ids);
+            }
+            stats.count(Stat::Distances, rows.size());
+        }
+        stats_.add(stats);
+
+        std::sort(found.begin(), found.end());
+        ids.resize(found.size());
+        distances.resize(found.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            distances[i] = found[i].first;
+            ids[i] = found[i].second;
+        }
+    }
+
+    void save(const std::string& path) const override {
+        auto read = lock_.read();
+        IndexWriter out(path, "ivf", metric_, dimension_);
+        out.set("nlist", nlist_);
+        out.set("nlist_param", nlist_param_);
+        out.set("nprobe", nprobe_);
+        out.set("kmeans_iters", kmeans_iters_);
+        out.set("seed", seed_);
+        out.set("pq_m", pq_m_param_);
+        out.set("pq_nbits", pq_nbits_);
+        out.set("rerank", rerank_);
+        out.set("filter_brute_force", filter_brute_force_);
+        out.set("n_samples", static_cast<double>(n_samples_));
+        out.write("centroids", centroids_);
+        out.write("list_offsets", list_offsets_);
+        out.write("list_ids", list_ids_);
+        out.write_store("list_vectors", list_vectors_);
+        out.write("list_codes", list_codes_);
+        out.write("list_block_offsets", list_block_offsets_);
+        out.write_store("vectors", vectors_);
+        if (use_pq()) {
+            pq_.save(out, "pq");
+        }
+        out.set("tail_begin", static_cast<double>(tail_begin_));
+        out.write_store("tail_vectors", tail_vectors_);
+        out.write("tail_lists", tail_lists_);
+        if (n_deleted_ > 0) {
+            out.write("deleted", deleted_);
+        }
+        if (!labels_.empty()) {
+            out.write("labels", labels_);
+        }
+        out.finish();
+    }
+
+    void load(const std::string& path) override {
+        std::shared_ptr<IndexFile> in = IndexFile::open(path);
+        in->expect_kind("ivf");
+        auto write = lock_.write();
+        init(in->metric(), in->dimension());
+
+        nlist_ = static_cast<int>(in->get("nlist"));
+        nlist_param_ = static_cast<int>(in->get("nlist_param"));
+        nprobe_ = static_cast<int>(in->get("nprobe"));
+        kmeans_iters_ = static_cast<int>(in->get("kmeans_iters"));
+        seed_ = static_cast<unsigned>(in->get("seed"));
+        pq_m_param_ = static_cast<int>(in->get("pq_m"));
+        pq_nbits_ = static_cast<int>(in->get("pq_nbits"));
+        rerank_ = static_cast<int>(in->get("rerank"));
+        filter_brute_force_ = in->get("filter_brute_force", filter_brute_force_);
+        n_samples_ = static_cast<size_t>(in->get("n_samples"));
+
+        centroids_ = in->vector<float>("centroids");
+        list_offsets_ = in->vector<size_t>("list_offsets");
+        list_ids_ = in->vector<int>("list_ids");
+        in->map_store("list_vectors", list_vectors_);
+        list_codes_ = in->vector<uint8_t>("list_codes");
+        list_block_offsets_ = in->vector<size_t>("list_block_offsets");
+        in->map_store("vectors", vectors_);
+        pq_ = ProductQuantizer();
+        if (in->has("pq.codebooks")) {
+            pq_.load(*in, "pq");
+        }
+        if (centroids_.size() != static_cast<size_t>(nlist_) * dimension_ ||
+            list_offsets_.size() != static_cast<size_t>(nlist_) + 1) {
+            throw std::runtime_error("index file " + path + ": inconsistent IVF lists");
+        }
+
+        clear_updates();
+        if (in->has("tail_lists")) {
+            tail_begin_ = static_cast<size_t>(in->get("tail_begin"));
+            in->map_store("tail_vectors", tail_vectors_);
+            tail_lists_ = in->vector<int>("tail_lists");
+            if (tail_lists_.size() != tail_vectors_.size() ||
+                tail_begin_ + tail_lists_.size() != n_samples_) {
+                throw std::runtime_error("index file " + path + ": inconsistent IVF tails");
+            }
+            for (size_t r = 0; r < tail_lists_.size(); ++r) {
+                tail_rows_.at(tail_lists_[r]).push_back(static_cast<int>(r));
+            }
+        }
+        if (in->has("deleted")) {
+            deleted_ = in->vector<uint8_t>("deleted");
+            if (deleted_.size() != n_samples_) {
+                throw std::runtime_error("index file " + path + ": inconsistent IVF tombstones");
+            }
+            n_deleted_ = static_cast<size_t>(std::count(deleted_.begin(), deleted_.end(), 1));
+        }
+        labels_ = in->has("labels") ? in->vector<int>("labels") : std::vector<int>();
+    }
+
+    size_t get_memory_usage() const override {
+        auto read = lock_.read();
+        return centroids_.size() * sizeof(float) +
+               list_vectors_.memory_usage() +
+               list_codes_.size() * sizeof(uint8_t) +
+               vectors_.memory_usage() +
+               pq_.get_memory_usage() +
+               list_ids_.size() * sizeof(int) +
+               list_offsets_.size() * sizeof(size_t) +
+               list_block_offsets_.size() * sizeof(size_t) +
+               tail_vectors_.memory_usage() +
+               tail_lists_.size() * 2 * sizeof(int) +
+               deleted_.size() +
+               labels_.size() * sizeof(int);
+    }
+
+    std::string name() const override {
+        return use_pq() ? "IVFPQ" : "IVF";
+    }
+
+private:
+    // Rows scanned per kernel call; the distance buffer stays in L1
+    static constexpr size_t kScanBlock = 256;
+    static constexpr size_t kPQ4Block = 32;
+
+    // Vectors per residual-encoding chunk (bounds the temporary copy)
+    static constexpr size_t kEncodeChunk = 65536;
+
+    // PQ codebooks are trained on at most this many residuals
+    static constexpr size_t kPQTrainRows = 65536;
+
+    // Streamed builds train k-means on the first nlist * kStreamTrainPerList
+    // rows (fit() samples up to 256 per list out of all of them)
+    static constexpr size_t kStreamTrainPerList = 64;
+
+    /**
+     * Per-thread query buffers, reused across calls (and across instances;
+     * every user resizes what it needs), so concurrent queries never share
+     * state and steady-state queries do not allocate.
+     */
+    struct QueryScratch {
+        std::vector<float> normalized;
+        std::vector<float> centroid_dists;
+        std::vector<int> probes;
+        std::vector<int> round;  // lists scanned in one probing round
+        TopK top;
+        std::vector<float> lut;
+        std::vector<float> residual;
+        std::vector<uint8_t> lut8;
+        std::vector<float> dists;
+        std::vector<uint16_t> sums;
+        std::vector<int> ids;
+        std::vector<std::pair<float, int>> found;  // range_search() hits
+        SearchStats stats;  // this query's counts, added to stats_ at its end
+    };
+
+    /**
+     * Lists rebuilt by compact(), swapped in once complete.
+     */
+    struct CompactedLists {
+        std::vector<size_t> offsets;
+        std::vector<int> ids;
+        VectorStore vectors;
+        std::vector<uint8_t> codes;
+        std::vector<size_t> block_offsets;
+    };
+
+    static QueryScratch& query_scratch() {
+        thread_local QueryScratch scratch;
+        return scratch;
+    }
+
+    bool use_pq() const {
+        return pq_.m() > 0;
+    }
+
+    const float* centroid_at(int list) const {
+        return centroids_.data() + static_cast<size_t>(list) * dimension_;
+    }
+
+    /**
+     * Fill list_offsets_ / list_ids_ from labels: a stable counting sort, so
+     * each list holds its vectors in index order. Parallel over contiguous
+     * ranges of vectors; each range counts its labels, and a prefix sum over
+     * (list, range) gives every range its own write cursor per list, so the
+     * result does not depend on the thread count.
+     */
+    void bucket_by_list(const std::vector<int>& labels) {
+        size_t n = labels.size();
+        list_offsets_.assign(nlist_ + 1, 0);
+        list_ids_.resize(n);
+
+        size_t n_ranges = std::max<size_t>(1, std::min<size_t>(thread_count(0), n / kScanBlock));
+        std::vector<size_t> cursors(n_ranges * nlist_, 0);  // [range][list]
+        auto range_begin = [&](size_t r) { return n * r / n_ranges; };
+
+        #pragma omp parallel for schedule(static) num_threads(static_cast<int>(n_ranges))
+        for (long long r = 0; r < static_cast<long long>(n_ranges); ++r) {
+            size_t* counts = cursors.data() + r * nlist_;
+            for (size_t i = range_begin(r); i < range_begin(r + 1); ++i) {
+                ++counts[labels[i]];
+            }
+        }
+
+        size_t offset = 0;
+        for (int l = 0; l < nlist_; ++l) {
+            list_offsets_[l] = offset;
+            for (size_t r = 0; r < n_ranges; ++r) {
+                size_t count = cursors[r * nlist_ + l];
+                cursors[r * nlist_ + l] = offset;
+                offset += count;
+            }
+        }
+        list_offsets_[nlist_] = offset;
+
+        #pragma omp parallel for schedule(static) num_threads(static_cast<int>(n_ranges))
+        for (long long r = 0; r < static_cast<long long>(n_ranges); ++r) {
+            size_t* cursor = cursors.data() + r * nlist_;
+            for (size_t i = range_begin(r); i < range_begin(r + 1); ++i) {
+                list_ids_[cursor[labels[i]]++] = static_cast<int>(i);
+            }
+        }
+    }
+
+    /**
+     * nlist to use for n vectors (nlist param, or auto 4 * sqrt(n)).
+     */
+    int list_count(size_t n) const {
+        int nlist = nlist_param_ > 0
+            ? nlist_param_
+            : static_cast<int>(4.0 * std::sqrt(static_cast<double>(n)));
+        return std::max(1, std::min(nlist, static_cast<int>(n)));
+    }
+
+    /**
+     * Train the PQ on the residuals of (at most kPQTrainRows) random
+     * vectors out of data[0 .. n).
+     */
+    void train_pq(const float* data, const int* labels, size_t n) {
+        int m = pq_m_param_ < 0 ? default_pq_m(dimension_) : pq_m_param_;
+
+        size_t n_train = std::min(n, kPQTrainRows);
+        std::vector<size_t> sample(n);
+        std::iota(sample.begin(), sample.end(), size_t(0));
+        std::mt19937 rng(seed_);
+        std::shuffle(sample.begin(), sample.end(), rng);
+        sample.resize(n_train);
+
+        std::vector<float> residuals(n_train * dimension_);
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n_train); ++i) {
+            compute_residual(data + sample[i] * dimension_, labels[sample[i]],
+                             residuals.data() + i * dimension_);
+        }
+        pq_.train(residuals.data(), n_train, dimension_, m, pq_nbits_, seed_);
+    }
+
+    /**
+     * Train the PQ on residuals of a sample, then encode every vector's
+     * residual to its list centroid into the list-ordered code buffer.
+     */
+    void build_pq_lists(const float* data, const std::vector<int>& labels) {
+        train_pq(data, labels.data(), n_samples_);
+        const int m = pq_.m();
+
+        // Encode in chunks of list positions
+        std::vector<float> residuals;
+        std::vector<uint8_t> codes(n_samples_ * m);
+        residuals.resize(std::min(n_samples_, kEncodeChunk) * dimension_);
+        for (size_t start = 0; start < n_samples_; start += kEncodeChunk) {
+            size_t count = std::min(kEncodeChunk, n_samples_ - start);
+            #pragma omp parallel for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(count); ++i) {
+                int id = list_ids_[start + i];
+                compute_residual(data + static_cast<size_t>(id) * dimension_, labels[id],
+                                 residuals.data() + i * dimension_);
+            }
+            pq_.encode(residuals.data(), count, codes.data() + start * m);
+        }
+
+        if (pq_nbits_ == 8) {
+            list_codes_ = std::move(codes);
+            list_block_offsets_.clear();
+            return;
+        }
+
+        pack_pq4_lists(list_offsets_, codes, m, list_block_offsets_, list_codes_);
+    }
+
+    /**
+     * Streamed build: train the coarse quantizer (and PQ) on the buffered
+     * rows, then store those rows like any later chunk.
+     */
+    void train_streamed() {
+        std::vector<float> rows;
+        rows.swap(stream_rows_);
+        size_t n = rows.size() / dimension_;
+
+        KMeansParams params;
+        params.iterations = kmeans_iters_;
+        params.seed = seed_;
+        centroids_ = kmeans_train(rows.data(), n, dimension_, nlist_, params);
+        if (pq_m_param_ != 0) {
+            std::vector<int> labels(n);
+            kmeans_assign(rows.data(), n, dimension_, centroids_.data(), nlist_, labels.data());
+            train_pq(rows.data(), labels.data(), n);
+            list_codes_.reserve(stream_total_ * pq_.m());
+        }
+        append_streamed(rows.data(), n);
+    }
+
+    /**
+     * Streamed build: assign n (normalized) rows to lists and store them,
+     * or their codes, in arrival order; fit_end() reorders them.
+     */
+    void append_streamed(const float* data, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        size_t first = stream_labels_.size();
+        stream_labels_.resize(first + n);
+        int* labels = stream_labels_.data() + first;
+        kmeans_assign(data, n, dimension_, centroids_.data(), nlist_, labels);
+
+        if (!use_pq()) {
+            list_vectors_.append(data, n, dimension_);
+            return;
+        }
+
+        const int m = pq_.m();
+        list_codes_.resize((first + n) * m);
+        std::vector<float> residuals(std::min(n, kEncodeChunk) * dimension_);
+        for (size_t start = 0; start < n; start += kEncodeChunk) {
+            size_t count = std::min(kEncodeChunk, n - start);
+            #pragma omp parallel for schedule(static)
+            for (long long i = 0; i < static_cast<long long>(count); ++i) {
+                compute_residual(data + (start + i) * dimension_, labels[start + i],
+                                 residuals.data() + i * dimension_);
+            }
+            pq_.encode(residuals.data(), count, list_codes_.data() + (first + start) * m);
+        }
+        if (rerank_ > 0) {
+            vectors_.append(data, n, dimension_);
+        }
+    }
+
+    /**
+     * Reorder rows of row_bytes each in place so that row pos becomes old
+     * row order[pos] (order is a permutation), following each cycle with a
+     * single row of scratch.
+     */
+    static void gather_rows(char* base, size_t row_bytes, const std::vector<int>& order) {
+        std::vector<char> saved(row_bytes);
+        std::vector<uint8_t> done(order.size(), 0);
+        for (size_t start = 0; start < order.size(); ++start) {
+            if (done[start] || static_cast<size_t>(order[start]) == start) {
+                continue;
+            }
+            std::memcpy(saved.data(), base + start * row_bytes, row_bytes);
+            size_t pos = start;
+            while (true) {
+                done[pos] = 1;
+                size_t src = static_cast<size_t>(order[pos]);
+                if (src == start) {
+                    std::memcpy(base + pos * row_bytes, saved.data(), row_bytes);
+                    break;
+                }
+                std::memcpy(base + pos * row_bytes, base + src * row_bytes, row_bytes);
+                pos = src;
+            }
+        }
+    }
+
+    /**
+     * Repack list-ordered 4-bit codes into 32-vector fast-scan blocks, each
+     * list starting on a new block.
+     */
+    void pack_pq4_lists(const std::vector<size_t>& offsets, const std::vector<uint8_t>& codes,
+                        int m, std::vector<size_t>& block_offsets,
+                        std::vector<uint8_t>& packed) const {
+        block_offsets.assign(nlist_ + 1, 0);
+        for (int l = 0; l < nlist_; ++l) {
+            size_t size = offsets[l + 1] - offsets[l];
+            block_offsets[l + 1] = block_offsets[l] + (size + kPQ4Block - 1) / kPQ4Block;
+        }
+        packed.assign(block_offsets[nlist_] * pq4_block_bytes(m), 0);
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int l = 0; l < nlist_; ++l) {
+            size_t begin = offsets[l];
+            size_t end = offsets[l + 1];
+            size_t block = block_offsets[l];
+            for (size_t pos = begin; pos < end; pos += kPQ4Block, ++block) {
+                pack_pq4_block(codes.data() + pos * m, std::min(kPQ4Block, end - pos), m,
+                               packed.data() + block * pq4_block_bytes(m));
+            }
+        }
+    }
+
+    /**
+     * Reset the add() / remove() state for freshly built lists.
+     */
+    void clear_updates() {
+        tail_vectors_.clear();
+        tail_rows_.assign(nlist_, {});
+        tail_lists_.clear();
+        tail_begin_ = n_samples_;
+        deleted_.clear();
+        n_deleted_ = 0;
+    }
+
+    /**
+     * Fp32 row of any id for re-ranking: vectors_ up to tail_begin_, then
+     * the add() tail.
+     */
+    const float* exact_row(int id) const {
+        size_t i = static_cast<size_t>(id);
+        return i < tail_begin_ ? vectors_.row(i) : tail_vectors_.row(i - tail_begin_);
+    }
+
+    /**
+     * The current lists without tombstoned entries and with every tail
+     * appended to its list, in the same layout fit() produces. Only reads
+     * the index.
+     */
+    void build_compacted_lists(CompactedLists& next) const {
+        const int m = pq_.m();
+        const bool pq = use_pq();
+        auto live = [&](int id) { return n_deleted_ == 0 || !deleted_[id]; };
+
+        next.offsets.assign(nlist_ + 1, 0);
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int l = 0; l < nlist_; ++l) {
+            size_t count = 0;
+            for (size_t pos = list_offsets_[l]; pos < list_offsets_[l + 1]; ++pos) {
+                count += live(list_ids_[pos]);
+            }
+            for (int row : tail_rows_[l]) {
+                count += live(static_cast<int>(tail_begin_ + row));
+            }
+            next.offsets[l + 1] = count;
+        }
+        for (int l = 0; l < nlist_; ++l) {
+            next.offsets[l + 1] += next.offsets[l];
+        }
+
+        size_t total = next.offsets[nlist_];
+        next.ids.resize(total);
+        std::vector<uint8_t> codes;
+        if (pq) {
+            codes.resize(total * m);
+        } else {
+            next.vectors.allocate(total, dimension_);
+        }
+
+        #pragma omp parallel
+        {
+            std::vector<uint8_t> unpacked;
+            std::vector<float> residual(dimension_);
+
+            #pragma omp for schedule(dynamic, 16)
+            for (int l = 0; l < nlist_; ++l) {
+                size_t begin = list_offsets_[l];
+                size_t size = list_offsets_[l + 1] - begin;
+                const uint8_t* old_codes = pq ? &list_codes_[begin * m] : nullptr;
+                if (pq && pq_.nbits() == 4) {
+                    unpacked.resize(size * m);
+                    size_t block = list_block_offsets_[l];
+                    for (size_t i = 0; i < size; i += kPQ4Block, ++block) {
+                        unpack_pq4_block(&list_codes_[block * pq4_block_bytes(m)],
+                                         std::min(kPQ4Block, size - i), m, &unpacked[i * m]);
+                    }
+                    old_codes = unpacked.data();
+                }
+
+                size_t out = next.offsets[l];
+                for (size_t i = 0; i < size; ++i) {
+                    int id = list_ids_[begin + i];
+                    if (!live(id)) {
+                        continue;
+                    }
+                    next.ids[out] = id;
+                    if (pq) {
+                        std::copy(old_codes + i * m, old_codes + (i + 1) * m, &codes[out * m]);
+                    } else {
+                        std::copy(list_vectors_.row(begin + i), list_vectors_.row(begin + i) + dimension_,
+                                  next.vectors.row(out));
+                    }
+                    ++out;
+                }
+                for (int row : tail_rows_[l]) {
+                    int id = static_cast<int>(tail_begin_ + row);
+                    if (!live(id)) {
+                        continue;
+                    }
+                    next.ids[out] = id;
+                    const float* x = tail_vectors_.row(row);
+                    if (pq) {
+                        compute_residual(x, l, residual.data());
+                        pq_.encode(residual.data(), 1, &codes[out * m]);
+                    } else {
+                        std::copy(x, x + dimension_, next.vectors.row(out));
+                    }
+                    ++out;
+                }
+            }
+        }
+
+        if (pq && pq_.nbits() == 4) {
+            pack_pq4_lists(next.offsets, codes, m, next.block_offsets, next.codes);
+        } else {
+            next.codes = std::move(codes);
+        }
+    }
+
+    void compute_residual(const float* x, int list, float* out) const {
+        const float* c = centroid_at(list);
+        for (int j = 0; j < dimension_; ++j) {
+            out[j] = x[j] - c[j];
+        }
+    }
+
+    /**
+     * search() / search_filtered() (filter may be null). A filter scores
+     * only the rows it allows and keeps probing the next closest lists,
+     * nprobe at a time, until k results are in; filters below
+     * filter_brute_force scan every list.
+     */
+    void search_lists(const float* query, int k, const IdFilter* filter, int* ids,
+                      float* distances) const {
+        QueryScratch& scratch = query_scratch();
+        query = prepare_query(metric_type_, query, dimension_, scratch.normalized);
+        auto read = lock_.read();
+        SearchStats& stats = scratch.stats;
+        stats.clear();
+        stats.count(Stat::Queries);
+
+        // Rank centroids and keep the nprobe closest lists (all of them,
+        // in order, for a filter)
+        int nprobe = std::min(nprobe_, nlist_);
+        bool exhaustive = filter && filter->count() <= filter_brute_force_ * n_samples_;
+        std::vector<int>& probes = scratch.probes;
+        if (exhaustive) {
+            nprobe = nlist_;
+            probes.resize(nlist_);
+            std::iota(probes.begin(), probes.end(), 0);
+            stats.count(Stat::ExactScans);
+        } else {
+            rank_lists(query, filter ? nlist_ : nprobe, scratch);
+        }
+
+        bool rerank = use_pq() && rerank_ > 0 && !vectors_.empty();
+        TopK& top = scratch.top;
+        top.reset(rerank ? std::max(k, rerank_) : k);
+        uint64_t pushes = top.inserts();
+        std::vector<int>& round = scratch.round;
+        for (size_t first = 0; first < probes.size(); first += nprobe) {
+            if (first > 0 && top.size() >= static_cast<size_t>(k)) {
+                break;
+            }
+            round.assign(probes.begin() + first,
+                         probes.begin() + std::min(probes.size(), first + nprobe));
+            stats.count(Stat::ListsProbed, round.size());
+            if (use_pq()) {
+                scan_pq_lists(query, round, filter, top, scratch);
+            } else {
+                scan_flat_lists(query, round, filter, top);
+            }
+            scan_tail_lists(query, round, filter, top, scratch);
+        }
+        if (!rerank) {
+            stats.count(Stat::HeapPushes, top.inserts() - pushes);
+            stats_.add(stats);
+            top.take_into(k, ids, distances);
+            return;
+        }
+
+        // Exact re-rank of the PQ shortlist against the original floats
+        std::vector<int>& shortlist = scratch.ids;
+        shortlist.resize(top.size());
+        top.take_into(shortlist.size(), shortlist.data(), nullptr);
+        std::vector<float>& exact = scratch.dists;
+        exact.resize(shortlist.size());
+        if (tail_vectors_.empty()) {
+            scan_ids_(query, vectors_.data(), shortlist.data(), shortlist.size(), vectors_.stride(),
+                      dimension_, exact.data());
+        } else {
+            for (size_t i = 0; i < shortlist.size(); ++i) {
+                scan_(query, exact_row(shortlist[i]), 1, 0, dimension_, &exact[i]);
+            }
+        }
+
+        top.reset(k);
+        top.push_block(exact.data(), shortlist.size(), shortlist.data());
+        stats.count(Stat::Reranked, shortlist.size());
+        stats.count(Stat::Distances, shortlist.size());
+        stats.count(Stat::HeapPushes, top.inserts() - pushes);
+        stats_.add(stats);
+        top.take_into(k, ids, distances);
+    }
+
+    /**
+     * scratch.probes = the count lists with the closest centroids, closest
+     * first.
+     */
+    void rank_lists(const float* query, int count, QueryScratch& scratch) const {
+        std::vector<int>& probes = scratch.probes;
+        probes.resize(nlist_);
+        std::iota(probes.begin(), probes.end(), 0);
+        std::vector<float>& centroid_dists = scratch.centroid_dists;
+        centroid_dists.resize(nlist_);
+        centroid_scan_(query, centroids_.data(), nlist_, dimension_, dimension_,
+                       centroid_dists.data());
+        scratch.stats.count(Stat::Distances, nlist_);
+        auto closer = [&](int a, int b) { return centroid_dists[a] < centroid_dists[b]; };
+        std::partial_sort(probes.begin(), probes.begin() + count, probes.end(), closer);
+        probes.resize(count);
+    }
+
+    /**
+     * top.push_block() without the tombstoned ids and the ids filter (if
+     * any) rejects.
+     */
+    void offer(TopK& top, const float* dists, size_t count, const int* ids,
+               const IdFilter* filter = nullptr) const {
+        if (n_deleted_ == 0 && !filter) {
+            top.push_block(dists, count, ids);
+            return;
+        }
+        for (size_t j = 0; j < count; ++j) {
+            if (dists[j] < top.threshold() && (n_deleted_ == 0 || !deleted_[ids[j]]) &&
+                (!filter || filter->allows(ids[j]))) {
+                top.push(dists[j], ids[j]);
+            }
+        }
+    }
+
+    /**
+     * List positions [begin, end) whose ids filter allows, in rounds of at
+     * most kScanBlock: fills positions / ids and calls score(count).
+     */
+    template <typename Score>
+    void for_allowed(size_t begin, size_t end, const IdFilter& filter, int* positions, int* ids,
+                     Score score) const {
+        size_t count = 0;
+        for (size_t pos = begin; pos < end; ++pos) {
+            int id = list_ids_[pos];
+            if (!filter.allows(id)) {
+                continue;
+            }
+            positions[count] = static_cast<int>(pos);
+            ids[count] = id;
+            if (++count == kScanBlock) {
+                score(count);
+                count = 0;
+            }
+        }
+        if (count > 0) {
+            score(count);
+        }
+    }
+
+    /**
+     * Exact scan of the vectors add() put in the probed lists' tails.
+     */
+    void scan_tail_lists(const float* query, const std::vector<int>& probes,
+                         const IdFilter* filter, TopK& top, QueryScratch& scratch) const {
+        if (tail_vectors_.empty()) {
+            return;
+        }
+        std::vector<float>& dists = scratch.dists;
+        std::vector<int>& ids = scratch.ids;
+        dists.resize(kScanBlock);
+        ids.resize(kScanBlock);
+        for (int list : probes) {
+            const std::vector<int>& rows = tail_rows_[list];
+            for (size_t start = 0; start < rows.size(); start += kScanBlock) {
+                size_t count = std::min(kScanBlock, rows.size() - start);
+                scan_ids_(query, tail_vectors_.data(), rows.data() + start, count,
+                          tail_vectors_.stride(), dimension_, dists.data());
+                for (size_t j = 0; j < count; ++j) {
+                    ids[j] = static_cast<int>(tail_begin_ + rows[start + j]);
+                }
+                offer(top, dists.data(), count, ids.data(), filter);
+            }
+            scratch.stats.count(Stat::Distances, rows.size());
+        }
+    }
+
+    void scan_flat_lists(const float* query, const std::vector<int>& probes,
+                         const IdFilter* filter, TopK& top) const {
+        SearchStats& stats = query_scratch().stats;
+        float block[kScanBlock];
+        int positions[kScanBlock];
+        int ids[kScanBlock];
+        for (int list : probes) {
+            size_t begin = list_offsets_[list];
+            size_t end = list_offsets_[list + 1];
+
+            if (filter) {
+                // Score only the allowed rows
+                for_allowed(begin, end, *filter, positions, ids, [&](size_t count) {
+                    scan_ids_(query, list_vectors_.data(), positions, count, list_vectors_.stride(),
+                              dimension_, block);
+                    stats.count(Stat::Distances, count);
+                    offer(top, block, count, ids);
+                });
+                continue;
+            }
+
+            for (size_t start = begin; start < end; start += kScanBlock) {
+                size_t count = std::min(kScanBlock, end - start);
+                scan_(query, list_vectors_.row(start), count, list_vectors_.stride(), dimension_, block);
+                offer(top, block, count, &list_ids_[start]);
+            }
+            stats.count(Stat::Distances, end - begin);
+        }
+    }
+
+    /**
+     * ADC scan of the probed lists. Distances decompose as
+     * bias(list) + sum_s lut[s][code_s]:
+     * - euclidean: lut built from the query residual q - c, bias 0
+     * - angular:   lut of -(q_s · codeword) built once, bias 1 - q · c
+     */
+    void scan_pq_lists(const float* query, const std::vector<int>& probes,
+                       const IdFilter* filter, TopK& top, QueryScratch& scratch) const {
+        const int m = pq_.m();
+        std::vector<float>& lut = scratch.lut;
+        std::vector<float>& residual = scratch.residual;
+        std::vector<uint8_t>& lut8 = scratch.lut8;
+        std::vector<float>& dists = scratch.dists;
+        std::vector<uint16_t>& sums = scratch.sums;
+        lut.resize(pq_.lut_size());
+        residual.resize(dimension_);
+        lut8.resize(pq_.lut_size());
+        dists.resize(kScanBlock);
+        sums.resize(kScanBlock);
+        const DistanceKernels& kernels = distance_kernels();
+
+        if (metric_type_ == Metric::Angular) {
+            pq_.compute_ip_lut(query, lut.data());
+        }
+
+        for (int list : probes) {
+            size_t begin = list_offsets_[list];
+            size_t end = list_offsets_[list + 1];
+            // Selective filters leave most lists empty: skip their tables
+            if (filter && std::none_of(list_ids_.begin() + begin, list_ids_.begin() + end,
+                                       [&](int id) { return filter->allows(id); })) {
+                continue;
+            }
+
+            float list_bias = 0.0f;
+            if (metric_type_ == Metric::Euclidean) {
+                compute_residual(query, list, residual.data());
+                pq_.compute_l2_lut(residual.data(), lut.data());
+            } else {
+                list_bias = 1.0f - kernels.inner_product(query, centroid_at(list), dimension_);
+            }
+
+            if (pq_.nbits() == 8 && filter) {
+                int positions[kScanBlock];
+                int list_ids[kScanBlock];
+                for_allowed(begin, end, *filter, positions, list_ids, [&](size_t count) {
+                    for (size_t j = 0; j < count; ++j) {
+                        pq_.adc_scan(&list_codes_[static_cast<size_t>(positions[j]) * m], 1,
+                                     lut.data(), &dists[j]);
+                        dists[j] += list_bias;
+                    }
+                    scratch.stats.count(Stat::Distances, count);
+                    offer(top, dists.data(), count, list_ids);
+                });
+                continue;
+            }
+            if (pq_.nbits() == 8) {
+                for (size_t start = begin; start < end; start += kScanBlock) {
+                    size_t count = std::min(kScanBlock, end - start);
+                    pq_.adc_scan(&list_codes_[start * m], count, lut.data(), dists.data());
+                    for (size_t j = 0; j < count; ++j) {
+                        dists[j] += list_bias;
+                    }
+                    offer(top, dists.data(), count, &list_ids_[start]);
+                }
+                scratch.stats.count(Stat::Distances, end - begin);
+                continue;
+            }
+
+            // 4-bit fast-scan: quantized table, kScanBlock codes per call
+            float scale, lut_bias;
+            quantize_pq4_lut(lut.data(), m, lut8.data(), scale, lut_bias);
+            float inv_scale = 1.0f / scale;
+            list_bias += lut_bias;
+
+            size_t first_block = list_block_offsets_[list];
+            size_t n_blocks = list_block_offsets_[list + 1] - first_block;
+            const size_t blocks_per_call = kScanBlock / kPQ4Block;
+            for (size_t b = 0; b < n_blocks; b += blocks_per_call) {
+                size_t count_blocks = std::min(blocks_per_call, n_blocks - b);
+                kernels.pq4_scan(&list_codes_[(first_block + b) * pq4_block_bytes(m)],
+                                 count_blocks, m, lut8.data(), sums.data());
+
+                size_t pos = begin + b * kPQ4Block;
+                size_t count = std::min(count_blocks * kPQ4Block, end - pos);
+                for (size_t j = 0; j < count; ++j) {
+                    dists[j] = list_bias + sums[j] * inv_scale;
+                }
+                offer(top, dists.data(), count, &list_ids_[pos], filter);
+            }
+            scratch.stats.count(Stat::Distances, end - begin);
+        }
+    }
+
+    // Parameters
+    int nlist_param_ = 0;
+    int nprobe_ = 16;
+    int kmeans_iters_ = 10;
+    unsigned seed_ = 1234;
+    int pq_m_param_ = 0;
+    int pq_nbits_ = 8;
+    int rerank_ = 0;
+    double filter_brute_force_ = 0.01;
+
+    Metric metric_type_ = Metric::Euclidean;
+    ScanFunc scan_ = nullptr;
+    ScanIdsFunc scan_ids_ = nullptr;
+    ScanFunc centroid_scan_ = nullptr;
+
+    int nlist_ = 0;
+    std::vector<float> centroids_;            // nlist * dim
+    std::vector<size_t> list_offsets_;        // nlist + 1, CSR offsets into list_ids_
+    std::vector<int> list_ids_;               // original id of each stored vector
+    VectorStore list_vectors_;                // flat: vectors in list order
+    ProductQuantizer pq_;
+    std::vector<uint8_t> list_codes_;         // PQ: codes in list order (or 4-bit blocks)
+    std::vector<size_t> list_block_offsets_;  // 4-bit PQ: nlist + 1, in 32-vector blocks
+    VectorStore vectors_;                     // PQ re-rank: original floats, id order
+    size_t n_samples_ = 0;
+
+    // add() / remove() state, folded into the lists by compact()
+    VectorStore tail_vectors_;                // rows of ids tail_begin_, tail_begin_ + 1, ...
+    std::vector<std::vector<int>> tail_rows_; // per list: its rows of tail_vectors_
+    std::vector<int> tail_lists_;             // list of each tail row
+    size_t tail_begin_ = 0;
+    std::vector<uint8_t> deleted_;            // tombstones, empty until remove()
+    size_t n_deleted_ = 0;
+
+    // Streamed build (fit_begin() .. fit_end()); stream_rows_ holds the
+    // training rows until the quantizers are trained
+    size_t stream_total_ = 0;                 // rows announced, 0 = buffer all
+    size_t stream_train_rows_ = 0;
+    std::vector<int> stream_labels_;          // list of each row, arrival order
+    IndexLock lock_;
+};
+
+// Factory functions
+extern "C" ANNAlgorithm* create_ivf_index() {
+    return new IVFIndex();
+}
+
+extern "C" ANNAlgorithm* create_ivfpq_index() {
+    return new IVFIndex(-1);
+}
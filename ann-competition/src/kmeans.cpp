@@ -0,0 +1,158 @@
+#include "../include/kmeans.hpp"
+#include "../include/distance.hpp"
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+void kmeans_assign(const float* data, size_t n, size_t dim,
+                   const float* centroids, int k,
+                   int* labels, float* distances) {
+    ScanFunc scan = resolve_scan(Metric::Euclidean, static_cast<int>(dim));
+
+    #pragma omp parallel
+    {
+        std::vector<float> dists(k);
+
+        #pragma omp for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n); ++i) {
+            scan(data + i * dim, centroids, k, dim, dim, dists.data());
+            int best = static_cast<int>(std::min_element(dists.begin(), dists.end()) - dists.begin());
+            labels[i] = best;
+            if (distances) {
+                distances[i] = dists[best];
+            }
+        }
+    }
+}
+
+/**
+ * Re-seed empty clusters by splitting the largest one: both halves get the
+ * big centroid nudged in opposite directions, and the next iteration sorts
+ * out which points go where.
+ */
+static void split_empty_clusters(std::vector<float>& centroids, std::vector<size_t>& sizes,
+                                 size_t dim, std::mt19937& rng) {
+    const float kEps = 1.0f / 1024.0f;
+    int k = static_cast<int>(sizes.size());
+
+    for (int c = 0; c < k; ++c) {
+        if (sizes[c] != 0) {
+            continue;
+        }
+
+        // Pick a big cluster with probability proportional to its size
+        size_t total = std::accumulate(sizes.begin(), sizes.end(), size_t(0));
+        if (total == 0) {
+            return;
+        }
+        std::uniform_int_distribution<size_t> pick(0, total - 1);
+        size_t r = pick(rng);
+        int big = 0;
+        while (r >= sizes[big]) {
+            r -= sizes[big];
+            ++big;
+        }
+
+        float* dst = centroids.data() + c * dim;
+        float* src = centroids.data() + big * dim;
+        for (size_t j = 0; j < dim; ++j) {
+            float sign = (j % 2 == 0) ? 1.0f : -1.0f;
+            dst[j] = src[j] * (1.0f + sign * kEps);
+            src[j] = src[j] * (1.0f - sign * kEps);
+        }
+        sizes[c] = sizes[big] / 2;
+        sizes[big] -= sizes[c];
+    }
+}
+
+std::vector<float> kmeans_train(const float* data, size_t n, size_t dim, int k,
+                                const KMeansParams& params) {
+    std::mt19937 rng(params.seed);
+    std::vector<float> centroids(static_cast<size_t>(k) * dim);
+
+    // Nothing to train on: all-zero centroids
+    if (n == 0) {
+        return centroids;
+    }
+
+    // Degenerate case: fewer points than centroids, reuse points cyclically
+    if (n <= static_cast<size_t>(k)) {
+        for (int c = 0; c < k; ++c) {
+            std::copy(data + (c % n) * dim, data + (c % n + 1) * dim, centroids.begin() + c * dim);
+        }
+        return centroids;
+    }
+
+    // Random subsample for training (partial Fisher-Yates)
+    std::vector<size_t> perm(n);
+    std::iota(perm.begin(), perm.end(), size_t(0));
+    size_t n_train = std::min(n, static_cast<size_t>(k) * params.max_points_per_centroid);
+    for (size_t i = 0; i < n_train; ++i) {
+        std::uniform_int_distribution<size_t> pick(i, n - 1);
+        std::swap(perm[i], perm[pick(rng)]);
+    }
+    std::sort(perm.begin(), perm.begin() + n_train);
+
+    std::vector<float> train(n_train * dim);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(n_train); ++i) {
+        std::copy(data + perm[i] * dim, data + (perm[i] + 1) * dim, train.begin() + i * dim);
+    }
+
+    // Initialize from k distinct training points
+    std::vector<size_t> rows(n_train);
+    std::iota(rows.begin(), rows.end(), size_t(0));
+    for (int c = 0; c < k; ++c) {
+        std::uniform_int_distribution<size_t> pick(c, n_train - 1);
+        std::swap(rows[c], rows[pick(rng)]);
+        std::copy(train.begin() + rows[c] * dim, train.begin() + (rows[c] + 1) * dim,
+                  centroids.begin() + c * dim);
+    }
+
+    std::vector<int> labels(n_train);
+    std::vector<size_t> offsets(k + 1);
+    std::vector<size_t> members(n_train);
+    std::vector<size_t> sizes(k);
+
+    for (int iter = 0; iter < params.iterations; ++iter) {
+        kmeans_assign(train.data(), n_train, dim, centroids.data(), k, labels.data());
+
+        // Group points by cluster (counting sort keeps index order)
+        std::fill(sizes.begin(), sizes.end(), 0);
+        for (int label : labels) {
+            ++sizes[label];
+        }
+        offsets[0] = 0;
+        for (int c = 0; c < k; ++c) {
+            offsets[c + 1] = offsets[c] + sizes[c];
+        }
+        std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < n_train; ++i) {
+            members[cursor[labels[i]]++] = i;
+        }
+
+        // Recompute means, one cluster per task
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int c = 0; c < k; ++c) {
+            if (sizes[c] == 0) {
+                continue;
+            }
+            float* centroid = centroids.data() + c * dim;
+            std::fill(centroid, centroid + dim, 0.0f);
+            for (size_t m = offsets[c]; m < offsets[c + 1]; ++m) {
+                const float* x = train.data() + members[m] * dim;
+                for (size_t j = 0; j < dim; ++j) {
+                    centroid[j] += x[j];
+                }
+            }
+            float inv = 1.0f / static_cast<float>(sizes[c]);
+            for (size_t j = 0; j < dim; ++j) {
+                centroid[j] *= inv;
+            }
+        }
+
+        split_empty_clusters(centroids, sizes, dim, rng);
+    }
+
+    return centroids;
+}
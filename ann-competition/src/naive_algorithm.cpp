@@ -1,4 +1,5 @@
 #include "../include/ann_interface.hpp"
+#include "../include/distance.hpp"
 #include <cmath>
 #include <algorithm>
 #include <queue>
@@ -21,6 +22,7 @@ public:
     void init(const std::string& metric, int dimension) override {
         metric_ = metric;
         dimension_ = dimension;
+        metric_type_ = parse_metric(metric);
     }
 
     void fit(const float* data, size_t n_samples) override {
@@ -41,6 +43,10 @@ public:
             float dist = compute_distance(query, &data_[i * dimension_]);
             distances.emplace_back(dist, static_cast<int>(i));
         }
+        SearchStats stats;
+        stats.count(Stat::Queries);
+        stats.count(Stat::Distances, n_samples_);
+        stats_.add(stats);
         
         // Partial sort to get k smallest
         std::partial_sort(
@@ -76,7 +82,7 @@ private:
      * 3. Consider loop unrolling
      */
     float compute_distance(const float* a, const float* b) const {
-        if (metric_ == "euclidean") {
+        if (metric_type_ == Metric::Euclidean) {
             return euclidean_distance(a, b);
         } else { // angular (cosine)
             return angular_distance(a, b);
@@ -119,6 +125,7 @@ private:
         return 1.0f - (dot / (std::sqrt(norm_a) * std::sqrt(norm_b)));
     }
 
+    Metric metric_type_ = Metric::Euclidean;
     std::vector<float> data_;
     size_t n_samples_ = 0;
 };
@@ -0,0 +1,166 @@
+#include "../include/numa.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#if defined(__has_include)
+#if __has_include(<linux/mempolicy.h>)
+#define ANN_HAVE_MEMPOLICY 1
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
+// Node ids the memory-policy masks cover
+static constexpr int kMaxNodes = 1024;
+
+/**
+ * Parse a kernel list such as "0-3,8-11" (cpulist, node/online).
+ */
+static std::vector<int> parse_list(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range[0] == '\n') {
+            continue;
+        }
+        char* end = nullptr;
+        long first = std::strtol(range.c_str(), &end, 10);
+        long last = *end == '-' ? std::strtol(end + 1, nullptr, 10) : first;
+        for (long v = first; v <= last; ++v) {
+            values.push_back(static_cast<int>(v));
+        }
+    }
+    return values;
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+/**
+ * CPUs the process may run on.
+ */
+static std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < count; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+static std::vector<NumaNode> detect_nodes() {
+    std::vector<int> allowed = allowed_cpus();
+    std::vector<NumaNode> nodes;
+    const char* env = std::getenv("ANN_NUMA");
+    if (env == nullptr || std::strcmp(env, "0") != 0) {
+        const std::string root = "/sys/devices/system/node/";
+        for (int id : parse_list(read_file(root + "online"))) {
+            NumaNode node{id, {}};
+            for (int cpu : parse_list(read_file(root + "node" + std::to_string(id) + "/cpulist"))) {
+                if (std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            if (!node.cpus.empty()) {
+                nodes.push_back(std::move(node));
+            }
+        }
+    }
+    if (nodes.size() <= 1) {
+        nodes.assign(1, NumaNode{-1, allowed});
+    }
+    return nodes;
+}
+
+const std::vector<NumaNode>& numa_nodes() {
+    static const std::vector<NumaNode> nodes = detect_nodes();
+    return nodes;
+}
+
+#ifdef ANN_HAVE_MEMPOLICY
+/**
+ * Memory-policy node mask with only node set.
+ */
+struct NodeMask {
+    explicit NodeMask(int node) {
+        std::memset(words, 0, sizeof(words));
+        words[node / kWordBits] |= 1ul << (node % kWordBits);
+    }
+
+    static constexpr int kWordBits = 8 * sizeof(unsigned long);
+    // The kernel reads maxnode - 1 bits
+    static constexpr unsigned long kMaxNode = kMaxNodes + 1;
+    unsigned long words[kMaxNodes / kWordBits];
+};
+#endif
+
+bool numa_bind_thread(const NumaNode& node) {
+    bool ok = true;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : node.cpus) {
+        CPU_SET(cpu, &set);
+    }
+    ok = sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+#ifdef ANN_HAVE_MEMPOLICY
+    if (node.id >= 0 && node.id < kMaxNodes) {
+        NodeMask mask(node.id);
+        ok = syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.words, NodeMask::kMaxNode) == 0 &&
+             ok;
+    }
+#endif
+    return ok;
+}
+
+bool numa_place(const void* data, size_t bytes, const NumaNode& node) {
+#ifdef ANN_HAVE_MEMPOLICY
+    if (node.id < 0 || node.id >= kMaxNodes) {
+        return false;
+    }
+    // mbind() works on whole pages; the partial ones at the ends stay put
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page - 1) / page * page;
+    uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) / page * page;
+    if (begin >= end) {
+        return false;
+    }
+    NodeMask mask(node.id);
+    return syscall(SYS_mbind, begin, end - begin, MPOL_PREFERRED, mask.words, NodeMask::kMaxNode,
+                   MPOL_MF_MOVE) == 0;
+#else
+    (void)data;
+    (void)bytes;
+    (void)node;
+    return false;
+#endif
+}
@@ -0,0 +1,304 @@
+#include "../include/pca.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+// Rows the covariance is estimated on: at least this many, and at least
+// kSamplePerDim per dimension, when the data has them
+static constexpr size_t kSampleRows = 4096;
+static constexpr size_t kSamplePerDim = 4;
+
+// Extra directions iterated beyond out_dim (faster, steadier convergence
+// of the last kept ones)
+static constexpr size_t kOversample = 8;
+static constexpr int kPowerIterations = 24;
+static constexpr int kJacobiSweeps = 50;
+
+// Rows per dot_tile() call in apply() and the covariance products
+static constexpr size_t kTileRows = 64;
+
+static constexpr unsigned kSeed = 1234;
+
+/**
+ * out[i * ld + j] = a_i · b_j for na rows of a and nb rows of b (both dim
+ * floats, contiguous), parallel over tiles of b.
+ */
+static void dot_products(const float* a, size_t na, const float* b, size_t nb, size_t dim,
+                         float* out, size_t ld) {
+    DotTileFunc dot_tile = distance_kernels().dot_tile;
+    long long n_tiles = static_cast<long long>((nb + kTileRows - 1) / kTileRows);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long long t = 0; t < n_tiles; ++t) {
+        size_t first = static_cast<size_t>(t) * kTileRows;
+        size_t count = std::min(kTileRows, nb - first);
+        dot_tile(a, na, b + first * dim, count, dim, dim, out + first, ld);
+    }
+}
+
+/**
+ * Orthonormalize the n rows of v (dim floats each) in place: modified
+ * Gram-Schmidt, run twice for accuracy. A row that is (numerically) in the
+ * span of the earlier ones is replaced by a random direction.
+ */
+static void orthonormalize(std::vector<float>& v, size_t n, size_t dim, std::mt19937& rng) {
+    std::normal_distribution<float> normal;
+    for (size_t i = 0; i < n; ++i) {
+        float* row = &v[i * dim];
+        for (int attempt = 0;; ++attempt) {
+            for (int pass = 0; pass < 2; ++pass) {
+                for (size_t j = 0; j < i; ++j) {
+                    const float* other = &v[j * dim];
+                    double dot = 0.0;
+                    for (size_t d = 0; d < dim; ++d) {
+                        dot += static_cast<double>(row[d]) * other[d];
+                    }
+                    for (size_t d = 0; d < dim; ++d) {
+                        row[d] -= static_cast<float>(dot) * other[d];
+                    }
+                }
+            }
+            double norm = 0.0;
+            for (size_t d = 0; d < dim; ++d) {
+                norm += static_cast<double>(row[d]) * row[d];
+            }
+            if (norm > 1e-20 || attempt == 3) {
+                float scale = norm > 0.0 ? static_cast<float>(1.0 / std::sqrt(norm)) : 0.0f;
+                for (size_t d = 0; d < dim; ++d) {
+                    row[d] *= scale;
+                }
+                break;
+            }
+            for (size_t d = 0; d < dim; ++d) {
+                row[d] = normal(rng);
+            }
+        }
+    }
+}
+
+/**
+ * Eigen-decomposition of the symmetric n x n matrix a (row-major, destroyed)
+ * by cyclic Jacobi rotations: afterwards a's diagonal holds the eigenvalues
+ * and column r of vectors the eigenvector of a[r][r].
+ */
+static void symmetric_eigen(std::vector<double>& a, size_t n, std::vector<double>& vectors) {
+    vectors.assign(n * n, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        vectors[i * n + i] = 1.0;
+    }
+    for (int sweep = 0; sweep < kJacobiSweeps; ++sweep) {
+        double off = 0.0;
+        double diag = 0.0;
+        for (size_t p = 0; p < n; ++p) {
+            diag += a[p * n + p] * a[p * n + p];
+            for (size_t q = p + 1; q < n; ++q) {
+                off += a[p * n + q] * a[p * n + q];
+            }
+        }
+        if (off <= 1e-24 * diag) {
+            break;
+        }
+
+        for (size_t p = 0; p < n; ++p) {
+            for (size_t q = p + 1; q < n; ++q) {
+                double apq = a[p * n + q];
+                if (apq == 0.0) {
+                    continue;
+                }
+                // Rotation in the (p, q) plane that zeroes a[p][q]
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                double c = 1.0 / std::sqrt(t * t + 1.0);
+                double s = t * c;
+                for (size_t k = 0; k < n; ++k) {
+                    double akp = a[k * n + p];
+                    double akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    double apk = a[p * n + k];
+                    double aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    double vkp = vectors[k * n + p];
+                    double vkq = vectors[k * n + q];
+                    vectors[k * n + p] = c * vkp - s * vkq;
+                    vectors[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+void PCATransform::train(const float* data, size_t n, size_t dim, size_t stride, size_t out_dim) {
+    if (out_dim == 0 || out_dim >= dim) {
+        throw std::runtime_error("PCA: output dimension must be in 1 .. " + std::to_string(dim - 1));
+    }
+    if (n == 0) {
+        throw std::runtime_error("PCA: no training vectors");
+    }
+    stride = stride == 0 ? dim : stride;
+    dim_ = dim;
+    out_dim_ = out_dim;
+
+    // Evenly spaced sample, centered and transposed (dim x m): the
+    // covariance is then one dot product per pair of dimensions
+    size_t wanted = std::min(n, std::max(kSampleRows, kSamplePerDim * dim));
+    size_t step = n / wanted;
+    size_t m = (n + step - 1) / step;
+    std::vector<double> mean(dim, 0.0);
+    for (size_t i = 0; i < m; ++i) {
+        const float* row = data + i * step * stride;
+        for (size_t d = 0; d < dim; ++d) {
+            mean[d] += row[d];
+        }
+    }
+    mean_.resize(dim);
+    for (size_t d = 0; d < dim; ++d) {
+        mean_[d] = static_cast<float>(mean[d] / m);
+    }
+    std::vector<float> columns(dim * m);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(m); ++i) {
+        const float* row = data + i * step * stride;
+        for (size_t d = 0; d < dim; ++d) {
+            columns[d * m + i] = row[d] - mean_[d];
+        }
+    }
+    std::vector<float> covariance(dim * dim);
+    dot_products(columns.data(), dim, columns.data(), dim, m, covariance.data(), dim);
+    float inv_m = 1.0f / static_cast<float>(m);
+    double trace = 0.0;
+    for (size_t i = 0; i < dim * dim; ++i) {
+        covariance[i] *= inv_m;
+    }
+    for (size_t d = 0; d < dim; ++d) {
+        trace += covariance[d * dim + d];
+    }
+    columns = std::vector<float>();
+
+    // Orthogonal iteration: basis <- orth(C basis) converges to the top
+    // eigenspace (C is symmetric, so row i of basis C is C basis_i)
+    size_t block = std::min(dim, out_dim + kOversample);
+    std::mt19937 rng(kSeed);
+    std::normal_distribution<float> normal;
+    std::vector<float> basis(block * dim);
+    for (float& x : basis) {
+        x = normal(rng);
+    }
+    orthonormalize(basis, block, dim, rng);
+    std::vector<float> product(block * dim);
+    for (int iter = 0; iter < kPowerIterations; ++iter) {
+        dot_products(basis.data(), block, covariance.data(), dim, dim, product.data(), dim);
+        basis.swap(product);
+        orthonormalize(basis, block, dim, rng);
+    }
+
+    // Rayleigh-Ritz: eigen-decompose C restricted to the basis to get the
+    // individual directions, largest variance first
+    dot_products(basis.data(), block, covariance.data(), dim, dim, product.data(), dim);
+    std::vector<double> restricted(block * block);
+    for (size_t i = 0; i < block; ++i) {
+        for (size_t j = 0; j < block; ++j) {
+            double dot = 0.0;
+            for (size_t d = 0; d < dim; ++d) {
+                dot += static_cast<double>(basis[i * dim + d]) * product[j * dim + d];
+            }
+            restricted[i * block + j] = dot;
+        }
+    }
+    for (size_t i = 0; i < block; ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            restricted[i * block + j] = restricted[j * block + i] =
+                0.5 * (restricted[i * block + j] + restricted[j * block + i]);
+        }
+    }
+    std::vector<double> vectors;
+    symmetric_eigen(restricted, block, vectors);
+    std::vector<size_t> order(block);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return restricted[a * block + a] > restricted[b * block + b];
+    });
+
+    components_.assign(out_dim * dim, 0.0f);
+    double kept = 0.0;
+    for (size_t r = 0; r < out_dim; ++r) {
+        size_t e = order[r];
+        kept += restricted[e * block + e];
+        float* component = &components_[r * dim];
+        for (size_t i = 0; i < block; ++i) {
+            float weight = static_cast<float>(vectors[i * block + e]);
+            for (size_t d = 0; d < dim; ++d) {
+                component[d] += weight * basis[i * dim + d];
+            }
+        }
+    }
+    explained_variance_ = trace > 0.0 ? kept / trace : 0.0;
+
+    offsets_.resize(out_dim);
+    for (size_t r = 0; r < out_dim; ++r) {
+        double dot = 0.0;
+        for (size_t d = 0; d < dim; ++d) {
+            dot += static_cast<double>(components_[r * dim + d]) * mean_[d];
+        }
+        offsets_[r] = static_cast<float>(dot);
+    }
+}
+
+void PCATransform::apply(const float* data, size_t n, size_t stride, float* out) const {
+    stride = stride == 0 ? dim_ : stride;
+    DotTileFunc dot_tile = distance_kernels().dot_tile;
+    long long n_tiles = static_cast<long long>((n + kTileRows - 1) / kTileRows);
+
+    #pragma omp parallel for schedule(static) if (n_tiles > 1)
+    for (long long t = 0; t < n_tiles; ++t) {
+        size_t first = static_cast<size_t>(t) * kTileRows;
+        size_t count = std::min(kTileRows, n - first);
+        const float* rows = data + first * stride;
+        std::vector<float> packed;
+        if (stride != dim_) {
+            // dot_tile() takes contiguous queries
+            packed.resize(count * dim_);
+            for (size_t i = 0; i < count; ++i) {
+                std::copy(rows + i * stride, rows + i * stride + dim_, &packed[i * dim_]);
+            }
+            rows = packed.data();
+        }
+        float* projected = out + first * out_dim_;
+        dot_tile(rows, count, components_.data(), out_dim_, dim_, dim_, projected, out_dim_);
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t r = 0; r < out_dim_; ++r) {
+                projected[i * out_dim_ + r] -= offsets_[r];
+            }
+        }
+    }
+}
+
+void PCATransform::save(IndexWriter& out, const std::string& prefix) const {
+    out.set(prefix + ".dim", static_cast<double>(dim_));
+    out.set(prefix + ".out_dim", static_cast<double>(out_dim_));
+    out.set(prefix + ".explained_variance", explained_variance_);
+    out.write(prefix + ".mean", mean_);
+    out.write(prefix + ".components", components_);
+    out.write(prefix + ".offsets", offsets_);
+}
+
+void PCATransform::load(const IndexFile& in, const std::string& prefix) {
+    dim_ = static_cast<size_t>(in.get(prefix + ".dim"));
+    out_dim_ = static_cast<size_t>(in.get(prefix + ".out_dim"));
+    explained_variance_ = in.get(prefix + ".explained_variance", 0.0);
+    mean_ = in.vector<float>(prefix + ".mean");
+    components_ = in.vector<float>(prefix + ".components");
+    offsets_ = in.vector<float>(prefix + ".offsets");
+    if (mean_.size() != dim_ || components_.size() != out_dim_ * dim_ ||
+        offsets_.size() != out_dim_) {
+        throw std::runtime_error("PCA: projection in index file does not match its dimensions");
+    }
+}
@@ -0,0 +1,429 @@
+#include "../include/ann_interface.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include "../include/index_lock.hpp"
+#include "../include/pca.hpp"
+#include "../include/topk.hpp"
+#include "../include/vector_store.hpp"
+#include <algorithm>
+#include <memory>
+
+// Relative headroom on the reduced range radius: the projected distance is
+// computed along a different rounding path and may land a few ulps above
+// the exact one for hits sitting on the boundary.
+static constexpr float kRangeSlack = 1e-4f;
+
+/**
+ * Dimensionality-reduction stage in front of any other index.
+ *
+ * fit() learns a PCA projection (pca.hpp) to pca_dim dimensions and builds
+ * the wrapped index on the projected vectors; queries are projected the same
+ * way, the wrapped index returns pca_rerank candidates and those are
+ * re-ranked exactly on the full vectors. The wrapped index scans, stores
+ * and traverses pca_dim floats per vector instead of dimension, which on
+ * redundant data (gist-960, fashion-mnist-784) costs little recall once the
+ * shortlist is re-ranked.
+ *
+ * The wrapped index always works in euclidean space: angular vectors are
+ * normalized before projecting, and for unit vectors
+ * ||x - y||^2 = 2 (1 - cos). Projections never lengthen distances, so
+ * range_search() asks the wrapped index for the same (angular: doubled)
+ * radius and filters the re-ranked hits, losing nothing to the projection.
+ *
+ * Parameters (set_param; any other name goes to the wrapped index):
+ * - pca_dim:    dimensions kept (build; 0 = auto, dimension / 4)
+ * - pca_rerank: candidates re-ranked on the full vectors (query). The full
+ *               vectors are only kept if pca_rerank > 0 at fit() time; with
+ *               0 the wrapped index's results and reduced-space distances
+ *               are returned as they are.
+ *
+ * fit_borrowed() references euclidean rows instead of copying them. add(),
+ * remove() and compact() pass through (the projection is not retrained).
+ * save() writes the projection and full vectors to path and the wrapped
+ * index to path + ".inner".
+ */
+class PCAIndex : public ANNAlgorithm {
+public:
+    explicit PCAIndex(ANNAlgorithm* inner) : inner_(inner) {}
+
+    void init(const std::string& metric, int dimension) override {
+        metric_ = metric;
+        dimension_ = dimension;
+        metric_type_ = parse_metric(metric);
+        scan_ids_ = resolve_scan_ids(metric_type_, dimension);
+    }
+
+    void set_param(const std::string& name, double value) override {
+        if (name == "pca_dim") {
+            pca_dim_param_ = std::max(0, static_cast<int>(value));
+        } else if (name == "pca_rerank") {
+            rerank_ = std::max(0, static_cast<int>(value));
+        } else {
+            inner_->set_param(name, value);
+        }
+    }
+
+    std::map<std::string, double> get_params() const override {
+        std::map<std::string, double> params = inner_->get_params();
+        params["pca_dim"] = pca_dim_param_;
+        params["pca_rerank"] = rerank_;
+        return params;
+    }
+
+    void fit(const float* data, size_t n_samples) override {
+        build(data, n_samples, false);
+    }
+
+    void fit_borrowed(const float* data, size_t n_samples) override {
+        build(data, n_samples, true);
+    }
+
+    void add(const float* data, size_t n_samples) override {
+        auto update = lock_.update();
+        std::vector<float> projected(n_samples * pca_.out_dim());
+        if (keep_rows_) {
+            // The rows must be in place before the wrapped index can return
+            // their ids; appending may move them, so queries wait
+            size_t first = rows_.size();
+            {
+                auto write = lock_.write();
+                rows_.append(data, n_samples, dimension_);
+                if (metric_type_ == Metric::Angular) {
+                    normalize_rows(rows_.row(first), n_samples, rows_.stride(), dimension_);
+                }
+            }
+            pca_.apply(rows_.row(first), n_samples, rows_.stride(), projected.data());
+        } else {
+            std::vector<float> normalized;
+            if (metric_type_ == Metric::Angular) {
+                normalized.assign(data, data + n_samples * dimension_);
+                normalize_rows(normalized.data(), n_samples, dimension_);
+                data = normalized.data();
+            }
+            pca_.apply(data, n_samples, dimension_, projected.data());
+        }
+        inner_->add(projected.data(), n_samples);
+    }
+
+    void remove(const std::vector<int>& ids) override {
+        inner_->remove(ids);
+    }
+
+    void compact() override {
+        inner_->compact();
+    }
+
+    std::vector<int> query(const float* query, int k) override {
+        return search_ids(query, k);
+    }
+
+    void search(const float* query, int k, int* ids, float* distances) override {
+        search_reduced(query, k, nullptr, ids, distances);
+    }
+
+    void search_filtered(const float* query, int k, const IdFilter& filter, int* ids,
+                         float* distances) override {
+        search_reduced(query, k, &filter, ids, distances);
+    }
+
+    void batch_search(const float* queries, size_t n_queries, int k, int* ids,
+                      float* distances, int num_threads = 0) override {
+        batch_reduced(queries, n_queries, k, nullptr, ids, distances, num_threads);
+    }
+
+    void batch_search_filtered(const float* queries, size_t n_queries, int k,
+                               const IdFilter& filter, int* ids, float* distances,
+                               int num_threads = 0) override {
+        batch_reduced(queries, n_queries, k, &filter, ids, distances, num_threads);
+    }
+
+    void range_search(const float* query, float radius, std::vector<int>& ids,
+                      std::vector<float>& distances) override {
+        QueryScratch& scratch = query_scratch();
+        query = project_query(query, scratch);
+        auto read = lock_.read();
+
+        float reduced_radius = metric_type_ == Metric::Angular ? 2.0f * radius : radius;
+        if (keep_rows_) {
+            reduced_radius *= 1.0f + kRangeSlack;
+        }
+        inner_->range_search(scratch.projected.data(), reduced_radius, ids, distances);
+        if (!keep_rows_) {
+            to_index_distances(distances.data(), distances.size());
+            return;
+        }
+
+        // Re-score on the full vectors; the reduced hits are a superset
+        std::vector<float>& exact = scratch.exact;
+        exact.resize(ids.size());
+        scan_ids_(query, rows_.data(), ids.data(), ids.size(), rows_.stride(), dimension_,
+                  exact.data());
+        std::vector<std::pair<float, int>>& found = scratch.found;
+        found.clear();
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (exact[i] <= radius) {
+                found.emplace_back(exact[i], ids[i]);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        ids.resize(found.size());
+        distances.resize(found.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            distances[i] = found[i].first;
+            ids[i] = found[i].second;
+        }
+    }
+
+    void save(const std::string& path) const override {
+        auto read = lock_.read();
+        IndexWriter out(path, "pca", metric_, dimension_);
+        out.set("pca_dim", pca_dim_param_);
+        out.set("pca_rerank", rerank_);
+        out.set("keep_rows", keep_rows_ ? 1.0 : 0.0);
+        pca_.save(out, "pca");
+        if (keep_rows_) {
+            out.write_store("rows", rows_);
+        }
+        if (!labels_.empty()) {
+            out.write("labels", labels_);
+        }
+        out.finish();
+        inner_->save(path + ".inner");
+    }
+
+    void load(const std::string& path) override {
+        std::shared_ptr<IndexFile> in = IndexFile::open(path);
+        in->expect_kind("pca");
+        init(in->metric(), in->dimension());
+        pca_dim_param_ = static_cast<int>(in->get("pca_dim"));
+        rerank_ = static_cast<int>(in->get("pca_rerank"));
+        keep_rows_ = in->get("keep_rows") != 0.0;
+        pca_.load(*in, "pca");
+        rows_.clear();
+        if (keep_rows_) {
+            in->map_store("rows", rows_);
+        }
+        labels_ = in->has("labels") ? in->vector<int>("labels") : std::vector<int>();
+        inner_->load(path + ".inner");
+    }
+
+    size_t get_memory_usage() const override {
+        return rows_.memory_usage() + pca_.get_memory_usage() + labels_.size() * sizeof(int) +
+               inner_->get_memory_usage();
+    }
+
+    size_t get_disk_usage() const override {
+        return inner_->get_disk_usage();
+    }
+
+    /**
+     * The wrapped index's counters plus the re-ranking done here.
+     */
+    std::map<std::string, double> get_stats() const override {
+        std::map<std::string, double> stats = inner_->get_stats();
+        add_stats(stats, stats_.snapshot());
+        return stats;
+    }
+
+    void reset_stats() override {
+        inner_->reset_stats();
+        stats_.reset();
+    }
+
+    std::string name() const override {
+        return "PCA+" + inner_->name();
+    }
+
+private:
+    /**
+     * Per-thread query buffers, reused across calls.
+     */
+    struct QueryScratch {
+        std::vector<float> normalized;
+        std::vector<float> projected;
+        std::vector<int> candidates;
+        std::vector<float> exact;
+        std::vector<std::pair<float, int>> found;  // range_search() hits
+        TopK top;
+    };
+
+    static QueryScratch& query_scratch() {
+        thread_local QueryScratch scratch;
+        return scratch;
+    }
+
+    void build(const float* data, size_t n_samples, bool borrow) {
+        size_t out_dim = pca_dim_param_ > 0 ? static_cast<size_t>(pca_dim_param_)
+                                            : std::max<size_t>(1, dimension_ / 4);
+        keep_rows_ = rerank_ > 0;
+        rows_.clear();
+
+        // Rows the projection is trained on: unit vectors for angular
+        const float* source = data;
+        size_t source_stride = dimension_;
+        std::vector<float> normalized;
+        if (keep_rows_ && borrow && metric_type_ == Metric::Euclidean) {
+            rows_.borrow(data, n_samples, dimension_);
+        } else if (keep_rows_) {
+            rows_.assign(data, n_samples, dimension_);
+            if (metric_type_ == Metric::Angular) {
+                normalize_rows(rows_.data(), n_samples, rows_.stride(), dimension_);
+            }
+            source = rows_.data();
+            source_stride = rows_.stride();
+        } else if (metric_type_ == Metric::Angular) {
+            normalized.assign(data, data + n_samples * dimension_);
+            normalize_rows(normalized.data(), n_samples, dimension_);
+            source = normalized.data();
+        }
+
+        pca_.train(source, n_samples, dimension_, source_stride, out_dim);
+        std::vector<float> projected(n_samples * out_dim);
+        pca_.apply(source, n_samples, source_stride, projected.data());
+        normalized = std::vector<float>();
+
+        inner_->init("euclidean", static_cast<int>(out_dim));
+        inner_->fit(projected.data(), n_samples);
+    }
+
+    /**
+     * Normalize (angular) and project a query into scratch.projected;
+     * returns the full-space query the re-rank scores against.
+     */
+    const float* project_query(const float* query, QueryScratch& scratch) const {
+        query = prepare_query(metric_type_, query, dimension_, scratch.normalized);
+        scratch.projected.resize(pca_.out_dim());
+        pca_.apply(query, 1, dimension_, scratch.projected.data());
+        return query;
+    }
+
+    /**
+     * Reduced-space squared L2 as the index's distance: halved for angular
+     * (1 - cos of unit vectors).
+     */
+    void to_index_distances(float* distances, size_t n) const {
+        if (metric_type_ != Metric::Angular) {
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (distances[i] != std::numeric_limits<float>::infinity()) {
+                distances[i] *= 0.5f;
+            }
+        }
+    }
+
+    bool reranks() const {
+        return keep_rows_ && rerank_ > 0;
+    }
+
+    void search_reduced(const float* query, int k, const IdFilter* filter, int* ids,
+                        float* distances) {
+        QueryScratch& scratch = query_scratch();
+        query = project_query(query, scratch);
+        auto read = lock_.read();
+
+        bool rerank = reranks();
+        size_t n_candidates = static_cast<size_t>(rerank ? std::max(k, rerank_) : k);
+        int* out = ids;
+        if (rerank) {
+            scratch.candidates.resize(n_candidates);
+            out = scratch.candidates.data();
+        }
+        int inner_k = static_cast<int>(n_candidates);
+        float* inner_distances = rerank ? nullptr : distances;
+        if (filter) {
+            inner_->search_filtered(scratch.projected.data(), inner_k, *filter, out, inner_distances);
+        } else {
+            inner_->search(scratch.projected.data(), inner_k, out, inner_distances);
+        }
+        if (!rerank) {
+            if (distances) {
+                to_index_distances(distances, k);
+            }
+            return;
+        }
+        rerank_candidates(query, k, scratch.candidates.data(), n_candidates, ids, distances, scratch);
+    }
+
+    void batch_reduced(const float* queries, size_t n_queries, int k, const IdFilter* filter,
+                       int* ids, float* distances, int num_threads) {
+        // Project every query, then let the wrapped index batch them
+        std::vector<float> normalized;
+        if (metric_type_ == Metric::Angular) {
+            normalized.assign(queries, queries + n_queries * dimension_);
+            normalize_rows(normalized.data(), n_queries, dimension_);
+            queries = normalized.data();
+        }
+        std::vector<float> projected(n_queries * pca_.out_dim());
+        pca_.apply(queries, n_queries, dimension_, projected.data());
+        auto read = lock_.read();
+
+        bool rerank = reranks();
+        size_t n_candidates = static_cast<size_t>(rerank ? std::max(k, rerank_) : k);
+        std::vector<int> shortlist;
+        int* out = ids;
+        if (rerank) {
+            shortlist.resize(n_queries * n_candidates);
+            out = shortlist.data();
+        }
+        int inner_k = static_cast<int>(n_candidates);
+        float* inner_distances = rerank ? nullptr : distances;
+        if (filter) {
+            inner_->batch_search_filtered(projected.data(), n_queries, inner_k, *filter, out,
+                                          inner_distances, num_threads);
+        } else {
+            inner_->batch_search(projected.data(), n_queries, inner_k, out, inner_distances,
+                                 num_threads);
+        }
+        if (!rerank) {
+            if (distances) {
+                to_index_distances(distances, n_queries * k);
+            }
+            return;
+        }
+
+        parallel_queries(n_queries, num_threads, [&](size_t i) {
+            rerank_candidates(queries + i * dimension_, k, &shortlist[i * n_candidates],
+                              n_candidates, ids + i * k, distances ? distances + i * k : nullptr,
+                              query_scratch());
+        });
+    }
+
+    /**
+     * Exact top-k of the candidates (-1 padded) on the full vectors.
+     */
+    void rerank_candidates(const float* query, int k, const int* shortlist, size_t n_candidates,
+                           int* ids, float* distances, QueryScratch& scratch) const {
+        size_t count = std::find(shortlist, shortlist + n_candidates, -1) - shortlist;
+        std::vector<float>& exact = scratch.exact;
+        exact.resize(count);
+        scan_ids_(query, rows_.data(), shortlist, count, rows_.stride(), dimension_, exact.data());
+        TopK& top = scratch.top;
+        top.reset(k);
+        uint64_t pushes = top.inserts();
+        top.push_block(exact.data(), count, shortlist);
+        SearchStats stats;
+        stats.count(Stat::Reranked, count);
+        stats.count(Stat::Distances, count);
+        stats.count(Stat::HeapPushes, top.inserts() - pushes);
+        stats_.add(stats);
+        top.take_into(k, ids, distances);
+    }
+
+    // Parameters
+    int pca_dim_param_ = 0;
+    int rerank_ = 100;
+
+    std::unique_ptr<ANNAlgorithm> inner_;  // built on the projected vectors
+    Metric metric_type_ = Metric::Euclidean;
+    ScanIdsFunc scan_ids_ = nullptr;
+    PCATransform pca_;
+    bool keep_rows_ = false;               // pca_rerank > 0 at fit()
+    VectorStore rows_;                     // full vectors (unit length for angular)
+    IndexLock lock_;
+};
+
+// Factory function: takes ownership of inner
+extern "C" ANNAlgorithm* create_pca_index(ANNAlgorithm* inner) {
+    return new PCAIndex(inner);
+}
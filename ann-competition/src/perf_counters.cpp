@@ -0,0 +1,192 @@
+#include "../include/perf_counters.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+// Group members, the leader first: the order of the values a read returns
+static const uint64_t kEvents[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+static constexpr size_t kEventCount = sizeof(kEvents) / sizeof(kEvents[0]);
+
+/**
+ * One thread's counter group, read and closed as a unit.
+ */
+struct ThreadGroup {
+    int fds[kEventCount] = {-1, -1, -1};
+    int error = 0;  // errno of the first event that could not be opened
+
+    /**
+     * Open the group on the calling thread, stopped.
+     */
+    void open() {
+        for (size_t i = 0; i < kEventCount; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = kEvents[i];
+            attr.disabled = i == 0;  // members follow the leader
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            long fd = syscall(SYS_perf_event_open, &attr, 0, -1,
+                              i == 0 ? -1 : fds[0], 0);
+            if (fd < 0) {
+                error = errno;
+                close();
+                return;
+            }
+            fds[i] = static_cast<int>(fd);
+        }
+    }
+
+    bool is_open() const {
+        return fds[0] >= 0;
+    }
+
+    void start() {
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    /**
+     * Stop the group and add its counts, scaled by enabled / running time
+     * when the kernel multiplexed it, to totals.
+     */
+    bool stop(double totals[kEventCount]) {
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // nr, time_enabled, time_running, one value per event
+        uint64_t data[3 + kEventCount];
+        ssize_t bytes = read(fds[0], data, sizeof(data));
+        if (bytes != static_cast<ssize_t>(sizeof(data)) || data[0] != kEventCount) {
+            return false;
+        }
+        double scale = data[2] > 0 ? static_cast<double>(data[1]) / data[2] : 0.0;
+        for (size_t i = 0; i < kEventCount; ++i) {
+            totals[i] += static_cast<double>(data[3 + i]) * scale;
+        }
+        return true;
+    }
+
+    void close() {
+        for (int& fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+    }
+};
+#endif
+
+PerfCounts perf_measure(int num_threads, const std::function<void()>& fn) {
+    PerfCounts counts;
+    using Clock = std::chrono::steady_clock;
+#ifdef __linux__
+#ifdef _OPENMP
+    int threads = num_threads > 0 ? num_threads : omp_get_max_threads();
+#else
+    (void)num_threads;
+    int threads = 1;
+#endif
+    // Each thread opens (and later reads) its own group: a group counts
+    // the thread it was opened on
+    std::vector<ThreadGroup> groups(threads);
+    #pragma omp parallel num_threads(threads)
+    {
+#ifdef _OPENMP
+        int t = omp_get_thread_num();
+#else
+        int t = 0;
+#endif
+        groups[t].open();
+    }
+    int error = 0;
+    for (const ThreadGroup& group : groups) {
+        if (!group.is_open()) {
+            error = group.error;
+        }
+    }
+    if (error) {
+        for (ThreadGroup& group : groups) {
+            group.close();
+        }
+        counts.error = std::string("perf_event_open: ") + std::strerror(error);
+        if (error == EACCES || error == EPERM) {
+            counts.error += " (see /proc/sys/kernel/perf_event_paranoid)";
+        } else if (error == ENOENT || error == EOPNOTSUPP) {
+            counts.error += " (no hardware counters here, e.g. a VM without a virtual PMU)";
+        }
+        auto begin = Clock::now();
+        fn();
+        counts.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        return counts;
+    }
+
+    #pragma omp parallel num_threads(threads)
+    {
+#ifdef _OPENMP
+        groups[omp_get_thread_num()].start();
+#else
+        groups[0].start();
+#endif
+    }
+    auto begin = Clock::now();
+    fn();
+    counts.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    double totals[kEventCount] = {};
+    bool complete = true;
+    #pragma omp parallel num_threads(threads)
+    {
+#ifdef _OPENMP
+        int t = omp_get_thread_num();
+#else
+        int t = 0;
+#endif
+        double local[kEventCount] = {};
+        bool ok = groups[t].stop(local);
+        groups[t].close();
+        #pragma omp critical
+        {
+            complete = complete && ok;
+            for (size_t i = 0; i < kEventCount; ++i) {
+                totals[i] += local[i];
+            }
+        }
+    }
+    if (!complete) {
+        counts.error = "perf counters could not be read";
+        return counts;
+    }
+    counts.available = true;
+    counts.cycles = totals[0];
+    counts.instructions = totals[1];
+    counts.llc_misses = totals[2];
+#else
+    (void)num_threads;
+    counts.error = "hardware counters need Linux perf_event_open";
+    auto begin = Clock::now();
+    fn();
+    counts.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+#endif
+    return counts;
+}
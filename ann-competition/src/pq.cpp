@@ -0,0 +1,172 @@
+#include "../include/pq.hpp"
+#include "../include/distance.hpp"
+#include "../include/index_io.hpp"
+#include "../include/kmeans.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+void ProductQuantizer::train(const float* data, size_t n, size_t dim, int m, int nbits,
+                             unsigned seed) {
+    if (m <= 0 || dim % m != 0) {
+        throw std::runtime_error("PQ: dimension " + std::to_string(dim) +
+                                 " is not a multiple of pq_m=" + std::to_string(m));
+    }
+    if (nbits != 4 && nbits != 8) {
+        throw std::runtime_error("PQ: pq_nbits must be 4 or 8");
+    }
+
+    dim_ = dim;
+    m_ = m;
+    nbits_ = nbits;
+    ksub_ = 1 << nbits;
+    dsub_ = dim / m;
+    codebooks_.resize(static_cast<size_t>(m_) * ksub_ * dsub_);
+
+    // Train each subspace independently on its slice of the data
+    std::vector<float> sub(n * dsub_);
+    for (int s = 0; s < m_; ++s) {
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n); ++i) {
+            const float* src = data + i * dim_ + s * dsub_;
+            std::copy(src, src + dsub_, sub.begin() + i * dsub_);
+        }
+
+        KMeansParams params;
+        params.seed = seed + s;
+        std::vector<float> centroids = kmeans_train(sub.data(), n, dsub_, ksub_, params);
+        std::copy(centroids.begin(), centroids.end(),
+                  codebooks_.begin() + static_cast<size_t>(s) * ksub_ * dsub_);
+    }
+}
+
+void ProductQuantizer::encode(const float* data, size_t n, uint8_t* codes) const {
+    ScanFunc scan = resolve_scan(Metric::Euclidean, static_cast<int>(dsub_));
+
+    #pragma omp parallel
+    {
+        std::vector<float> dists(ksub_);
+
+        #pragma omp for schedule(static)
+        for (long long i = 0; i < static_cast<long long>(n); ++i) {
+            for (int s = 0; s < m_; ++s) {
+                const float* x = data + i * dim_ + s * dsub_;
+                const float* book = codebooks_.data() + static_cast<size_t>(s) * ksub_ * dsub_;
+                scan(x, book, ksub_, dsub_, dsub_, dists.data());
+                codes[i * m_ + s] = static_cast<uint8_t>(
+                    std::min_element(dists.begin(), dists.end()) - dists.begin());
+            }
+        }
+    }
+}
+
+void ProductQuantizer::compute_l2_lut(const float* query, float* lut) const {
+    ScanFunc scan = resolve_scan(Metric::Euclidean, static_cast<int>(dsub_));
+    for (int s = 0; s < m_; ++s) {
+        const float* book = codebooks_.data() + static_cast<size_t>(s) * ksub_ * dsub_;
+        scan(query + s * dsub_, book, ksub_, dsub_, dsub_, lut + static_cast<size_t>(s) * ksub_);
+    }
+}
+
+void ProductQuantizer::compute_ip_lut(const float* query, float* lut) const {
+    DistanceFunc inner_product = distance_kernels().inner_product;
+    for (int s = 0; s < m_; ++s) {
+        const float* book = codebooks_.data() + static_cast<size_t>(s) * ksub_ * dsub_;
+        for (int c = 0; c < ksub_; ++c) {
+            lut[s * ksub_ + c] = -inner_product(query + s * dsub_, book + c * dsub_, dsub_);
+        }
+    }
+}
+
+void ProductQuantizer::adc_scan(const uint8_t* codes, size_t n, const float* lut,
+                                float* out) const {
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* code = codes + i * m_;
+        // Two accumulators break the add dependency chain between lookups
+        float sum0 = 0.0f;
+        float sum1 = 0.0f;
+        int s = 0;
+        for (; s + 2 <= m_; s += 2) {
+            sum0 += lut[s * ksub_ + code[s]];
+            sum1 += lut[(s + 1) * ksub_ + code[s + 1]];
+        }
+        if (s < m_) {
+            sum0 += lut[s * ksub_ + code[s]];
+        }
+        out[i] = sum0 + sum1;
+    }
+}
+
+void ProductQuantizer::save(IndexWriter& out, const std::string& prefix) const {
+    out.set(prefix + ".dim", static_cast<double>(dim_));
+    out.set(prefix + ".m", m_);
+    out.set(prefix + ".nbits", nbits_);
+    out.write(prefix + ".codebooks", codebooks_);
+}
+
+void ProductQuantizer::load(const IndexFile& in, const std::string& prefix) {
+    dim_ = static_cast<size_t>(in.get(prefix + ".dim"));
+    m_ = static_cast<int>(in.get(prefix + ".m"));
+    nbits_ = static_cast<int>(in.get(prefix + ".nbits"));
+    ksub_ = 1 << nbits_;
+    dsub_ = m_ > 0 ? dim_ / m_ : 0;
+    codebooks_ = in.vector<float>(prefix + ".codebooks");
+    if (codebooks_.size() != static_cast<size_t>(m_) * ksub_ * dsub_) {
+        throw std::runtime_error("PQ: codebooks in index file do not match m / nbits");
+    }
+}
+
+void pack_pq4_block(const uint8_t* codes, size_t count, int m, uint8_t* block) {
+    for (int s = 0; s < m; ++s) {
+        for (int j = 0; j < 16; ++j) {
+            uint8_t lo = static_cast<size_t>(j) < count ? codes[j * m + s] : 0;
+            uint8_t hi = static_cast<size_t>(j + 16) < count ? codes[(j + 16) * m + s] : 0;
+            block[s * 16 + j] = static_cast<uint8_t>((lo & 0x0F) | (hi << 4));
+        }
+    }
+}
+
+void unpack_pq4_block(const uint8_t* block, size_t count, int m, uint8_t* codes) {
+    for (size_t j = 0; j < count; ++j) {
+        for (int s = 0; s < m; ++s) {
+            uint8_t packed = block[s * 16 + j % 16];
+            codes[j * m + s] = j < 16 ? (packed & 0x0F) : (packed >> 4);
+        }
+    }
+}
+
+void quantize_pq4_lut(const float* lut, int m, uint8_t* lut8, float& scale, float& bias) {
+    // Shift every subspace table to start at 0, then share one scale so the
+    // uint16 sums stay comparable across subspaces
+    std::vector<float> mins(m);
+    float max_range = 0.0f;
+    bias = 0.0f;
+    for (int s = 0; s < m; ++s) {
+        const float* row = lut + s * 16;
+        float lo = *std::min_element(row, row + 16);
+        float hi = *std::max_element(row, row + 16);
+        mins[s] = lo;
+        bias += lo;
+        max_range = std::max(max_range, hi - lo);
+    }
+
+    // Entries are capped so that m of them still sum within uint16
+    float max_entry = std::min(255.0f, 65535.0f / m);
+    scale = max_range > 0.0f ? max_entry / max_range : 1.0f;
+    for (int s = 0; s < m; ++s) {
+        for (int c = 0; c < 16; ++c) {
+            float q = std::round((lut[s * 16 + c] - mins[s]) * scale);
+            lut8[s * 16 + c] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, q)));
+        }
+    }
+}
+
+int default_pq_m(int dim) {
+    for (int m = dim / 4; m > 1; --m) {
+        if (dim % m == 0) {
+            return m;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,265 @@
+#include "../include/query_server.hpp"
+#include "../include/ann_interface.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Failed try_push() rounds before a full queue makes submit() yield
+static constexpr int kSpinTries = 64;
+
+// Longest an idle dispatcher sleeps before re-checking on its own
+static constexpr std::chrono::milliseconds kIdleWait(100);
+
+static uint64_t elapsed_ns(std::chrono::steady_clock::duration duration) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+template <typename T>
+static void atomic_max(std::atomic<T>& target, T value) {
+    T current = target.load(std::memory_order_relaxed);
+    while (current < value &&
+           !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+QueryServer::QueryServer(ANNAlgorithm* index, int dimension, const QueryServerParams& params)
+    : index_(index), dimension_(dimension), params_(params), queue_(params.queue_capacity) {
+    if (!index_ || dimension_ <= 0) {
+        throw std::runtime_error("QueryServer requires a built index");
+    }
+    params_.max_batch = std::max<size_t>(1, params_.max_batch);
+    params_.max_wait_us = std::max(0.0, params_.max_wait_us);
+    params_.workers = std::max(1, params_.workers);
+    if (params_.threads_per_batch <= 0) {
+#ifdef _OPENMP
+        params_.threads_per_batch = std::max(1, omp_get_max_threads() / params_.workers);
+#else
+        params_.threads_per_batch = 1;
+#endif
+    }
+
+    for (int i = 0; i < params_.workers; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+    dispatcher_ = std::thread([this] { dispatch_loop(); });
+}
+
+QueryServer::~QueryServer() {
+    stop();
+}
+
+std::future<QueryResult> QueryServer::submit(const float* query, int k) {
+    Request* request = new Request;
+    request->query.assign(query, query + dimension_);
+    request->k = k;
+    std::future<QueryResult> result = request->promise.get_future();
+    enqueue(request);
+    return result;
+}
+
+void QueryServer::submit(const float* query, int k, Callback done) {
+    Request* request = new Request;
+    request->query.assign(query, query + dimension_);
+    request->k = k;
+    request->done = std::move(done);
+    enqueue(request);
+}
+
+void QueryServer::enqueue(Request* request) {
+    std::unique_ptr<Request> owned(request);
+    // Announce the push before checking stopping_, so a stopping dispatcher
+    // keeps draining until it lands (see dispatch_loop())
+    submitting_.fetch_add(1);
+    if (stopping_.load()) {
+        submitting_.fetch_sub(1);
+        throw std::runtime_error("QueryServer is stopped");
+    }
+    request->submitted = Clock::now();
+    for (int tries = 0; !queue_.try_push(request); ++tries) {
+        if (tries >= kSpinTries) {
+            std::this_thread::yield();
+        }
+    }
+    owned.release();
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    submitting_.fetch_sub(1);
+
+    // Pairs with the fence in wait_for_requests(): either the dispatcher
+    // sees the request or we see it idle and wake it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (dispatcher_idle_.load()) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cv_.notify_one();
+    }
+}
+
+void QueryServer::wait_for_requests(Clock::time_point deadline) {
+    dispatcher_idle_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (queue_.size() == 0 && !stopping_.load()) {
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cv_.wait_until(lock, deadline,
+                            [&] { return queue_.size() > 0 || stopping_.load(); });
+    }
+    dispatcher_idle_.store(false);
+}
+
+void QueryServer::dispatch_loop() {
+    const auto max_wait = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::micro>(params_.max_wait_us));
+    std::vector<Request*> batch;
+    Request* request = nullptr;
+    for (;;) {
+        if (!queue_.try_pop(request)) {
+            if (stopping_.load() && submitting_.load() == 0 && queue_.size() == 0) {
+                break;
+            }
+            wait_for_requests(Clock::now() + kIdleWait);
+            continue;
+        }
+
+        // Collect until the batch is full or its oldest request is due; a
+        // backlog (all workers busy) is due at once and goes out in full
+        batch.push_back(request);
+        Clock::time_point deadline = request->submitted + max_wait;
+        while (batch.size() < params_.max_batch) {
+            if (queue_.try_pop(request)) {
+                batch.push_back(request);
+                continue;
+            }
+            if (stopping_.load() || Clock::now() >= deadline) {
+                break;
+            }
+            wait_for_requests(deadline);
+        }
+
+        {
+            // At most one formed batch waits per worker; beyond that the
+            // queue itself fills up and pushes back on submit()
+            std::unique_lock<std::mutex> lock(work_mutex_);
+            space_cv_.wait(lock, [&] { return work_.size() < workers_.size(); });
+            work_.push_back(std::move(batch));
+        }
+        work_cv_.notify_one();
+        batch = std::vector<Request*>();
+    }
+}
+
+void QueryServer::worker_loop() {
+    std::vector<float> queries;
+    std::vector<int> ids;
+    std::vector<float> distances;
+    for (;;) {
+        std::vector<Request*> batch;
+        {
+            std::unique_lock<std::mutex> lock(work_mutex_);
+            work_cv_.wait(lock, [&] { return !work_.empty() || work_done_; });
+            if (work_.empty()) {
+                return;
+            }
+            batch = std::move(work_.front());
+            work_.pop_front();
+        }
+        space_cv_.notify_one();
+        run_batch(batch, queries, ids, distances);
+    }
+}
+
+void QueryServer::run_batch(std::vector<Request*>& batch, std::vector<float>& queries,
+                            std::vector<int>& ids, std::vector<float>& distances) {
+    Clock::time_point start = Clock::now();
+    size_t n = batch.size();
+    int k = 0;
+    queries.resize(n * dimension_);
+    for (size_t i = 0; i < n; ++i) {
+        k = std::max(k, batch[i]->k);
+        std::copy(batch[i]->query.begin(), batch[i]->query.end(), queries.begin() + i * dimension_);
+    }
+
+    // One search at the largest k; each request keeps its own prefix
+    std::exception_ptr error;
+    ids.resize(n * k);
+    distances.resize(n * k);
+    if (k > 0) {
+        try {
+            index_->batch_search(queries.data(), n, k, ids.data(), distances.data(),
+                                 params_.threads_per_batch);
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    batched_.fetch_add(n, std::memory_order_relaxed);
+    atomic_max(max_batch_size_, n);
+
+    for (size_t i = 0; i < n; ++i) {
+        std::unique_ptr<Request> request(batch[i]);
+        uint64_t wait = elapsed_ns(start - request->submitted);
+        wait_ns_.fetch_add(wait, std::memory_order_relaxed);
+        atomic_max(max_wait_ns_, wait);
+
+        QueryResult result;
+        if (!error && request->k > 0) {
+            const int* row = ids.data() + i * k;
+            size_t count = std::find(row, row + request->k, -1) - row;
+            result.ids.assign(row, row + count);
+            result.distances.assign(distances.begin() + i * k, distances.begin() + i * k + count);
+        }
+        latency_ns_.fetch_add(elapsed_ns(Clock::now() - request->submitted),
+                              std::memory_order_relaxed);
+        (error ? failed_ : completed_).fetch_add(1, std::memory_order_relaxed);
+
+        if (request->done) {
+            request->done(std::move(result), error);
+        } else if (error) {
+            request->promise.set_exception(error);
+        } else {
+            request->promise.set_value(std::move(result));
+        }
+    }
+}
+
+QueryServerStats QueryServer::stats() const {
+    QueryServerStats stats;
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.failed = failed_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.queue_depth = queue_.size();
+    stats.max_batch_size = max_batch_size_.load(std::memory_order_relaxed);
+    stats.max_wait_us = max_wait_ns_.load(std::memory_order_relaxed) * 1e-3;
+    uint64_t answered = stats.completed + stats.failed;
+    if (stats.batches > 0) {
+        stats.mean_batch_size =
+            static_cast<double>(batched_.load(std::memory_order_relaxed)) / stats.batches;
+    }
+    if (answered > 0) {
+        stats.mean_wait_us = wait_ns_.load(std::memory_order_relaxed) * 1e-3 / answered;
+        stats.mean_latency_us = latency_ns_.load(std::memory_order_relaxed) * 1e-3 / answered;
+    }
+    return stats;
+}
+
+void QueryServer::stop() {
+    std::call_once(stopped_, [this] {
+        stopping_.store(true);
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+        }
+        idle_cv_.notify_all();
+        dispatcher_.join();
+        {
+            std::lock_guard<std::mutex> lock(work_mutex_);
+            work_done_ = true;
+        }
+        work_cv_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    });
+}
@@ -0,0 +1,39 @@
+#include "../include/registry.hpp"
+#include "../include/ann_interface.hpp"
+#include <stdexcept>
+
+// Factory functions, one per implementation file
+extern "C" ANNAlgorithm* create_vectordb_kernel();
+extern "C" ANNAlgorithm* create_naive_algorithm();
+extern "C" ANNAlgorithm* create_hnsw_index();
+extern "C" ANNAlgorithm* create_ivf_index();
+extern "C" ANNAlgorithm* create_ivfpq_index();
+extern "C" ANNAlgorithm* create_diskann_index();
+extern "C" ANNAlgorithm* create_pca_index(ANNAlgorithm* inner);
+extern "C" ANNAlgorithm* create_sharded_index(ANNAlgorithm* (*create_shard)(const char*),
+                                              const char* shard_type);
+
+ANNAlgorithm* create_algorithm(const std::string& impl_type) {
+    if (impl_type.compare(0, 4, "pca+") == 0) {
+        return create_pca_index(create_algorithm(impl_type.substr(4)));
+    }
+    if (impl_type.compare(0, 6, "shard+") == 0) {
+        return create_sharded_index(+[](const char* shard_type) {
+            return create_algorithm(shard_type);
+        }, impl_type.substr(6).c_str());
+    }
+    if (impl_type == "naive") {
+        return create_naive_algorithm();
+    } else if (impl_type == "vectordb") {
+        return create_vectordb_kernel();
+    } else if (impl_type == "hnsw") {
+        return create_hnsw_index();
+    } else if (impl_type == "ivf") {
+        return create_ivf_index();
+    } else if (impl_type == "ivfpq") {
+        return create_ivfpq_index();
+    } else if (impl_type == "diskann") {
+        return create_diskann_index();
+    }
+    throw std::runtime_error("Unknown implementation: " + impl_type);
+}
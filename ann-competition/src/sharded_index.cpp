@@ -0,0 +1,538 @@
+#include "../include/ann_interface.hpp"
+#include "../include/index_io.hpp"
+#include "../include/index_lock.hpp"
+#include "../include/numa.hpp"
+#include "../include/topk.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * New, empty index of the named impl_type (bindings.cpp names).
+ */
+typedef ANNAlgorithm* (*ShardFactory)(const char* impl_type);
+
+/**
+ * A thread bound to one node for its whole life, running posted jobs in
+ * order. Binding once keeps the thread (and the OpenMP team it starts,
+ * which the runtime reuses) on the node without a spawn per call.
+ */
+class ShardWorker {
+public:
+    explicit ShardWorker(const NumaNode& node)
+        : thread_([this, node] {
+              numa_bind_thread(node);
+              run();
+          }) {}
+
+    ~ShardWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    ShardWorker(const ShardWorker&) = delete;
+    ShardWorker& operator=(const ShardWorker&) = delete;
+
+    /**
+     * Queue job to run on this thread; it must not throw.
+     */
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+            std::function<void()> job = std::move(jobs_.front());
+            jobs_.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    bool stopping_ = false;
+    std::thread thread_;  // last: starts once the rest is constructed
+};
+
+/**
+ * Index split into shards, one or more per NUMA node, each an independent
+ * index of any other type.
+ *
+ * Every shard has a worker thread, pinned to its node with a
+ * node-preferred memory policy (numa.hpp) once, when the shard is created
+ * by fit() or load(), and kept until the shard is dropped. fit() gives
+ * shard s a contiguous range of ids and builds it on that worker, so
+ * whatever the shard allocates, and the OpenMP threads it starts, stay on
+ * that node; fit_borrowed() instead migrates each shard's rows of the
+ * borrowed array to its node. batch_search() runs every shard's batch on
+ * its own node's worker at once and merges the per-shard top-k, so each
+ * socket scans its local memory instead of half the threads reading the
+ * other socket's. On a single-node machine this is plain sharding.
+ *
+ * search() visits the shards in turn from the calling thread. Filters are
+ * sliced to each shard's id range; labels live here, by global id.
+ *
+ * Parameters (set_param; any other name goes to every shard):
+ * - shards: number of shards (build; 0 = one per NUMA node)
+ *
+ * add() appends to the last shard (refit to rebalance), and remove() /
+ * compact() go to the shards holding the ids. save() writes the layout to
+ * path and shard s to path + ".shard<s>".
+ */
+class ShardedIndex : public ANNAlgorithm {
+public:
+    ShardedIndex(ShardFactory create_shard, const std::string& shard_type)
+        : create_shard_(create_shard), shard_type_(shard_type) {
+        shards_.emplace_back(create_shard_(shard_type_.c_str()));
+        workers_.emplace_back(new ShardWorker(node_of(0)));
+    }
+
+    void init(const std::string& metric, int dimension) override {
+        metric_ = metric;
+        dimension_ = dimension;
+    }
+
+    void set_param(const std::string& name, double value) override {
+        if (name == "shards") {
+            shards_param_ = std::max(0, static_cast<int>(value));
+            return;
+        }
+        shard_params_[name] = value;
+        for (auto& shard : shards_) {
+            shard->set_param(name, value);
+        }
+    }
+
+    std::map<std::string, double> get_params() const override {
+        std::map<std::string, double> params = shards_[0]->get_params();
+        params["shards"] = shards_param_;
+        return params;
+    }
+
+    void fit(const float* data, size_t n_samples) override {
+        build(data, n_samples, false);
+    }
+
+    void fit_borrowed(const float* data, size_t n_samples) override {
+        build(data, n_samples, true);
+    }
+
+    void add(const float* data, size_t n_samples) override {
+        auto update = lock_.update();
+        size_t last = shards_.size() - 1;
+        on_shards(last, last + 1, [&](size_t s) { shards_[s]->add(data, n_samples); });
+        total_ += n_samples;
+    }
+
+    void remove(const std::vector<int>& ids) override {
+        auto update = lock_.update();
+        std::vector<std::vector<int>> local(shards_.size());
+        for (int id : ids) {
+            if (id < 0 || static_cast<size_t>(id) >= total_) {
+                throw std::runtime_error("remove(): id " + std::to_string(id) + " does not exist");
+            }
+            size_t s = shard_of(static_cast<size_t>(id));
+            local[s].push_back(id - static_cast<int>(bases_[s]));
+        }
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            if (!local[s].empty()) {
+                shards_[s]->remove(local[s]);
+            }
+        }
+    }
+
+    void compact() override {
+        auto update = lock_.update();
+        on_shards(0, shards_.size(), [&](size_t s) { shards_[s]->compact(); });
+    }
+
+    std::vector<int> query(const float* query, int k) override {
+        return search_ids(query, k);
+    }
+
+    void search(const float* query, int k, int* ids, float* distances) override {
+        search_shards(query, k, nullptr, ids, distances);
+    }
+
+    void search_filtered(const float* query, int k, const IdFilter& filter, int* ids,
+                         float* distances) override {
+        search_shards(query, k, &filter, ids, distances);
+    }
+
+    void batch_search(const float* queries, size_t n_queries, int k, int* ids,
+                      float* distances, int num_threads = 0) override {
+        batch_shards(queries, n_queries, k, nullptr, ids, distances, num_threads);
+    }
+
+    void batch_search_filtered(const float* queries, size_t n_queries, int k,
+                               const IdFilter& filter, int* ids, float* distances,
+                               int num_threads = 0) override {
+        batch_shards(queries, n_queries, k, &filter, ids, distances, num_threads);
+    }
+
+    void range_search(const float* query, float radius, std::vector<int>& ids,
+                      std::vector<float>& distances) override {
+        count_queries(1);
+        QueryScratch& scratch = query_scratch();
+        std::vector<std::pair<float, int>>& found = scratch.found;
+        found.clear();
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            shards_[s]->range_search(query, radius, scratch.ids, scratch.distances);
+            int base = static_cast<int>(bases_[s]);
+            for (size_t i = 0; i < scratch.ids.size(); ++i) {
+                found.emplace_back(scratch.distances[i], scratch.ids[i] + base);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        ids.resize(found.size());
+        distances.resize(found.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            distances[i] = found[i].first;
+            ids[i] = found[i].second;
+        }
+    }
+
+    void save(const std::string& path) const override {
+        auto update = lock_.update();
+        IndexWriter out(path, "sharded", metric_, dimension_);
+        out.set("shards", shards_param_);
+        out.set("total", static_cast<double>(total_.load()));
+        out.write("bases", std::vector<uint64_t>(bases_.begin(), bases_.end()));
+        if (!labels_.empty()) {
+            out.write("labels", labels_);
+        }
+        out.finish();
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            shards_[s]->save(shard_path(path, s));
+        }
+    }
+
+    void load(const std::string& path) override {
+        std::shared_ptr<IndexFile> in = IndexFile::open(path);
+        in->expect_kind("sharded");
+        init(in->metric(), in->dimension());
+        shards_param_ = static_cast<int>(in->get("shards"));
+        total_ = static_cast<size_t>(in->get("total"));
+        std::vector<uint64_t> bases = in->vector<uint64_t>("bases");
+        bases_.assign(bases.begin(), bases.end());
+        labels_ = in->has("labels") ? in->vector<int>("labels") : std::vector<int>();
+        resize_shards(bases_.size());
+        on_shards(0, shards_.size(), [&](size_t s) { shards_[s]->load(shard_path(path, s)); });
+    }
+
+    size_t get_memory_usage() const override {
+        size_t bytes = labels_.size() * sizeof(int) + bases_.size() * sizeof(size_t);
+        for (const auto& shard : shards_) {
+            bytes += shard->get_memory_usage();
+        }
+        return bytes;
+    }
+
+    size_t get_disk_usage() const override {
+        size_t bytes = 0;
+        for (const auto& shard : shards_) {
+            bytes += shard->get_disk_usage();
+        }
+        return bytes;
+    }
+
+    /**
+     * The shards' counters summed, except queries: each one reaches every
+     * shard but counts once.
+     */
+    std::map<std::string, double> get_stats() const override {
+        std::map<std::string, double> stats;
+        for (const auto& shard : shards_) {
+            add_stats(stats, shard->get_stats());
+        }
+        for (const auto& own : stats_.snapshot()) {
+            if (own.first == stat_name(Stat::Queries)) {
+                stats[own.first] = own.second;
+            }
+        }
+        return stats;
+    }
+
+    void reset_stats() override {
+        for (auto& shard : shards_) {
+            shard->reset_stats();
+        }
+        stats_.reset();
+    }
+
+    std::string name() const override {
+        return "Sharded+" + shards_[0]->name();
+    }
+
+private:
+    /**
+     * Per-thread query buffers, reused across calls.
+     */
+    struct QueryScratch {
+        std::vector<int> ids;
+        std::vector<float> distances;
+        std::vector<std::pair<float, int>> found;  // range_search() hits
+        TopK top;
+    };
+
+    static QueryScratch& query_scratch() {
+        thread_local QueryScratch scratch;
+        return scratch;
+    }
+
+    static std::string shard_path(const std::string& path, size_t s) {
+        return path + ".shard" + std::to_string(s);
+    }
+
+    void count_queries(size_t n) const {
+        SearchStats stats;
+        stats.count(Stat::Queries, n);
+        stats_.add(stats);
+    }
+
+    const NumaNode& node_of(size_t s) const {
+        const std::vector<NumaNode>& nodes = numa_nodes();
+        return nodes[s % nodes.size()];
+    }
+
+    size_t end_of(size_t s) const {
+        return s + 1 < bases_.size() ? bases_[s + 1] : total_.load();
+    }
+
+    size_t shard_of(size_t id) const {
+        return std::upper_bound(bases_.begin(), bases_.end(), id) - bases_.begin() - 1;
+    }
+
+    /**
+     * Threads one shard's batch gets: its share of num_threads, or of its
+     * node's cores for 0.
+     */
+    int threads_for(size_t s, int num_threads) const {
+        if (num_threads > 0) {
+            return std::max(1, num_threads / static_cast<int>(shards_.size()));
+        }
+        size_t n_nodes = numa_nodes().size();
+        size_t node_index = s % n_nodes;
+        size_t on_node = (shards_.size() - node_index + n_nodes - 1) / n_nodes;
+        return std::max(1, static_cast<int>(node_of(s).cpus.size() / on_node));
+    }
+
+    /**
+     * Run fn(s) for shards begin .. end - 1 at once, each on the shard's
+     * worker; the first exception one throws is rethrown once all are
+     * done. Concurrent calls queue on the workers. A lone shard on a
+     * non-NUMA machine runs on the calling thread.
+     */
+    template <typename Fn>
+    void on_shards(size_t begin, size_t end, Fn fn) const {
+        if (end - begin == 1 && node_of(begin).id < 0) {
+            fn(begin);
+            return;
+        }
+        std::vector<std::exception_ptr> errors(end - begin);
+        size_t pending = end - begin;
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        auto wait = [&] {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done_cv.wait(lock, [&] { return pending == 0; });
+        };
+        size_t s = begin;
+        try {
+            for (; s < end; ++s) {
+                workers_[s]->post([&, s] {
+                    try {
+                        fn(s);
+                    } catch (...) {
+                        errors[s - begin] = std::current_exception();
+                    }
+                    // Notify under the lock: once it is released, done_cv may be gone
+                    std::lock_guard<std::mutex> lock(done_mutex);
+                    if (--pending == 0) {
+                        done_cv.notify_one();
+                    }
+                });
+            }
+        } catch (...) {
+            // The jobs already posted use these locals: let them finish
+            {
+                std::lock_guard<std::mutex> lock(done_mutex);
+                pending -= end - s;
+            }
+            wait();
+            throw;
+        }
+        wait();
+        for (const std::exception_ptr& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    /**
+     * Create or drop shards, and their workers, to reach count; every
+     * shard is (re)initialized and gets the forwarded parameters.
+     */
+    void resize_shards(size_t count) {
+        while (shards_.size() < count) {
+            shards_.emplace_back(create_shard_(shard_type_.c_str()));
+            workers_.emplace_back(new ShardWorker(node_of(workers_.size())));
+        }
+        shards_.resize(count);
+        workers_.resize(count);
+        for (auto& shard : shards_) {
+            shard->init(metric_, dimension_);
+            for (const auto& param : shard_params_) {
+                shard->set_param(param.first, param.second);
+            }
+        }
+    }
+
+    void build(const float* data, size_t n_samples, bool borrow) {
+        size_t count = shards_param_ > 0 ? static_cast<size_t>(shards_param_) : numa_nodes().size();
+        count = std::max<size_t>(1, std::min(count, n_samples));
+        resize_shards(count);
+        bases_.resize(count);
+        for (size_t s = 0; s < count; ++s) {
+            bases_[s] = s * n_samples / count;
+        }
+        total_ = n_samples;
+
+        on_shards(0, count, [&](size_t s) {
+            const float* rows = data + bases_[s] * dimension_;
+            size_t n_rows = end_of(s) - bases_[s];
+            if (borrow) {
+                numa_place(rows, n_rows * dimension_ * sizeof(float), node_of(s));
+                shards_[s]->fit_borrowed(rows, n_rows);
+            } else {
+                shards_[s]->fit(rows, n_rows);
+            }
+        });
+    }
+
+    /**
+     * filter restricted to shard s, in its local ids, in local; returns the
+     * filter to pass on (filter itself when the shard spans all its ids).
+     */
+    const IdFilter* shard_filter(const IdFilter* filter, size_t s, IdFilter& local) const {
+        if (!filter || (bases_[s] == 0 && end_of(s) >= filter->size())) {
+            return filter;
+        }
+        local = filter->slice(bases_[s], end_of(s));
+        return &local;
+    }
+
+    /**
+     * Offer shard s's results (local ids, -1 padded) to top in global ids.
+     */
+    void push_results(size_t s, const int* ids, const float* distances, int k, TopK& top) const {
+        int base = static_cast<int>(bases_[s]);
+        for (int j = 0; j < k && ids[j] != -1; ++j) {
+            top.push(distances[j], ids[j] + base);
+        }
+    }
+
+    void search_shards(const float* query, int k, const IdFilter* filter, int* ids,
+                       float* distances) {
+        count_queries(1);
+        QueryScratch& scratch = query_scratch();
+        scratch.ids.resize(k);
+        scratch.distances.resize(k);
+        TopK& top = scratch.top;
+        top.reset(k);
+        IdFilter local;
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            if (filter && !filter->any(bases_[s], end_of(s))) {
+                continue;
+            }
+            const IdFilter* shard = shard_filter(filter, s, local);
+            if (shard) {
+                shards_[s]->search_filtered(query, k, *shard, scratch.ids.data(),
+                                            scratch.distances.data());
+            } else {
+                shards_[s]->search(query, k, scratch.ids.data(), scratch.distances.data());
+            }
+            push_results(s, scratch.ids.data(), scratch.distances.data(), k, top);
+        }
+        top.take_into(k, ids, distances);
+    }
+
+    void batch_shards(const float* queries, size_t n_queries, int k, const IdFilter* filter,
+                      int* ids, float* distances, int num_threads) {
+        count_queries(n_queries);
+        size_t n_shards = shards_.size();
+        size_t per_shard = n_queries * static_cast<size_t>(k);
+        std::vector<int> shard_ids(n_shards * per_shard, -1);
+        std::vector<float> shard_dists(n_shards * per_shard);
+
+        // Every shard searches all queries on its own node, concurrently
+        on_shards(0, n_shards, [&](size_t s) {
+            int* out = shard_ids.data() + s * per_shard;
+            float* out_dists = shard_dists.data() + s * per_shard;
+            int threads = threads_for(s, num_threads);
+            if (!filter) {
+                shards_[s]->batch_search(queries, n_queries, k, out, out_dists, threads);
+                return;
+            }
+            if (!filter->any(bases_[s], end_of(s))) {
+                return;
+            }
+            IdFilter local;
+            const IdFilter* shard = shard_filter(filter, s, local);
+            shards_[s]->batch_search_filtered(queries, n_queries, k, *shard, out, out_dists,
+                                              threads);
+        });
+
+        parallel_queries(n_queries, num_threads, [&](size_t i) {
+            TopK& top = query_scratch().top;
+            top.reset(k);
+            for (size_t s = 0; s < n_shards; ++s) {
+                size_t offset = s * per_shard + i * k;
+                push_results(s, &shard_ids[offset], &shard_dists[offset], k, top);
+            }
+            top.take_into(k, ids + i * k, distances ? distances + i * k : nullptr);
+        });
+    }
+
+    // Parameters
+    int shards_param_ = 0;
+    std::map<std::string, double> shard_params_;  // forwarded to every shard
+
+    ShardFactory create_shard_;
+    std::string shard_type_;
+    std::vector<std::unique_ptr<ANNAlgorithm>> shards_;
+    std::vector<std::unique_ptr<ShardWorker>> workers_;  // one per shard; joined first
+    std::vector<size_t> bases_;  // first global id of each shard
+    std::atomic<size_t> total_{0};  // ids handed out; add() grows it while queries read it
+    IndexLock lock_;                // add() / remove() / compact() / save()
+};
+
+// Factory function
+extern "C" ANNAlgorithm* create_sharded_index(ShardFactory create_shard, const char* shard_type) {
+    return new ShardedIndex(create_shard, shard_type);
+}
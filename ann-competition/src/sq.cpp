@@ -0,0 +1,140 @@
+#include "../include/sq.hpp"
+#include "../include/index_io.hpp"
+#include <algorithm>
+#include <cmath>
+
+void ScalarQuantizer::train(const float* data, size_t n, size_t dim, size_t stride) {
+    dim_ = dim;
+    stride = stride == 0 ? dim : stride;
+    mins_.assign(dim, 0.0f);
+    steps_.assign(dim, 0.0f);
+    if (n == 0) {
+        return;
+    }
+
+    std::vector<float> maxs(data, data + dim);
+    std::copy(data, data + dim, mins_.begin());
+    for (size_t i = 1; i < n; ++i) {
+        const float* row = data + i * stride;
+        for (size_t d = 0; d < dim; ++d) {
+            mins_[d] = std::min(mins_[d], row[d]);
+            maxs[d] = std::max(maxs[d], row[d]);
+        }
+    }
+
+    for (size_t d = 0; d < dim; ++d) {
+        steps_[d] = (maxs[d] - mins_[d]) / 255.0f;
+    }
+}
+
+void ScalarQuantizer::encode(const float* data, size_t n, uint8_t* codes,
+                             size_t stride) const {
+    stride = stride == 0 ? dim_ : stride;
+
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(n); ++i) {
+        const float* row = data + i * stride;
+        uint8_t* code = codes + i * dim_;
+        for (size_t d = 0; d < dim_; ++d) {
+            float c = steps_[d] > 0.0f ? std::round((row[d] - mins_[d]) / steps_[d]) : 0.0f;
+            code[d] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, c)));
+        }
+    }
+}
+
+void ScalarQuantizer::decoded_norms(const uint8_t* codes, size_t n, float* out) const {
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(n); ++i) {
+        const uint8_t* code = codes + i * dim_;
+        float sum = 0.0f;
+        for (size_t d = 0; d < dim_; ++d) {
+            float x = mins_[d] + steps_[d] * code[d];
+            sum += x * x;
+        }
+        out[i] = sum;
+    }
+}
+
+void ScalarQuantizer::encode_query(const float* query, EncodedQuery& out) const {
+    out.codes.resize(dim_);
+    out.bias = 0.0f;
+
+    float max_abs = 0.0f;
+    for (size_t d = 0; d < dim_; ++d) {
+        out.bias += query[d] * mins_[d];
+        max_abs = std::max(max_abs, std::fabs(query[d] * steps_[d]));
+    }
+
+    out.scale = max_abs > 0.0f ? max_abs / kSQQueryMax : 1.0f;
+    float inv_scale = 1.0f / out.scale;
+    for (size_t d = 0; d < dim_; ++d) {
+        float c = std::round(query[d] * steps_[d] * inv_scale);
+        c = std::min<float>(kSQQueryMax, std::max<float>(-kSQQueryMax, c));
+        out.codes[d] = static_cast<int8_t>(c);
+    }
+}
+
+void ScalarQuantizer::save(IndexWriter& out, const std::string& prefix) const {
+    out.set(prefix + ".dim", static_cast<double>(dim_));
+    out.write(prefix + ".mins", mins_);
+    out.write(prefix + ".steps", steps_);
+}
+
+void ScalarQuantizer::load(const IndexFile& in, const std::string& prefix) {
+    dim_ = static_cast<size_t>(in.get(prefix + ".dim"));
+    mins_ = in.vector<float>(prefix + ".mins");
+    steps_ = in.vector<float>(prefix + ".steps");
+    if (mins_.size() != dim_ || steps_.size() != dim_) {
+        throw std::runtime_error("SQ: ranges in index file do not match dim");
+    }
+}
+
+void BinaryQuantizer::train(const float* data, size_t n, size_t dim, size_t stride) {
+    dim_ = dim;
+    stride = stride == 0 ? dim : stride;
+    std::vector<double> sums(dim, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        const float* row = data + i * stride;
+        for (size_t d = 0; d < dim; ++d) {
+            sums[d] += row[d];
+        }
+    }
+
+    means_.resize(dim);
+    for (size_t d = 0; d < dim; ++d) {
+        means_[d] = n > 0 ? static_cast<float>(sums[d] / n) : 0.0f;
+    }
+}
+
+void BinaryQuantizer::encode(const float* data, size_t n, uint64_t* codes,
+                             size_t stride) const {
+    const size_t n_words = words();
+    stride = stride == 0 ? dim_ : stride;
+
+    #pragma omp parallel for schedule(static) if (n > 1024)
+    for (long long i = 0; i < static_cast<long long>(n); ++i) {
+        const float* row = data + i * stride;
+        uint64_t* code = codes + i * n_words;
+        for (size_t w = 0; w < n_words; ++w) {
+            uint64_t bits = 0;
+            size_t end = std::min(dim_, (w + 1) * 64);
+            for (size_t d = w * 64; d < end; ++d) {
+                bits |= static_cast<uint64_t>(row[d] > means_[d]) << (d - w * 64);
+            }
+            code[w] = bits;
+        }
+    }
+}
+
+void BinaryQuantizer::save(IndexWriter& out, const std::string& prefix) const {
+    out.set(prefix + ".dim", static_cast<double>(dim_));
+    out.write(prefix + ".means", means_);
+}
+
+void BinaryQuantizer::load(const IndexFile& in, const std::string& prefix) {
+    dim_ = static_cast<size_t>(in.get(prefix + ".dim"));
+    means_ = in.vector<float>(prefix + ".means");
+    if (means_.size() != dim_) {
+        throw std::runtime_error("BQ: means in index file do not match dim");
+    }
+}
@@ -0,0 +1,152 @@
+#include "../include/vector_store.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <sys/mman.h>
+
+// Transparent huge page size on x86_64 and most ARM64 kernels
+static constexpr size_t kHugePageBytes = 2 * 1024 * 1024;
+
+static bool huge_pages_enabled() {
+    static const bool enabled = [] {
+        const char* env = std::getenv("ANN_HUGE_PAGES");
+        return env == nullptr || std::strcmp(env, "0") != 0;
+    }();
+    return enabled;
+}
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+VectorStore::~VectorStore() {
+    clear();
+}
+
+VectorStore::VectorStore(VectorStore&& other) noexcept {
+    *this = std::move(other);
+}
+
+VectorStore& VectorStore::operator=(VectorStore&& other) noexcept {
+    if (this != &other) {
+        clear();
+        data_ = other.data_;
+        n_ = other.n_;
+        dim_ = other.dim_;
+        stride_ = other.stride_;
+        bytes_ = other.bytes_;
+        capacity_ = other.capacity_;
+        owned_ = other.owned_;
+        owner_ = std::move(other.owner_);
+        other.data_ = nullptr;
+        other.n_ = other.dim_ = other.stride_ = other.bytes_ = other.capacity_ = 0;
+        other.owned_ = false;
+    }
+    return *this;
+}
+
+void VectorStore::allocate(size_t n, size_t dim) {
+    clear();
+    n_ = n;
+    capacity_ = n;
+    dim_ = dim;
+    stride_ = padded_dim(dim);
+
+    size_t bytes = n * stride_ * sizeof(float);
+    if (bytes == 0) {
+        return;
+    }
+
+    // Large arenas: 2 MB aligned so the kernel can back them with huge pages
+    bool huge = huge_pages_enabled() && bytes >= kHugePageBytes;
+    size_t alignment = huge ? kHugePageBytes : kAlignment;
+    bytes_ = round_up(bytes, alignment);
+
+    data_ = static_cast<float*>(std::aligned_alloc(alignment, bytes_));
+    if (data_ == nullptr) {
+        throw std::bad_alloc();
+    }
+    owned_ = true;
+
+#ifdef MADV_HUGEPAGE
+    if (huge) {
+        madvise(data_, bytes_, MADV_HUGEPAGE);  // advisory; failure is harmless
+    }
+#endif
+
+    // Zero in parallel: first touch places pages near the scanning threads
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(n_); ++i) {
+        std::memset(row(i), 0, stride_ * sizeof(float));
+    }
+}
+
+void VectorStore::assign(const float* data, size_t n, size_t dim) {
+    allocate(n, dim);
+
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(n_); ++i) {
+        std::memcpy(row(i), data + i * dim, dim * sizeof(float));
+    }
+}
+
+void VectorStore::borrow(const float* data, size_t n, size_t dim, size_t stride) {
+    clear();
+    data_ = const_cast<float*>(data);  // never written through while borrowed
+    n_ = n;
+    dim_ = dim;
+    stride_ = stride == 0 ? dim : stride;
+}
+
+void VectorStore::map(std::shared_ptr<const void> owner, const float* data, size_t n,
+                      size_t dim, size_t stride) {
+    borrow(data, n, dim, stride);
+    owner_ = std::move(owner);
+    bytes_ = n * stride_ * sizeof(float);
+}
+
+void VectorStore::append(const float* data, size_t n, size_t dim) {
+    if (!empty() && dim != dim_) {
+        throw std::runtime_error("VectorStore::append: dimension mismatch");
+    }
+    size_t old_n = n_;
+    if (!owned_ || old_n + n > capacity_) {
+        reserve(std::max(old_n + n, 2 * old_n), dim);
+    }
+    n_ = old_n + n;
+    #pragma omp parallel for schedule(static) if (n >= 4096)
+    for (long long i = 0; i < static_cast<long long>(n); ++i) {
+        std::memcpy(row(old_n + i), data + i * dim, dim * sizeof(float));
+    }
+}
+
+void VectorStore::reserve(size_t n, size_t dim) {
+    if (!empty() && dim != dim_) {
+        throw std::runtime_error("VectorStore::reserve: dimension mismatch");
+    }
+    if (owned_ && n <= capacity_) {
+        return;
+    }
+    size_t old_n = n_;
+    VectorStore grown;
+    grown.allocate(std::max(n, old_n), dim);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(old_n); ++i) {
+        std::memcpy(grown.row(i), row(i), dim * sizeof(float));
+    }
+    grown.n_ = old_n;
+    *this = std::move(grown);
+}
+
+void VectorStore::clear() {
+    if (owned_) {
+        std::free(data_);
+    }
+    data_ = nullptr;
+    n_ = dim_ = stride_ = bytes_ = capacity_ = 0;
+    owned_ = false;
+    owner_.reset();
+}
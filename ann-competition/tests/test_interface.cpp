@@ -0,0 +1,792 @@
+/**
+ * Native benchmark harness: drives any index through the C++ interface,
+ * without Python, pybind11 or the GIL in the timed path.
+ *
+ * Usage:
+ *     ann_bench --impl hnsw --dataset gist-960-euclidean
+ *     ann_bench --impl hnsw --hdf5 data/sift-128-euclidean.hdf5 --sweep ef_search=10,20,40,80
+ *     ann_bench --impl ivf --train base.fvecs --test query.fvecs --gt groundtruth.ivecs
+ *     ann_bench --impl ivfpq --param nlist=1024 --param rerank=100 --threads 1,4,16
+ *     ann_bench --impl hnsw --index indexes/hnsw-gist.ann --output results/native.json
+ *     ann_bench --impl vectordb --synthetic 20000,128 --metric angular
+ *
+ * Reports build time, memory, recall@k against the ground truth, batch QPS
+ * for each --threads count and the p50/p90/p95/p99 latency of single
+ * search() calls (std::chrono::steady_clock). --output writes the same JSON
+ * as scripts/benchmark.py --output, with the per-thread QPS added under
+ * throughput.by_threads.
+ *
+ * Data: ann-benchmarks HDF5 files (train / test / neighbors, needs
+ * ANN_WITH_HDF5), .fvecs / .fbin vectors with .ivecs / .ibin ground truth,
+ * or --synthetic Gaussian data. Missing ground truth is computed with an
+ * exact vectordb scan, as is ground truth for a --subset-size subset.
+ */
+
+#include "../include/ann_interface.hpp"
+#include "../include/registry.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef ANN_HAVE_HDF5
+#include <hdf5.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Dataset {
+    std::string name;
+    std::string metric;
+    int dimension = 0;
+    size_t n_train = 0;
+    size_t n_test = 0;
+    std::vector<float> train;
+    std::vector<float> test;
+    std::vector<int> ground_truth;  // n_test rows of gt_k ids
+    size_t gt_k = 0;
+};
+
+struct Options {
+    std::string impl = "vectordb";
+    std::string dataset;
+    std::string hdf5;
+    std::string train;
+    std::string test;
+    std::string gt;
+    std::string metric;
+    size_t synthetic_n = 0;
+    int synthetic_dim = 0;
+    int k = 10;
+    size_t subset_size = 0;
+    std::vector<std::pair<std::string, double>> params;
+    std::string sweep_name;
+    std::vector<double> sweep_values;
+    std::vector<int> threads;
+    std::string index;
+    std::string output;
+    bool borrow = false;
+    size_t num_warmup = 10;
+    size_t num_latency_samples = 1000;
+    int repeats = 3;
+};
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static std::string file_extension(const std::string& path) {
+    size_t dot = path.rfind('.');
+    return dot == std::string::npos ? std::string() : path.substr(dot);
+}
+
+static std::vector<char> read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    std::vector<char> bytes(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(bytes.data(), bytes.size());
+    if (!in) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    return bytes;
+}
+
+/**
+ * Rows of a .fvecs / .ivecs (per row an int32 dimension, then the values)
+ * or .fbin / .ibin file (uint32 rows, uint32 dimension, then the values)
+ * of 4-byte T; sets rows and dim.
+ */
+template <typename T>
+static std::vector<T> read_vectors(const std::string& path, size_t& rows, int& dim) {
+    std::vector<char> bytes = read_file(path);
+    std::string ext = file_extension(path);
+    std::vector<T> values;
+    if (ext == ".fbin" || ext == ".ibin") {
+        uint32_t header[2];
+        if (bytes.size() < sizeof(header)) {
+            throw std::runtime_error(path + ": truncated header");
+        }
+        std::memcpy(header, bytes.data(), sizeof(header));
+        rows = header[0];
+        dim = static_cast<int>(header[1]);
+        if (bytes.size() != sizeof(header) + rows * dim * sizeof(T)) {
+            throw std::runtime_error(path + ": size does not match its header");
+        }
+        values.resize(rows * dim);
+        std::memcpy(values.data(), bytes.data() + sizeof(header), values.size() * sizeof(T));
+        return values;
+    }
+    if (ext != ".fvecs" && ext != ".ivecs") {
+        throw std::runtime_error(path + ": expected .fvecs, .ivecs, .fbin or .ibin");
+    }
+    int32_t first = 0;
+    if (bytes.size() < sizeof(first)) {
+        throw std::runtime_error(path + ": empty file");
+    }
+    std::memcpy(&first, bytes.data(), sizeof(first));
+    dim = first;
+    size_t row_bytes = sizeof(int32_t) + dim * sizeof(T);
+    if (dim <= 0 || bytes.size() % row_bytes != 0) {
+        throw std::runtime_error(path + ": size is not a multiple of the row length");
+    }
+    rows = bytes.size() / row_bytes;
+    values.resize(rows * dim);
+    for (size_t i = 0; i < rows; ++i) {
+        std::memcpy(values.data() + i * dim, bytes.data() + i * row_bytes + sizeof(int32_t),
+                    dim * sizeof(T));
+    }
+    return values;
+}
+
+#ifdef ANN_HAVE_HDF5
+/**
+ * One 2-D dataset of an HDF5 file, converted to T by the library.
+ */
+template <typename T>
+static std::vector<T> read_hdf5(hid_t file, const char* name, hid_t type, size_t& rows,
+                                size_t& cols) {
+    hid_t dataset = H5Dopen2(file, name, H5P_DEFAULT);
+    if (dataset < 0) {
+        throw std::runtime_error(std::string("HDF5 file has no '") + name + "' dataset");
+    }
+    hid_t space = H5Dget_space(dataset);
+    hsize_t dims[2] = {0, 0};
+    int ndims = H5Sget_simple_extent_ndims(space);
+    if (ndims != 2) {
+        H5Sclose(space);
+        H5Dclose(dataset);
+        throw std::runtime_error(std::string("HDF5 dataset '") + name + "' is not 2-D");
+    }
+    H5Sget_simple_extent_dims(space, dims, nullptr);
+    rows = dims[0];
+    cols = dims[1];
+    std::vector<T> values(rows * cols);
+    herr_t status = H5Dread(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data());
+    H5Sclose(space);
+    H5Dclose(dataset);
+    if (status < 0) {
+        throw std::runtime_error(std::string("Cannot read HDF5 dataset '") + name + "'");
+    }
+    return values;
+}
+
+/**
+ * The file's "distance" attribute (ann-benchmarks sets it), or "".
+ */
+static std::string read_hdf5_metric(hid_t file) {
+    if (H5Aexists(file, "distance") <= 0) {
+        return std::string();
+    }
+    hid_t attr = H5Aopen(file, "distance", H5P_DEFAULT);
+    hid_t type = H5Aget_type(attr);
+    std::string value;
+    if (H5Tis_variable_str(type) > 0) {
+        char* text = nullptr;
+        if (H5Aread(attr, type, &text) >= 0 && text) {
+            value = text;
+            H5free_memory(text);
+        }
+    } else {
+        std::vector<char> text(H5Tget_size(type) + 1, '\0');
+        if (H5Aread(attr, type, text.data()) >= 0) {
+            value = text.data();
+        }
+    }
+    H5Tclose(type);
+    H5Aclose(attr);
+    return value;
+}
+#endif
+
+static void load_hdf5(const std::string& path, Dataset& data) {
+    if (!std::ifstream(path).good()) {
+        throw std::runtime_error("Cannot open " + path +
+                                 " (python/dataset_loader.py downloads the ann-benchmarks files)");
+    }
+#ifdef ANN_HAVE_HDF5
+    hid_t file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    try {
+        size_t cols = 0;
+        data.train = read_hdf5<float>(file, "train", H5T_NATIVE_FLOAT, data.n_train, cols);
+        data.dimension = static_cast<int>(cols);
+        data.test = read_hdf5<float>(file, "test", H5T_NATIVE_FLOAT, data.n_test, cols);
+        if (static_cast<int>(cols) != data.dimension) {
+            throw std::runtime_error(path + ": test and train dimensions differ");
+        }
+        size_t gt_rows = 0;
+        data.ground_truth = read_hdf5<int>(file, "neighbors", H5T_NATIVE_INT, gt_rows, data.gt_k);
+        if (gt_rows != data.n_test) {
+            throw std::runtime_error(path + ": one neighbors row per test query expected");
+        }
+        if (data.metric.empty()) {
+            data.metric = read_hdf5_metric(file);
+        }
+    } catch (...) {
+        H5Fclose(file);
+        throw;
+    }
+    H5Fclose(file);
+#else
+    (void)data;
+    throw std::runtime_error("Reading " + path + " needs HDF5; configure with -DANN_WITH_HDF5=ON");
+#endif
+}
+
+static void load_synthetic(size_t n, int dim, Dataset& data) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    data.dimension = dim;
+    data.n_train = n;
+    data.n_test = std::max<size_t>(1, std::min<size_t>(1000, n / 10));
+    data.train.resize(n * dim);
+    data.test.resize(data.n_test * dim);
+    for (float& v : data.train) {
+        v = normal(rng);
+    }
+    for (float& v : data.test) {
+        v = normal(rng);
+    }
+}
+
+/**
+ * Exact k nearest neighbors of every test query, from a vectordb scan.
+ */
+static void compute_ground_truth(Dataset& data, int k) {
+    std::unique_ptr<ANNAlgorithm> exact(create_algorithm("vectordb"));
+    exact->init(data.metric, data.dimension);
+    exact->fit(data.train.data(), data.n_train);
+    data.gt_k = k;
+    data.ground_truth.assign(data.n_test * k, -1);
+    exact->batch_search(data.test.data(), data.n_test, k, data.ground_truth.data(), nullptr);
+}
+
+/**
+ * Name of a dataset from its file path: the file name without extension.
+ */
+static std::string stem(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static Dataset load_dataset(const Options& options) {
+    Dataset data;
+    data.metric = options.metric;
+    if (options.synthetic_n > 0) {
+        data.name = "synthetic-" + std::to_string(options.synthetic_dim);
+        load_synthetic(options.synthetic_n, options.synthetic_dim, data);
+    } else if (!options.train.empty()) {
+        if (options.test.empty()) {
+            throw std::runtime_error("--train needs --test queries");
+        }
+        data.name = stem(options.train);
+        int test_dim = 0;
+        data.train = read_vectors<float>(options.train, data.n_train, data.dimension);
+        data.test = read_vectors<float>(options.test, data.n_test, test_dim);
+        if (test_dim != data.dimension) {
+            throw std::runtime_error("Test and train dimensions differ");
+        }
+        if (!options.gt.empty()) {
+            size_t gt_rows = 0;
+            int gt_k = 0;
+            data.ground_truth = read_vectors<int>(options.gt, gt_rows, gt_k);
+            data.gt_k = gt_k;
+            if (gt_rows != data.n_test) {
+                throw std::runtime_error("One ground truth row per test query expected");
+            }
+        }
+    } else {
+        // Same cache layout as python/dataset_loader.py (data/<name>.hdf5)
+        std::string path = !options.hdf5.empty() ? options.hdf5
+                           : "data/" + options.dataset + ".hdf5";
+        data.name = options.hdf5.empty() ? options.dataset : stem(options.hdf5);
+        load_hdf5(path, data);
+    }
+
+    if (data.metric.empty()) {
+        // ann-benchmarks names end in the metric
+        bool angular = data.name.size() >= 7 &&
+                       data.name.compare(data.name.size() - 7, 7, "angular") == 0;
+        data.metric = angular ? "angular" : "euclidean";
+    }
+    if (data.n_train == 0 || data.n_test == 0) {
+        throw std::runtime_error("Dataset " + data.name + " has no train or test vectors");
+    }
+
+    // Same subset rule as python/benchmark.py, but with exact ground truth
+    // for the reduced training set
+    bool subset = options.subset_size > 0 && options.subset_size < data.n_train;
+    if (subset) {
+        data.n_train = options.subset_size;
+        data.train.resize(data.n_train * data.dimension);
+        data.n_test = std::max<size_t>(1, std::min(data.n_test, options.subset_size / 10));
+        data.test.resize(data.n_test * data.dimension);
+    }
+    if (subset || data.ground_truth.empty() || data.gt_k < static_cast<size_t>(options.k)) {
+        compute_ground_truth(data, options.k);
+    }
+    return data;
+}
+
+/**
+ * Mean over queries of |found[0..k) ∩ truth[0..k)| / k, as
+ * python/metrics.py calculate_recall().
+ */
+static double calculate_recall(const std::vector<int>& ids, const Dataset& data, int k) {
+    double total = 0.0;
+    for (size_t q = 0; q < data.n_test; ++q) {
+        const int* found = ids.data() + q * k;
+        const int* truth = data.ground_truth.data() + q * data.gt_k;
+        size_t hits = 0;
+        for (int j = 0; j < k; ++j) {
+            hits += std::find(found, found + k, truth[j]) != found + k;
+        }
+        total += static_cast<double>(hits) / k;
+    }
+    return total / data.n_test;
+}
+
+/**
+ * Percentile of sorted values with linear interpolation (numpy's default).
+ */
+static double percentile(const std::vector<double>& sorted, double p) {
+    double position = p / 100.0 * (sorted.size() - 1);
+    size_t below = static_cast<size_t>(position);
+    size_t above = std::min(below + 1, sorted.size() - 1);
+    return sorted[below] + (sorted[above] - sorted[below]) * (position - below);
+}
+
+struct Throughput {
+    int threads = 0;
+    double qps = 0.0;
+    double total_time = 0.0;
+};
+
+struct Latency {
+    double mean = 0.0, std = 0.0, min = 0.0, max = 0.0;
+    double p50 = 0.0, p90 = 0.0, p95 = 0.0, p99 = 0.0;
+};
+
+struct Result {
+    std::string algorithm;
+    std::map<std::string, double> params;
+    double build_time = 0.0;
+    double memory_mb = 0.0;
+    double disk_mb = 0.0;
+    double recall = 0.0;
+    std::vector<Throughput> throughput;  // one per --threads count
+    Latency latency;
+};
+
+/**
+ * Best of repeats batch_search() runs over every test query; the ids of
+ * the last run go to ids.
+ */
+static Throughput measure_throughput(ANNAlgorithm& index, const Dataset& data, int k,
+                                     int threads, int repeats, std::vector<int>& ids) {
+    Throughput result;
+    result.threads = threads;
+    result.total_time = INFINITY;
+    ids.assign(data.n_test * k, -1);
+    for (int r = 0; r < std::max(1, repeats); ++r) {
+        Clock::time_point start = Clock::now();
+        index.batch_search(data.test.data(), data.n_test, k, ids.data(), nullptr, threads);
+        result.total_time = std::min(result.total_time, seconds_since(start));
+    }
+    result.qps = data.n_test / result.total_time;
+    return result;
+}
+
+/**
+ * Distribution of single-query search() times over the first
+ * num_samples test queries (cycled if there are fewer).
+ */
+static Latency measure_latency(ANNAlgorithm& index, const Dataset& data, int k,
+                               size_t num_samples) {
+    std::vector<int> ids(k);
+    std::vector<double> times(std::max<size_t>(1, num_samples));
+    for (size_t i = 0; i < times.size(); ++i) {
+        const float* query = data.test.data() + (i % data.n_test) * data.dimension;
+        Clock::time_point start = Clock::now();
+        index.search(query, k, ids.data(), nullptr);
+        times[i] = seconds_since(start);
+    }
+    std::sort(times.begin(), times.end());
+
+    Latency latency;
+    double sum = 0.0, sum_sq = 0.0;
+    for (double t : times) {
+        sum += t;
+        sum_sq += t * t;
+    }
+    latency.mean = sum / times.size();
+    latency.std = std::sqrt(std::max(0.0, sum_sq / times.size() - latency.mean * latency.mean));
+    latency.min = times.front();
+    latency.max = times.back();
+    latency.p50 = percentile(times, 50);
+    latency.p90 = percentile(times, 90);
+    latency.p95 = percentile(times, 95);
+    latency.p99 = percentile(times, 99);
+    return latency;
+}
+
+static void warmup(ANNAlgorithm& index, const Dataset& data, int k, size_t num_queries) {
+    std::vector<int> ids(k);
+    for (size_t i = 0; i < std::min(num_queries, data.n_test); ++i) {
+        index.search(data.test.data() + i * data.dimension, k, ids.data(), nullptr);
+    }
+}
+
+/**
+ * Fit index on the training set, or load it from options.index (and save
+ * it there after fitting if the file does not exist yet); returns seconds.
+ */
+static double build_index(ANNAlgorithm& index, const Dataset& data, const Options& options) {
+    if (!options.index.empty() && std::ifstream(options.index).good()) {
+        Clock::time_point start = Clock::now();
+        index.load(options.index);
+        std::printf("  Loaded index from %s (build time is load time)\n", options.index.c_str());
+        return seconds_since(start);
+    }
+    index.init(data.metric, data.dimension);
+    Clock::time_point start = Clock::now();
+    if (options.borrow) {
+        index.fit_borrowed(data.train.data(), data.n_train);
+    } else {
+        index.fit(data.train.data(), data.n_train);
+    }
+    double build_time = seconds_since(start);
+    if (!options.index.empty()) {
+        index.save(options.index);
+        std::printf("  Saved index to %s\n", options.index.c_str());
+    }
+    return build_time;
+}
+
+static std::string json_string(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static std::string json_number(double value) {
+    if (!std::isfinite(value)) {
+        // What Python's json module writes
+        return std::isnan(value) ? "NaN" : value > 0 ? "Infinity" : "-Infinity";
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.17g", value);
+    return text;
+}
+
+/**
+ * Local time in datetime.isoformat() form.
+ */
+static std::string iso_timestamp() {
+    auto now = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    long micros = static_cast<long>(std::chrono::duration_cast<std::chrono::microseconds>(
+        now.time_since_epoch()).count() % 1000000);
+    std::tm local;
+    localtime_r(&seconds, &local);
+    char text[40];
+    size_t length = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &local);
+    std::snprintf(text + length, sizeof(text) - length, ".%06ld", micros);
+    return text;
+}
+
+/**
+ * {"timestamp": ..., "results": [...]} in the layout of
+ * scripts/benchmark.py --output. throughput holds the run with the most
+ * threads; by_threads lists every --threads run.
+ */
+static void write_json(std::ostream& out, const std::vector<Result>& results,
+                       const Dataset& data, int k) {
+    out << "{\n  \"timestamp\": " << json_string(iso_timestamp()) << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        const Throughput& main = r.throughput.back();
+        out << (i ? ",\n" : "\n") << "    {\n"
+            << "      \"algorithm\": " << json_string(r.algorithm) << ",\n"
+            << "      \"dataset\": " << json_string(data.name) << ",\n"
+            << "      \"k\": " << k << ",\n"
+            << "      \"params\": {";
+        size_t p = 0;
+        for (const auto& param : r.params) {
+            out << (p++ ? ", " : "") << json_string(param.first) << ": " << json_number(param.second);
+        }
+        out << "},\n"
+            << "      \"build_time\": " << json_number(r.build_time) << ",\n"
+            << "      \"memory_mb\": " << json_number(r.memory_mb) << ",\n"
+            << "      \"disk_mb\": " << json_number(r.disk_mb) << ",\n"
+            << "      \"recall\": " << json_number(r.recall) << ",\n"
+            << "      \"throughput\": {\n"
+            << "        \"qps\": " << json_number(main.qps) << ",\n"
+            << "        \"total_time\": " << json_number(main.total_time) << ",\n"
+            << "        \"num_queries\": " << data.n_test << ",\n"
+            << "        \"threads\": " << main.threads << ",\n"
+            << "        \"by_threads\": [";
+        for (size_t t = 0; t < r.throughput.size(); ++t) {
+            out << (t ? ", " : "") << "{\"threads\": " << r.throughput[t].threads
+                << ", \"qps\": " << json_number(r.throughput[t].qps)
+                << ", \"total_time\": " << json_number(r.throughput[t].total_time) << "}";
+        }
+        const Latency& l = r.latency;
+        out << "]\n"
+            << "      },\n"
+            << "      \"latency\": {\n"
+            << "        \"mean\": " << json_number(l.mean) << ",\n"
+            << "        \"std\": " << json_number(l.std) << ",\n"
+            << "        \"min\": " << json_number(l.min) << ",\n"
+            << "        \"max\": " << json_number(l.max) << ",\n"
+            << "        \"p50\": " << json_number(l.p50) << ",\n"
+            << "        \"p90\": " << json_number(l.p90) << ",\n"
+            << "        \"p95\": " << json_number(l.p95) << ",\n"
+            << "        \"p99\": " << json_number(l.p99) << "\n"
+            << "      }\n"
+            << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static std::pair<std::string, std::string> split_pair(const std::string& text, const char* flag) {
+    size_t eq = text.find('=');
+    if (eq == std::string::npos || eq == 0) {
+        throw std::runtime_error(std::string(flag) + " expects NAME=VALUE, got '" + text + "'");
+    }
+    return {text.substr(0, eq), text.substr(eq + 1)};
+}
+
+static std::vector<std::string> split_list(const std::string& text, char separator) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, separator)) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static void print_usage() {
+    std::printf(
+        "usage: ann_bench [--impl NAME] (--dataset NAME | --hdf5 FILE |\n"
+        "                 --train FILE --test FILE [--gt FILE] | --synthetic N,DIM)\n"
+        "                 [--metric euclidean|angular] [--k K] [--subset-size N]\n"
+        "                 [--param NAME=VALUE]... [--sweep NAME=V1,V2,...]\n"
+        "                 [--threads T1,T2,...] [--index PATH] [--borrow]\n"
+        "                 [--warmup N] [--latency-samples N] [--repeats N]\n"
+        "                 [--output FILE]\n"
+        "\n"
+        "NAME is any create_algorithm() name (naive, vectordb, hnsw, ivf, ivfpq,\n"
+        "diskann, pca+<impl>, shard+<impl>). --threads defaults to 1 and the\n"
+        "OpenMP maximum. --output writes scripts/benchmark.py's JSON layout.\n");
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "-h" || flag == "--help") {
+            print_usage();
+            std::exit(0);
+        }
+        if (flag == "--borrow") {
+            options.borrow = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error(flag + " needs a value");
+        }
+        std::string value = argv[++i];
+        if (flag == "--impl") {
+            options.impl = value;
+        } else if (flag == "--dataset") {
+            options.dataset = value;
+        } else if (flag == "--hdf5") {
+            options.hdf5 = value;
+        } else if (flag == "--train") {
+            options.train = value;
+        } else if (flag == "--test") {
+            options.test = value;
+        } else if (flag == "--gt") {
+            options.gt = value;
+        } else if (flag == "--metric") {
+            options.metric = value;
+        } else if (flag == "--synthetic") {
+            std::vector<std::string> shape = split_list(value, ',');
+            if (shape.size() != 2) {
+                throw std::runtime_error("--synthetic expects N,DIM");
+            }
+            options.synthetic_n = std::stoull(shape[0]);
+            options.synthetic_dim = std::stoi(shape[1]);
+        } else if (flag == "--k") {
+            options.k = std::stoi(value);
+        } else if (flag == "--subset-size") {
+            options.subset_size = std::stoull(value);
+        } else if (flag == "--param") {
+            auto param = split_pair(value, "--param");
+            options.params.emplace_back(param.first, std::stod(param.second));
+        } else if (flag == "--sweep") {
+            auto sweep = split_pair(value, "--sweep");
+            options.sweep_name = sweep.first;
+            for (const std::string& v : split_list(sweep.second, ',')) {
+                options.sweep_values.push_back(std::stod(v));
+            }
+        } else if (flag == "--threads") {
+            for (const std::string& t : split_list(value, ',')) {
+                options.threads.push_back(std::stoi(t));
+            }
+        } else if (flag == "--index") {
+            options.index = value;
+        } else if (flag == "--output") {
+            options.output = value;
+        } else if (flag == "--warmup") {
+            options.num_warmup = std::stoull(value);
+        } else if (flag == "--latency-samples") {
+            options.num_latency_samples = std::stoull(value);
+        } else if (flag == "--repeats") {
+            options.repeats = std::stoi(value);
+        } else {
+            throw std::runtime_error("Unknown option " + flag + " (see --help)");
+        }
+    }
+    if (options.dataset.empty() && options.hdf5.empty() && options.train.empty() &&
+        options.synthetic_n == 0) {
+        options.dataset = "gist-960-euclidean";
+    }
+    if (options.k <= 0) {
+        throw std::runtime_error("--k must be positive");
+    }
+
+    if (options.threads.empty()) {
+        int max_threads = 1;
+#ifdef _OPENMP
+        max_threads = omp_get_max_threads();
+#endif
+        options.threads.push_back(1);
+        if (max_threads > 1) {
+            options.threads.push_back(max_threads);
+        }
+    }
+    std::sort(options.threads.begin(), options.threads.end());
+    options.threads.erase(std::unique(options.threads.begin(), options.threads.end()),
+                          options.threads.end());
+    return options;
+}
+
+static void run(const Options& options) {
+    // Unknown names and parameters fail before the data is read
+    std::unique_ptr<ANNAlgorithm> index(create_algorithm(options.impl));
+    for (const auto& param : options.params) {
+        index->set_param(param.first, param.second);
+    }
+
+    Dataset data = load_dataset(options);
+    std::printf("Running native benchmark on %s\n", data.name.c_str());
+    std::printf("  Train: (%zu, %d)\n", data.n_train, data.dimension);
+    std::printf("  Test:  (%zu, %d)\n", data.n_test, data.dimension);
+    std::printf("  Metric: %s, k = %d\n", data.metric.c_str(), options.k);
+
+    std::printf("\nBuilding index...\n");
+    double build_time = build_index(*index, data, options);
+    double memory_mb = index->get_memory_usage() / 1e6;
+    double disk_mb = index->get_disk_usage() / 1e6;
+    std::printf("  Build time: %.2fs\n", build_time);
+    std::printf("  Memory: %.1f MB\n", memory_mb);
+    if (disk_mb > 0) {
+        std::printf("  Disk: %.1f MB\n", disk_mb);
+    }
+
+    // No sweep: one run with the parameters as set
+    std::vector<double> values = options.sweep_values;
+    if (options.sweep_name.empty()) {
+        values.assign(1, NAN);
+    }
+
+    std::vector<Result> results;
+    std::vector<int> ids;
+    for (double value : values) {
+        if (!options.sweep_name.empty()) {
+            index->set_param(options.sweep_name, value);
+            std::printf("\n%s=%g\n", options.sweep_name.c_str(), value);
+        } else {
+            std::printf("\n");
+        }
+        warmup(*index, data, options.k, options.num_warmup);
+
+        Result result;
+        result.algorithm = index->name();
+        result.params = index->get_params();
+        result.build_time = build_time;
+        result.memory_mb = memory_mb;
+        result.disk_mb = disk_mb;
+        for (int threads : options.threads) {
+            result.throughput.push_back(
+                measure_throughput(*index, data, options.k, threads, options.repeats, ids));
+            std::printf("  QPS (%d threads): %.1f\n", threads, result.throughput.back().qps);
+        }
+        result.recall = calculate_recall(ids, data, options.k);
+        result.latency = measure_latency(*index, data, options.k, options.num_latency_samples);
+        std::printf("  Recall@%d: %.4f\n", options.k, result.recall);
+        std::printf("  Latency p50 / p90 / p95 / p99: %.3f / %.3f / %.3f / %.3f ms\n",
+                    result.latency.p50 * 1e3, result.latency.p90 * 1e3,
+                    result.latency.p95 * 1e3, result.latency.p99 * 1e3);
+        results.push_back(std::move(result));
+    }
+
+    if (!options.output.empty()) {
+        std::ofstream out(options.output);
+        if (!out) {
+            throw std::runtime_error("Cannot write " + options.output);
+        }
+        write_json(out, results, data, options.k);
+        std::printf("\nResults saved to %s\n", options.output.c_str());
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        run(parse_options(argc, argv));
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "ann_bench: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""
+QueryServer regression tests: more submissions than the queue holds must
+drain instead of deadlocking on the GIL.
+
+Usage:
+    python tests/test_query_server.py
+    pytest tests/test_query_server.py
+"""
+
+import asyncio
+import faulthandler
+import sys
+import threading
+from pathlib import Path
+
+import numpy as np
+
+# Add build directory to path
+project_root = Path(__file__).parent.parent
+sys.path.insert(0, str(project_root / "build"))
+
+from ann_cpp import ANNAlgorithm, QueryServer
+
+# A deadlock holds the GIL, so no Python-level timeout can fire; this
+# dumps the stacks and exits from faulthandler's own thread instead
+TIMEOUT_S = 120
+
+DIMENSION = 16
+QUEUE_CAPACITY = 8
+N_QUERIES = 40 * QUEUE_CAPACITY
+K = 5
+
+
+def build_index():
+    rng = np.random.default_rng(0)
+    train = rng.standard_normal((2000, DIMENSION), dtype=np.float32)
+    queries = rng.standard_normal((N_QUERIES, DIMENSION), dtype=np.float32)
+    algo = ANNAlgorithm('vectordb', 'euclidean')
+    algo.fit(train)
+    expected, _ = algo.batch_search(queries, K)
+    return algo, queries, expected
+
+
+def check_results(results, expected):
+    """Every query answered; micro-batches may break exact ties differently."""
+    assert len(results) == len(expected)
+    found = sum(len(set(ids.tolist()) & set(want.tolist())) for ids, want in zip(results, expected))
+    assert found >= 0.99 * expected.size
+
+
+def test_submit_beyond_queue_capacity():
+    """asyncio.gather over more submit() calls than queue_capacity."""
+    algo, queries, expected = build_index()
+    server = QueryServer(algo, max_batch=4, queue_capacity=QUEUE_CAPACITY)
+
+    async def run():
+        return await asyncio.gather(*(server.submit(q, K) for q in queries))
+
+    faulthandler.dump_traceback_later(TIMEOUT_S, exit=True)
+    try:
+        results = asyncio.run(run())
+    finally:
+        faulthandler.cancel_dump_traceback_later()
+        server.close()
+
+    check_results([ids for ids, _ in results], expected)
+
+
+def test_query_beyond_queue_capacity():
+    """Blocking query() from more threads than the queue holds."""
+    algo, queries, expected = build_index()
+    server = QueryServer(algo, max_batch=4, queue_capacity=QUEUE_CAPACITY)
+    results = [None] * N_QUERIES
+
+    def run(first):
+        for i in range(first, N_QUERIES, 4 * QUEUE_CAPACITY):
+            results[i] = server.query(queries[i], K)[0]
+
+    threads = [threading.Thread(target=run, args=(t,)) for t in range(4 * QUEUE_CAPACITY)]
+    faulthandler.dump_traceback_later(TIMEOUT_S, exit=True)
+    try:
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+    finally:
+        faulthandler.cancel_dump_traceback_later()
+        server.close()
+
+    check_results(results, expected)
+
+
+if __name__ == '__main__':
+    test_submit_beyond_queue_capacity()
+    test_query_beyond_queue_capacity()
+    print("✓ QueryServer tests passed")